@@ -21,7 +21,9 @@
 #include <string>
 
 #include <iterator>
+#include <list>
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 #include <algorithm>
@@ -39,6 +41,8 @@ extern "C" {
 #include "guid.h"
 #include "mail-user.h"
 #include "array.h"
+#include "ioloop.h"
+#include "strnum.h"
 #include "dict-rados.h"
 }
 
@@ -48,6 +52,7 @@ extern "C" {
 #include "../librmb/rados-cluster.h"
 #include "../librmb/rados-guid-generator.h"
 #include "../librmb/rados-util.h"
+#include "../librmb/rados-stats.h"
 
 #if DOVECOT_PREREQ(2, 3)
 #define dict_lookup(dict, pool, key, value_r, error_r) dict_lookup(dict, pool, key, value_r, error_r)
@@ -75,12 +80,22 @@ using librmb::RadosDictionary;
 using librmb::RadosGuidGenerator;
 
 #define DICT_USERNAME_SEPARATOR '/'
+#define DICT_ITERATE_DEFAULT_PAGE_SIZE 1000
+#define DICT_LOOKUP_BATCH_MAX_KEYS 100
+#define DICT_MOVE_LEGACY_MAX_ATTEMPTS 5
+
+class rados_dict_lookup_batch;
 
 struct rados_dict {
   struct dict dict;
   RadosCluster *cluster;
   RadosDictionary *d;
   RadosGuidGenerator *guid_generator;
+  /* max number of omap entries fetched per iterate request */
+  unsigned int iterate_page_size;
+  /* async lookups of the current ioloop run, by object */
+  std::map<string, rados_dict_lookup_batch *> *lookup_batches;
+  struct timeout *to_lookup_batches;
 };
 
 class DictGuidGenerator : public librmb::RadosGuidGenerator {
@@ -121,6 +136,9 @@ int rados_dict_init(struct dict *driver, const char *uri, const struct dict_sett
   string clustername = "ceph";
   string rados_username = "client.admin";
   string ceph_cfg = "rbox_cfg";
+  unsigned int iterate_page_size = DICT_ITERATE_DEFAULT_PAGE_SIZE;
+  unsigned int shared_shards = 1;
+  unsigned int cache_ttl = 0;
 
   if (uri != nullptr) {
     vector<string> props(explode(uri, ':'));
@@ -136,6 +154,21 @@ int rados_dict_init(struct dict *driver, const char *uri, const struct dict_sett
         rados_username = it->substr(16);
       } else if (it->compare(0, 21, "dict_cfg_object_name=") == 0) {
         ceph_cfg = it->substr(21);
+      } else if (it->compare(0, 23, "dict_iterate_page_size=") == 0) {
+        if (str_to_uint(it->substr(23).c_str(), &iterate_page_size) < 0 || iterate_page_size == 0) {
+          *error_r = t_strdup_printf("Invalid dict_iterate_page_size: %s", it->substr(23).c_str());
+          return -1;
+        }
+      } else if (it->compare(0, 19, "dict_shared_shards=") == 0) {
+        if (str_to_uint(it->substr(19).c_str(), &shared_shards) < 0 || shared_shards == 0) {
+          *error_r = t_strdup_printf("Invalid dict_shared_shards: %s", it->substr(19).c_str());
+          return -1;
+        }
+      } else if (it->compare(0, 15, "dict_cache_ttl=") == 0) {
+        if (str_to_uint(it->substr(15).c_str(), &cache_ttl) < 0) {
+          *error_r = t_strdup_printf("Invalid dict_cache_ttl: %s", it->substr(15).c_str());
+          return -1;
+        }
       } else {
         *error_r = t_strdup_printf("Invalid URI!");
         return -1;
@@ -161,7 +194,13 @@ int rados_dict_init(struct dict *driver, const char *uri, const struct dict_sett
   }
 
   dict->guid_generator = new DictGuidGenerator();
-  dict->d = new librmb::RadosDictionaryImpl(dict->cluster, poolname, username, oid, dict->guid_generator, ceph_cfg);
+  dict->iterate_page_size = iterate_page_size;
+  dict->lookup_batches = new std::map<string, rados_dict_lookup_batch *>();
+  librmb::RadosDictionaryImpl *d =
+      new librmb::RadosDictionaryImpl(dict->cluster, poolname, username, oid, dict->guid_generator, ceph_cfg);
+  d->set_shared_shard_count(shared_shards);
+  d->set_cache_ttl(cache_ttl);
+  dict->d = d;
   dict->dict = *driver;
   *dict_r = &dict->dict;
 
@@ -191,11 +230,16 @@ void rados_dict_deinit(struct dict *_dict) {
     delete dict->guid_generator;
     dict->guid_generator = nullptr;
   }
+  if (dict->lookup_batches != nullptr) {
+    delete dict->lookup_batches;
+    dict->lookup_batches = nullptr;
+  }
 
   i_free(_dict);
 }
 
 static void rados_lookup_complete_callback(rados_completion_t comp, void *arg);
+static void rados_dict_flush_lookups(struct rados_dict *dict);
 
 #if DOVECOT_PREREQ(2, 3)
 void rados_dict_wait(struct dict *_dict)
@@ -204,6 +248,7 @@ int rados_dict_wait(struct dict *_dict)
 #endif
 {
   struct rados_dict *dict = (struct rados_dict *)_dict;
+  rados_dict_flush_lookups(dict);
   // JRSE: not required with remote update? = > yes due to async lookup
   dict->d->wait_for_completions();
 
@@ -215,6 +260,15 @@ int rados_dict_wait(struct dict *_dict)
 }
 
 class rados_dict_lookup_context {
+ public:
+  string key;
+  string value;
+  void *context = nullptr;
+  dict_lookup_callback_t *callback = nullptr;
+};
+
+/* all async lookups of one rados object, read with a single omap_get_vals_by_keys */
+class rados_dict_lookup_batch {
  public:
   RadosDictionary *dict;
   ObjectReadOperation read_op;
@@ -222,23 +276,22 @@ class rados_dict_lookup_context {
   int r_val = -1;
   bufferlist bl;
 
-  AioCompletion *completion;
-  string key;
-  string value;
-  void *context = nullptr;
-  dict_lookup_callback_t *callback;
+  AioCompletion *completion = nullptr;
+  string oid;
+  string io_ctx_key;
+  set<string> keys;
+  std::list<rados_dict_lookup_context> lookups;
+  // cache generation when the read was sent
+  uint64_t cache_generation = 0;
+  // from send to the complete callback
+  std::unique_ptr<librmb::RadosStatsTimer> timer;
 
-  explicit rados_dict_lookup_context(RadosDictionary *_dict) : callback(nullptr) {
-    dict = _dict;
-    completion = librados::Rados::aio_create_completion(this, rados_lookup_complete_callback, nullptr);
-  }
+  explicit rados_dict_lookup_batch(RadosDictionary *_dict) { dict = _dict; }
 
-  ~rados_dict_lookup_context() {}
+  ~rados_dict_lookup_batch() {}
 };
 
-static void rados_lookup_complete_callback(rados_completion_t comp ATTR_UNUSED, void *arg) {
-  rados_dict_lookup_context *lc = reinterpret_cast<rados_dict_lookup_context *>(arg);
-
+static void rados_dict_lookup_result(rados_dict_lookup_batch *batch, rados_dict_lookup_context *lc, int ret) {
   struct dict_lookup_result result;
   i_zero(&result);
   result.ret = RADOS_COMMIT_RET_NOTFOUND;
@@ -247,12 +300,19 @@ static void rados_lookup_complete_callback(rados_completion_t comp ATTR_UNUSED,
   const char *values[2];
 #endif
 
-  int ret = lc->completion->get_return_value();
+  if (ret == 0) {
+    auto it = batch->result_map.find(lc->key);
+    if (it != batch->result_map.end()) {
+      batch->dict->add_cached(lc->key, it->second.to_str(), true, batch->cache_generation);
+    } else {
+      batch->dict->add_cached(lc->key, "", false, batch->cache_generation);
+    }
+  }
 
   if (lc->callback != nullptr) {
     if (ret == 0) {
-      auto it = lc->result_map.find(lc->key);
-      if (it != lc->result_map.end()) {
+      auto it = batch->result_map.find(lc->key);
+      if (it != batch->result_map.end()) {
         lc->value = it->second.to_str();
         result.value = lc->value.c_str();
 #ifdef DOVECOT_CEPH_PLUGINS_HAVE_DICT_LOOKUP_RESULT_VALUES
@@ -273,37 +333,123 @@ static void rados_lookup_complete_callback(rados_completion_t comp ATTR_UNUSED,
     }
     lc->callback(&result, lc->context);
   }
-
-  delete lc;
-  lc = NULL;
 }
 
-void rados_dict_lookup_async(struct dict *_dict, const char *key, dict_lookup_callback_t *callback, void *context) {
-  RadosDictionary *d = ((struct rados_dict *)_dict)->d;
-  set<string> keys;
-  keys.insert(key);
-  auto lc = new rados_dict_lookup_context(d);
+static void rados_lookup_complete_callback(rados_completion_t comp ATTR_UNUSED, void *arg) {
+  rados_dict_lookup_batch *batch = reinterpret_cast<rados_dict_lookup_batch *>(arg);
 
-  lc->key = key;
-  lc->context = context;
-  lc->callback = callback;
-  lc->read_op.omap_get_vals_by_keys(keys, &lc->result_map, &lc->r_val);
+  int ret = batch->timer->done(batch->completion->get_return_value());
+  for (auto &lc : batch->lookups) {
+    rados_dict_lookup_result(batch, &lc, ret);
+  }
 
-  int err = d->get_io_ctx(key).aio_operate(d->get_full_oid(key), lc->completion, &lc->read_op,
-                                           LIBRADOS_OPERATION_NOFLAG, &lc->bl);
+  delete batch;
+  batch = NULL;
+}
+
+static void rados_dict_send_lookup_batch(RadosDictionary *d, rados_dict_lookup_batch *batch) {
+  batch->read_op.omap_get_vals_by_keys(batch->keys, &batch->result_map, &batch->r_val);
+  batch->cache_generation = d->get_cache_generation();
+  batch->completion = librados::Rados::aio_create_completion(batch, rados_lookup_complete_callback, nullptr);
+  batch->timer.reset(new librmb::RadosStatsTimer(librmb::RADOS_OP_OMAP_GET, batch->oid));
 
+  int err = d->get_io_ctx(batch->io_ctx_key).aio_operate(batch->oid, batch->completion, &batch->read_op,
+                                                         LIBRADOS_OPERATION_NOFLAG, &batch->bl);
+#ifdef DEBUG
+  i_debug("rados_dict_send_lookup_batch(oid=%s, keys=%lu): err=%d", batch->oid.c_str(), batch->keys.size(), err);
+#endif
   if (err < 0) {
-    if (lc->callback != nullptr) {
-      struct dict_lookup_result result;
-      i_zero(&result);
-      result.ret = RADOS_COMMIT_RET_FAILED;
-      lc->callback(&result, context);
-    }
-    lc->completion->release();
-    delete lc;
-    lc = nullptr;
+    batch->timer->done(err);
+    for (auto &lc : batch->lookups) {
+      rados_dict_lookup_result(batch, &lc, err);
+    }
+    batch->completion->release();
+    delete batch;
+    batch = nullptr;
+  } else {
+    d->push_back_completion(batch->completion);
+  }
+}
+
+static void rados_dict_flush_lookups(struct rados_dict *dict) {
+  if (dict->to_lookup_batches != nullptr) {
+    timeout_remove(&dict->to_lookup_batches);
+  }
+  // the batches are deleted by the completion callback
+  std::map<string, rados_dict_lookup_batch *> batches;
+  batches.swap(*dict->lookup_batches);
+  for (auto &b : batches) {
+    rados_dict_send_lookup_batch(dict->d, b.second);
+  }
+}
+
+void rados_dict_lookup_async(struct dict *_dict, const char *key, dict_lookup_callback_t *callback, void *context) {
+  struct rados_dict *dict = (struct rados_dict *)_dict;
+  RadosDictionary *d = dict->d;
+
+  string cached_value;
+  bool exists;
+  if (d->get_cached(key, &cached_value, &exists) || d->is_legacy_lookup_required(key)) {
+    // cached, or the key may be in the shard or in the unsharded object: look it up
+    // synchronously until the shared objects are migrated.
+    struct dict_lookup_result result;
+    i_zero(&result);
+    pool_t pool = pool_alloconly_create("rados lookup legacy", 256);
+    const char *value = nullptr;
+#ifdef DOVECOT_CEPH_PLUGINS_HAVE_DICT_LOOKUP_RESULT_VALUES
+    const char *values[2];
+#endif
+#if DOVECOT_PREREQ(2, 3)
+    const char *error = nullptr;
+    result.ret = rados_dict_lookup(_dict, pool, key, &value, &error);
+#else
+    result.ret = rados_dict_lookup(_dict, pool, key, &value);
+#endif
+    if (result.ret == RADOS_COMMIT_RET_OK) {
+      result.value = value;
+#ifdef DOVECOT_CEPH_PLUGINS_HAVE_DICT_LOOKUP_RESULT_VALUES
+      values[0] = value;
+      values[1] = nullptr;
+      result.values = values;
+#endif
+    }
+    if (callback != nullptr) {
+      callback(&result, context);
+    }
+    pool_unref(&pool);
+    return;
+  }
+
+  // lookups of the same ioloop run are merged into one request per object
+  string oid = d->get_full_oid(key);
+  string io_ctx_key = !strncmp(key, DICT_PATH_PRIVATE, strlen(DICT_PATH_PRIVATE)) ? DICT_PATH_PRIVATE : DICT_PATH_SHARED;
+  string batch_key = io_ctx_key + oid;
+
+  rados_dict_lookup_batch *batch;
+  auto it = dict->lookup_batches->find(batch_key);
+  if (it == dict->lookup_batches->end()) {
+    batch = new rados_dict_lookup_batch(d);
+    batch->oid = oid;
+    batch->io_ctx_key = io_ctx_key;
+    (*dict->lookup_batches)[batch_key] = batch;
   } else {
-    d->push_back_completion(lc->completion);
+    batch = it->second;
+  }
+
+  batch->keys.insert(key);
+  batch->lookups.emplace_back();
+  batch->lookups.back().key = key;
+  batch->lookups.back().context = context;
+  batch->lookups.back().callback = callback;
+
+  if (batch->lookups.size() >= DICT_LOOKUP_BATCH_MAX_KEYS) {
+    dict->lookup_batches->erase(batch_key);
+    rados_dict_send_lookup_batch(d, batch);
+  } else if (current_ioloop == nullptr) {
+    // no ioloop to run the batch, send it now
+    rados_dict_flush_lookups(dict);
+  } else if (dict->to_lookup_batches == nullptr) {
+    dict->to_lookup_batches = timeout_add_short(0, rados_dict_flush_lookups, dict);
   }
 }
 
@@ -323,18 +469,41 @@ int rados_dict_lookup(struct dict *_dict, pool_t pool, const char *key, const ch
   *value_r = nullptr;
   *error_r = nullptr;
 
+  string cached_value;
+  bool exists;
+  if (d->get_cached(key, &cached_value, &exists)) {
+    if (!exists) {
+      return RADOS_COMMIT_RET_NOTFOUND;
+    }
+    *value_r = p_strdup(pool, cached_value.c_str());
+    return RADOS_COMMIT_RET_OK;
+  }
+  uint64_t generation = d->get_cache_generation();
+
   int err = d->get_io_ctx(key).omap_get_vals_by_keys(d->get_full_oid(key), keys, &result_map);
   if (err == 0) {
     auto value = result_map.find(key);
     if (value != result_map.end()) {
+      d->add_cached(key, value->second.to_str(), true, generation);
       *value_r = p_strdup(pool, value->second.to_str().c_str());
       return RADOS_COMMIT_RET_OK;
     }
-  } else if (err < 0 && err != -ENOENT) {
+  }
+  if ((err == 0 || err == -ENOENT) && d->is_legacy_lookup_required(key)) {
+    string legacy_value;
+    err = d->get_legacy(key, &legacy_value);
+    if (err == 0) {
+      d->add_cached(key, legacy_value, true, generation);
+      *value_r = p_strdup(pool, legacy_value.c_str());
+      return RADOS_COMMIT_RET_OK;
+    }
+  }
+  if (err < 0 && err != -ENOENT) {
     *error_r = NULL;  // t_strdup_printf("omap_get_vals_by_keys(%s) failed: %s", key, strerror(-err));
     return RADOS_COMMIT_RET_FAILED;
   }
 
+  d->add_cached(key, "", false, generation);
   return RADOS_COMMIT_RET_NOTFOUND;
 }
 
@@ -448,11 +617,13 @@ class rados_dict_transaction_context {
         const string key = it->first;
         map.insert(pair<string, bufferlist>(key, bl));
 
-        std::string oid = is_private(key) ? d->get_private_oid() : d->get_shared_oid();
+        std::string oid = is_private(key) ? d->get_private_oid() : d->get_full_oid(key);
 #ifdef DEBUG
         i_debug("deploy_set_map_value: %s , oid=%s", bl.to_str().c_str(), oid.c_str());
 #endif
-        if ((is_private(key) ? d->get_private_io_ctx() : d->get_shared_io_ctx()).omap_set(oid, map) < 0) {
+        librmb::RadosStatsTimer timer(librmb::RADOS_OP_OMAP_SET, oid);
+        if (timer.done((is_private(key) ? d->get_private_io_ctx() : d->get_shared_io_ctx()).omap_set(oid, map),
+                       bl.length()) < 0) {
           i_error("unable to set key(%s), oid(%s), is_private(%d)", key.c_str(), oid.c_str(), is_private(key));
         }
       }
@@ -460,6 +631,24 @@ class rados_dict_transaction_context {
     }
   }
 
+  /* moves a not yet migrated shared key to its shard, so that it can be incremented there */
+  void move_legacy_key(RadosDictionary *d, const string &key, const string &shard_oid) {
+    int err = -ECANCELED;
+    for (int attempt = 0; err == -ECANCELED && attempt < DICT_MOVE_LEGACY_MAX_ATTEMPTS; attempt++) {
+      string value;
+      if (d->get_legacy(key, &value) < 0) {
+        return;
+      }
+      map<string, bufferlist> legacy_value;
+      legacy_value[key].append(value);
+      // guarded by the read value, -ECANCELED if the key was changed meanwhile
+      err = d->move_legacy_values(legacy_value);
+    }
+    if (err < 0) {
+      i_error("unable to move key(%s) to shard oid(%s): %d", key.c_str(), shard_oid.c_str(), err);
+    }
+  }
+
   void deploy_atomic_inc_map() {
     if (atomic_inc_map.size() > 0) {
       struct rados_dict *dict = (struct rados_dict *)ctx.dict;
@@ -471,7 +660,10 @@ class rados_dict_transaction_context {
 #endif
       for (auto it = atomic_inc_map.begin(); it != atomic_inc_map.end() && !atomic_inc_not_found; it++) {
         const string key = it->first;
-        std::string oid = is_private(key) ? d->get_private_oid() : d->get_shared_oid();
+        std::string oid = is_private(key) ? d->get_private_oid() : d->get_full_oid(key);
+        if (d->is_legacy_lookup_required(key)) {
+          move_legacy_key(d, key, oid);
+        }
         // it->second is a signed long int
         librmb::RadosUtils::osd_add(&(is_private(key) ? d->get_private_io_ctx() : d->get_shared_io_ctx()), oid, key,
                                     it->second);
@@ -491,11 +683,21 @@ class rados_dict_transaction_context {
         set<string> keys;
         const string key = *it;
         keys.insert(key);
-        std::string oid = is_private(key) ? d->get_private_oid() : d->get_shared_oid();
+        std::string oid = is_private(key) ? d->get_private_oid() : d->get_full_oid(key);
 #ifdef DEBUG
         i_debug("deploy_unset_map_value key: %s , oid=%s", key.c_str(), oid.c_str());
 #endif
-        if ((is_private(key) ? d->get_private_io_ctx() : d->get_shared_io_ctx()).omap_rm_keys(oid, keys) < 0) {
+        if (d->is_legacy_lookup_required(key)) {
+          // otherwise a not yet migrated value would still be found
+          librmb::RadosStatsTimer legacy_timer(librmb::RADOS_OP_OMAP_RM, d->get_shared_oid());
+          int err = legacy_timer.done(d->get_shared_io_ctx().omap_rm_keys(d->get_shared_oid(), keys));
+          if (err < 0 && err != -ENOENT) {
+            i_error("unable to unset key(%s) in unsharded oid(%s)", key.c_str(), d->get_shared_oid().c_str());
+          }
+        }
+        librmb::RadosStatsTimer timer(librmb::RADOS_OP_OMAP_RM, oid);
+        if (timer.done((is_private(key) ? d->get_private_io_ctx() : d->get_shared_io_ctx()).omap_rm_keys(oid, keys)) <
+            0) {
           i_error("unable to unset key(%s), oid(%s), is_private(%d)", key.c_str(), oid.c_str(), is_private(key));
         }
       }
@@ -540,10 +742,21 @@ int rados_dict_transaction_commit(struct dict_transaction_context *_ctx, bool as
   rados_dict_transaction_context *ctx = reinterpret_cast<rados_dict_transaction_context *>(_ctx);
   string old_value = "0";
 
+  set<string> changed_keys(ctx->unset_set);
+  for (auto &kv : ctx->set_map) {
+    changed_keys.insert(kv.first);
+  }
+  for (auto &kv : ctx->atomic_inc_map) {
+    changed_keys.insert(kv.first);
+  }
+
   ctx->deploy_set_map();
   ctx->deploy_atomic_inc_map();
   ctx->deploy_unset_set();
 
+  // invalidate the cached values of all processes
+  ((struct rados_dict *)_ctx->dict)->d->notify_changed(changed_keys);
+
   bool failed = false;
   int ret;
 
@@ -617,16 +830,36 @@ class kv_map {
  public:
   int rval = -1;
   string key;
+  bool is_private = false;
+  string oid;
+  // true if the object has more omap entries matching key than the current page
+  bool more = false;
+  // last key of the current page before moved keys were dropped, the next page starts after it
+  string last_key;
+  // read from the unsharded shared object while the keys are moved to the shards
+  bool legacy = false;
   std::map<string, bufferlist> map;
   typename std::map<string, bufferlist>::iterator map_iter;
 };
 
+class rados_dict_object_read {
+ public:
+  bool is_private = false;
+  bool legacy = false;
+  string oid;
+  set<string> keys;
+  ObjectReadOperation read_op;
+  AioCompletion *completion = nullptr;
+  bufferlist bl;
+};
+
 class rados_dict_iterate_context {
  public:
   struct dict_iterate_context ctx;
   enum dict_iterate_flags flags;
   bool failed;
   pool_t result_pool;
+  unsigned int page_size;
 
   vector<kv_map> results;
   typename vector<kv_map>::iterator results_iter;
@@ -640,6 +873,7 @@ class rados_dict_iterate_context {
     ctx.dict = dict;
     flags = _flags;
     failed = false;
+    page_size = ((struct rados_dict *)dict)->iterate_page_size;
     result_pool = pool_alloconly_create("iterate value pool", 1024);
     guid_128_generate(this->guid);
     guid_to_str = guid_128_to_string(this->guid);
@@ -655,6 +889,37 @@ class rados_dict_iterate_context {
   }
 };
 
+/*
+ * Removes the keys of a page of the unsharded shared object which are already in their shard,
+ * the shard value is the newer one.
+ */
+static int rados_dict_iterate_drop_moved(struct rados_dict_iterate_context *iter, kv_map *kv) {
+  RadosDictionary *d = ((struct rados_dict *)iter->ctx.dict)->d;
+
+  map<string, set<string>> shard_keys;
+  for (auto &kv_entry : kv->map) {
+    shard_keys[d->get_full_oid(kv_entry.first)].insert(kv_entry.first);
+  }
+  for (auto &s : shard_keys) {
+    std::map<string, bufferlist> moved;
+    librmb::RadosStatsTimer timer(librmb::RADOS_OP_OMAP_GET, s.first);
+    int err = timer.done(d->get_shared_io_ctx().omap_get_vals_by_keys(s.first, s.second, &moved));
+    if (err == -ENOENT) {
+      // shard does not exist (yet), nothing moved
+      continue;
+    }
+    if (err < 0) {
+      i_error("rados_dict_iterate(): reading shard %s failed: %d(%s)", s.first.c_str(), err, strerror(-err));
+      return err;
+    }
+    for (auto &m : moved) {
+      kv->map.erase(m.first);
+    }
+  }
+  kv->map_iter = kv->map.begin();
+  return 0;
+}
+
 struct dict_iterate_context *rados_dict_iterate_init(struct dict *_dict, const char *const *paths,
                                                      const enum dict_iterate_flags flags) {
   RadosDictionary *d = ((struct rados_dict *)_dict)->d;
@@ -679,120 +944,164 @@ struct dict_iterate_context *rados_dict_iterate_init(struct dict *_dict, const c
       private_keys.insert(key);
     }
   }
-  bufferlist bl_private;
-  bufferlist bl_shared;
-  if (private_keys.size() + shared_keys.size() > 0) {
-    AioCompletion *private_read_completion = nullptr;
-    ObjectReadOperation private_read_op;
-    AioCompletion *shared_read_completion = nullptr;
-    ObjectReadOperation shared_read_op;
 
-    if (flags & DICT_ITERATE_FLAG_EXACT_KEY) {
-      iter->results.reserve(2);
-    } else {
-      iter->results.reserve(private_keys.size() + shared_keys.size());
-    }
+  if (private_keys.size() + shared_keys.size() > 0) {
+    // one read operation per rados object
+    std::list<rados_dict_object_read> reads;
+    // the unsharded shared object is read last
+    bool legacy_read = false;
 
     if (private_keys.size() > 0) {
-#ifdef DEBUG
-      i_debug("rados_dict_iterate_init(): private query");
-#endif
-      private_read_completion = librados::Rados::aio_create_completion();
+      reads.emplace_back();
+      reads.back().is_private = true;
+      reads.back().oid = d->get_private_oid();
+      reads.back().keys = private_keys;
+    }
 
+    if (shared_keys.size() > 0) {
       if (flags & DICT_ITERATE_FLAG_EXACT_KEY) {
-        iter->results.emplace_back();
-        private_read_op.omap_get_vals_by_keys(private_keys, &iter->results.back().map, &iter->results.back().rval);
+        map<string, set<string>> shard_keys;
+        for (auto k : shared_keys) {
+          shard_keys[d->get_full_oid(k)].insert(k);
+        }
+        for (auto &s : shard_keys) {
+          reads.emplace_back();
+          reads.back().oid = s.first;
+          reads.back().keys = s.second;
+        }
       } else {
-        for (auto k : private_keys) {
-          iter->results.emplace_back();
-          iter->results.back().key = k;
-#ifdef DOVECOT_CEPH_PLUGIN_HAVE_OMAP_GET_VALS2
-          bool more;
-          private_read_op.omap_get_vals2("", k, LONG_MAX, &iter->results.back().map, &more, &iter->results.back().rval);
-#else
-          private_read_op.omap_get_vals("", k, LONG_MAX, &iter->results.back().map, &iter->results.back().rval);
-#endif
+        for (unsigned int i = 0; i < d->get_shared_shard_count(); i++) {
+          reads.emplace_back();
+          reads.back().oid = d->get_shared_shard_oid(i);
+          reads.back().keys = shared_keys;
         }
       }
+      if (d->is_legacy_lookup_required(*shared_keys.begin())) {
+        // shared keys are not migrated to the shards, yet
+        legacy_read = true;
+        reads.emplace_back();
+        reads.back().legacy = true;
+        reads.back().oid = d->get_shared_oid();
+        reads.back().keys = shared_keys;
+      }
+    }
 
-      int err = d->get_private_io_ctx().aio_operate(d->get_private_oid(), private_read_completion, &private_read_op,
-                                                    &bl_private);
-#ifdef DEBUG
-      i_debug("rados_dict_iterate_init(): private err=%d(%s)", err, strerror(-err));
-#endif
-      iter->failed = err < 0;
+    if (flags & DICT_ITERATE_FLAG_EXACT_KEY) {
+      iter->results.reserve(reads.size());
+    } else {
+      size_t count = 0;
+      for (auto &r : reads) {
+        count += r.keys.size();
+      }
+      iter->results.reserve(count);
     }
 
-    if (!iter->failed && shared_keys.size() > 0) {
+    for (auto &r : reads) {
 #ifdef DEBUG
-      i_debug("rados_dict_iterate_init(): shared query");
+      i_debug("rados_dict_iterate_init(): %s query oid=%s", r.is_private ? "private" : "shared", r.oid.c_str());
 #endif
-      shared_read_completion = librados::Rados::aio_create_completion();
-
       if (flags & DICT_ITERATE_FLAG_EXACT_KEY) {
         iter->results.emplace_back();
-        shared_read_op.omap_get_vals_by_keys(shared_keys, &iter->results.back().map, &iter->results.back().rval);
+        iter->results.back().is_private = r.is_private;
+        iter->results.back().oid = r.oid;
+        r.read_op.omap_get_vals_by_keys(r.keys, &iter->results.back().map, &iter->results.back().rval);
       } else {
-        for (auto k : shared_keys) {
+        for (auto k : r.keys) {
           iter->results.emplace_back();
           iter->results.back().key = k;
+          iter->results.back().is_private = r.is_private;
+          iter->results.back().legacy = r.legacy;
+          iter->results.back().oid = r.oid;
 #ifdef DOVECOT_CEPH_PLUGIN_HAVE_OMAP_GET_VALS2
-          bool more;
-          shared_read_op.omap_get_vals2("", k, LONG_MAX, &iter->results.back().map, &more, &iter->results.back().rval);
+          r.read_op.omap_get_vals2("", k, iter->page_size, &iter->results.back().map, &iter->results.back().more,
+                                   &iter->results.back().rval);
 #else
-          shared_read_op.omap_get_vals("", k, LONG_MAX, &iter->results.back().map, &iter->results.back().rval);
+          r.read_op.omap_get_vals("", k, iter->page_size, &iter->results.back().map, &iter->results.back().rval);
 #endif
         }
       }
 
-      int err =
-          d->get_shared_io_ctx().aio_operate(d->get_shared_oid(), shared_read_completion, &shared_read_op, &bl_shared);
-#ifdef DEBUG
-      i_debug("rados_dict_iterate_init(): shared err=%d(%s)", err, strerror(-err));
-#endif
-      iter->failed = err < 0;
-    }
-
-    if (!iter->failed && private_keys.size() > 0) {
-      if (!private_read_completion->is_complete()) {
-        int err = private_read_completion->wait_for_complete_and_cb();
-#ifdef DEBUG
-        i_debug("rados_dict_iterate_init(): priv wait_for_complete_and_cb() err=%d(%s)", err, strerror(-err));
-#endif
-        iter->failed = err < 0;
+      r.completion = librados::Rados::aio_create_completion();
+      librmb::RadosStatsAioTimer *timer =
+          librmb::RadosStatsAioTimer::start(librmb::RADOS_OP_OMAP_GET, r.oid, r.completion);
+      int err = (r.is_private ? d->get_private_io_ctx() : d->get_shared_io_ctx())
+                    .aio_operate(r.oid, r.completion, &r.read_op, &r.bl);
+      if (err < 0) {
+        timer->cancel(err);
       }
-      if (!iter->failed) {
-        int err = private_read_completion->get_return_value();
 #ifdef DEBUG
-        i_debug("rados_dict_iterate_init(): priv get_return_value() err=%d(%s)", err, strerror(-err));
+      i_debug("rados_dict_iterate_init(): %s err=%d(%s)", r.oid.c_str(), err, strerror(-err));
 #endif
-        iter->failed |= err < 0;
+      if (err < 0) {
+        iter->failed = true;
+        break;
       }
     }
 
-    if (!iter->failed && shared_keys.size() > 0) {
-      if (!shared_read_completion->is_complete()) {
-        int err = shared_read_completion->wait_for_complete_and_cb();
+    for (auto &r : reads) {
+      if (r.completion == nullptr) {
+        continue;
+      }
+      // wait for all submitted reads, the read operations are released afterwards
+      int err = r.completion->wait_for_complete_and_cb();
 #ifdef DEBUG
-        i_debug("rados_dict_iterate_init(): shared wait_for_complete_and_cb() err=%d(%s)", err, strerror(-err));
+      i_debug("rados_dict_iterate_init(): %s wait_for_complete_and_cb() err=%d(%s)", r.oid.c_str(), err,
+              strerror(-err));
 #endif
-        iter->failed = err < 0;
-      }
-      if (!iter->failed) {
-        int err = shared_read_completion->get_return_value();
+      if (err >= 0) {
+        err = r.completion->get_return_value();
 #ifdef DEBUG
-        i_debug("rados_dict_iterate_init(): shared get_return_value() err=%d(%s)", err, strerror(-err));
+        i_debug("rados_dict_iterate_init(): %s get_return_value() err=%d(%s)", r.oid.c_str(), err, strerror(-err));
 #endif
+      }
+      if (err == -ENOENT) {
+        // object does not exist (e.g. empty shard), no results
+        for (auto &result : iter->results) {
+          if (result.is_private == r.is_private && result.oid == r.oid) {
+            result.rval = 0;
+            result.more = false;
+            result.map.clear();
+          }
+        }
+      } else {
         iter->failed |= err < 0;
       }
+      r.completion->release();
+      r.completion = nullptr;
     }
 
     if (!iter->failed) {
-      for (auto r : iter->results) {
+      for (auto &r : iter->results) {
 #ifdef DEBUG
         i_debug("rados_dict_iterate_init(): r_val=%d(%s)", r.rval, strerror(-r.rval));
 #endif
         iter->failed |= (r.rval < 0);
+#ifndef DOVECOT_CEPH_PLUGIN_HAVE_OMAP_GET_VALS2
+        r.more = !(flags & DICT_ITERATE_FLAG_EXACT_KEY) && r.map.size() >= iter->page_size;
+#endif
+        r.last_key = r.map.empty() ? "" : r.map.rbegin()->first;
+      }
+    }
+
+    if (!iter->failed && legacy_read && !(flags & DICT_ITERATE_FLAG_EXACT_KEY)) {
+      // the shard pages are not complete, the moved keys of each legacy page are looked up in the shards
+      for (auto &r : iter->results) {
+        if (r.legacy && rados_dict_iterate_drop_moved(iter, &r) < 0) {
+          iter->failed = true;
+          break;
+        }
+      }
+    }
+
+    if (!iter->failed && legacy_read && (flags & DICT_ITERATE_FLAG_EXACT_KEY)) {
+      // a key which is being moved is in its shard and the unsharded object, the shard value is the newer one
+      kv_map &legacy = iter->results.back();
+      for (auto it = iter->results.begin(); it + 1 != iter->results.end(); ++it) {
+        if (!it->is_private) {
+          for (auto &kv : it->map) {
+            legacy.map.erase(kv.first);
+          }
+        }
       }
     }
 
@@ -801,15 +1110,6 @@ struct dict_iterate_context *rados_dict_iterate_init(struct dict *_dict, const c
       iter->results_iter = iter->results.begin();
       iter->results_iter->map_iter = iter->results_iter->map.begin();
     }
-
-    if (private_read_completion != nullptr) {
-      private_read_completion->release();
-      private_read_completion = nullptr;
-    }
-    if (shared_read_completion != nullptr) {
-      shared_read_completion->release();
-      shared_read_completion = nullptr;
-    }
   } else {
 #ifdef DEBUG
     i_debug("rados_dict_iterate_init() no keys");
@@ -820,6 +1120,47 @@ struct dict_iterate_context *rados_dict_iterate_init(struct dict *_dict, const c
   return &iter->ctx;
 }
 
+/*
+ * Replaces the current page of kv with the next page_size omap entries following the
+ * last key of the current page.
+ */
+static int rados_dict_iterate_next_page(struct rados_dict_iterate_context *iter, kv_map *kv) {
+  RadosDictionary *d = ((struct rados_dict *)iter->ctx.dict)->d;
+  string start_after = kv->last_key;
+
+  kv->map.clear();
+  kv->more = false;
+
+  ObjectReadOperation read_op;
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_OMAP_GET_VALS2
+  read_op.omap_get_vals2(start_after, kv->key, iter->page_size, &kv->map, &kv->more, &kv->rval);
+#else
+  read_op.omap_get_vals(start_after, kv->key, iter->page_size, &kv->map, &kv->rval);
+#endif
+
+  bufferlist bl;
+  int err = (kv->is_private ? d->get_private_io_ctx() : d->get_shared_io_ctx()).operate(kv->oid, &read_op, &bl);
+#ifdef DEBUG
+  i_debug("rados_dict_iterate_next_page(%s, start_after=%s): err=%d, r_val=%d", kv->key.c_str(), start_after.c_str(),
+          err, kv->rval);
+#endif
+  if (err < 0) {
+    return err;
+  }
+  if (kv->rval < 0) {
+    return kv->rval;
+  }
+#ifndef DOVECOT_CEPH_PLUGIN_HAVE_OMAP_GET_VALS2
+  kv->more = kv->map.size() >= iter->page_size;
+#endif
+  kv->last_key = kv->map.empty() ? "" : kv->map.rbegin()->first;
+  kv->map_iter = kv->map.begin();
+  if (kv->legacy) {
+    return rados_dict_iterate_drop_moved(iter, kv);
+  }
+  return 0;
+}
+
 bool rados_dict_iterate(struct dict_iterate_context *ctx, const char **key_r, const char **value_r) {
   struct rados_dict_iterate_context *iter = (struct rados_dict_iterate_context *)ctx;
 
@@ -830,23 +1171,35 @@ bool rados_dict_iterate(struct dict_iterate_context *ctx, const char **key_r, co
     return FALSE;
   }
 
-  while (iter->results_iter->map_iter == iter->results_iter->map.end()) {
-    if (++iter->results_iter == iter->results.end())
-      return FALSE;
-    iter->results_iter->map_iter = iter->results_iter->map.begin();
-  }
+  typename std::map<string, bufferlist>::iterator map_iter;
+  for (;;) {
+    if (iter->results_iter->map_iter == iter->results_iter->map.end()) {
+      if (iter->results_iter->more && !iter->results_iter->last_key.empty()) {
+        int err = rados_dict_iterate_next_page(iter, &(*iter->results_iter));
+        if (err < 0) {
+          i_error("rados_dict_iterate(): reading next page of %s failed: %d(%s)", iter->results_iter->key.c_str(), err,
+                  strerror(-err));
+          iter->failed = true;
+          return FALSE;
+        }
+      } else {
+        if (++iter->results_iter == iter->results.end())
+          return FALSE;
+        iter->results_iter->map_iter = iter->results_iter->map.begin();
+      }
+      continue;
+    }
 
-  auto map_iter = iter->results_iter->map_iter++;
+    map_iter = iter->results_iter->map_iter++;
 
-  if ((iter->flags & DICT_ITERATE_FLAG_RECURSE) != 0) {
-    // match everything
-  } else if ((iter->flags & DICT_ITERATE_FLAG_EXACT_KEY) != 0) {
-    // prefiltered by query, match everything
-  } else {
-    if (map_iter->first.find('/', iter->results_iter->key.length()) != string::npos) {
-      auto ret = rados_dict_iterate(ctx, key_r, value_r);
-      return ret;
+    if ((iter->flags & DICT_ITERATE_FLAG_RECURSE) != 0) {
+      // match everything
+    } else if ((iter->flags & DICT_ITERATE_FLAG_EXACT_KEY) != 0) {
+      // prefiltered by query, match everything
+    } else if (map_iter->first.find('/', iter->results_iter->key.length()) != string::npos) {
+      continue;
     }
+    break;
   }
 #ifdef DEBUG
   i_debug("rados_dict_iterate() found key='%s', value='%s'", map_iter->first.c_str(),
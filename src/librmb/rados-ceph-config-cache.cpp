@@ -0,0 +1,157 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-ceph-config-cache.h"
+
+#include <errno.h>
+
+#include <list>
+#include <string>
+
+namespace librmb {
+
+#define CONFIG_CACHE_NOTIFY_TIMEOUT_MS 5000
+
+std::map<std::string, RadosCephConfigCache::Entry> RadosCephConfigCache::entries;
+std::mutex RadosCephConfigCache::cache_mutex;
+
+std::string RadosCephConfigCache::object_id(librados::IoCtx *io_ctx, const std::string &oid) {
+  return io_ctx->get_pool_name() + "/" + io_ctx->get_namespace() + "/" + oid;
+}
+
+bool RadosCephConfigCache::get(librados::IoCtx *io_ctx, const std::string &oid, RadosCephJsonConfig *config,
+                               uint64_t *version) {
+  std::string id = object_id(io_ctx, oid);
+
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  auto it = entries.find(id);
+  if (it == entries.end() || !it->second.valid || it->second.watcher == nullptr || !it->second.watcher->watching) {
+    return false;
+  }
+  *config = it->second.config;
+  *version = it->second.version;
+  return true;
+}
+
+int RadosCephConfigCache::put(librados::IoCtx *io_ctx, const std::string &oid, const RadosCephJsonConfig &config,
+                              uint64_t version) {
+  std::string id = object_id(io_ctx, oid);
+  Watcher *watcher = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    Entry &entry = entries[id];
+    if (entry.watcher != nullptr && entry.watcher->watching) {
+      entry.config = config;
+      entry.version = version;
+      entry.valid = true;
+      return 0;
+    }
+    if (entry.watcher == nullptr) {
+      entry.watcher = new Watcher(io_ctx, id, oid);
+    } else if (entry.watcher->connecting) {
+      return -EAGAIN;
+    }
+    watcher = entry.watcher;
+    watcher->connecting = true;
+  }
+
+  if (watcher->handle != 0) {
+    // watch has been lost (handle_error)
+    watcher->io_ctx->unwatch2(watcher->handle);
+    watcher->handle = 0;
+  }
+  uint64_t handle = 0;
+  int ret = watcher->io_ctx->watch2(oid, &handle, watcher);
+  if (ret == 0) {
+    // the object may have been changed before the watch was established
+    librados::ObjectReadOperation check_version;
+    check_version.assert_version(version);
+    librados::bufferlist bl;
+    int ret_check = watcher->io_ctx->operate(oid, &check_version, &bl);
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    watcher->handle = handle;
+    watcher->watching = true;
+    watcher->connecting = false;
+    if (ret_check == 0) {
+      Entry &entry = entries[id];
+      entry.config = config;
+      entry.version = version;
+      entry.valid = true;
+    }
+    return ret_check;
+  }
+
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  watcher->connecting = false;
+  return ret;
+}
+
+int RadosCephConfigCache::notify(librados::IoCtx *io_ctx, const std::string &oid) {
+  invalidate(object_id(io_ctx, oid), false);
+
+  librados::bufferlist bl;
+  return io_ctx->notify2(oid, bl, CONFIG_CACHE_NOTIFY_TIMEOUT_MS, nullptr);
+}
+
+void RadosCephConfigCache::invalidate(const std::string &id, bool watch_lost) {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  auto it = entries.find(id);
+  if (it == entries.end()) {
+    return;
+  }
+  it->second.valid = false;
+  if (watch_lost && it->second.watcher != nullptr) {
+    it->second.watcher->watching = false;
+  }
+}
+
+void RadosCephConfigCache::clear(librados::Rados *cluster) {
+  std::list<Watcher *> watchers;
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    for (auto &it : entries) {
+      if (it.second.watcher != nullptr) {
+        watchers.push_back(it.second.watcher);
+      }
+    }
+    entries.clear();
+  }
+  if (watchers.empty()) {
+    return;
+  }
+  for (auto watcher : watchers) {
+    if (watcher->handle != 0) {
+      watcher->io_ctx->unwatch2(watcher->handle);
+    }
+  }
+  if (cluster != nullptr) {
+    cluster->watch_flush();
+  }
+  for (auto watcher : watchers) {
+    delete watcher;
+  }
+}
+
+void RadosCephConfigCache::Watcher::handle_notify(uint64_t notify_id, uint64_t cookie, uint64_t notifier_id,
+                                                  librados::bufferlist &bl) {
+  RadosCephConfigCache::invalidate(id, false);
+
+  librados::bufferlist reply;
+  io_ctx->notify_ack(oid, notify_id, cookie, reply);
+}
+
+void RadosCephConfigCache::Watcher::handle_error(uint64_t cookie, int err) {
+  // notifications may have been missed, reload until the watch is reestablished
+  RadosCephConfigCache::invalidate(id, true);
+}
+
+}  // namespace librmb
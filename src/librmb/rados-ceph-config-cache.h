@@ -0,0 +1,94 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_CEPH_CONFIG_CACHE_H_
+#define SRC_LIBRMB_RADOS_CEPH_CONFIG_CACHE_H_
+
+#include <map>
+#include <string>
+#include <mutex>  // NOLINT
+
+#include <rados/librados.hpp>
+#include "rados-ceph-json-config.h"
+
+namespace librmb {
+
+/**
+ * Rados Ceph Config Cache
+ *
+ * Process wide cache of parsed rbox configuration objects. A configuration
+ * is cached only while a watch on its object is established, writers
+ * notify the watchers, which invalidates the cached configuration.
+ */
+class RadosCephConfigCache {
+ public:
+  /*!
+   * @param[in] io_ctx io_ctx the configuration object is read from.
+   * @param[out] config copy of the cached configuration
+   * @param[out] version object version of the cached configuration
+   * @return true if a valid configuration is cached.
+   */
+  static bool get(librados::IoCtx *io_ctx, const std::string &oid, RadosCephJsonConfig *config, uint64_t *version);
+  /*!
+   * cache the configuration and watch oid for changes.
+   * @param[in] io_ctx valid io_ctx, needs to live until clear() is called.
+   * @return linux error code or 0 if successful
+   */
+  static int put(librados::IoCtx *io_ctx, const std::string &oid, const RadosCephJsonConfig &config,
+                 uint64_t version);
+  /*!
+   * notify all processes watching oid that the configuration has changed.
+   * @return linux error code or 0 if successful
+   */
+  static int notify(librados::IoCtx *io_ctx, const std::string &oid);
+  /*!
+   * remove all watches and cached configurations, needs to be called before the
+   * cluster connection is shut down.
+   */
+  static void clear(librados::Rados *cluster);
+
+ private:
+  class Watcher : public librados::WatchCtx2 {
+   public:
+    Watcher(librados::IoCtx *io_ctx_, const std::string &id_, const std::string &oid_)
+        : io_ctx(io_ctx_), id(id_), oid(oid_), handle(0), watching(false), connecting(false) {}
+
+    void handle_notify(uint64_t notify_id, uint64_t cookie, uint64_t notifier_id, librados::bufferlist &bl) override;
+    void handle_error(uint64_t cookie, int err) override;
+
+    librados::IoCtx *io_ctx;
+    std::string id;
+    std::string oid;
+    uint64_t handle;
+    bool watching;
+    bool connecting;
+  };
+
+  struct Entry {
+    Entry() : version(0), valid(false), watcher(nullptr) {}
+
+    RadosCephJsonConfig config;
+    uint64_t version;
+    bool valid;
+    Watcher *watcher;
+  };
+
+  static std::string object_id(librados::IoCtx *io_ctx, const std::string &oid);
+  static void invalidate(const std::string &id, bool watch_lost);
+
+ private:
+  static std::map<std::string, Entry> entries;
+  static std::mutex cache_mutex;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_CEPH_CONFIG_CACHE_H_
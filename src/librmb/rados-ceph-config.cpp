@@ -10,17 +10,27 @@
  */
 
 #include "rados-ceph-config.h"
+#include "rados-ceph-config-cache.h"
+#include "rados-namespace-cache.h"
+#include "rados-stats.h"
+#include <errno.h>
 #include <jansson.h>
 #include <climits>
+#include <cstdlib>
 #include <unistd.h>
 
 namespace librmb {
 
-RadosCephConfig::RadosCephConfig(librados::IoCtx *io_ctx_) { io_ctx = io_ctx_; }
+RadosCephConfig::RadosCephConfig(librados::IoCtx *io_ctx_)
+    : io_ctx(io_ctx_), default_io_ctx(io_ctx_), cluster(nullptr), pooled_generation(0), version(0) {}
 
 int RadosCephConfig::save_cfg() {
   ceph::bufferlist buffer;
   bool success = config.to_json(&buffer) ? save_object(config.get_cfg_object_name(), buffer) >= 0 : false;
+  if (success) {
+    // running processes reload the configuration
+    RadosCephConfigCache::notify(get_io_ctx(), config.get_cfg_object_name());
+  }
   return success ? 0 : -1;
 }
 
@@ -28,13 +38,27 @@ int RadosCephConfig::load_cfg() {
   if (config.is_valid()) {
     return 0;
   }
+  // only the shared io contexts live long enough to be watched
+  get_io_ctx();
+  bool shared = cluster != nullptr && io_ctx != nullptr && io_ctx != default_io_ctx;
+  if (shared && RadosCephConfigCache::get(io_ctx, config.get_cfg_object_name(), &config, &version)) {
+    return 0;
+  }
+
   ceph::bufferlist buffer;
   int ret = read_object(config.get_cfg_object_name(), &buffer);
   if (ret < 0) {
     return ret;
   }
+  version = io_ctx->get_last_version();
   config.set_valid(true);
-  return config.from_json(&buffer) ? 0 : -1;
+  if (!config.from_json(&buffer)) {
+    return -1;
+  }
+  if (shared) {
+    RadosCephConfigCache::put(io_ctx, config.get_cfg_object_name(), config, version);
+  }
+  return 0;
 }
 
 bool RadosCephConfig::is_valid_key_value(const std::string &key, const std::string &value) {
@@ -61,10 +85,25 @@ bool RadosCephConfig::is_valid_key_value(const std::string &key, const std::stri
     success = value.compare("default") == 0 || value.compare("ima") == 0;
   } else if (get_config()->get_metadata_storage_attribute_key().compare(key) == 0) {
     success = true;
+  } else if (get_config()->get_namespace_cache_ttl_key().compare(key) == 0) {
+    char *end = nullptr;
+    errno = 0;
+    unsigned long ttl = strtoul(value.c_str(), &end, 10);  // NOLINT
+    success = value[0] != '-' && *end == '\0' && errno == 0 && ttl <= UINT_MAX;
   }
   return success;
 }
 
+unsigned int RadosCephConfig::get_namespace_cache_ttl() {
+  char *end = nullptr;
+  errno = 0;
+  unsigned long ttl = strtoul(config.get_namespace_cache_ttl().c_str(), &end, 10);  // NOLINT
+  if (config.get_namespace_cache_ttl().empty() || *end != '\0' || errno != 0 || ttl > UINT_MAX) {
+    return RadosNamespaceCache::DEFAULT_TTL;
+  }
+  return static_cast<unsigned int>(ttl);
+}
+
 bool RadosCephConfig::update_valid_key_value(const std::string &key, const std::string &value) {
   bool success = false;
   if (value.empty() || key.empty()) {
@@ -97,19 +136,23 @@ bool RadosCephConfig::update_valid_key_value(const std::string &key, const std::
   } else if (get_config()->get_metadata_storage_attribute_key().compare(key) == 0) {
     get_config()->set_metadata_storage_attribute(value);
     success = true;
+  } else if (get_config()->get_namespace_cache_ttl_key().compare(key) == 0) {
+    get_config()->set_namespace_cache_ttl(value);
+    success = true;
   }
   return success;
 }
 
 int RadosCephConfig::save_object(const std::string &oid, librados::bufferlist &buffer) {
-  if (io_ctx == nullptr) {
+  if (get_io_ctx() == nullptr) {
     return -1;
   }
-  return io_ctx->write_full(oid, buffer);
+  RadosStatsTimer timer(RADOS_OP_WRITE);
+  return timer.done(io_ctx->write_full(oid, buffer), buffer.length());
 }
 int RadosCephConfig::read_object(const std::string &oid, librados::bufferlist *buffer) {
   size_t max = INT_MAX;
-  if (io_ctx == nullptr) {
+  if (get_io_ctx() == nullptr) {
     return -1;
   }
   // retry max times to read the object.
@@ -117,7 +160,12 @@ int RadosCephConfig::read_object(const std::string &oid, librados::bufferlist *b
   int ret_read = -1;
 
   for(int i = 0;i<max_retry;i++){
-    ret_read = io_ctx->read(oid, *buffer, max, 0); 
+    if (i > 0) {
+      RadosStats::record_retry(RADOS_OP_READ);
+    }
+    RadosStatsTimer timer(RADOS_OP_READ);
+    ret_read = io_ctx->read(oid, *buffer, max, 0);
+    timer.done(ret_read, ret_read > 0 ? ret_read : 0);
     if(ret_read >= 0 || ret_read == -ENOENT ){
       // exit here if the file does not exist, or we were successful      
       break;
@@ -131,9 +179,31 @@ int RadosCephConfig::read_object(const std::string &oid, librados::bufferlist *b
 }
 
 void RadosCephConfig::set_io_ctx_namespace(const std::string &namespace_) {
+  if (cluster != nullptr) {
+    librados::IoCtx *pooled = nullptr;
+    // read the generation first, a concurrent teardown then invalidates the pointer
+    uint64_t generation = cluster->get_io_ctx_pool_generation();
+    if (cluster->io_ctx_get(pool_name, namespace_, &pooled) == 0) {
+      io_ctx = pooled;
+      pooled_namespace = namespace_;
+      pooled_generation = generation;
+      return;
+    }
+  }
+  // fallback: switch the namespace of the configured io_ctx
+  io_ctx = default_io_ctx;
   if (io_ctx != nullptr) {
     io_ctx->set_namespace(namespace_);
   }
 }
 
+librados::IoCtx *RadosCephConfig::get_io_ctx() {
+  if (cluster != nullptr && io_ctx != nullptr && io_ctx != default_io_ctx &&
+      cluster->get_io_ctx_pool_generation() != pooled_generation) {
+    // the last cluster deinit destroyed the shared io contexts
+    set_io_ctx_namespace(pooled_namespace);
+  }
+  return io_ctx;
+}
+
 } /* namespace librmb */
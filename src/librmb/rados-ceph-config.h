@@ -16,6 +16,7 @@
 #include "rados-types.h"
 #include <rados/librados.hpp>
 #include "rados-storage.h"
+#include "rados-cluster.h"
 
 namespace librmb {
 /**
@@ -26,14 +27,26 @@ namespace librmb {
 class RadosCephConfig {
  public:
   explicit RadosCephConfig(librados::IoCtx *io_ctx_);
-  RadosCephConfig() { io_ctx = nullptr; }
+  RadosCephConfig()
+      : io_ctx(nullptr), default_io_ctx(nullptr), cluster(nullptr), pooled_generation(0), version(0) {}
   virtual ~RadosCephConfig() {}
 
-  // load settings from rados cfg_object
+  // load settings from rados cfg_object, shared with other instances if set_io_ctx_pool was called.
   int load_cfg();
   int save_cfg();
 
-  void set_io_ctx(librados::IoCtx *io_ctx_) { io_ctx = io_ctx_; }
+  void set_io_ctx(librados::IoCtx *io_ctx_) {
+    io_ctx = io_ctx_;
+    default_io_ctx = io_ctx_;
+  }
+  /*!
+   * namespace switches use the shared io contexts of cluster for pool, the
+   * configured io_ctx is no longer modified.
+   */
+  void set_io_ctx_pool(RadosCluster *cluster_, const std::string &pool_) {
+    cluster = cluster_;
+    pool_name = pool_;
+  }
   bool is_config_valid() { return config.is_valid(); }
   void set_config_valid(bool valid_) { config.set_valid(valid_); }
   bool is_user_mapping() { return !config.get_user_mapping().compare("true"); }
@@ -44,10 +57,19 @@ class RadosCephConfig {
   std::string &get_user_suffix() { return config.get_user_suffix(); }
   const std::string &get_public_namespace() const { return config.get_public_namespace(); }
   void set_public_namespace(const std::string &public_namespace_) { config.set_public_namespace(public_namespace_); }
+  /*!
+   * the mapping of a user is cached this long by every process, a migrated user is switched after it.
+   * @return seconds, the default if the setting is invalid
+   */
+  unsigned int get_namespace_cache_ttl();
 
   void set_cfg_object_name(const std::string &cfg_object_name_) { config.set_cfg_object_name(cfg_object_name_); }
   std::string get_cfg_object_name() { return config.get_cfg_object_name(); }
   RadosCephJsonConfig *get_config() { return &config; }
+  /*!
+   * @return object version of the loaded configuration
+   */
+  uint64_t get_version() { return version; }
 
   bool is_valid_key_value(const std::string &key, const std::string &value);
   bool update_valid_key_value(const std::string &key, const std::string &value);
@@ -73,9 +95,23 @@ class RadosCephConfig {
   int read_object(const std::string &oid, librados::bufferlist *buffer);
   void set_io_ctx_namespace(const std::string &namespace_);
 
+ private:
+  /*!
+   * the pooled io_ctx is fetched again if the cluster tore down the shared io contexts.
+   * @return io_ctx to use, may be nullptr
+   */
+  librados::IoCtx *get_io_ctx();
+
  private:
   RadosCephJsonConfig config;
   librados::IoCtx *io_ctx;
+  librados::IoCtx *default_io_ctx;
+  RadosCluster *cluster;
+  std::string pool_name;
+  // namespace and pool generation of a shared io_ctx
+  std::string pooled_namespace;
+  uint64_t pooled_generation;
+  uint64_t version;
 };
 
 } /* namespace tallence */
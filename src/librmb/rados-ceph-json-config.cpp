@@ -26,6 +26,7 @@ RadosCephJsonConfig::RadosCephJsonConfig()
       update_attributes("false"),
       metadata_storage_module("default"),
       metadata_storage_attribute("ima"),
+      namespace_cache_ttl("600"),
       key_user_mapping("user_mapping"),
       key_user_ns("user_ns"),
       key_user_suffix("user_suffix"),
@@ -34,7 +35,8 @@ RadosCephJsonConfig::RadosCephJsonConfig()
       key_update_attributes("rbox_update_attributes"),
       key_updateable_attributes("rbox_updateable_attributes"),
       key_metadata_storage_module("rbox_metadata_storage"),
-      key_metadata_storage_attribute("rbox_storage_metadata_attr") {
+      key_metadata_storage_attribute("rbox_storage_metadata_attr"),
+      key_namespace_cache_ttl("rbox_namespace_cache_ttl") {
   set_default_mail_attributes();
   set_default_updateable_attributes();
 }
@@ -90,6 +92,12 @@ bool RadosCephJsonConfig::from_json(librados::bufferlist *buffer) {
     json_t *metadata_storage_attr_ = json_object_get(root, key_metadata_storage_attribute.c_str());
     metadata_storage_attribute = json_string_value(metadata_storage_attr_);
 
+    // added later, configurations written by older versions use the default
+    json_t *namespace_cache_ttl_ = json_object_get(root, key_namespace_cache_ttl.c_str());
+    if (json_is_string(namespace_cache_ttl_)) {
+      namespace_cache_ttl = json_string_value(namespace_cache_ttl_);
+    }
+
     ret = valid = true;
     json_decref(root);
   }
@@ -110,6 +118,7 @@ bool RadosCephJsonConfig::to_json(librados::bufferlist *buffer) {
   json_object_set_new(root, key_update_attributes.c_str(), json_string(update_attributes.c_str()));
   json_object_set_new(root, key_metadata_storage_module.c_str(), json_string(metadata_storage_module.c_str()));
   json_object_set_new(root, key_metadata_storage_attribute.c_str(), json_string(metadata_storage_attribute.c_str()));
+  json_object_set_new(root, key_namespace_cache_ttl.c_str(), json_string(namespace_cache_ttl.c_str()));
 
   char *s = json_dumps(root, 0);
   buffer->append(s);
@@ -130,6 +139,7 @@ std::string RadosCephJsonConfig::to_string() {
   ss << "  " << key_updateable_attributes << "=" << updateable_attributes << std::endl;
   ss << "  " << key_metadata_storage_module << "=" << metadata_storage_module << std::endl;
   ss << "  " << key_metadata_storage_attribute << "=" << metadata_storage_attribute << std::endl;
+  ss << "  " << key_namespace_cache_ttl << "=" << namespace_cache_ttl << std::endl;
   return ss.str();
 }
 
@@ -79,6 +79,9 @@ class RadosCephJsonConfig {
   }
   const std::string& get_metadata_storage_attribute() { return metadata_storage_attribute; }
 
+  void set_namespace_cache_ttl(const std::string& namespace_cache_ttl_) { namespace_cache_ttl = namespace_cache_ttl_; }
+  const std::string& get_namespace_cache_ttl() const { return namespace_cache_ttl; }
+
   void update_mail_attribute(const char* value);
   void update_updateable_attribute(const char* value);
 
@@ -93,6 +96,7 @@ class RadosCephJsonConfig {
 
   const std::string& get_metadata_storage_module_key() { return key_metadata_storage_module; }
   const std::string& get_metadata_storage_attribute_key() { return key_metadata_storage_attribute; }
+  const std::string& get_namespace_cache_ttl_key() { return key_namespace_cache_ttl; }
 
  private:
   void set_default_mail_attributes();
@@ -112,6 +116,8 @@ class RadosCephJsonConfig {
 
   std::string metadata_storage_module;
   std::string metadata_storage_attribute;
+  // seconds a user namespace mapping is cached by each process
+  std::string namespace_cache_ttl;
 
   std::string key_user_mapping;
   std::string key_user_ns;
@@ -124,6 +130,7 @@ class RadosCephJsonConfig {
 
   std::string key_metadata_storage_module;
   std::string key_metadata_storage_attribute;
+  std::string key_namespace_cache_ttl;
 };
 
 } /* namespace librmb */
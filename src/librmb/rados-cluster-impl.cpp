@@ -16,6 +16,7 @@
 #include <utility>
 
 #include "rados-dictionary-impl.h"
+#include "rados-ceph-config-cache.h"
 #include "rados-storage-impl.h"
 #include "rados-util.h"
 using std::list;
@@ -37,6 +38,14 @@ const char *RadosClusterImpl::RADOS_OSD_OP_TIMEOUT_DEFAULT = "600";
 librados::Rados *RadosClusterImpl::cluster = 0;
 int RadosClusterImpl::cluster_ref_count = 0;
 bool RadosClusterImpl::connected = false;
+enum librmb::rbox_cluster_state RadosClusterImpl::state = librmb::CLUSTER_STATE_DISABLED;
+std::string RadosClusterImpl::prewarm_clustername;
+std::string RadosClusterImpl::prewarm_username;
+std::map<std::pair<std::string, std::string>, librados::IoCtx *> RadosClusterImpl::io_ctx_pool;
+std::mutex RadosClusterImpl::io_ctx_pool_mutex;
+uint64_t RadosClusterImpl::io_ctx_pool_generation = 0;
+std::map<std::string, std::string> RadosClusterImpl::config_cache;
+std::mutex RadosClusterImpl::config_cache_mutex;
 
 RadosClusterImpl::RadosClusterImpl() {}
 
@@ -149,6 +158,13 @@ int RadosClusterImpl::initialize() {
 
 bool RadosClusterImpl::is_connected() { return RadosClusterImpl::connected; }
 
+int RadosClusterImpl::watch_flush() {
+  if (!RadosClusterImpl::connected) {
+    return 0;
+  }
+  return RadosClusterImpl::cluster->watch_flush();
+}
+
 int RadosClusterImpl::connect() {
   int ret = 0;
   if (RadosClusterImpl::cluster_ref_count > 0 && !RadosClusterImpl::connected) {
@@ -161,6 +177,17 @@ int RadosClusterImpl::connect() {
 void RadosClusterImpl::deinit() {
   if (RadosClusterImpl::cluster_ref_count > 0) {
     if (--RadosClusterImpl::cluster_ref_count == 0) {
+      if (RadosClusterImpl::connected) {
+        librmb::RadosCephConfigCache::clear(RadosClusterImpl::cluster);
+      }
+      io_ctx_pool_clear();
+      RadosClusterImpl::state = librmb::CLUSTER_STATE_DISABLED;
+      RadosClusterImpl::prewarm_clustername.clear();
+      RadosClusterImpl::prewarm_username.clear();
+      {
+        std::lock_guard<std::mutex> lock(RadosClusterImpl::config_cache_mutex);
+        RadosClusterImpl::config_cache.clear();
+      }
       if (RadosClusterImpl::connected) {
         RadosClusterImpl::cluster->shutdown();
         RadosClusterImpl::connected = false;
@@ -215,10 +242,13 @@ int RadosClusterImpl::io_ctx_create(const string &pool, librados::IoCtx *io_ctx)
     return ret;
   }
 
-  // pool exists? else create
-  ret = pool_create(pool);
-  if (ret == 0) {
-    ret = RadosClusterImpl::cluster->ioctx_create(pool.c_str(), *io_ctx);
+  ret = RadosClusterImpl::cluster->ioctx_create(pool.c_str(), *io_ctx);
+  if (ret == -ENOENT) {
+    // pool does not exist => create
+    ret = pool_create(pool);
+    if (ret == 0) {
+      ret = RadosClusterImpl::cluster->ioctx_create(pool.c_str(), *io_ctx);
+    }
   }
   return ret;
 }
@@ -227,16 +257,123 @@ int RadosClusterImpl::recovery_index_io_ctx(const std::string &pool,
     if(!is_connected()) {
       return -1;
     }
-    // pool exists? else create
-    int ret = pool_create(pool);
-    if (ret == 0) {
-      ret = RadosClusterImpl::cluster->ioctx_create(pool.c_str(), *io_ctx);
+    int ret = RadosClusterImpl::cluster->ioctx_create(pool.c_str(), *io_ctx);
+    if (ret == -ENOENT) {
+      // pool does not exist => create
+      ret = pool_create(pool);
+      if (ret == 0) {
+        ret = RadosClusterImpl::cluster->ioctx_create(pool.c_str(), *io_ctx);
+      }
+    }
+    return ret;
+}
+
+int RadosClusterImpl::prewarm(const std::string &clustername, const std::string &rados_username,
+                              const std::list<std::string> &pools) {
+  RadosClusterImpl::state = librmb::CLUSTER_STATE_CONNECTING;
+  int ret = init(clustername, rados_username);
+  if (ret < 0) {
+    RadosClusterImpl::state = librmb::CLUSTER_STATE_FAILED;
+    return ret;
+  }
+  ret = connect();
+  // open the pools, this also fetches the osd map
+  for (std::list<std::string>::const_iterator it = pools.begin(); ret == 0 && it != pools.end(); ++it) {
+    librados::IoCtx *io_ctx = nullptr;
+    ret = io_ctx_get(*it, "", &io_ctx);
+  }
+  if (ret < 0) {
+    // release the cluster, users connect on demand
+    deinit();
+    RadosClusterImpl::state = librmb::CLUSTER_STATE_FAILED;
+    return ret;
+  }
+  RadosClusterImpl::state = librmb::CLUSTER_STATE_READY;
+  RadosClusterImpl::prewarm_clustername = clustername;
+  RadosClusterImpl::prewarm_username = rados_username;
+  return 0;
+}
+
+bool RadosClusterImpl::is_prewarm_compatible(const std::string &clustername, const std::string &rados_username,
+                                             std::string *mismatch) {
+  if (RadosClusterImpl::state != librmb::CLUSTER_STATE_READY || RadosClusterImpl::cluster_ref_count == 0) {
+    return true;
+  }
+  if (clustername != RadosClusterImpl::prewarm_clustername) {
+    *mismatch = "cluster_name " + clustername + " != " + RadosClusterImpl::prewarm_clustername;
+    return false;
+  }
+  if (rados_username != RadosClusterImpl::prewarm_username) {
+    *mismatch = "rados_username " + rados_username + " != " + RadosClusterImpl::prewarm_username;
+    return false;
+  }
+  for (std::map<const char *, const char *>::iterator it = client_options.begin(); it != client_options.end(); ++it) {
+    std::string value;
+    if (get_config_option(it->first, &value) < 0 || value.compare(it->second) != 0) {
+      *mismatch = std::string(it->first) + " " + it->second + " != " + value;
+      return false;
     }
-    return ret;      
+  }
+  return true;
+}
+
+int RadosClusterImpl::io_ctx_get(const std::string &pool, const std::string &ns, librados::IoCtx **io_ctx) {
+  assert(io_ctx != nullptr);
+
+  std::lock_guard<std::mutex> lock(RadosClusterImpl::io_ctx_pool_mutex);
+  if (RadosClusterImpl::cluster_ref_count == 0 || !RadosClusterImpl::connected) {
+    return -ENOTCONN;
+  }
+  std::pair<std::string, std::string> key(pool, ns);
+  auto it = RadosClusterImpl::io_ctx_pool.find(key);
+  if (it != RadosClusterImpl::io_ctx_pool.end()) {
+    *io_ctx = it->second;
+    return 0;
+  }
+
+  librados::IoCtx *pooled = new librados::IoCtx();
+  int ret = RadosClusterImpl::cluster->ioctx_create(pool.c_str(), *pooled);
+  if (ret < 0) {
+    delete pooled;
+    return ret;
+  }
+  pooled->set_namespace(ns);
+  RadosClusterImpl::io_ctx_pool[key] = pooled;
+  *io_ctx = pooled;
+  return 0;
+}
+
+void RadosClusterImpl::io_ctx_pool_clear() {
+  std::lock_guard<std::mutex> lock(RadosClusterImpl::io_ctx_pool_mutex);
+  for (auto &it : RadosClusterImpl::io_ctx_pool) {
+    delete it.second;
+  }
+  RadosClusterImpl::io_ctx_pool.clear();
+  ++RadosClusterImpl::io_ctx_pool_generation;
+}
+
+uint64_t RadosClusterImpl::get_io_ctx_pool_generation() {
+  std::lock_guard<std::mutex> lock(RadosClusterImpl::io_ctx_pool_mutex);
+  return RadosClusterImpl::io_ctx_pool_generation;
 }
 
 int RadosClusterImpl::get_config_option(const char *option, string *value) {
-  return RadosClusterImpl::cluster->conf_get(option, *value);
+  if (!RadosClusterImpl::connected) {
+    // configuration may still change
+    return RadosClusterImpl::cluster->conf_get(option, *value);
+  }
+
+  std::lock_guard<std::mutex> lock(RadosClusterImpl::config_cache_mutex);
+  auto it = RadosClusterImpl::config_cache.find(option);
+  if (it != RadosClusterImpl::config_cache.end()) {
+    *value = it->second;
+    return 0;
+  }
+  int ret = RadosClusterImpl::cluster->conf_get(option, *value);
+  if (ret == 0) {
+    RadosClusterImpl::config_cache[option] = *value;
+  }
+  return ret;
 }
 
 void RadosClusterImpl::set_config_option(const char *option, const char *value) { client_options[option] = value; }
@@ -14,10 +14,13 @@
 
 #include <list>
 #include <string>
+#include <utility>
+#include <mutex>  // NOLINT
 
 #include <rados/librados.hpp>
 #include <map>
 #include "rados-cluster.h"
+#include "rados-types.h"
 namespace librmb {
 
 class RadosClusterImpl : public RadosCluster {
@@ -34,24 +37,59 @@ class RadosClusterImpl : public RadosCluster {
   int pool_create(const std::string &pool) override;
   int io_ctx_create(const std::string &pool, librados::IoCtx *io_ctx) override;
   int recovery_index_io_ctx(const std::string &pool, librados::IoCtx *io_ctx) override;
+  int io_ctx_get(const std::string &pool, const std::string &ns, librados::IoCtx **io_ctx) override;
+  uint64_t get_io_ctx_pool_generation() override;
   
   int get_config_option(const char *option, std::string *value) override;
   int dictionary_create(const std::string &pool, const std::string &username, const std::string &oid,
                         RadosDictionary **dictionary);
   bool is_connected() override;
+  int watch_flush() override;
   librados::Rados &get_cluster() { return *cluster; }
   void set_config_option(const char *option, const char *value);
 
+  /*!
+   * connect the cluster and open the io contexts of pools before the first user needs them.
+   * The cluster reference is kept until deinit() is called, on failure it is released.
+   * @param[in] pools existing pools to open.
+   * @return linux error code or 0 if successful
+   */
+  int prewarm(const std::string &clustername, const std::string &rados_username, const std::list<std::string> &pools);
+  /*!
+   * @return state of the prewarmed cluster, CLUSTER_STATE_DISABLED if prewarm was not called.
+   */
+  static enum rbox_cluster_state get_state() { return state; }
+  /*!
+   * the prewarmed cluster is shared by all users of the process, their cluster name, rados user and
+   * ceph client options (set_config_option) are not applied anymore.
+   * @param[out] mismatch first setting which differs from the prewarmed cluster
+   * @return false if the cluster is prewarmed with different settings.
+   */
+  bool is_prewarm_compatible(const std::string &clustername, const std::string &rados_username,
+                             std::string *mismatch);
+
   std::vector<std::string> list_pgs_for_pool(std::string &pool_name) override;
   std::map<std::string, std::vector<std::string>> list_pgs_osd_for_pool(std::string &pool_name) override;
 
  private:
   int initialize();
+  static void io_ctx_pool_clear();
 
  private:
   static librados::Rados *cluster;
   static int cluster_ref_count;
   static bool connected;
+  static enum rbox_cluster_state state;
+  // settings of the prewarmed cluster
+  static std::string prewarm_clustername;
+  static std::string prewarm_username;
+  // shared io contexts by (pool, namespace)
+  static std::map<std::pair<std::string, std::string>, librados::IoCtx *> io_ctx_pool;
+  static std::mutex io_ctx_pool_mutex;
+  static uint64_t io_ctx_pool_generation;
+  // configuration values read after connect, they do not change anymore
+  static std::map<std::string, std::string> config_cache;
+  static std::mutex config_cache_mutex;
   std::map<const char *, const char *> client_options;
 
   static const char *CLIENT_MOUNT_TIMEOUT;
@@ -0,0 +1,77 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-cluster-memory.h"
+
+#include <errno.h>
+
+#include <string>
+
+namespace librmb {
+
+RadosClusterMemory::RadosClusterMemory(RadosMemoryBackend *backend_) : backend(backend_), ref_count(0) {
+  // ceph defaults
+  config["osd_max_write_size"] = "90";
+  config["osd_max_object_size"] = "134217728";
+}
+
+RadosClusterMemory::~RadosClusterMemory() {}
+
+int RadosClusterMemory::init() {
+  ++ref_count;
+  return 0;
+}
+
+int RadosClusterMemory::init(const std::string &clustername, const std::string &rados_username) { return init(); }
+
+void RadosClusterMemory::deinit() {
+  if (ref_count > 0) {
+    --ref_count;
+  }
+}
+
+int RadosClusterMemory::pool_create(const std::string &pool) {
+  int ret = backend->pool_create(pool);
+  return ret == -EEXIST ? 0 : ret;
+}
+
+int RadosClusterMemory::io_ctx_create(const std::string &pool, librados::IoCtx *io_ctx) { return -EOPNOTSUPP; }
+
+int RadosClusterMemory::recovery_index_io_ctx(const std::string &pool, librados::IoCtx *io_ctx) {
+  return -EOPNOTSUPP;
+}
+
+int RadosClusterMemory::io_ctx_get(const std::string &pool, const std::string &ns, librados::IoCtx **io_ctx) {
+  return -EOPNOTSUPP;
+}
+
+int RadosClusterMemory::get_config_option(const char *option, std::string *value) {
+  auto it = config.find(option);
+  if (it == config.end()) {
+    return -ENOENT;
+  }
+  *value = it->second;
+  return 0;
+}
+
+void RadosClusterMemory::set_config_option(const char *option, const char *value) { config[option] = value; }
+
+bool RadosClusterMemory::is_connected() { return ref_count > 0; }
+
+std::vector<std::string> RadosClusterMemory::list_pgs_for_pool(std::string &pool_name) {
+  return std::vector<std::string>();
+}
+
+std::map<std::string, std::vector<std::string>> RadosClusterMemory::list_pgs_osd_for_pool(std::string &pool_name) {
+  return std::map<std::string, std::vector<std::string>>();
+}
+
+}  // namespace librmb
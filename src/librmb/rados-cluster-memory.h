@@ -0,0 +1,65 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_CLUSTER_MEMORY_H_
+#define SRC_LIBRMB_RADOS_CLUSTER_MEMORY_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <rados/librados.hpp>
+#include "rados-cluster.h"
+#include "rados-memory-backend.h"
+
+namespace librmb {
+
+/**
+ * Rados Cluster Memory
+ *
+ * RadosCluster on top of a RadosMemoryBackend. There is no librados
+ * connection, so no librados::IoCtx can be created: io_ctx_create,
+ * recovery_index_io_ctx and io_ctx_get fail with -EOPNOTSUPP.
+ */
+class RadosClusterMemory : public RadosCluster {
+ public:
+  explicit RadosClusterMemory(RadosMemoryBackend *backend_);
+  virtual ~RadosClusterMemory();
+
+  int init() override;
+  int init(const std::string &clustername, const std::string &rados_username) override;
+  void deinit() override;
+
+  int pool_create(const std::string &pool) override;
+  int io_ctx_create(const std::string &pool, librados::IoCtx *io_ctx) override;
+  int recovery_index_io_ctx(const std::string &pool, librados::IoCtx *io_ctx) override;
+  int io_ctx_get(const std::string &pool, const std::string &ns, librados::IoCtx **io_ctx) override;
+  uint64_t get_io_ctx_pool_generation() override { return 0; }
+
+  int get_config_option(const char *option, std::string *value) override;
+  void set_config_option(const char *option, const char *value) override;
+  bool is_connected() override;
+  int watch_flush() override { return 0; }
+
+  std::vector<std::string> list_pgs_for_pool(std::string &pool_name) override;
+  std::map<std::string, std::vector<std::string>> list_pgs_osd_for_pool(std::string &pool_name) override;
+
+  RadosMemoryBackend *get_backend() { return backend; }
+
+ private:
+  RadosMemoryBackend *backend;
+  int ref_count;
+  std::map<std::string, std::string> config;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_CLUSTER_MEMORY_H_
@@ -66,6 +66,22 @@ class RadosCluster {
   */
   virtual int recovery_index_io_ctx(const std::string &pool,librados::IoCtx *io_ctx) = 0;
 
+  /*!
+   * get a shared io context for pool and namespace. The io context is created on first
+   * use and kept until the cluster connection is torn down. It is safe to use from
+   * multiple threads as long as its namespace is never changed.
+   * @param[in] pool existing poolname
+   * @param[in] ns namespace of the io context
+   * @param[out] io_ctx valid ptr, owned by the cluster.
+   * @return linux error code or 0 if successful
+   */
+  virtual int io_ctx_get(const std::string &pool, const std::string &ns, librados::IoCtx **io_ctx) = 0;
+  /*!
+   * the shared io contexts are destroyed when the last cluster reference is released.
+   * @return generation of the shared io contexts, pointers of an older generation are invalid.
+   */
+  virtual uint64_t get_io_ctx_pool_generation() = 0;
+
   virtual int get_config_option(const char *option, std::string *value) = 0;
 
   /*!
@@ -83,6 +99,12 @@ class RadosCluster {
    */
   virtual bool is_connected() = 0;
 
+  /*!
+   * wait until all pending watch/notify callbacks have been delivered.
+   * @return linux error code or 0 if successful
+   */
+  virtual int watch_flush() = 0;
+
   /*! get placement groups for mailbox storage pool 
   */
   virtual std::vector<std::string> list_pgs_for_pool(std::string &pool_name) = 0;
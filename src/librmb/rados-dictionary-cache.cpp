@@ -0,0 +1,238 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-dictionary-cache.h"
+
+#include <errno.h>
+
+#include <sstream>
+#include <string>
+
+namespace librmb {
+
+// notifications are acked by the watchers immediately
+#define DICT_CACHE_NOTIFY_TIMEOUT_MS 5000
+
+const size_t RadosDictionaryCache::MAX_ENTRIES = 10000;
+
+RadosDictionaryCache::RadosDictionaryCache(unsigned int ttl_) : ttl(ttl_), generation(0), min_generation(0) {}
+
+RadosDictionaryCache::~RadosDictionaryCache() {
+  for (auto &w : watchers) {
+    delete w.second;
+  }
+  watchers.clear();
+}
+
+std::string RadosDictionaryCache::object_id(librados::IoCtx *io_ctx, const std::string &oid) {
+  return io_ctx->get_namespace() + "/" + oid;
+}
+
+int RadosDictionaryCache::watch(librados::IoCtx *io_ctx, const std::string &oid) {
+  std::string id = object_id(io_ctx, oid);
+  auto now = std::chrono::steady_clock::now();
+  Watcher *watcher = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = watchers.find(id);
+    if (it != watchers.end()) {
+      watcher = it->second;
+      if (watcher->watching) {
+        return 0;
+      }
+      if (now - watcher->last_attempt < ttl) {
+        return -EAGAIN;
+      }
+    } else {
+      watcher = new Watcher(this, io_ctx, id, oid);
+      watchers[id] = watcher;
+    }
+    watcher->last_attempt = now;
+  }
+
+  if (watcher->handle != 0) {
+    // watch has been lost (handle_error)
+    io_ctx->unwatch2(watcher->handle);
+    watcher->handle = 0;
+  }
+  // watch requires an existing object, lookups must not create it
+  uint64_t handle = 0;
+  int ret = io_ctx->watch2(oid, &handle, watcher);
+  if (ret == -ENOENT) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    watcher->missing = true;
+    return ret;
+  }
+  if (ret < 0) {
+    return ret;
+  }
+
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  watcher->handle = handle;
+  watcher->watching = true;
+  return 0;
+}
+
+void RadosDictionaryCache::unwatch_all() {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  for (auto &w : watchers) {
+    if (w.second->handle != 0) {
+      w.second->io_ctx->unwatch2(w.second->handle);
+      w.second->handle = 0;
+    }
+    w.second->watching = false;
+  }
+  entries.clear();
+}
+
+bool RadosDictionaryCache::get(const std::string &key, std::string *value_r, bool *exists_r) {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  auto it = entries.find(key);
+  if (it == entries.end()) {
+    return false;
+  }
+  if (it->second.expires < std::chrono::steady_clock::now()) {
+    entries.erase(it);
+    return false;
+  }
+  *value_r = it->second.value;
+  *exists_r = it->second.exists;
+  return true;
+}
+
+uint64_t RadosDictionaryCache::get_generation() {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  return generation;
+}
+
+bool RadosDictionaryCache::is_invalidated(const std::string &key, const std::string &id, uint64_t read_generation) {
+  if (read_generation < min_generation) {
+    return true;
+  }
+  auto k = key_generations.find(key);
+  if (k != key_generations.end() && k->second > read_generation) {
+    return true;
+  }
+  auto o = object_generations.find(id);
+  return o != object_generations.end() && o->second > read_generation;
+}
+
+void RadosDictionaryCache::put(librados::IoCtx *io_ctx, const std::string &oid, const std::string &key,
+                               const std::string &value, bool exists, uint64_t read_generation) {
+  std::string id = object_id(io_ctx, oid);
+  auto now = std::chrono::steady_clock::now();
+
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  auto w = watchers.find(id);
+  if (w == watchers.end() || !w->second->watching) {
+    // changes would not be noticed
+    return;
+  }
+  if (is_invalidated(key, id, read_generation)) {
+    // changed while the lookup was in flight, the value may be stale
+    return;
+  }
+  if (entries.size() >= MAX_ENTRIES) {
+    for (auto it = entries.begin(); it != entries.end();) {
+      if (it->second.expires < now) {
+        it = entries.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    if (entries.size() >= MAX_ENTRIES) {
+      entries.clear();
+    }
+  }
+  Entry &entry = entries[key];
+  entry.value = value;
+  entry.exists = exists;
+  entry.object_id = id;
+  entry.expires = now + ttl;
+}
+
+void RadosDictionaryCache::invalidate(const std::set<std::string> &keys) {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  for (auto &key : keys) {
+    invalidate_key(key);
+  }
+}
+
+void RadosDictionaryCache::invalidate_key(const std::string &key) {
+  entries.erase(key);
+  if (key_generations.size() >= MAX_ENTRIES) {
+    // lookups still in flight are discarded
+    key_generations.clear();
+    min_generation = generation + 1;
+  }
+  key_generations[key] = ++generation;
+}
+
+void RadosDictionaryCache::invalidate_object(const std::string &id) {
+  object_generations[id] = ++generation;
+  for (auto it = entries.begin(); it != entries.end();) {
+    if (it->second.object_id == id) {
+      it = entries.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+int RadosDictionaryCache::notify(librados::IoCtx *io_ctx, const std::string &oid, const std::set<std::string> &keys,
+                                 librados::AioCompletion *completion) {
+  invalidate(keys);
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto w = watchers.find(object_id(io_ctx, oid));
+    if (w != watchers.end() && w->second->missing) {
+      // the object has been written, watch it with the next lookup
+      w->second->missing = false;
+      w->second->last_attempt = std::chrono::steady_clock::time_point();
+    }
+  }
+
+  librados::bufferlist bl;
+  for (auto &key : keys) {
+    bl.append(key);
+    bl.append('\n');
+  }
+  return io_ctx->aio_notify(oid, completion, bl, DICT_CACHE_NOTIFY_TIMEOUT_MS, nullptr);
+}
+
+void RadosDictionaryCache::Watcher::handle_notify(uint64_t notify_id, uint64_t cookie, uint64_t notifier_id,
+                                                  librados::bufferlist &bl) {
+  std::set<std::string> keys;
+  std::istringstream payload(bl.to_str());
+  std::string key;
+  while (std::getline(payload, key)) {
+    keys.insert(key);
+  }
+
+  if (keys.empty()) {
+    std::lock_guard<std::mutex> lock(cache->cache_mutex);
+    cache->invalidate_object(id);
+  } else {
+    cache->invalidate(keys);
+  }
+
+  librados::bufferlist reply;
+  io_ctx->notify_ack(oid, notify_id, cookie, reply);
+}
+
+void RadosDictionaryCache::Watcher::handle_error(uint64_t cookie, int err) {
+  // notifications may have been missed, do not trust cached values until the watch is reestablished
+  std::lock_guard<std::mutex> lock(cache->cache_mutex);
+  watching = false;
+  cache->invalidate_object(id);
+}
+
+}  // namespace librmb
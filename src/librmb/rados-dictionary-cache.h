@@ -0,0 +1,129 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_DICTIONARY_CACHE_H_
+#define SRC_LIBRMB_RADOS_DICTIONARY_CACHE_H_
+
+#include <stdint.h>
+
+#include <chrono>  // NOLINT
+#include <map>
+#include <set>
+#include <string>
+#include <mutex>  // NOLINT
+
+#include <rados/librados.hpp>
+
+namespace librmb {
+
+/**
+ * Rados Dictionary Cache
+ *
+ * In process cache of dictionary lookups. Values are only cached for objects
+ * with an established watch. Writers notify the watchers of the changed keys,
+ * which are then removed from the cache. Entries expire after ttl seconds.
+ *
+ * Every invalidation bumps a generation. A lookup takes the generation before
+ * it reads, put discards its value if the key was invalidated since then.
+ */
+class RadosDictionaryCache {
+ public:
+  explicit RadosDictionaryCache(unsigned int ttl_);
+  virtual ~RadosDictionaryCache();
+
+  /*!
+   * establish a watch on oid. Values of oid are cached only while the watch is
+   * established. Failed attempts are retried at most once per ttl. The object is
+   * not created, a missing object is watched after the first notify of a writer.
+   * @param[in] io_ctx valid io_ctx, needs to live as long as the watch.
+   * @return linux error code or 0 if successful
+   */
+  int watch(librados::IoCtx *io_ctx, const std::string &oid);
+  /*!
+   * remove all watches, call Rados::watch_flush before the cache is deleted.
+   */
+  void unwatch_all();
+
+  /*!
+   * @param[out] value_r cached value
+   * @param[out] exists_r false if the key is known not to exist.
+   * @return true if the key is cached.
+   */
+  bool get(const std::string &key, std::string *value_r, bool *exists_r);
+  /*!
+   * generation to pass to put, taken before the lookup is sent.
+   */
+  uint64_t get_generation();
+  /*!
+   * cache the result of a lookup, unless the key was invalidated after read_generation.
+   */
+  void put(librados::IoCtx *io_ctx, const std::string &oid, const std::string &key, const std::string &value,
+           bool exists, uint64_t read_generation);
+  void invalidate(const std::set<std::string> &keys);
+  /*!
+   * notify all watchers of oid that keys have been changed.
+   * @return linux error code or 0 if successful
+   */
+  int notify(librados::IoCtx *io_ctx, const std::string &oid, const std::set<std::string> &keys,
+             librados::AioCompletion *completion);
+
+ private:
+  class Watcher : public librados::WatchCtx2 {
+   public:
+    Watcher(RadosDictionaryCache *cache_, librados::IoCtx *io_ctx_, const std::string &id_, const std::string &oid_)
+        : cache(cache_), io_ctx(io_ctx_), id(id_), oid(oid_), handle(0), watching(false), missing(false) {}
+
+    void handle_notify(uint64_t notify_id, uint64_t cookie, uint64_t notifier_id, librados::bufferlist &bl) override;
+    void handle_error(uint64_t cookie, int err) override;
+
+    RadosDictionaryCache *cache;
+    librados::IoCtx *io_ctx;
+    std::string id;
+    std::string oid;
+    uint64_t handle;
+    bool watching;
+    // the object did not exist at the last attempt
+    bool missing;
+    std::chrono::steady_clock::time_point last_attempt;
+  };
+
+  struct Entry {
+    std::string value;
+    bool exists;
+    std::string object_id;
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  static std::string object_id(librados::IoCtx *io_ctx, const std::string &oid);
+  // called with cache_mutex held
+  void invalidate_key(const std::string &key);
+  void invalidate_object(const std::string &id);
+  bool is_invalidated(const std::string &key, const std::string &id, uint64_t read_generation);
+
+ private:
+  static const size_t MAX_ENTRIES;
+
+  std::chrono::seconds ttl;
+  std::map<std::string, Entry> entries;
+  std::map<std::string, Watcher *> watchers;
+  std::mutex cache_mutex;
+
+  uint64_t generation;
+  // generation of the last invalidation per key and per object
+  std::map<std::string, uint64_t> key_generations;
+  std::map<std::string, uint64_t> object_generations;
+  // lookups started before are discarded, set when key_generations is pruned
+  uint64_t min_generation;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_DICTIONARY_CACHE_H_
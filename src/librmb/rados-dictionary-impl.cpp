@@ -9,7 +9,12 @@
  * Foundation.  See file COPYING.
  */
 
+#ifdef HAVE_CONFIG_H
+#include "dovecot-ceph-plugin-config.h"
+#endif
+
 #include "rados-dictionary-impl.h"
+#include "rados-stats.h"
 
 #include <errno.h>
 #include <limits.h>
@@ -33,6 +38,9 @@ using std::set;
 
 using librmb::RadosDictionaryImpl;
 
+// retries of a legacy key move which raced with a concurrent change
+static const int MOVE_LEGACY_MAX_ATTEMPTS = 5;
+
 #define DICT_USERNAME_SEPARATOR '/'
 #define DICT_PATH_PRIVATE "priv/"
 #define DICT_PATH_SHARED "shared/"
@@ -46,8 +54,11 @@ RadosDictionaryImpl::RadosDictionaryImpl(RadosCluster *_cluster, const string &_
       oid(_oid),
       cfg(nullptr),
       namespace_mgr(nullptr),
-      cfg_object_name(cfg_object_name_) {
+      cfg_object_name(cfg_object_name_),
+      cache(nullptr) {
   shared_io_ctx_created = false;
+  shared_shard_count = 1;
+  legacy_shared_removed = false;
   private_io_ctx_created = false;
   guid_generator = guid_generator_;
   shared_oid = oid;
@@ -55,6 +66,12 @@ RadosDictionaryImpl::RadosDictionaryImpl(RadosCluster *_cluster, const string &_
 }
 
 RadosDictionaryImpl::~RadosDictionaryImpl() {
+  if (cache != nullptr) {
+    cache->unwatch_all();
+    cluster->watch_flush();
+    delete cache;
+    cache = nullptr;
+  }
   if (namespace_mgr != nullptr) {
     delete namespace_mgr;
     namespace_mgr = nullptr;
@@ -73,6 +90,9 @@ const string RadosDictionaryImpl::get_full_oid(const std::string &key) {
   if (!key.compare(0, strlen(DICT_PATH_PRIVATE), DICT_PATH_PRIVATE)) {
     return get_private_oid();
   } else if (!key.compare(0, strlen(DICT_PATH_SHARED), DICT_PATH_SHARED)) {
+    if (shared_shard_count > 1) {
+      return get_shared_shard_oid(shard_hash(key) % shared_shard_count);
+    }
     return get_shared_oid();
   } else {
     // TODO(peter) i_unreached();
@@ -80,6 +100,23 @@ const string RadosDictionaryImpl::get_full_oid(const std::string &key) {
   return "";
 }
 
+const string RadosDictionaryImpl::get_shared_shard_oid(unsigned int shard) {
+  if (shared_shard_count <= 1) {
+    return get_shared_oid();
+  }
+  return shared_oid + "." + std::to_string(shard);
+}
+
+uint32_t RadosDictionaryImpl::shard_hash(const std::string &key) {
+  // FNV-1a, the shard of a key must be stable across processes and builds
+  uint32_t hash = 2166136261u;
+  for (const char &c : key) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
 librados::IoCtx &RadosDictionaryImpl::get_shared_io_ctx() {
   if (!shared_io_ctx_created) {
     shared_io_ctx_created = cluster->io_ctx_create(poolname, &shared_io_ctx) == 0;
@@ -89,6 +126,11 @@ librados::IoCtx &RadosDictionaryImpl::get_shared_io_ctx() {
       lookup_namespace(user, cfg, &ns);
       shared_io_ctx.set_namespace(ns);
     }
+    if (shared_io_ctx_created && cache != nullptr) {
+      for (unsigned int i = 0; i < shared_shard_count; i++) {
+        cache->watch(&shared_io_ctx, get_shared_shard_oid(i));
+      }
+    }
   }
   return shared_io_ctx;
 }
@@ -135,6 +177,9 @@ librados::IoCtx &RadosDictionaryImpl::get_private_io_ctx() {
         lookup_namespace(user, cfg, &ns);
         private_io_ctx_created = true;
         private_io_ctx.set_namespace(ns);
+        if (cache != nullptr) {
+          cache->watch(&private_io_ctx, private_oid);
+        }
       }
     }
   }
@@ -155,6 +200,12 @@ librados::IoCtx &RadosDictionaryImpl::get_io_ctx(const std::string &key) {
 int RadosDictionaryImpl::get(const string &key, string *value_r) {
   int r_val = -1;
 
+  bool exists;
+  if (get_cached(key, value_r, &exists)) {
+    return exists ? 0 : -ENOENT;
+  }
+  uint64_t generation = get_cache_generation();
+
   set<string> keys;
   keys.insert(key);
 
@@ -163,7 +214,8 @@ int RadosDictionaryImpl::get(const string &key, string *value_r) {
   oro.omap_get_vals_by_keys(keys, &map, &r_val);
 
   librados::bufferlist bl;
-  int err = get_io_ctx(key).operate(get_full_oid(key), &oro, &bl);
+  RadosStatsTimer timer(RADOS_OP_OMAP_GET);
+  int err = timer.done(get_io_ctx(key).operate(get_full_oid(key), &oro, &bl));
 
   if (err == 0) {
     if (r_val == 0) {
@@ -172,15 +224,278 @@ int RadosDictionaryImpl::get(const string &key, string *value_r) {
         *value_r = it->second.to_str();
         return 0;
       }
-      return -ENOENT;
+      err = -ENOENT;
     } else {
       err = r_val;
     }
   }
 
+  if (err == -ENOENT && is_legacy_lookup_required(key)) {
+    err = get_legacy(key, value_r);
+  }
+  if (err == 0) {
+    add_cached(key, *value_r, true, generation);
+  } else if (err == -ENOENT) {
+    add_cached(key, "", false, generation);
+  }
   return err;
 }
 
+void RadosDictionaryImpl::set_cache_ttl(unsigned int ttl) {
+  if (cache != nullptr) {
+    return;
+  }
+  if (ttl > 0) {
+    cache = new RadosDictionaryCache(ttl);
+  }
+}
+
+bool RadosDictionaryImpl::get_cached(const std::string &key, std::string *value_r, bool *exists_r) {
+  if (cache == nullptr) {
+    return false;
+  }
+  librados::IoCtx &io_ctx = get_io_ctx(key);
+  // reestablishes a lost watch
+  if (cache->watch(&io_ctx, get_full_oid(key)) < 0) {
+    return false;
+  }
+  return cache->get(key, value_r, exists_r);
+}
+
+uint64_t RadosDictionaryImpl::get_cache_generation() { return cache != nullptr ? cache->get_generation() : 0; }
+
+void RadosDictionaryImpl::add_cached(const std::string &key, const std::string &value, bool exists,
+                                     uint64_t read_generation) {
+  if (cache == nullptr) {
+    return;
+  }
+  cache->put(&get_io_ctx(key), get_full_oid(key), key, value, exists, read_generation);
+}
+
+void RadosDictionaryImpl::notify_changed(const std::set<std::string> &keys) {
+  if (cache == nullptr) {
+    return;
+  }
+  map<string, set<string>> private_keys;
+  map<string, set<string>> shared_keys;
+  for (auto &key : keys) {
+    if (!key.compare(0, strlen(DICT_PATH_PRIVATE), DICT_PATH_PRIVATE)) {
+      private_keys[get_full_oid(key)].insert(key);
+    } else if (!key.compare(0, strlen(DICT_PATH_SHARED), DICT_PATH_SHARED)) {
+      shared_keys[get_full_oid(key)].insert(key);
+    }
+  }
+  for (int i = 0; i < 2; i++) {
+    librados::IoCtx &io_ctx = i == 0 ? get_private_io_ctx() : get_shared_io_ctx();
+    for (auto &object : i == 0 ? private_keys : shared_keys) {
+      librados::AioCompletion *completion = librados::Rados::aio_create_completion();
+      if (cache->notify(&io_ctx, object.first, object.second, completion) < 0) {
+        completion->release();
+      } else {
+        push_back_completion(completion);
+      }
+    }
+  }
+}
+
+bool RadosDictionaryImpl::is_legacy_lookup_required(const std::string &key) {
+  return shared_shard_count > 1 && !legacy_shared_removed &&
+         !key.compare(0, strlen(DICT_PATH_SHARED), DICT_PATH_SHARED);
+}
+
+int RadosDictionaryImpl::get_legacy(const std::string &key, std::string *value_r) {
+  int r_val = -1;
+
+  set<string> keys;
+  keys.insert(key);
+
+  map<std::string, librados::bufferlist> map;
+  librados::ObjectReadOperation oro;
+  oro.omap_get_vals_by_keys(keys, &map, &r_val);
+
+  librados::bufferlist bl;
+  RadosStatsTimer timer(RADOS_OP_OMAP_GET);
+  int err = timer.done(get_shared_io_ctx().operate(get_shared_oid(), &oro, &bl));
+  if (err == -ENOENT) {
+    // unsharded object does not exist (anymore), no need to look there again.
+    legacy_shared_removed = true;
+    return err;
+  }
+  if (err < 0) {
+    return err;
+  }
+  if (r_val < 0) {
+    return r_val;
+  }
+  auto it = map.find(key);
+  if (it == map.end()) {
+    return -ENOENT;
+  }
+  *value_r = it->second.to_str();
+  return 0;
+}
+
+int RadosDictionaryImpl::move_legacy_values(const map<string, librados::bufferlist> &legacy) {
+  librados::IoCtx &io_ctx = get_shared_io_ctx();
+  map<string, map<string, librados::bufferlist>> shards;
+  for (auto &kv : legacy) {
+    shards[get_full_oid(kv.first)].insert(kv);
+  }
+
+  // keys which already exist in the shard have been written after sharding was enabled,
+  // the shard value is the newer one. omap_cmp of a missing key compares an empty value,
+  // but fails with -ENOENT on a missing object, so the shard is created first.
+  map<string, map<string, librados::bufferlist>> moved;
+  for (auto &shard : shards) {
+    int err = -ECANCELED;
+    for (int attempt = 0; err == -ECANCELED && attempt < MOVE_LEGACY_MAX_ATTEMPTS; attempt++) {
+      set<string> keys;
+      for (auto &kv : shard.second) {
+        keys.insert(kv.first);
+      }
+      map<string, librados::bufferlist> existing;
+      RadosStatsTimer get_timer(RADOS_OP_OMAP_GET);
+      err = get_timer.done(io_ctx.omap_get_vals_by_keys(shard.first, keys, &existing));
+      if (err < 0 && err != -ENOENT) {
+        return err;
+      }
+      map<string, librados::bufferlist> to_set;
+      map<string, pair<librados::bufferlist, int>> absent;
+      for (auto &kv : shard.second) {
+        if (existing.find(kv.first) == existing.end()) {
+          to_set.insert(kv);
+          absent[kv.first] = std::make_pair(librados::bufferlist(), LIBRADOS_CMPXATTR_OP_EQ);
+        }
+      }
+      moved[shard.first] = to_set;
+      if (to_set.empty()) {
+        err = 0;
+        break;
+      }
+      int cmp_val = 0;
+      librados::ObjectWriteOperation set_op;
+      set_op.create(false);
+      set_op.omap_cmp(absent, &cmp_val);
+      set_op.omap_set(to_set);
+      RadosStatsTimer set_timer(RADOS_OP_OMAP_SET);
+      err = set_timer.done(io_ctx.operate(shard.first, &set_op));
+    }
+    if (err < 0) {
+      return err;
+    }
+  }
+
+  // remove the keys from the unsharded object only if nobody changed them meanwhile
+  set<string> keys;
+  map<string, pair<librados::bufferlist, int>> unchanged;
+  for (auto &kv : legacy) {
+    keys.insert(kv.first);
+    unchanged[kv.first] = std::make_pair(kv.second, LIBRADOS_CMPXATTR_OP_EQ);
+  }
+  int cmp_val = 0;
+  librados::ObjectWriteOperation rm_op;
+  rm_op.omap_cmp(unchanged, &cmp_val);
+  rm_op.omap_rm_keys(keys);
+  RadosStatsTimer rm_timer(RADOS_OP_OMAP_RM);
+  int err = rm_timer.done(io_ctx.operate(get_shared_oid(), &rm_op));
+  if (err != -ECANCELED) {
+    return err;
+  }
+
+  // a key was unset or changed after it was read: take back the moved values which are
+  // still unchanged in the shard, the caller moves the current values again.
+  map<string, librados::bufferlist> current;
+  RadosStatsTimer get_timer(RADOS_OP_OMAP_GET);
+  int get_err = get_timer.done(io_ctx.omap_get_vals_by_keys(get_shared_oid(), keys, &current));
+  if (get_err < 0 && get_err != -ENOENT) {
+    return get_err;
+  }
+  for (auto &shard : moved) {
+    for (auto &kv : shard.second) {
+      auto it = current.find(kv.first);
+      if (it != current.end() && it->second.contents_equal(kv.second)) {
+        continue;
+      }
+      map<string, pair<librados::bufferlist, int>> ours;
+      ours[kv.first] = std::make_pair(kv.second, LIBRADOS_CMPXATTR_OP_EQ);
+      set<string> key;
+      key.insert(kv.first);
+      int undo_val = 0;
+      librados::ObjectWriteOperation undo_op;
+      undo_op.omap_cmp(ours, &undo_val);
+      undo_op.omap_rm_keys(key);
+      RadosStatsTimer undo_timer(RADOS_OP_OMAP_RM);
+      int undo_err = undo_timer.done(io_ctx.operate(shard.first, &undo_op));
+      if (undo_err < 0 && undo_err != -ECANCELED && undo_err != -ENOENT) {
+        return undo_err;
+      }
+    }
+  }
+  return -ECANCELED;
+}
+
+int RadosDictionaryImpl::migrate_shared_shards(unsigned int page_size) {
+  if (shared_shard_count <= 1 || page_size == 0) {
+    return -EINVAL;
+  }
+
+  librados::IoCtx &io_ctx = get_shared_io_ctx();
+  string start_after;
+  bool more = true;
+  int attempts = 0;
+
+  while (more) {
+    map<string, librados::bufferlist> page;
+    int r_val = -1;
+    librados::ObjectReadOperation read_op;
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_OMAP_GET_VALS2
+    read_op.omap_get_vals2(start_after, DICT_PATH_SHARED, page_size, &page, &more, &r_val);
+#else
+    read_op.omap_get_vals(start_after, DICT_PATH_SHARED, page_size, &page, &r_val);
+#endif
+    librados::bufferlist bl;
+    RadosStatsTimer read_timer(RADOS_OP_OMAP_GET);
+    int err = read_timer.done(io_ctx.operate(get_shared_oid(), &read_op, &bl));
+    if (err == -ENOENT) {
+      // nothing (left) to migrate
+      legacy_shared_removed = true;
+      return 0;
+    }
+    if (err < 0) {
+      return err;
+    }
+    if (r_val < 0) {
+      return r_val;
+    }
+#ifndef DOVECOT_CEPH_PLUGIN_HAVE_OMAP_GET_VALS2
+    more = page.size() >= page_size;
+#endif
+    if (page.empty()) {
+      break;
+    }
+
+    err = move_legacy_values(page);
+    if (err == -ECANCELED && ++attempts < MOVE_LEGACY_MAX_ATTEMPTS) {
+      // a key of the page was changed concurrently, read the page again
+      more = true;
+      continue;
+    }
+    if (err < 0) {
+      return err;
+    }
+    attempts = 0;
+    start_after = page.rbegin()->first;
+  }
+
+  RadosStatsTimer remove_timer(RADOS_OP_REMOVE);
+  int err = remove_timer.done(io_ctx.remove(get_shared_oid()));
+  if (err < 0 && err != -ENOENT) {
+    return err;
+  }
+  legacy_shared_removed = true;
+  return 0;
+}
+
 void RadosDictionaryImpl::remove_completion(librados::AioCompletion *c) {
   completions_mutex.lock();
   completions.remove(c);
@@ -20,6 +20,7 @@
 #include <rados/librados.hpp>
 #include "rados-cluster.h"
 #include "rados-dictionary.h"
+#include "rados-dictionary-cache.h"
 #include "rados-dovecot-ceph-cfg.h"
 #include "rados-dovecot-ceph-cfg-impl.h"
 #include "rados-namespace-manager.h"
@@ -52,11 +53,36 @@ class RadosDictionaryImpl : public RadosDictionary {
 
   int get(const std::string& key, std::string* value_r) override;
 
+  unsigned int get_shared_shard_count() override { return shared_shard_count; }
+  const std::string get_shared_shard_oid(unsigned int shard) override;
+  bool is_legacy_lookup_required(const std::string& key) override;
+  int get_legacy(const std::string& key, std::string* value_r) override;
+  int migrate_shared_shards(unsigned int page_size) override;
+  int move_legacy_values(const std::map<std::string, librados::bufferlist>& legacy) override;
+
+  /*!
+   * distribute shared keys to shard_count objects, 0 and 1 disable sharding.
+   */
+  void set_shared_shard_count(unsigned int shard_count) { shared_shard_count = shard_count > 0 ? shard_count : 1; }
+
+  bool get_cached(const std::string& key, std::string* value_r, bool* exists_r) override;
+  uint64_t get_cache_generation() override;
+  void add_cached(const std::string& key, const std::string& value, bool exists, uint64_t read_generation) override;
+  void notify_changed(const std::set<std::string>& keys) override;
+
+  /*!
+   * cache lookups for ttl seconds, 0 disables the cache. Needs to be set before the
+   * first access.
+   */
+  void set_cache_ttl(unsigned int ttl);
+
  private:
   bool load_configuration(librados::IoCtx* io_ctx);
 
   bool lookup_namespace(std::string& username_, librmb::RadosDovecotCephCfg* cfg_, std::string* ns);
 
+  static uint32_t shard_hash(const std::string& key);
+
  private:
   RadosCluster* cluster;
   std::string poolname;
@@ -66,6 +92,9 @@ class RadosDictionaryImpl : public RadosDictionary {
   std::string shared_oid;
   librados::IoCtx shared_io_ctx;
   bool shared_io_ctx_created;
+  unsigned int shared_shard_count;
+  // true if the unsharded shared object is known to be migrated
+  bool legacy_shared_removed;
 
   std::string private_oid;
   librados::IoCtx private_io_ctx;
@@ -79,6 +108,8 @@ class RadosDictionaryImpl : public RadosDictionary {
 
   RadosGuidGenerator* guid_generator;
   std::string cfg_object_name;
+
+  RadosDictionaryCache* cache;
 };
 
 }  // namespace librmb
@@ -0,0 +1,97 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-dictionary-memory.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "rados-stats.h"
+
+#define DICT_PATH_PRIVATE "priv/"
+
+namespace librmb {
+
+RadosDictionaryMemory::RadosDictionaryMemory(RadosMemoryBackend *backend_, const std::string &poolname_,
+                                             const std::string &username_, const std::string &oid_)
+    : backend(backend_), poolname(poolname_), username(username_), oid(oid_) {
+  backend->pool_create(poolname);
+}
+
+RadosDictionaryMemory::~RadosDictionaryMemory() {}
+
+const std::string RadosDictionaryMemory::get_namespace(const std::string &key) {
+  if (!key.compare(0, strlen(DICT_PATH_PRIVATE), DICT_PATH_PRIVATE)) {
+    return username;
+  }
+  return "";
+}
+
+int RadosDictionaryMemory::get(const std::string &key, std::string *value_r) {
+  std::set<std::string> keys;
+  keys.insert(key);
+  std::map<std::string, librados::bufferlist> map;
+
+  RadosStatsTimer timer(RADOS_OP_OMAP_GET);
+  int err = backend->inject(RADOS_OP_OMAP_GET);
+  if (err == 0) {
+    err = backend->omap_get(poolname, get_namespace(key), oid, keys, &map);
+  }
+  timer.done(err);
+  if (err < 0) {
+    return err;
+  }
+  auto it = map.find(key);
+  if (it == map.end()) {
+    return -ENOENT;
+  }
+  *value_r = it->second.to_str();
+  return 0;
+}
+
+int RadosDictionaryMemory::set(const std::string &key, const std::string &value) {
+  std::map<std::string, librados::bufferlist> map;
+  map[key].append(value);
+
+  RadosStatsTimer timer(RADOS_OP_OMAP_SET);
+  int err = backend->inject(RADOS_OP_OMAP_SET);
+  if (err == 0) {
+    err = backend->omap_set(poolname, get_namespace(key), oid, map);
+  }
+  return timer.done(err, value.size());
+}
+
+int RadosDictionaryMemory::unset(const std::string &key) {
+  std::set<std::string> keys;
+  keys.insert(key);
+
+  RadosStatsTimer timer(RADOS_OP_OMAP_RM);
+  int err = backend->inject(RADOS_OP_OMAP_RM);
+  if (err == 0) {
+    err = backend->omap_rm(poolname, get_namespace(key), oid, keys);
+  }
+  return timer.done(err);
+}
+
+int RadosDictionaryMemory::atomic_inc(const std::string &key, int64_t diff) {
+  RadosStatsTimer timer(RADOS_OP_EXEC);
+  int err = backend->inject(RADOS_OP_EXEC);
+  if (err == 0) {
+    err = backend->omap_add(poolname, get_namespace(key), oid, key, diff);
+  }
+  return timer.done(err);
+}
+
+}  // namespace librmb
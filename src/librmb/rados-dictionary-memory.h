@@ -0,0 +1,95 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_DICTIONARY_MEMORY_H_
+#define SRC_LIBRMB_RADOS_DICTIONARY_MEMORY_H_
+
+#include <set>
+#include <string>
+
+#include <rados/librados.hpp>
+#include "rados-dictionary.h"
+#include "rados-memory-backend.h"
+
+namespace librmb {
+
+/**
+ * Rados Dictionary Memory
+ *
+ * RadosDictionary on top of a RadosMemoryBackend. Private keys are stored
+ * in the namespace of the user, shared keys in the default namespace.
+ * Sharding, the legacy lookup and the cache are not supported. The io_ctx
+ * getters return an unconnected io_ctx, write access is available with
+ * set, unset and atomic_inc.
+ */
+class RadosDictionaryMemory : public RadosDictionary {
+ public:
+  RadosDictionaryMemory(RadosMemoryBackend *backend_, const std::string &poolname_, const std::string &username_,
+                        const std::string &oid_);
+  virtual ~RadosDictionaryMemory();
+
+  const std::string get_full_oid(const std::string &key) override { return oid; }
+  const std::string get_shared_oid() override { return oid; }
+  const std::string get_private_oid() override { return oid; }
+
+  const std::string &get_oid() override { return oid; }
+  const std::string &get_username() override { return username; }
+  const std::string &get_poolname() override { return poolname; }
+
+  librados::IoCtx &get_io_ctx(const std::string &key) override { return io_ctx; }
+  librados::IoCtx &get_shared_io_ctx() override { return io_ctx; }
+  librados::IoCtx &get_private_io_ctx() override { return io_ctx; }
+
+  void remove_completion(librados::AioCompletion *c) override {}
+  void push_back_completion(librados::AioCompletion *c) override {}
+  void wait_for_completions() override {}
+
+  int get(const std::string &key, std::string *value_r) override;
+
+  unsigned int get_shared_shard_count() override { return 1; }
+  const std::string get_shared_shard_oid(unsigned int shard) override { return oid; }
+  bool is_legacy_lookup_required(const std::string &key) override { return false; }
+  int get_legacy(const std::string &key, std::string *value_r) override { return -ENOENT; }
+  int migrate_shared_shards(unsigned int page_size) override { return 0; }
+  int move_legacy_values(const std::map<std::string, librados::bufferlist>& legacy) override { return 0; }
+
+  bool get_cached(const std::string &key, std::string *value_r, bool *exists_r) override { return false; }
+  uint64_t get_cache_generation() override { return 0; }
+  void add_cached(const std::string &key, const std::string &value, bool exists, uint64_t read_generation) override {}
+  void notify_changed(const std::set<std::string> &keys) override {}
+
+  /*!
+   * @return linux error code or 0 if successful
+   */
+  int set(const std::string &key, const std::string &value);
+  /*!
+   * @return linux error code or 0 if successful
+   */
+  int unset(const std::string &key);
+  /*!
+   * @return linux error code or 0 if successful
+   */
+  int atomic_inc(const std::string &key, int64_t diff);
+
+ private:
+  const std::string get_namespace(const std::string &key);
+
+ private:
+  RadosMemoryBackend *backend;
+  std::string poolname;
+  std::string username;
+  std::string oid;
+  librados::IoCtx io_ctx;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_DICTIONARY_MEMORY_H_
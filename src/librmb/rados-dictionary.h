@@ -12,6 +12,8 @@
 #ifndef SRC_LIBRMB_INTERFACES_RADOS_DICTIONARY_INTERFACE_H_
 #define SRC_LIBRMB_INTERFACES_RADOS_DICTIONARY_INTERFACE_H_
 
+#include <map>
+#include <set>
 #include <string>
 
 #include <rados/librados.hpp>
@@ -44,6 +46,67 @@ class RadosDictionary {
   virtual void wait_for_completions() = 0;
 
   virtual int get(const std::string& key, std::string* value_r) = 0;
+
+  /*!
+   * number of objects the shared keys are distributed to. 1 means unsharded,
+   * all shared keys are stored in get_shared_oid().
+   */
+  virtual unsigned int get_shared_shard_count() = 0;
+  /*!
+   * @param[in] shard shard index < get_shared_shard_count()
+   * @return oid of the shared shard object
+   */
+  virtual const std::string get_shared_shard_oid(unsigned int shard) = 0;
+  /*!
+   * true if the given shared key may still be stored in the unsharded shared object,
+   * because the shared objects have not been migrated, yet.
+   */
+  virtual bool is_legacy_lookup_required(const std::string& key) = 0;
+  /*!
+   * read the given shared key from the unsharded shared object
+   * @return linux error code or 0 if successful
+   */
+  virtual int get_legacy(const std::string& key, std::string* value_r) = 0;
+  /*!
+   * move all keys of the unsharded shared object to the shard objects and remove the
+   * unsharded object. Can be used while the dictionary is in use.
+   * @param[in] page_size max number of keys moved per request
+   * @return linux error code or 0 if successful
+   */
+  virtual int migrate_shared_shards(unsigned int page_size) = 0;
+  /*!
+   * move shared keys from the unsharded shared object to their shards. A key which
+   * already exists in its shard keeps the shard value. The keys are only removed from
+   * the unsharded object if their values are still the given ones.
+   * @param[in] legacy keys and values as read from the unsharded object
+   * @return linux error code or 0 if successful, -ECANCELED if a value changed meanwhile,
+   *         read them again and retry.
+   */
+  virtual int move_legacy_values(const std::map<std::string, librados::bufferlist>& legacy) = 0;
+
+  /*!
+   * lookup key in the dictionary cache.
+   * @param[out] value_r cached value
+   * @param[out] exists_r false if the key is known not to exist.
+   * @return true if the key is cached
+   */
+  virtual bool get_cached(const std::string& key, std::string* value_r, bool* exists_r) = 0;
+  /*!
+   * cache generation, to be taken before a lookup is sent.
+   */
+  virtual uint64_t get_cache_generation() = 0;
+  /*!
+   * add the result of a lookup to the dictionary cache, if the cache is enabled.
+   * @param[in] read_generation get_cache_generation before the lookup was sent, the
+   *            result is dropped if the key has been changed since.
+   */
+  virtual void add_cached(const std::string& key, const std::string& value, bool exists,
+                          uint64_t read_generation) = 0;
+  /*!
+   * remove the keys from the local cache and notify all other processes watching the
+   * dictionary objects of the keys.
+   */
+  virtual void notify_changed(const std::set<std::string>& keys) = 0;
 };
 }  // namespace librmb
 
@@ -34,6 +34,8 @@ class RadosDovecotCephCfgImpl : public RadosDovecotCephCfg {
   const std::string &get_rados_username() override { return dovecot_cfg.get_rados_username(); }
   void update_pool_name_metadata(const char *value) override { dovecot_cfg.update_pool_name_metadata(value); }
   const std::string &get_rados_save_log_file() override { return dovecot_cfg.get_rados_save_log_file(); }
+  const std::string &get_rados_save_log_format() override { return dovecot_cfg.get_rados_save_log_format(); }
+  const std::string &get_rados_save_log_fsync() override { return dovecot_cfg.get_rados_save_log_fsync(); }
   const std::string &get_pool_name_metadata_key() override { return dovecot_cfg.get_pool_name_metadata_key(); }
  
   int get_write_method() override { return std::stoi(dovecot_cfg.get_write_method());}
@@ -50,6 +52,11 @@ class RadosDovecotCephCfgImpl : public RadosDovecotCephCfg {
   bool is_ceph_posix_bugfix_enabled() override { return dovecot_cfg.is_ceph_posix_bugfix_enabled(); }
   bool is_ceph_aio_wait_for_safe_and_cb() override { return dovecot_cfg.is_ceph_aio_wait_for_safe_and_cb(); }
   bool is_write_chunks() override { return dovecot_cfg.is_write_chunks(); }
+  bool is_user_mapping_prefetch() override { return dovecot_cfg.is_user_mapping_prefetch(); }
+  bool is_trace_enabled() override { return dovecot_cfg.is_trace_enabled(); }
+  int get_trace_threshold() override { return std::stoi(dovecot_cfg.get_trace_threshold()); }
+  const std::string &get_trace_file() override { return dovecot_cfg.get_trace_file(); }
+  int get_copy_aio_window() override { return std::stoi(dovecot_cfg.get_copy_aio_window()); }
   
   // rados config
   bool is_user_mapping() override { return rados_cfg.is_user_mapping(); }
@@ -95,6 +102,7 @@ class RadosDovecotCephCfgImpl : public RadosDovecotCephCfg {
 
   bool is_config_valid() override { return dovecot_cfg.is_config_valid() && rados_cfg.is_config_valid(); }
   const std::string &get_public_namespace() override { return rados_cfg.get_public_namespace(); }
+  unsigned int get_namespace_cache_ttl() override { return rados_cfg.get_namespace_cache_ttl(); }
   void update_mail_attributes(const std::string &mail_attributes) {
     rados_cfg.update_mail_attribute(mail_attributes.c_str());
   }
@@ -108,6 +116,9 @@ class RadosDovecotCephCfgImpl : public RadosDovecotCephCfg {
     return rados_cfg.read_object(oid, buffer);
   }
   void set_io_ctx_namespace(const std::string &namespace_) override { rados_cfg.set_io_ctx_namespace(namespace_); }
+  void set_io_ctx_pool(RadosCluster *cluster, const std::string &pool) override {
+    rados_cfg.set_io_ctx_pool(cluster, pool);
+  }
 
   RadosConfig *get_dovecot_cfg() { return &dovecot_cfg; }
   RadosCephConfig *get_rados_ceph_cfg() { return &rados_cfg; }
@@ -15,6 +15,7 @@
 #include <string>
 #include <map>
 #include "rados-storage.h"
+#include "rados-cluster.h"
 namespace librmb {
 
 /**
@@ -32,6 +33,8 @@ class RadosDovecotCephCfg {
   virtual const std::string &get_rados_cluster_name() = 0;
   virtual const std::string &get_rados_username() = 0;
   virtual const std::string &get_rados_save_log_file() = 0;
+  virtual const std::string &get_rados_save_log_format() = 0;
+  virtual const std::string &get_rados_save_log_fsync() = 0;
   virtual bool is_mail_attribute(enum rbox_metadata_key key) = 0;
   virtual bool is_updateable_attribute(enum rbox_metadata_key key) = 0;
   virtual void set_update_attributes(const std::string &update_attributes_) = 0;
@@ -41,6 +44,12 @@ class RadosDovecotCephCfg {
   virtual bool is_ceph_posix_bugfix_enabled() = 0;
   virtual bool is_ceph_aio_wait_for_safe_and_cb() = 0;
   virtual bool is_write_chunks() = 0;
+  virtual bool is_user_mapping_prefetch() = 0;
+  virtual bool is_trace_enabled() = 0;
+  // msecs
+  virtual int get_trace_threshold() = 0;
+  virtual const std::string &get_trace_file() = 0;
+  virtual int get_copy_aio_window() = 0;
   virtual int get_chunk_size() = 0;
   virtual int get_write_method() = 0;
 
@@ -79,6 +88,10 @@ class RadosDovecotCephCfg {
   virtual void set_user_suffix(const std::string &ns_suffix) = 0;
   virtual std::string &get_user_suffix() = 0;
   virtual const std::string &get_public_namespace() = 0;
+  /*!
+   * @return seconds a user namespace mapping is cached
+   */
+  virtual unsigned int get_namespace_cache_ttl() = 0;
 
   /*!
    * Save configuration to objectt
@@ -98,6 +111,11 @@ class RadosDovecotCephCfg {
    * set rados configuration namespace
    */
   virtual void set_io_ctx_namespace(const std::string &namespace_) = 0;
+  /*!
+   * use the shared io contexts of cluster for pool instead of switching the
+   * namespace of the configured io_ctx.
+   */
+  virtual void set_io_ctx_pool(RadosCluster *cluster, const std::string &pool) = 0;
 
   virtual bool is_rbox_check_empty_mailboxes() = 0;
 };
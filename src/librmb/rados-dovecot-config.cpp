@@ -26,13 +26,20 @@ RadosConfig::RadosConfig()
       prefix_keyword("k"),
       bugfix_cephfs_posix_hardlinks("rbox_bugfix_cephfs_21652"),
       save_log("rados_save_log"),
+      save_log_format("rados_save_log_format"),
+      save_log_fsync("rados_save_log_fsync"),
       rbox_check_empty_mailboxes("rados_check_empty_mailboxes"),
       rbox_ceph_aio_wait_for_safe_and_cb("rbox_ceph_aio_wait_for_safe_and_cb"),
       rbox_ceph_write_chunks("rbox_ceph_write_chunks"),
       rbox_chunk_size("rbox_chunk_size"),
       rbox_write_method("rbox_write_method"),
       rbox_object_search_method("rbox_object_search_method"),
-      rbox_object_search_threads("rbox_object_search_threads") {
+      rbox_object_search_threads("rbox_object_search_threads"),
+      rbox_user_mapping_prefetch("rbox_user_mapping_prefetch"),
+      rbox_trace("rbox_trace"),
+      rbox_trace_threshold("rbox_trace_threshold"),
+      rbox_trace_file("rbox_trace_file"),
+      rbox_copy_aio_window("rbox_copy_aio_window") {
         
   config[pool_name] = "mail_storage";
   config[index_pool_name] = "object_recovery";
@@ -41,6 +48,10 @@ RadosConfig::RadosConfig()
   config[rados_username] = "client.admin";
   config[bugfix_cephfs_posix_hardlinks] = "false";
   config[save_log] = "";
+  // csv or binary
+  config[save_log_format] = "csv";
+  // none, batch or msecs between two fsyncs
+  config[save_log_fsync] = "none";
   config[rbox_check_empty_mailboxes] = "false";
   config[rbox_ceph_aio_wait_for_safe_and_cb] = "false";
   config[rbox_ceph_write_chunks] = "false";
@@ -48,6 +59,13 @@ RadosConfig::RadosConfig()
   config[rbox_write_method] = "0";
   config[rbox_object_search_method] = "0";
   config[rbox_object_search_threads] = "4";
+  config[rbox_user_mapping_prefetch] = "false";
+  config[rbox_trace] = "false";
+  // msecs, 0 = no automatic dumps
+  config[rbox_trace_threshold] = "0";
+  config[rbox_trace_file] = "";
+  // max. copies in flight per transaction
+  config[rbox_copy_aio_window] = "64";
   
   is_valid = false;
 }
@@ -83,6 +101,8 @@ std::string RadosConfig::to_string() {
   ss << "  " << rados_username << "=" << config[rados_username] << std::endl;
   ss << "  " << bugfix_cephfs_posix_hardlinks << "=" << config[bugfix_cephfs_posix_hardlinks] << std::endl;
   ss << "  " << save_log << "=" << config[save_log] << std::endl;
+  ss << "  " << save_log_format << "=" << config[save_log_format] << std::endl;
+  ss << "  " << save_log_fsync << "=" << config[save_log_fsync] << std::endl;
   ss << "  " << rbox_check_empty_mailboxes << "=" << config[rbox_check_empty_mailboxes] << std::endl;
   ss << "  " << rbox_ceph_aio_wait_for_safe_and_cb << "=" << config[rbox_ceph_aio_wait_for_safe_and_cb] << std::endl;
   ss << "  " << rbox_ceph_write_chunks << "=" << config[rbox_ceph_write_chunks] << std::endl;
@@ -90,6 +110,11 @@ std::string RadosConfig::to_string() {
   ss << "  " << rbox_chunk_size << "=" << config[rbox_chunk_size] << std::endl;
   ss << "  " << rbox_object_search_method << "=" << config[rbox_object_search_method] << std::endl;
   ss << "  " << rbox_object_search_threads << "=" << config[rbox_object_search_threads] << std::endl;
+  ss << "  " << rbox_user_mapping_prefetch << "=" << config[rbox_user_mapping_prefetch] << std::endl;
+  ss << "  " << rbox_trace << "=" << config[rbox_trace] << std::endl;
+  ss << "  " << rbox_trace_threshold << "=" << config[rbox_trace_threshold] << std::endl;
+  ss << "  " << rbox_trace_file << "=" << config[rbox_trace_file] << std::endl;
+  ss << "  " << rbox_copy_aio_window << "=" << config[rbox_copy_aio_window] << std::endl;
   
   return ss.str();
 }
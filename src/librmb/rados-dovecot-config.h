@@ -39,6 +39,8 @@ class RadosConfig {
   std::string &get_index_pool_name() { return config[index_pool_name]; };
 
   const std::string &get_rados_save_log_file() { return config[save_log]; }
+  const std::string &get_rados_save_log_format() { return config[save_log_format]; }
+  const std::string &get_rados_save_log_fsync() { return config[save_log_fsync]; }
   bool is_config_valid() { return is_valid; }
   void set_config_valid(bool is_valid_) { this->is_valid = is_valid_; }
 
@@ -69,6 +71,13 @@ class RadosConfig {
   bool is_write_chunks() {
     return config[rbox_ceph_write_chunks].compare("true") == 0 ? true : false;
   }
+  bool is_user_mapping_prefetch() {
+    return config[rbox_user_mapping_prefetch].compare("true") == 0 ? true : false;
+  }
+  bool is_trace_enabled() { return config[rbox_trace].compare("true") == 0 ? true : false; }
+  const std::string &get_trace_threshold() { return config[rbox_trace_threshold]; }
+  const std::string &get_trace_file() { return config[rbox_trace_file]; }
+  const std::string &get_copy_aio_window() { return config[rbox_copy_aio_window]; }
 
   /*!
    * print configuration
@@ -88,6 +97,8 @@ class RadosConfig {
   std::string prefix_keyword;
   std::string bugfix_cephfs_posix_hardlinks;
   std::string save_log;
+  std::string save_log_format;
+  std::string save_log_fsync;
   std::string rbox_check_empty_mailboxes;
   std::string rbox_ceph_aio_wait_for_safe_and_cb;
   std::string rbox_ceph_write_chunks;
@@ -95,6 +106,11 @@ class RadosConfig {
   std::string rbox_write_method;
   std::string rbox_object_search_method;
   std::string rbox_object_search_threads;
+  std::string rbox_user_mapping_prefetch;
+  std::string rbox_trace;
+  std::string rbox_trace_threshold;
+  std::string rbox_trace_file;
+  std::string rbox_copy_aio_window;
   bool is_valid;
 };
 
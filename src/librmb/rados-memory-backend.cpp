@@ -0,0 +1,434 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-memory-backend.h"
+
+#include <errno.h>
+
+#include <chrono>  // NOLINT
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <utility>
+
+namespace librmb {
+
+void RadosMemoryCompletion::complete(int ret_) {
+  std::lock_guard<std::mutex> lock(completion_mutex);
+  ret = ret_;
+  completed = true;
+  cond.notify_all();
+}
+
+int RadosMemoryCompletion::wait_for_complete() {
+  std::unique_lock<std::mutex> lock(completion_mutex);
+  while (!completed) {
+    cond.wait(lock);
+  }
+  return 0;
+}
+
+bool RadosMemoryCompletion::is_complete() {
+  std::lock_guard<std::mutex> lock(completion_mutex);
+  return completed;
+}
+
+int RadosMemoryCompletion::get_return_value() {
+  std::lock_guard<std::mutex> lock(completion_mutex);
+  return ret;
+}
+
+RadosMemoryBackend::RadosMemoryBackend(unsigned int aio_threads_) : aio_stop(false) {
+  for (unsigned int i = 0; i < aio_threads_; i++) {
+    aio_threads.push_back(std::thread(&RadosMemoryBackend::aio_worker, this));
+  }
+}
+
+RadosMemoryBackend::~RadosMemoryBackend() {
+  {
+    std::lock_guard<std::mutex> lock(aio_mutex);
+    aio_stop = true;
+    aio_cond.notify_all();
+  }
+  for (auto &t : aio_threads) {
+    t.join();
+  }
+}
+
+int RadosMemoryBackend::pool_create(const std::string &pool) {
+  std::lock_guard<std::mutex> lock(store_mutex);
+  if (pools.find(pool) != pools.end()) {
+    return -EEXIST;
+  }
+  pools[pool];
+  return 0;
+}
+
+bool RadosMemoryBackend::pool_exists(const std::string &pool) {
+  std::lock_guard<std::mutex> lock(store_mutex);
+  return pools.find(pool) != pools.end();
+}
+
+RadosMemoryObject *RadosMemoryBackend::find(const std::string &pool, const std::string &ns, const std::string &oid) {
+  auto p = pools.find(pool);
+  if (p == pools.end()) {
+    return nullptr;
+  }
+  auto n = p->second.find(ns);
+  if (n == p->second.end()) {
+    return nullptr;
+  }
+  auto o = n->second.find(oid);
+  return o == n->second.end() ? nullptr : &o->second;
+}
+
+RadosMemoryObject *RadosMemoryBackend::find_or_create(const std::string &pool, const std::string &ns,
+                                                      const std::string &oid, int *err) {
+  auto p = pools.find(pool);
+  if (p == pools.end()) {
+    *err = -ENOENT;
+    return nullptr;
+  }
+  *err = 0;
+  RadosMemoryObject &object = p->second[ns][oid];
+  object.mtime = time(NULL);
+  object.version++;
+  return &object;
+}
+
+int RadosMemoryBackend::write_full(const std::string &pool, const std::string &ns, const std::string &oid,
+                                   const librados::bufferlist &bl) {
+  std::lock_guard<std::mutex> lock(store_mutex);
+  int err = 0;
+  RadosMemoryObject *object = find_or_create(pool, ns, oid, &err);
+  if (object == nullptr) {
+    return err;
+  }
+  object->data = bl;
+  return 0;
+}
+
+int RadosMemoryBackend::append(const std::string &pool, const std::string &ns, const std::string &oid,
+                               const librados::bufferlist &bl) {
+  std::lock_guard<std::mutex> lock(store_mutex);
+  int err = 0;
+  RadosMemoryObject *object = find_or_create(pool, ns, oid, &err);
+  if (object == nullptr) {
+    return err;
+  }
+  object->data.append(bl);
+  return 0;
+}
+
+int RadosMemoryBackend::write_object(const std::string &pool, const std::string &ns, const std::string &oid,
+                                     const RadosMemoryObject &object) {
+  std::lock_guard<std::mutex> lock(store_mutex);
+  int err = 0;
+  RadosMemoryObject *dest = find_or_create(pool, ns, oid, &err);
+  if (dest == nullptr) {
+    return err;
+  }
+  uint64_t version = dest->version;
+  *dest = object;
+  dest->version = version;
+  if (dest->mtime == 0) {
+    dest->mtime = time(NULL);
+  }
+  return 0;
+}
+
+int RadosMemoryBackend::operate(const std::string &pool, const std::string &ns, const std::string &oid,
+                                const RadosMemoryWrite &write) {
+  std::lock_guard<std::mutex> lock(store_mutex);
+  int err = 0;
+  RadosMemoryObject *object = find_or_create(pool, ns, oid, &err);
+  if (object == nullptr) {
+    return err;
+  }
+  for (auto &x : write.xattrs) {
+    object->xattrs[x.first] = x.second;
+  }
+  for (auto &kv : write.omap) {
+    object->omap[kv.first] = kv.second;
+  }
+  for (auto &w : write.writes) {
+    uint64_t length = object->data.length();
+    librados::bufferlist data;
+    if (w.first > length) {
+      data = object->data;
+      data.append_zero(w.first - length);
+    } else {
+      data.substr_of(object->data, 0, w.first);
+    }
+    data.append(w.second);
+    uint64_t end = w.first + w.second.length();
+    if (end < length) {
+      librados::bufferlist tail;
+      tail.substr_of(object->data, end, length - end);
+      data.append(tail);
+    }
+    object->data = data;
+  }
+  if (write.mtime != 0) {
+    object->mtime = write.mtime;
+  }
+  return 0;
+}
+
+int RadosMemoryBackend::read(const std::string &pool, const std::string &ns, const std::string &oid,
+                             librados::bufferlist *bl) {
+  std::lock_guard<std::mutex> lock(store_mutex);
+  RadosMemoryObject *object = find(pool, ns, oid);
+  if (object == nullptr) {
+    return -ENOENT;
+  }
+  // shares the buffers, like a zero copy read
+  *bl = object->data;
+  return object->data.length();
+}
+
+int RadosMemoryBackend::stat(const std::string &pool, const std::string &ns, const std::string &oid, uint64_t *psize,
+                             time_t *pmtime) {
+  std::lock_guard<std::mutex> lock(store_mutex);
+  RadosMemoryObject *object = find(pool, ns, oid);
+  if (object == nullptr) {
+    return -ENOENT;
+  }
+  if (psize != nullptr) {
+    *psize = object->data.length();
+  }
+  if (pmtime != nullptr) {
+    *pmtime = object->mtime;
+  }
+  return 0;
+}
+
+int RadosMemoryBackend::remove(const std::string &pool, const std::string &ns, const std::string &oid) {
+  std::lock_guard<std::mutex> lock(store_mutex);
+  auto p = pools.find(pool);
+  if (p == pools.end()) {
+    return -ENOENT;
+  }
+  auto n = p->second.find(ns);
+  if (n == p->second.end() || n->second.erase(oid) == 0) {
+    return -ENOENT;
+  }
+  if (n->second.empty()) {
+    p->second.erase(n);
+  }
+  return 0;
+}
+
+int RadosMemoryBackend::copy(const std::string &pool, const std::string &src_ns, const std::string &src_oid,
+                             const std::string &dest_ns, const std::string &dest_oid) {
+  std::lock_guard<std::mutex> lock(store_mutex);
+  RadosMemoryObject *src = find(pool, src_ns, src_oid);
+  if (src == nullptr) {
+    return -ENOENT;
+  }
+  RadosMemoryObject copy = *src;
+  int err = 0;
+  RadosMemoryObject *dest = find_or_create(pool, dest_ns, dest_oid, &err);
+  if (dest == nullptr) {
+    return err;
+  }
+  dest->data = copy.data;
+  dest->xattrs = copy.xattrs;
+  dest->omap = copy.omap;
+  return 0;
+}
+
+int RadosMemoryBackend::getxattrs(const std::string &pool, const std::string &ns, const std::string &oid,
+                                  std::map<std::string, librados::bufferlist> *xattrs) {
+  std::lock_guard<std::mutex> lock(store_mutex);
+  RadosMemoryObject *object = find(pool, ns, oid);
+  if (object == nullptr) {
+    return -ENOENT;
+  }
+  *xattrs = object->xattrs;
+  return 0;
+}
+
+int RadosMemoryBackend::setxattrs(const std::string &pool, const std::string &ns, const std::string &oid,
+                                  const std::map<std::string, librados::bufferlist> &xattrs) {
+  std::lock_guard<std::mutex> lock(store_mutex);
+  int err = 0;
+  RadosMemoryObject *object = find_or_create(pool, ns, oid, &err);
+  if (object == nullptr) {
+    return err;
+  }
+  for (auto &x : xattrs) {
+    object->xattrs[x.first] = x.second;
+  }
+  return 0;
+}
+
+int RadosMemoryBackend::omap_get(const std::string &pool, const std::string &ns, const std::string &oid,
+                                 const std::set<std::string> &keys,
+                                 std::map<std::string, librados::bufferlist> *omap) {
+  std::lock_guard<std::mutex> lock(store_mutex);
+  RadosMemoryObject *object = find(pool, ns, oid);
+  if (object == nullptr) {
+    return -ENOENT;
+  }
+  if (keys.empty()) {
+    *omap = object->omap;
+    return 0;
+  }
+  for (auto &key : keys) {
+    auto it = object->omap.find(key);
+    if (it != object->omap.end()) {
+      (*omap)[key] = it->second;
+    }
+  }
+  return 0;
+}
+
+int RadosMemoryBackend::omap_set(const std::string &pool, const std::string &ns, const std::string &oid,
+                                 const std::map<std::string, librados::bufferlist> &omap) {
+  std::lock_guard<std::mutex> lock(store_mutex);
+  int err = 0;
+  RadosMemoryObject *object = find_or_create(pool, ns, oid, &err);
+  if (object == nullptr) {
+    return err;
+  }
+  for (auto &kv : omap) {
+    object->omap[kv.first] = kv.second;
+  }
+  return 0;
+}
+
+int RadosMemoryBackend::omap_rm(const std::string &pool, const std::string &ns, const std::string &oid,
+                                const std::set<std::string> &keys) {
+  std::lock_guard<std::mutex> lock(store_mutex);
+  RadosMemoryObject *object = find(pool, ns, oid);
+  if (object == nullptr) {
+    return -ENOENT;
+  }
+  for (auto &key : keys) {
+    object->omap.erase(key);
+  }
+  object->version++;
+  return 0;
+}
+
+int RadosMemoryBackend::omap_add(const std::string &pool, const std::string &ns, const std::string &oid,
+                                 const std::string &key, int64_t value) {
+  std::lock_guard<std::mutex> lock(store_mutex);
+  int err = 0;
+  RadosMemoryObject *object = find_or_create(pool, ns, oid, &err);
+  if (object == nullptr) {
+    return err;
+  }
+  int64_t current = 0;
+  auto it = object->omap.find(key);
+  if (it != object->omap.end()) {
+    current = strtoll(it->second.to_str().c_str(), nullptr, 10);
+  }
+  librados::bufferlist bl;
+  bl.append(std::to_string(current + value));
+  object->omap[key] = bl;
+  return 0;
+}
+
+int RadosMemoryBackend::list(const std::string &pool, const std::string &ns, std::set<std::string> *oids) {
+  std::lock_guard<std::mutex> lock(store_mutex);
+  auto p = pools.find(pool);
+  if (p == pools.end()) {
+    return -ENOENT;
+  }
+  auto n = p->second.find(ns);
+  if (n == p->second.end()) {
+    return 0;
+  }
+  for (auto &o : n->second) {
+    oids->insert(o.first);
+  }
+  return 0;
+}
+
+size_t RadosMemoryBackend::object_count(const std::string &pool) {
+  std::lock_guard<std::mutex> lock(store_mutex);
+  size_t count = 0;
+  auto p = pools.find(pool);
+  if (p != pools.end()) {
+    for (auto &n : p->second) {
+      count += n.second.size();
+    }
+  }
+  return count;
+}
+
+void RadosMemoryBackend::set_fault(rbox_rados_op op, const RadosMemoryFault &fault) {
+  std::lock_guard<std::mutex> lock(fault_mutex);
+  faults[op] = fault;
+}
+
+void RadosMemoryBackend::clear_faults() {
+  std::lock_guard<std::mutex> lock(fault_mutex);
+  for (int i = 0; i < RADOS_OP_COUNT; i++) {
+    faults[i] = RadosMemoryFault();
+  }
+}
+
+int RadosMemoryBackend::inject(rbox_rados_op op) {
+  RadosMemoryFault fault;
+  {
+    std::lock_guard<std::mutex> lock(fault_mutex);
+    fault = faults[op];
+  }
+  if (fault.latency_usecs == 0 && fault.jitter_usecs == 0 && fault.error_rate <= 0) {
+    return 0;
+  }
+  static thread_local std::minstd_rand rand(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  uint64_t usecs = fault.latency_usecs;
+  if (fault.jitter_usecs > 0) {
+    usecs += std::uniform_int_distribution<uint32_t>(0, fault.jitter_usecs)(rand);
+  }
+  if (usecs > 0) {
+    std::this_thread::sleep_for(std::chrono::microseconds(usecs));
+  }
+  if (fault.error_rate > 0 && std::uniform_real_distribution<double>(0, 1)(rand) < fault.error_rate) {
+    return fault.error_code;
+  }
+  return 0;
+}
+
+void RadosMemoryBackend::aio_submit(std::function<int()> op, RadosMemoryCompletion *completion) {
+  if (aio_threads.empty()) {
+    completion->complete(op());
+    return;
+  }
+  std::lock_guard<std::mutex> lock(aio_mutex);
+  aio_queue.push_back([op, completion]() { completion->complete(op()); });
+  aio_cond.notify_one();
+}
+
+void RadosMemoryBackend::aio_worker() {
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(aio_mutex);
+      while (!aio_stop && aio_queue.empty()) {
+        aio_cond.wait(lock);
+      }
+      if (aio_queue.empty()) {
+        // stopped, queue drained
+        return;
+      }
+      task = aio_queue.front();
+      aio_queue.pop_front();
+    }
+    task();
+  }
+}
+
+}  // namespace librmb
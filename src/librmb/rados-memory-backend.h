@@ -0,0 +1,190 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_MEMORY_BACKEND_H_
+#define SRC_LIBRMB_RADOS_MEMORY_BACKEND_H_
+
+#include <errno.h>
+#include <time.h>
+
+#include <condition_variable>  // NOLINT
+#include <functional>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+#include <mutex>  // NOLINT
+
+#include <rados/librados.hpp>
+#include "rados-stats.h"
+
+namespace librmb {
+
+struct RadosMemoryObject {
+  RadosMemoryObject() : mtime(0), version(0) {}
+
+  librados::bufferlist data;
+  std::map<std::string, librados::bufferlist> xattrs;
+  std::map<std::string, librados::bufferlist> omap;
+  time_t mtime;
+  uint64_t version;
+};
+
+/**
+ * compound write, the recorded content of a librados write operation.
+ */
+struct RadosMemoryWrite {
+  RadosMemoryWrite() : mtime(0) {}
+
+  std::map<std::string, librados::bufferlist> xattrs;
+  std::map<std::string, librados::bufferlist> omap;
+  // offset and data
+  std::list<std::pair<uint64_t, librados::bufferlist>> writes;
+  // 0: now
+  time_t mtime;
+};
+
+/**
+ * injected behaviour of one operation type.
+ */
+struct RadosMemoryFault {
+  RadosMemoryFault() : latency_usecs(0), jitter_usecs(0), error_rate(0), error_code(-EIO) {}
+
+  uint32_t latency_usecs;
+  // uniformly distributed additional latency
+  uint32_t jitter_usecs;
+  // 0.0 - 1.0
+  double error_rate;
+  int error_code;
+};
+
+/**
+ * Completion of an operation submitted with RadosMemoryBackend::aio_submit.
+ */
+class RadosMemoryCompletion {
+ public:
+  RadosMemoryCompletion() : completed(false), ret(0) {}
+
+  void complete(int ret_);
+  int wait_for_complete();
+  bool is_complete();
+  int get_return_value();
+
+ private:
+  std::mutex completion_mutex;
+  std::condition_variable cond;
+  bool completed;
+  int ret;
+};
+
+/**
+ * Rados Memory Backend
+ *
+ * Object store in memory: pools, namespaces, objects with data,
+ * xattrs and omap. Operations can be delayed or failed by injected
+ * faults, asynchronous operations run on a thread pool.
+ *
+ * All functions return linux error codes like librados.
+ */
+class RadosMemoryBackend {
+ public:
+  explicit RadosMemoryBackend(unsigned int aio_threads = 4);
+  virtual ~RadosMemoryBackend();
+
+  int pool_create(const std::string &pool);
+  bool pool_exists(const std::string &pool);
+
+  int write_full(const std::string &pool, const std::string &ns, const std::string &oid,
+                 const librados::bufferlist &bl);
+  int append(const std::string &pool, const std::string &ns, const std::string &oid, const librados::bufferlist &bl);
+  /*!
+   * creates or replaces the object including its xattrs and omap.
+   */
+  int write_object(const std::string &pool, const std::string &ns, const std::string &oid,
+                   const RadosMemoryObject &object);
+  /*!
+   * applies write atomically, creates the object if needed.
+   */
+  int operate(const std::string &pool, const std::string &ns, const std::string &oid, const RadosMemoryWrite &write);
+  int read(const std::string &pool, const std::string &ns, const std::string &oid, librados::bufferlist *bl);
+  int stat(const std::string &pool, const std::string &ns, const std::string &oid, uint64_t *psize, time_t *pmtime);
+  int remove(const std::string &pool, const std::string &ns, const std::string &oid);
+  /*!
+   * copies data, xattrs and omap, the destination mtime is set to now.
+   */
+  int copy(const std::string &pool, const std::string &src_ns, const std::string &src_oid, const std::string &dest_ns,
+           const std::string &dest_oid);
+
+  int getxattrs(const std::string &pool, const std::string &ns, const std::string &oid,
+                std::map<std::string, librados::bufferlist> *xattrs);
+  int setxattrs(const std::string &pool, const std::string &ns, const std::string &oid,
+                const std::map<std::string, librados::bufferlist> &xattrs);
+
+  /*!
+   * @param[in] keys keys to read, empty reads all keys
+   */
+  int omap_get(const std::string &pool, const std::string &ns, const std::string &oid,
+               const std::set<std::string> &keys, std::map<std::string, librados::bufferlist> *omap);
+  int omap_set(const std::string &pool, const std::string &ns, const std::string &oid,
+               const std::map<std::string, librados::bufferlist> &omap);
+  int omap_rm(const std::string &pool, const std::string &ns, const std::string &oid,
+              const std::set<std::string> &keys);
+  /*!
+   * adds value to the numeric omap value of key, like the numops add class method.
+   */
+  int omap_add(const std::string &pool, const std::string &ns, const std::string &oid, const std::string &key,
+               int64_t value);
+
+  int list(const std::string &pool, const std::string &ns, std::set<std::string> *oids);
+  size_t object_count(const std::string &pool);
+
+  void set_fault(rbox_rados_op op, const RadosMemoryFault &fault);
+  void clear_faults();
+  /*!
+   * waits the injected latency of op.
+   * @return injected error or 0
+   */
+  int inject(rbox_rados_op op);
+
+  /*!
+   * runs op on the thread pool and completes completion with its return value.
+   */
+  void aio_submit(std::function<int()> op, RadosMemoryCompletion *completion);
+
+ private:
+  typedef std::map<std::string, RadosMemoryObject> Namespace;
+  typedef std::map<std::string, Namespace> Pool;
+
+  RadosMemoryObject *find(const std::string &pool, const std::string &ns, const std::string &oid);
+  RadosMemoryObject *find_or_create(const std::string &pool, const std::string &ns, const std::string &oid,
+                                    int *err);
+  void aio_worker();
+
+ private:
+  std::map<std::string, Pool> pools;
+  std::mutex store_mutex;
+
+  RadosMemoryFault faults[RADOS_OP_COUNT];
+  std::mutex fault_mutex;
+
+  std::vector<std::thread> aio_threads;
+  std::list<std::function<void()>> aio_queue;
+  std::mutex aio_mutex;
+  std::condition_variable aio_cond;
+  bool aio_stop;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_MEMORY_BACKEND_H_
@@ -11,6 +11,7 @@
 
 #include "rados-metadata-storage-default.h"
 #include "rados-util.h"
+#include "rados-stats.h"
 #include <utility>
 namespace librmb {
 
@@ -28,7 +29,8 @@ int RadosMetadataStorageDefault::load_metadata(RadosMail *mail) {
   if (mail->get_metadata()->size() > 0) {
     mail->get_metadata()->clear();
   }
-  ret = io_ctx->getxattrs(*mail->get_oid(), *mail->get_metadata());
+  RadosStatsTimer timer(RADOS_OP_GETXATTRS, *mail->get_oid());
+  ret = timer.done(io_ctx->getxattrs(*mail->get_oid(), *mail->get_metadata()));
 
   if (ret >= 0) {
     ret = RadosUtils::get_all_keys_and_values(io_ctx, *mail->get_oid(), mail->get_extended_metadata());
@@ -36,9 +38,21 @@ int RadosMetadataStorageDefault::load_metadata(RadosMail *mail) {
 
   return ret;
 }
+int RadosMetadataStorageDefault::load_metadata(RadosMail *mail, std::map<std::string, ceph::bufferlist> *xattrs,
+                                               std::map<std::string, ceph::bufferlist> *omap) {
+  if (mail == nullptr || xattrs == nullptr) {
+    return -1;
+  }
+  *mail->get_metadata() = *xattrs;
+  if (omap != nullptr) {
+    *mail->get_extended_metadata() = *omap;
+  }
+  return 0;
+}
 int RadosMetadataStorageDefault::set_metadata(RadosMail *mail, RadosMetadata &xattr) {
   mail->add_metadata(xattr);
-  return io_ctx->setxattr(*mail->get_oid(), xattr.key.c_str(), xattr.bl);
+  RadosStatsTimer timer(RADOS_OP_WRITE, *mail->get_oid());
+  return timer.done(io_ctx->setxattr(*mail->get_oid(), xattr.key.c_str(), xattr.bl), xattr.bl.length());
 }
 
 int RadosMetadataStorageDefault::set_metadata(RadosMail *mail, RadosMetadata &xattr,
@@ -48,7 +62,12 @@ int RadosMetadataStorageDefault::set_metadata(RadosMail *mail, RadosMetadata &xa
     mail->set_completion(librados::Rados::aio_create_completion());
     mail->set_active_op(1);
   }
-  return io_ctx->aio_operate(*mail->get_oid(), mail->get_completion(), write_op);
+  RadosStatsAioTimer *timer = RadosStatsAioTimer::start(RADOS_OP_WRITE, *mail->get_oid(), mail->get_completion());
+  int ret = io_ctx->aio_operate(*mail->get_oid(), mail->get_completion(), write_op);
+  if (ret < 0) {
+    timer->cancel(ret);
+  }
+  return ret;
 }
 
 void RadosMetadataStorageDefault::save_metadata(librados::ObjectWriteOperation *write_op, RadosMail *mail) {
@@ -70,8 +89,13 @@ bool RadosMetadataStorageDefault::update_metadata(const std::string &oid, std::l
     write_op.setxattr((*it).key.c_str(), (*it).bl);
   }
 
+  RadosStatsTimer timer(RADOS_OP_WRITE, oid);
   int ret = io_ctx->aio_operate(oid, completion, &write_op);
-  completion->wait_for_complete();
+  if (ret == 0) {
+    completion->wait_for_complete();
+    ret = completion->get_return_value();
+  }
+  timer.done(ret);
   completion->release();
   return ret == 0;
 }
@@ -80,18 +104,21 @@ int RadosMetadataStorageDefault::update_keyword_metadata(const std::string &oid,
   if (metadata != nullptr) {
     std::map<std::string, librados::bufferlist> map;
     map.insert(std::pair<string, librados::bufferlist>(metadata->key, metadata->bl));
-    ret = io_ctx->omap_set(oid, map);
+    RadosStatsTimer timer(RADOS_OP_OMAP_SET, oid);
+    ret = timer.done(io_ctx->omap_set(oid, map), metadata->bl.length());
   }
   return ret;
 }
 int RadosMetadataStorageDefault::remove_keyword_metadata(const std::string &oid, std::string &key) {
   std::set<std::string> keys;
   keys.insert(key);
-  return io_ctx->omap_rm_keys(oid, keys);
+  RadosStatsTimer timer(RADOS_OP_OMAP_RM, oid);
+  return timer.done(io_ctx->omap_rm_keys(oid, keys));
 }
 int RadosMetadataStorageDefault::load_keyword_metadata(const std::string &oid, std::set<std::string> &keys,
                                                        std::map<std::string, ceph::bufferlist> *metadata) {
-  return io_ctx->omap_get_vals_by_keys(oid, keys, metadata);
+  RadosStatsTimer timer(RADOS_OP_OMAP_GET, oid);
+  return timer.done(io_ctx->omap_get_vals_by_keys(oid, keys, metadata));
 }
 
 } /* namespace librmb */
@@ -11,6 +11,7 @@
 
 #include "rados-metadata-storage-ima.h"
 #include "rados-util.h"
+#include "rados-stats.h"
 #include <string.h>
 #include <utility>
 #include <unistd.h>
@@ -70,7 +71,11 @@ int RadosMetadataStorageIma::load_metadata(RadosMail *mail) {
   int max_retry = 10;
   int ret = -1;
   for(int i=0;i<max_retry;i++){
-    ret = io_ctx->getxattrs(*mail->get_oid(), attr);
+    if (i > 0) {
+      RadosStats::record_retry(RADOS_OP_GETXATTRS);
+    }
+    RadosStatsTimer timer(RADOS_OP_GETXATTRS, *mail->get_oid());
+    ret = timer.done(io_ctx->getxattrs(*mail->get_oid(), attr));
     if(ret >= 0){      
       break;
     }
@@ -82,29 +87,48 @@ int RadosMetadataStorageIma::load_metadata(RadosMail *mail) {
     return ret;
   }
 
-  if (attr.find(cfg->get_metadata_storage_attribute()) != attr.end()) {
+  load_attributes(mail, &attr);
+
+  // load other omap values.
+  if (cfg->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS)) {
+    ret = RadosUtils::get_all_keys_and_values(io_ctx, *mail->get_oid(), mail->get_extended_metadata());
+  }
+
+  return ret;
+}
+
+int RadosMetadataStorageIma::load_metadata(RadosMail *mail, std::map<std::string, ceph::bufferlist> *xattrs,
+                                           std::map<std::string, ceph::bufferlist> *omap) {
+  if (mail == nullptr || xattrs == nullptr) {
+    return -1;
+  }
+  if (mail->get_metadata()->size() > 0) {
+    return 0;
+  }
+  load_attributes(mail, xattrs);
+  if (omap != nullptr && cfg->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS)) {
+    *mail->get_extended_metadata() = *omap;
+  }
+  return 0;
+}
+
+void RadosMetadataStorageIma::load_attributes(RadosMail *mail, std::map<std::string, ceph::bufferlist> *attr) {
+  if (attr->find(cfg->get_metadata_storage_attribute()) != attr->end()) {
     // json object for immutable attributes.
     json_t *root;
     json_error_t error;
-    root = json_loads(attr[cfg->get_metadata_storage_attribute()].to_str().c_str(), 0, &error);
+    root = json_loads((*attr)[cfg->get_metadata_storage_attribute()].to_str().c_str(), 0, &error);
     parse_attribute(mail, root);
 
     json_decref(root);
   }
 
   // load other attributes
-  for (std::map<string, ceph::bufferlist>::iterator it = attr.begin(); it != attr.end(); ++it) {
+  for (std::map<string, ceph::bufferlist>::iterator it = attr->begin(); it != attr->end(); ++it) {
     if ((*it).first.compare(cfg->get_metadata_storage_attribute()) != 0) {
       (*mail->get_metadata())[(*it).first] = (*it).second;
     }
   }
-
-  // load other omap values.
-  if (cfg->is_updateable_attribute(librmb::RBOX_METADATA_OLDV1_KEYWORDS)) {
-    ret = RadosUtils::get_all_keys_and_values(io_ctx, *mail->get_oid(), mail->get_extended_metadata());
-  }
-
-  return ret;
 }
 
 // it is required that mail->get_metadata is up to date before update.
@@ -114,9 +138,11 @@ int RadosMetadataStorageIma::set_metadata(RadosMail *mail, RadosMetadata &xattr)
     mail->add_metadata(xattr);
     librados::ObjectWriteOperation op;
     save_metadata(&op, mail);
-    return io_ctx->operate(*mail->get_oid(), &op);
+    RadosStatsTimer timer(RADOS_OP_WRITE, *mail->get_oid());
+    return timer.done(io_ctx->operate(*mail->get_oid(), &op));
   } else {
-    return io_ctx->setxattr(*mail->get_oid(), xattr.key.c_str(), xattr.bl);
+    RadosStatsTimer timer(RADOS_OP_WRITE, *mail->get_oid());
+    return timer.done(io_ctx->setxattr(*mail->get_oid(), xattr.key.c_str(), xattr.bl), xattr.bl.length());
   }
 }
 
@@ -128,9 +154,11 @@ int RadosMetadataStorageIma::set_metadata(RadosMail *mail, RadosMetadata &xattr,
     mail->add_metadata(xattr);
     librados::ObjectWriteOperation op;
     save_metadata(&op, mail);
-    return io_ctx->operate(*mail->get_oid(), &op);
+    RadosStatsTimer timer(RADOS_OP_WRITE, *mail->get_oid());
+    return timer.done(io_ctx->operate(*mail->get_oid(), &op));
   } else {
-    return io_ctx->setxattr(*mail->get_oid(), xattr.key.c_str(), xattr.bl);
+    RadosStatsTimer timer(RADOS_OP_WRITE, *mail->get_oid());
+    return timer.done(io_ctx->setxattr(*mail->get_oid(), xattr.key.c_str(), xattr.bl), xattr.bl.length());
   }
 
 }  // namespace librmb
@@ -194,8 +222,13 @@ bool RadosMetadataStorageIma::update_metadata(const std::string &oid, std::list<
   librados::AioCompletion *completion = librados::Rados::aio_create_completion();
   
   //TODO: do we need a retry mechanism here?
+  RadosStatsTimer timer(RADOS_OP_WRITE, oid);
   int ret = io_ctx->aio_operate(oid, completion, &write_op);
-  completion->wait_for_complete();
+  if (ret == 0) {
+    completion->wait_for_complete();
+    ret = completion->get_return_value();
+  }
+  timer.done(ret);
   completion->release();
   return ret == 0;
 }
@@ -206,7 +239,8 @@ int RadosMetadataStorageIma::update_keyword_metadata(const std::string &oid, Rad
     } else {
       std::map<std::string, librados::bufferlist> map;
       map.insert(std::pair<string, librados::bufferlist>(metadata->key, metadata->bl));
-      ret = io_ctx->omap_set(oid, map);
+      RadosStatsTimer timer(RADOS_OP_OMAP_SET, oid);
+      ret = timer.done(io_ctx->omap_set(oid, map), metadata->bl.length());
     }
   }
   return ret;
@@ -214,12 +248,14 @@ int RadosMetadataStorageIma::update_keyword_metadata(const std::string &oid, Rad
 int RadosMetadataStorageIma::remove_keyword_metadata(const std::string &oid, std::string &key) {
   std::set<std::string> keys;
   keys.insert(key);
-  return io_ctx->omap_rm_keys(oid, keys);
+  RadosStatsTimer timer(RADOS_OP_OMAP_RM, oid);
+  return timer.done(io_ctx->omap_rm_keys(oid, keys));
 }
 
 int RadosMetadataStorageIma::load_keyword_metadata(const std::string &oid, std::set<std::string> &keys,
                                                    std::map<std::string, ceph::bufferlist> *metadata) {
-  return io_ctx->omap_get_vals_by_keys(oid, keys, metadata);
+  RadosStatsTimer timer(RADOS_OP_OMAP_GET, oid);
+  return timer.done(io_ctx->omap_get_vals_by_keys(oid, keys, metadata));
 }
 
 } /* namespace librmb */
@@ -35,12 +35,16 @@ namespace librmb {
 class RadosMetadataStorageIma : public RadosStorageMetadataModule {
  private:
   int parse_attribute(RadosMail *mail, json_t *root);
+  /* the json attribute and the other xattrs of attr */
+  void load_attributes(RadosMail *mail, std::map<std::string, ceph::bufferlist> *attr);
 
  public:
   RadosMetadataStorageIma(librados::IoCtx *io_ctx_, RadosDovecotCephCfg *cfg_);
   virtual ~RadosMetadataStorageIma();
   void set_io_ctx(librados::IoCtx *io_ctx_) override { this->io_ctx = io_ctx_; }
   int load_metadata(RadosMail *mail) override;
+  int load_metadata(RadosMail *mail, std::map<std::string, ceph::bufferlist> *xattrs,
+                    std::map<std::string, ceph::bufferlist> *omap) override;
   int set_metadata(RadosMail *mail, RadosMetadata &xattr) override;
   int set_metadata(RadosMail *mail, RadosMetadata &xattr, librados::ObjectWriteOperation *write_op) override;
   bool update_metadata(const std::string &oid, std::list<RadosMetadata> &to_update) override;
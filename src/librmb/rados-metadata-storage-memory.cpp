@@ -0,0 +1,123 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-metadata-storage-memory.h"
+#include "rados-stats.h"
+#include <utility>
+namespace librmb {
+
+RadosMetadataStorageMemory::RadosMetadataStorageMemory(RadosStorageMemory *storage_)
+    : storage(storage_), backend(storage_->get_backend()) {}
+
+RadosMetadataStorageMemory::~RadosMetadataStorageMemory() {}
+
+int RadosMetadataStorageMemory::load_metadata(RadosMail *mail) {
+  int ret = -1;
+  if (mail == nullptr) {
+    return ret;
+  }
+  mail->get_metadata()->clear();
+  RadosStatsTimer timer(RADOS_OP_GETXATTRS);
+  ret = backend->inject(RADOS_OP_GETXATTRS);
+  if (ret == 0) {
+    ret = backend->getxattrs(storage->get_pool_name(), storage->get_namespace(), *mail->get_oid(),
+                             mail->get_metadata());
+  }
+  ret = timer.done(ret);
+
+  if (ret >= 0) {
+    RadosStatsTimer omap_timer(RADOS_OP_OMAP_GET);
+    std::set<std::string> all_keys;
+    ret = omap_timer.done(backend->omap_get(storage->get_pool_name(), storage->get_namespace(), *mail->get_oid(),
+                                            all_keys, mail->get_extended_metadata()));
+  }
+  return ret;
+}
+
+int RadosMetadataStorageMemory::load_metadata(RadosMail *mail, std::map<std::string, ceph::bufferlist> *xattrs,
+                                              std::map<std::string, ceph::bufferlist> *omap) {
+  if (mail == nullptr || xattrs == nullptr) {
+    return -1;
+  }
+  *mail->get_metadata() = *xattrs;
+  if (omap != nullptr) {
+    *mail->get_extended_metadata() = *omap;
+  }
+  return 0;
+}
+
+int RadosMetadataStorageMemory::set_metadata(RadosMail *mail, RadosMetadata &xattr) {
+  mail->add_metadata(xattr);
+  std::map<std::string, librados::bufferlist> xattrs;
+  xattrs[xattr.key] = xattr.bl;
+  RadosStatsTimer timer(RADOS_OP_WRITE);
+  int ret = backend->inject(RADOS_OP_WRITE);
+  if (ret == 0) {
+    ret = backend->setxattrs(storage->get_pool_name(), storage->get_namespace(), *mail->get_oid(), xattrs);
+  }
+  return timer.done(ret, xattr.bl.length());
+}
+
+int RadosMetadataStorageMemory::set_metadata(RadosMail *mail, RadosMetadata &xattr,
+                                             librados::ObjectWriteOperation *write_op) {
+  return set_metadata(mail, xattr);
+}
+
+bool RadosMetadataStorageMemory::update_metadata(const std::string &oid, std::list<RadosMetadata> &to_update) {
+  std::map<std::string, librados::bufferlist> xattrs;
+  for (auto &m : to_update) {
+    xattrs[m.key] = m.bl;
+  }
+  RadosStatsTimer timer(RADOS_OP_WRITE);
+  int ret = backend->inject(RADOS_OP_WRITE);
+  if (ret == 0) {
+    ret = backend->setxattrs(storage->get_pool_name(), storage->get_namespace(), oid, xattrs);
+  }
+  return timer.done(ret) == 0;
+}
+
+int RadosMetadataStorageMemory::update_keyword_metadata(const std::string &oid, RadosMetadata *metadata) {
+  int ret = -1;
+  if (metadata != nullptr) {
+    std::map<std::string, librados::bufferlist> map;
+    map.insert(std::pair<std::string, librados::bufferlist>(metadata->key, metadata->bl));
+    RadosStatsTimer timer(RADOS_OP_OMAP_SET);
+    ret = backend->inject(RADOS_OP_OMAP_SET);
+    if (ret == 0) {
+      ret = backend->omap_set(storage->get_pool_name(), storage->get_namespace(), oid, map);
+    }
+    ret = timer.done(ret, metadata->bl.length());
+  }
+  return ret;
+}
+
+int RadosMetadataStorageMemory::remove_keyword_metadata(const std::string &oid, std::string &key) {
+  std::set<std::string> keys;
+  keys.insert(key);
+  RadosStatsTimer timer(RADOS_OP_OMAP_RM);
+  int ret = backend->inject(RADOS_OP_OMAP_RM);
+  if (ret == 0) {
+    ret = backend->omap_rm(storage->get_pool_name(), storage->get_namespace(), oid, keys);
+  }
+  return timer.done(ret);
+}
+
+int RadosMetadataStorageMemory::load_keyword_metadata(const std::string &oid, std::set<std::string> &keys,
+                                                      std::map<std::string, ceph::bufferlist> *metadata) {
+  RadosStatsTimer timer(RADOS_OP_OMAP_GET);
+  int ret = backend->inject(RADOS_OP_OMAP_GET);
+  if (ret == 0) {
+    ret = backend->omap_get(storage->get_pool_name(), storage->get_namespace(), oid, keys, metadata);
+  }
+  return timer.done(ret);
+}
+
+} /* namespace librmb */
@@ -0,0 +1,57 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_METADATA_STORAGE_MEMORY_H_
+#define SRC_LIBRMB_RADOS_METADATA_STORAGE_MEMORY_H_
+#include <list>
+#include <map>
+#include <string>
+#include <set>
+#include "rados-metadata-storage-module.h"
+#include "rados-storage-memory.h"
+
+namespace librmb {
+/**
+ * Stores mail metadata like the default module, each metadata attribute
+ * as single xattribute, in the pool and namespace of a RadosStorageMemory.
+ *
+ * save_metadata records the metadata as content of write_op, see
+ * RadosStorageMemory::record_metadata. set_metadata with write_op sets the
+ * attribute directly.
+ */
+class RadosMetadataStorageMemory : public RadosStorageMetadataModule {
+ public:
+  explicit RadosMetadataStorageMemory(RadosStorageMemory *storage_);
+  virtual ~RadosMetadataStorageMemory();
+
+  int load_metadata(RadosMail *mail) override;
+  int load_metadata(RadosMail *mail, std::map<std::string, ceph::bufferlist> *xattrs,
+                    std::map<std::string, ceph::bufferlist> *omap) override;
+  int set_metadata(RadosMail *mail, RadosMetadata &xattr) override;
+  bool update_metadata(const std::string &oid, std::list<RadosMetadata> &to_update) override;
+  void save_metadata(librados::ObjectWriteOperation *write_op, RadosMail *mail) override {
+    storage->record_metadata(write_op, mail);
+  }
+  int set_metadata(RadosMail *mail, RadosMetadata &xattr, librados::ObjectWriteOperation *write_op) override;
+
+  int update_keyword_metadata(const std::string &oid, RadosMetadata *metadata) override;
+  int remove_keyword_metadata(const std::string &oid, std::string &key) override;
+  int load_keyword_metadata(const std::string &oid, std::set<std::string> &keys,
+                            std::map<std::string, ceph::bufferlist> *metadata) override;
+
+ private:
+  RadosStorageMemory *storage;
+  RadosMemoryBackend *backend;
+};
+
+} /* namespace librmb */
+
+#endif  // SRC_LIBRMB_RADOS_METADATA_STORAGE_MEMORY_H_
@@ -24,6 +24,9 @@ class RadosStorageMetadataModule {
   virtual void set_io_ctx(librados::IoCtx *io_ctx){};
   /* load the metadta into RadosMail */
   virtual int load_metadata(RadosMail *mail) = 0;
+  /* load the metadta into RadosMail from the xattrs and omap values the caller has already read */
+  virtual int load_metadata(RadosMail *mail, std::map<std::string, ceph::bufferlist> *xattrs,
+                            std::map<std::string, ceph::bufferlist> *omap) = 0;
   /* set a new metadata attribute to a mail object */
   virtual int set_metadata(RadosMail *mail, RadosMetadata &xattr) = 0;
   /* set a new metadata attribute to a mail object */
@@ -0,0 +1,110 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-namespace-cache.h"
+
+#include <string>
+#include <utility>
+
+namespace librmb {
+
+std::list<std::string> RadosNamespaceCache::lru;
+std::unordered_map<std::string, RadosNamespaceCache::Entry> RadosNamespaceCache::entries;
+std::mutex RadosNamespaceCache::cache_mutex;
+size_t RadosNamespaceCache::max_entries = 10000;
+const unsigned int RadosNamespaceCache::DEFAULT_TTL;
+std::chrono::seconds RadosNamespaceCache::ttl(DEFAULT_TTL);
+// other processes may create the mapping at any time
+std::chrono::seconds RadosNamespaceCache::negative_ttl(10);
+
+bool RadosNamespaceCache::get(const std::string &key, std::string *value_r, bool *exists_r) {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  auto it = entries.find(key);
+  if (it == entries.end()) {
+    return false;
+  }
+  if (it->second.expires < std::chrono::steady_clock::now()) {
+    lru.erase(it->second.lru_pos);
+    entries.erase(it);
+    return false;
+  }
+  lru.splice(lru.begin(), lru, it->second.lru_pos);
+  *value_r = it->second.value;
+  *exists_r = it->second.exists;
+  return true;
+}
+
+void RadosNamespaceCache::put(const std::string &key, const std::string &value, bool exists) {
+  auto expires = std::chrono::steady_clock::now() + (exists ? ttl : negative_ttl);
+
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  if (max_entries == 0) {
+    return;
+  }
+  auto it = entries.find(key);
+  if (it != entries.end()) {
+    lru.splice(lru.begin(), lru, it->second.lru_pos);
+  } else {
+    while (entries.size() >= max_entries) {
+      entries.erase(lru.back());
+      lru.pop_back();
+    }
+    lru.push_front(key);
+    it = entries.insert(std::make_pair(key, Entry())).first;
+    it->second.lru_pos = lru.begin();
+  }
+  it->second.value = value;
+  it->second.exists = exists;
+  it->second.expires = expires;
+}
+
+void RadosNamespaceCache::remove(const std::string &key) {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  auto it = entries.find(key);
+  if (it != entries.end()) {
+    lru.erase(it->second.lru_pos);
+    entries.erase(it);
+  }
+}
+
+void RadosNamespaceCache::clear() {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  entries.clear();
+  lru.clear();
+}
+
+size_t RadosNamespaceCache::size() {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  return entries.size();
+}
+
+void RadosNamespaceCache::set_limits(size_t max_entries_, unsigned int ttl_, unsigned int negative_ttl_) {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  max_entries = max_entries_;
+  ttl = std::chrono::seconds(ttl_);
+  negative_ttl = std::chrono::seconds(negative_ttl_);
+  while (entries.size() > max_entries) {
+    entries.erase(lru.back());
+    lru.pop_back();
+  }
+}
+
+void RadosNamespaceCache::set_ttl(unsigned int ttl_) {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  ttl = std::chrono::seconds(ttl_);
+}
+
+unsigned int RadosNamespaceCache::get_ttl() {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  return ttl.count();
+}
+
+}  // namespace librmb
@@ -0,0 +1,76 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_NAMESPACE_CACHE_H_
+#define SRC_LIBRMB_RADOS_NAMESPACE_CACHE_H_
+
+#include <chrono>  // NOLINT
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <mutex>  // NOLINT
+
+namespace librmb {
+
+/**
+ * Rados Namespace Cache
+ *
+ * Process wide LRU cache of user to namespace mappings. Users without a
+ * mapping are cached as well (negative entries) with a shorter ttl.
+ */
+class RadosNamespaceCache {
+ public:
+  /*!
+   * @param[out] value_r namespace of the user
+   * @param[out] exists_r false if the user is known to have no mapping.
+   * @return true if the key is cached.
+   */
+  static bool get(const std::string &key, std::string *value_r, bool *exists_r);
+  static void put(const std::string &key, const std::string &value, bool exists);
+  static void remove(const std::string &key);
+  static void clear();
+  static size_t size();
+  /*!
+   * @param[in] max_entries_ least recently used entries are evicted above this limit.
+   * @param[in] ttl_ seconds a mapping is cached.
+   * @param[in] negative_ttl_ seconds a missing mapping is cached.
+   */
+  static void set_limits(size_t max_entries_, unsigned int ttl_, unsigned int negative_ttl_);
+  /*!
+   * @param[in] ttl_ seconds a mapping is cached, applies to entries added later.
+   */
+  static void set_ttl(unsigned int ttl_);
+  /* seconds a mapping is cached, a changed mapping is used by all processes after this time */
+  static unsigned int get_ttl();
+
+  static const unsigned int DEFAULT_TTL = 600;
+
+ private:
+  struct Entry {
+    std::string value;
+    bool exists;
+    std::chrono::steady_clock::time_point expires;
+    std::list<std::string>::iterator lru_pos;
+  };
+
+ private:
+  // most recently used first
+  static std::list<std::string> lru;
+  static std::unordered_map<std::string, Entry> entries;
+  static std::mutex cache_mutex;
+  static size_t max_entries;
+  static std::chrono::seconds ttl;
+  static std::chrono::seconds negative_ttl;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_NAMESPACE_CACHE_H_
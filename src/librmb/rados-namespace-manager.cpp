@@ -10,11 +10,139 @@
  */
 #include "rados-namespace-manager.h"
 
+#include <climits>
+#include <list>
+#include <utility>
+
 #include <rados/librados.hpp>
+#include "rados-namespace-cache.h"
+#include "rados-stats.h"
 
 namespace librmb {
 
 RadosNamespaceManager::~RadosNamespaceManager() {
+  for (auto &it : prefetches) {
+    it.second->completion->wait_for_complete();
+    it.second->completion->release();
+    delete it.second;
+  }
+}
+
+int RadosNamespaceManager::prefetch_key(librados::IoCtx *io_ctx, const std::string &uid) {
+  if (io_ctx == nullptr || uid.empty() || prefetches.find(uid) != prefetches.end()) {
+    return -EINVAL;
+  }
+  Prefetch *prefetch = new Prefetch();
+  prefetch->ns = io_ctx->get_namespace();
+  prefetch->completion = librados::Rados::aio_create_completion();
+  size_t max = INT_MAX;
+  RadosStatsAioTimer *timer = RadosStatsAioTimer::start(RADOS_OP_READ, uid, prefetch->completion);
+  int ret = io_ctx->aio_read(uid, prefetch->completion, &prefetch->bl, max, 0);
+  if (ret < 0) {
+    timer->cancel(ret);
+    prefetch->completion->release();
+    delete prefetch;
+    return ret;
+  }
+  prefetches[uid] = prefetch;
+  return 0;
+}
+
+bool RadosNamespaceManager::wait_prefetch(const std::string &uid, std::string *value, bool *found) {
+  auto it = prefetches.find(uid);
+  if (it == prefetches.end()) {
+    return false;
+  }
+  Prefetch *prefetch = it->second;
+  prefetches.erase(it);
+
+  prefetch->completion->wait_for_complete();
+  int ret = prefetch->completion->get_return_value();
+  prefetch->completion->release();
+
+  // prefetch was done with a different user namespace or failed for other reasons than a missing object.
+  bool usable = prefetch->ns.compare(config->get_user_ns()) == 0 && (ret >= 0 || ret == -ENOENT);
+  *found = usable && ret >= 0 && !prefetch->bl.to_str().empty();
+  if (*found) {
+    *value = prefetch->bl.to_str();
+  }
+  delete prefetch;
+  return usable;
+}
+
+std::string RadosNamespaceManager::cache_key(const std::string &uid) {
+  return config->get_pool_name() + "/" + config->get_user_ns() + "/" + uid;
+}
+
+void RadosNamespaceManager::cache_result(const std::string &uid, int ret, librados::bufferlist &bl) {
+  if (ret >= 0 && !bl.to_str().empty()) {
+    RadosNamespaceCache::put(cache_key(uid), bl.to_str(), true);
+  } else if (ret >= 0 || ret == -ENOENT) {
+    RadosNamespaceCache::put(cache_key(uid), "", false);
+  }
+}
+
+int RadosNamespaceManager::prefetch_keys(librados::IoCtx *io_ctx, const std::list<std::string> &uids,
+                                         unsigned int max_in_flight) {
+  if (io_ctx == nullptr || config == nullptr || !config->is_config_valid() || max_in_flight == 0) {
+    return -EINVAL;
+  }
+  if (!config->is_user_mapping()) {
+    return 0;
+  }
+  if (io_ctx->get_namespace().compare(config->get_user_ns()) != 0) {
+    return -EINVAL;
+  }
+
+  int ret = 0;
+  size_t max = INT_MAX;
+  std::list<std::pair<std::string, Prefetch *>> in_flight;
+  auto complete_first = [&]() {
+    Prefetch *prefetch = in_flight.front().second;
+    prefetch->completion->wait_for_complete();
+    int err = prefetch->completion->get_return_value();
+    cache_result(in_flight.front().first, err, prefetch->bl);
+    if (err < 0 && err != -ENOENT && ret == 0) {
+      ret = err;
+    }
+    prefetch->completion->release();
+    delete prefetch;
+    in_flight.pop_front();
+  };
+
+  for (auto &uid : uids) {
+    std::string value;
+    bool exists;
+    if (uid.empty() || RadosNamespaceCache::get(cache_key(uid), &value, &exists)) {
+      continue;
+    }
+    Prefetch *prefetch = new Prefetch();
+    prefetch->ns = io_ctx->get_namespace();
+    prefetch->completion = librados::Rados::aio_create_completion();
+    RadosStatsAioTimer *timer = RadosStatsAioTimer::start(RADOS_OP_READ, uid, prefetch->completion);
+    int err = io_ctx->aio_read(uid, prefetch->completion, &prefetch->bl, max, 0);
+    if (err < 0) {
+      timer->cancel(err);
+      prefetch->completion->release();
+      delete prefetch;
+      ret = ret == 0 ? err : ret;
+      continue;
+    }
+    in_flight.push_back(std::make_pair(uid, prefetch));
+    if (in_flight.size() >= max_in_flight) {
+      complete_first();
+    }
+  }
+  while (!in_flight.empty()) {
+    complete_first();
+  }
+  return ret;
+}
+
+void RadosNamespaceManager::invalidate_key(const std::string &uid) {
+  if (config != nullptr) {
+    RadosNamespaceCache::remove(cache_key(uid));
+  }
 }
 
 bool RadosNamespaceManager::lookup_key(const std::string &uid, std::string *value) {
@@ -36,9 +164,14 @@ bool RadosNamespaceManager::lookup_key(const std::string &uid, std::string *valu
     return true;
   }
 
-  if (cache.find(uid) != cache.end()) {
-    *value = cache[uid];
-    return true;
+  bool exists = false;
+  if (RadosNamespaceCache::get(cache_key(uid), value, &exists)) {
+    return exists;
+  }
+
+  if (wait_prefetch(uid, value, &exists)) {
+    RadosNamespaceCache::put(cache_key(uid), exists ? *value : "", exists);
+    return exists;
   }
 
   ceph::bufferlist bl;
@@ -50,9 +183,9 @@ bool RadosNamespaceManager::lookup_key(const std::string &uid, std::string *valu
   int err = config->read_object(uid, &bl);
   if (err >= 0 && !bl.to_str().empty()) {
     *value = bl.to_str();
-    cache[uid] = *value;
     retval = true;
   }
+  cache_result(uid, err, bl);
   // reset namespace to empty
   config->set_io_ctx_namespace("");
   return retval;
@@ -71,15 +204,25 @@ bool RadosNamespaceManager::add_namespace_entry(const std::string &uid, std::str
     return false;
   }
 
-  guid_generator_->generate_guid(value);
   // temporarily set storage namespace to config namespace
   config->set_io_ctx_namespace(config->get_user_ns());
 
+  // lookup_key may have used a cached negative entry, do not overwrite
+  // a mapping another process has created in the meantime.
+  ceph::bufferlist existing;
+  if (config->read_object(uid, &existing) >= 0 && !existing.to_str().empty()) {
+    *value = existing.to_str();
+    RadosNamespaceCache::put(cache_key(uid), *value, true);
+    config->set_io_ctx_namespace("");
+    return true;
+  }
+
+  guid_generator_->generate_guid(value);
   ceph::bufferlist bl;
   bl.append(*value);
   bool retval = false;
   if (config->save_object(uid, bl) >= 0) {
-    cache[uid] = *value;
+    RadosNamespaceCache::put(cache_key(uid), *value, true);
     retval = true;
   }
   // reset namespace
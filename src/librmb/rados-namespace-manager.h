@@ -11,6 +11,7 @@
 #ifndef SRC_LIBRMB_RADOS_NAMESPACE_MANAGER_H_
 #define SRC_LIBRMB_RADOS_NAMESPACE_MANAGER_H_
 
+#include <list>
 #include <map>
 #include <string>
 #include "rados-storage.h"
@@ -37,9 +38,43 @@ class RadosNamespaceManager {
   void set_namespace_oid(std::string &namespace_oid_) { this->oid_suffix = namespace_oid_; }
   bool lookup_key(const std::string &uid, std::string *value);
   bool add_namespace_entry(const std::string &uid, std::string *value, RadosGuidGenerator *guid_generator_);
+  /*!
+   * start reading the namespace object of uid asynchronously, e.g. while the rados
+   * configuration is still loading. lookup_key uses the result if the configured
+   * user namespace turns out to be the namespace of io_ctx.
+   * @param[in] io_ctx valid io_ctx set to the (expected) user namespace
+   * @return linux error code or 0 if successful
+   */
+  int prefetch_key(librados::IoCtx *io_ctx, const std::string &uid);
+  /*!
+   * read the namespace objects of all uncached uids with at most max_in_flight
+   * parallel reads and add them to the process wide cache, e.g. before
+   * processing many users.
+   * @param[in] io_ctx valid io_ctx set to the configured user namespace
+   * @return linux error code or 0 if successful
+   */
+  int prefetch_keys(librados::IoCtx *io_ctx, const std::list<std::string> &uids, unsigned int max_in_flight);
+  /*!
+   * remove uid from the process wide cache, e.g. after its namespace object has been deleted.
+   */
+  void invalidate_key(const std::string &uid);
+
+ private:
+  struct Prefetch {
+    std::string ns;
+    librados::AioCompletion *completion;
+    librados::bufferlist bl;
+  };
+  /*!
+   * wait for the prefetched read of uid.
+   * @return true if the prefetch is usable, value is set if the object has a value.
+   */
+  bool wait_prefetch(const std::string &uid, std::string *value, bool *found);
+  std::string cache_key(const std::string &uid);
+  void cache_result(const std::string &uid, int ret, librados::bufferlist &bl);
 
  private:
-  std::map<std::string, std::string> cache;
+  std::map<std::string, Prefetch *> prefetches;
   std::string oid_suffix;
   RadosDovecotCephCfg *config;
 };
@@ -0,0 +1,201 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-save-log-writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <vector>
+
+namespace librmb {
+
+// flusher wakes up at least this often
+static const int SAVE_LOG_FLUSH_INTERVAL_MSECS = 100;
+// records are written in chunks of at most this size
+static const size_t SAVE_LOG_MAX_WRITE = 1024 * 1024;
+
+std::mutex RadosSaveLogWriter::writers_mutex;
+std::map<std::string, std::weak_ptr<RadosSaveLogWriter>> RadosSaveLogWriter::writers;
+
+RadosSaveLogWriter::RadosSaveLogWriter(int fd_, rados_save_log_format format_, int fsync_policy_)
+    : fd(fd_),
+      format(format_),
+      fsync_policy(fsync_policy_),
+      head(nullptr),
+      appended(0),
+      written(0),
+      last_error(0),
+      flush_requested(false),
+      stop(false),
+      last_sync(std::chrono::steady_clock::now()) {
+  flusher = std::thread(&RadosSaveLogWriter::run, this);
+}
+
+RadosSaveLogWriter::~RadosSaveLogWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  flush_cond.notify_one();
+  flusher.join();
+  if (fsync_policy != RADOS_SAVE_LOG_FSYNC_NONE) {
+    fdatasync(fd);
+  }
+  close(fd);
+}
+
+std::shared_ptr<RadosSaveLogWriter> RadosSaveLogWriter::acquire(const std::string &file,
+                                                                rados_save_log_format format, int fsync_policy) {
+  std::lock_guard<std::mutex> lock(writers_mutex);
+  std::shared_ptr<RadosSaveLogWriter> writer = writers[file].lock();
+  if (writer != nullptr) {
+    return writer;
+  }
+  int fd = open(file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0660);
+  if (fd < 0) {
+    writers.erase(file);
+    return nullptr;
+  }
+  writer.reset(new RadosSaveLogWriter(fd, format, fsync_policy));
+  writers[file] = writer;
+  return writer;
+}
+
+bool RadosSaveLogWriter::parse_format(const std::string &name, rados_save_log_format *format) {
+  if (name.empty() || name.compare("csv") == 0) {
+    *format = RADOS_SAVE_LOG_FORMAT_CSV;
+  } else if (name.compare("binary") == 0) {
+    *format = RADOS_SAVE_LOG_FORMAT_BINARY;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool RadosSaveLogWriter::parse_fsync_policy(const std::string &value, int *fsync_policy) {
+  if (value.empty() || value.compare("none") == 0) {
+    *fsync_policy = RADOS_SAVE_LOG_FSYNC_NONE;
+  } else if (value.compare("batch") == 0) {
+    *fsync_policy = RADOS_SAVE_LOG_FSYNC_BATCH;
+  } else {
+    char *end = NULL;
+    long msecs = strtol(value.c_str(), &end, 10);
+    if (end == value.c_str() || *end != '\0' || msecs <= 0) {
+      return false;
+    }
+    *fsync_policy = static_cast<int>(msecs);
+  }
+  return true;
+}
+
+void RadosSaveLogWriter::append(const std::string &record) {
+  Record *rec = new Record();
+  rec->data = record;
+  rec->next = head.load(std::memory_order_relaxed);
+  while (!head.compare_exchange_weak(rec->next, rec, std::memory_order_release, std::memory_order_relaxed)) {
+  }
+  appended.fetch_add(1, std::memory_order_release);
+}
+
+int RadosSaveLogWriter::flush() {
+  uint64_t target = appended.load(std::memory_order_acquire);
+  std::unique_lock<std::mutex> lock(mutex);
+  if (written < target) {
+    flush_requested = true;
+    flush_cond.notify_one();
+    written_cond.wait(lock, [&] { return written >= target || stop; });
+  }
+  return last_error;
+}
+
+int RadosSaveLogWriter::sync() {
+  last_sync = std::chrono::steady_clock::now();
+  return fdatasync(fd) < 0 ? -errno : 0;
+}
+
+bool RadosSaveLogWriter::write_queued() {
+  Record *list = head.exchange(nullptr, std::memory_order_acquire);
+  if (list == nullptr) {
+    return false;
+  }
+  // the list is newest first
+  std::vector<Record *> records;
+  for (Record *rec = list; rec != nullptr; rec = rec->next) {
+    records.push_back(rec);
+  }
+
+  int ret = 0;
+  std::string buffer;
+  for (auto it = records.rbegin(); it != records.rend(); ++it) {
+    buffer += (*it)->data;
+    delete *it;
+    if (buffer.size() >= SAVE_LOG_MAX_WRITE || it + 1 == records.rend()) {
+      size_t offset = 0;
+      while (offset < buffer.size()) {
+        ssize_t w = write(fd, buffer.data() + offset, buffer.size() - offset);
+        if (w < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          ret = -errno;
+          break;
+        }
+        offset += w;
+      }
+      buffer.clear();
+    }
+  }
+  if (ret == 0 && fsync_policy == RADOS_SAVE_LOG_FSYNC_BATCH) {
+    ret = sync();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  written += records.size();
+  if (ret < 0) {
+    last_error = ret;
+  }
+  written_cond.notify_all();
+  return true;
+}
+
+void RadosSaveLogWriter::run() {
+  // written but not synced yet (fsync interval)
+  bool dirty = false;
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    flush_cond.wait_for(lock, std::chrono::milliseconds(SAVE_LOG_FLUSH_INTERVAL_MSECS),
+                        [&] { return flush_requested || stop; });
+    flush_requested = false;
+    bool stopping = stop;
+    lock.unlock();
+    dirty = write_queued() || dirty;
+    if (fsync_policy > 0 && dirty &&
+        std::chrono::steady_clock::now() - last_sync >= std::chrono::milliseconds(fsync_policy)) {
+      dirty = false;
+      int ret = sync();
+      if (ret < 0) {
+        std::lock_guard<std::mutex> error_lock(mutex);
+        last_error = ret;
+      }
+    }
+    lock.lock();
+    if (stopping && head.load(std::memory_order_acquire) == nullptr) {
+      break;
+    }
+  }
+  written_cond.notify_all();
+}
+
+}  // namespace librmb
@@ -0,0 +1,113 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_SAVE_LOG_WRITER_H_
+#define SRC_LIBRMB_RADOS_SAVE_LOG_WRITER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <condition_variable>  // NOLINT
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+
+namespace librmb {
+
+enum rados_save_log_format { RADOS_SAVE_LOG_FORMAT_CSV = 0, RADOS_SAVE_LOG_FORMAT_BINARY };
+
+// fsync policies, a positive value is the max. msecs between two fsyncs
+#define RADOS_SAVE_LOG_FSYNC_NONE 0
+#define RADOS_SAVE_LOG_FSYNC_BATCH -1
+
+/**
+ * Rados Save Log Writer
+ *
+ * Appends records to a save log file in the background. append only pushes
+ * the encoded record to a lock free queue, a flusher thread writes all
+ * queued records with one write (group commit) and syncs the file according
+ * to the fsync policy.
+ *
+ * There is one writer per file and process, shared by all save logs of the
+ * file (acquire). Records still queued are lost if the process crashes.
+ */
+class RadosSaveLogWriter {
+ public:
+  ~RadosSaveLogWriter();
+
+  /*!
+   * the writer of file, opened with format and fsync policy if it is not open yet
+   * @return nullptr if the file cannot be opened
+   */
+  static std::shared_ptr<RadosSaveLogWriter> acquire(const std::string &file, rados_save_log_format format,
+                                                     int fsync_policy);
+  /*!
+   * parse csv or binary
+   */
+  static bool parse_format(const std::string &name, rados_save_log_format *format);
+  /*!
+   * parse none, batch or msecs
+   */
+  static bool parse_fsync_policy(const std::string &value, int *fsync_policy);
+
+  /*!
+   * queue an encoded record. Lock free, callable from any thread.
+   */
+  void append(const std::string &record);
+  /*!
+   * wait until all records appended so far are written
+   * @return linux error code or 0 if successful
+   */
+  int flush();
+
+  rados_save_log_format get_format() const { return format; }
+
+ private:
+  struct Record {
+    Record *next;
+    std::string data;
+  };
+
+  RadosSaveLogWriter(int fd_, rados_save_log_format format_, int fsync_policy_);
+  void run();
+  // write all queued records, returns false if nothing was queued
+  bool write_queued();
+  int sync();
+
+  static std::mutex writers_mutex;
+  static std::map<std::string, std::weak_ptr<RadosSaveLogWriter>> writers;
+
+ private:
+  int fd;
+  rados_save_log_format format;
+  int fsync_policy;
+
+  // records are pushed in front, the flusher takes the whole list
+  std::atomic<Record *> head;
+  std::atomic<uint64_t> appended;
+
+  std::mutex mutex;
+  std::condition_variable flush_cond;
+  std::condition_variable written_cond;
+  uint64_t written;
+  int last_error;
+  bool flush_requested;
+  bool stop;
+  std::chrono::steady_clock::time_point last_sync;
+  std::thread flusher;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_SAVE_LOG_WRITER_H_
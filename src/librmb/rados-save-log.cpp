@@ -14,23 +14,47 @@
 namespace librmb {
 
 bool RadosSaveLog::open() {
-  if (this->log_active && !ofs.is_open()) {
-    ofs.open(this->logfile, std::ofstream::out | std::ofstream::app);
-    this->log_active = ofs.is_open();
+  if (this->log_active && writer == nullptr) {
+    writer = RadosSaveLogWriter::acquire(this->logfile, format, fsync_policy);
+    this->log_active = writer != nullptr;
   }
   return this->log_active;
 }
 void RadosSaveLog::append(const RadosSaveLogEntry &entry) {
-  if (this->log_active && ofs.is_open()) {
-    ofs << entry;
+  if (this->log_active && writer != nullptr) {
+    writer->append(writer->get_format() == RADOS_SAVE_LOG_FORMAT_BINARY ? entry.to_binary() : entry.to_csv());
   }
 }
+int RadosSaveLog::flush() {
+  if (this->log_active && writer != nullptr) {
+    return writer->flush();
+  }
+  return 0;
+}
 bool RadosSaveLog::close() {
-  if (this->log_active && ofs.is_open()) {
-    ofs.close();
-    return !ofs.is_open();
+  if (this->log_active && writer != nullptr) {
+    int ret = writer->flush();
+    writer.reset();
+    return ret == 0;
   }
   return true;
 }
 
+int RadosSaveLog::convert_to_csv(std::istream &in, std::ostream &out) {
+  int count = 0;
+  while (true) {
+    RadosSaveLogEntry entry;
+    in >> entry;
+    if (in.eof()) {
+      break;
+    }
+    if (in.fail()) {
+      return -1;
+    }
+    out << entry.to_csv();
+    count++;
+  }
+  return count;
+}
+
 } /* namespace librmb */
@@ -12,15 +12,19 @@
 #ifndef SRC_LIBRMB_RADOS_SAVE_LOG_H_
 #define SRC_LIBRMB_RADOS_SAVE_LOG_H_
 
+#include <stdint.h>
+
 #include <fstream>  // std::ofstream
 //#include <regex>
 #include <cstdio>
+#include <memory>
 #include <vector>
 #include <sstream>
 #include <list>
 #include <iostream>
 
 #include "rados-metadata.h"
+#include "rados-save-log-writer.h"
 
 namespace librmb {
 /**
@@ -87,7 +91,65 @@ class RadosSaveLogEntry {
     return os;
   }
 
+  std::string to_csv() const { return op + "," + pool + "," + ns + "," + oid + "\n"; }
+
+  // binary record: magic, uint32 length of the fields, then op, pool, ns and oid,
+  // each as uint16 length and value. All integers are little endian.
+  static const unsigned char BINARY_MAGIC = 0xB1;
+
+  std::string to_binary() const {
+    std::string fields;
+    const std::string *values[] = {&op, &pool, &ns, &oid};
+    for (const std::string *value : values) {
+      uint16_t len = value->size() > UINT16_MAX ? UINT16_MAX : value->size();
+      fields += static_cast<char>(len & 0xff);
+      fields += static_cast<char>(len >> 8);
+      fields.append(*value, 0, len);
+    }
+    std::string record(1, static_cast<char>(BINARY_MAGIC));
+    uint32_t len = fields.size();
+    for (int i = 0; i < 4; i++) {
+      record += static_cast<char>((len >> (8 * i)) & 0xff);
+    }
+    return record + fields;
+  }
+
+  static bool from_binary(std::istream &is, RadosSaveLogEntry *obj) {
+    unsigned char header[5];
+    if (!is.read(reinterpret_cast<char *>(header), sizeof(header)) || header[0] != BINARY_MAGIC) {
+      return false;
+    }
+    uint32_t len = header[1] | (header[2] << 8) | (header[3] << 16) | (static_cast<uint32_t>(header[4]) << 24);
+    std::string fields(len, '\0');
+    if (!is.read(&fields[0], len)) {
+      return false;
+    }
+    std::string *values[] = {&obj->op, &obj->pool, &obj->ns, &obj->oid};
+    size_t pos = 0;
+    for (std::string *value : values) {
+      if (pos + 2 > len) {
+        return false;
+      }
+      size_t field_len = static_cast<unsigned char>(fields[pos]) | (static_cast<unsigned char>(fields[pos + 1]) << 8);
+      pos += 2;
+      if (pos + field_len > len) {
+        return false;
+      }
+      value->assign(fields, pos, field_len);
+      pos += field_len;
+    }
+    obj->parse_mv_op();
+    return true;
+  }
+
+  // reads csv lines and binary records
   friend std::istream &operator>>(std::istream &is, RadosSaveLogEntry &obj) {
+    if (is.peek() == BINARY_MAGIC) {
+      if (!from_binary(is, &obj)) {
+        is.setstate(std::ios::failbit);
+      }
+      return is;
+    }
     std::string line;
     std::string item;
     std::vector<std::string> csv_items;
@@ -140,24 +202,52 @@ class RadosSaveLogEntry {
   std::list<librmb::RadosMetadata> metadata;
 };
 
+/**
+ * Rados Save Log
+ *
+ * Log of the mail objects saved, copied and moved by the storage. Entries
+ * are written in the background by the writer of the log file (see
+ * RadosSaveLogWriter), as csv lines or binary records.
+ */
 class RadosSaveLog {
  public:
-  explicit RadosSaveLog(const std::string &logfile_) : logfile(logfile_) { log_active = !logfile.empty(); }
-  RadosSaveLog() { log_active = false; }
+  explicit RadosSaveLog(const std::string &logfile_)
+      : logfile(logfile_), format(RADOS_SAVE_LOG_FORMAT_CSV), fsync_policy(RADOS_SAVE_LOG_FSYNC_NONE) {
+    log_active = !logfile.empty();
+  }
+  RadosSaveLog() : format(RADOS_SAVE_LOG_FORMAT_CSV), fsync_policy(RADOS_SAVE_LOG_FSYNC_NONE) { log_active = false; }
   void set_save_log_file(const std::string &logfile_) {
     this->logfile = logfile_;
     this->log_active = !logfile.empty();
   }
-  virtual ~RadosSaveLog(){};
+  /*!
+   * format and fsync policy are used if the log file is not open in the process yet
+   */
+  void set_format(rados_save_log_format format_) { this->format = format_; }
+  void set_fsync_policy(int fsync_policy_) { this->fsync_policy = fsync_policy_; }
+  virtual ~RadosSaveLog() { close(); }
   bool open();
   void append(const RadosSaveLogEntry &entry);
+  /*!
+   * wait until all entries appended so far are written
+   * @return linux error code or 0 if successful
+   */
+  int flush();
   bool close();
-  bool is_open() { return ofs.is_open(); }
+  bool is_open() { return writer != nullptr; }
+
+  /*!
+   * write the entries of a save log (csv or binary) as csv
+   * @return number of entries or -1 if an entry is invalid
+   */
+  static int convert_to_csv(std::istream &in, std::ostream &out);
 
  private:
   std::string logfile;
   bool log_active;
-  std::ofstream ofs;
+  rados_save_log_format format;
+  int fsync_policy;
+  std::shared_ptr<RadosSaveLogWriter> writer;
 };
 
 } /* namespace librmb */
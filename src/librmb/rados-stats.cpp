@@ -0,0 +1,211 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-stats.h"
+
+#include <cstring>
+#include <sstream>
+#include <string>
+
+namespace librmb {
+
+thread_local RadosStats::ThreadSlot RadosStats::thread_slot;
+std::list<RadosStats::ThreadCounters *> RadosStats::threads;
+RadosStats::Snapshot RadosStats::retired;
+std::mutex RadosStats::threads_mutex;
+
+static const char *op_names[RADOS_OP_COUNT] = {"read",      "stat",     "getxattrs", "write",   "append", "remove",
+                                               "copy_from", "omap_get", "omap_set",  "omap_rm", "exec"};
+
+RadosStats::Snapshot::Snapshot() { memset(ops, 0, sizeof(ops)); }
+
+void RadosStats::Snapshot::add(const Snapshot &other) {
+  for (int i = 0; i < RADOS_OP_COUNT; i++) {
+    ops[i].count += other.ops[i].count;
+    ops[i].errors += other.ops[i].errors;
+    ops[i].retries += other.ops[i].retries;
+    ops[i].bytes += other.ops[i].bytes;
+    ops[i].usecs += other.ops[i].usecs;
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+      ops[i].histogram[b] += other.ops[i].histogram[b];
+    }
+  }
+}
+
+void RadosStats::Snapshot::subtract(const Snapshot &other) {
+  for (int i = 0; i < RADOS_OP_COUNT; i++) {
+    ops[i].count -= other.ops[i].count;
+    ops[i].errors -= other.ops[i].errors;
+    ops[i].retries -= other.ops[i].retries;
+    ops[i].bytes -= other.ops[i].bytes;
+    ops[i].usecs -= other.ops[i].usecs;
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+      ops[i].histogram[b] -= other.ops[i].histogram[b];
+    }
+  }
+}
+
+RadosStats::ThreadCounters::ThreadCounters() {
+  for (int i = 0; i < RADOS_OP_COUNT; i++) {
+    ops[i].count = 0;
+    ops[i].errors = 0;
+    ops[i].retries = 0;
+    ops[i].bytes = 0;
+    ops[i].usecs = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+      ops[i].histogram[b] = 0;
+    }
+  }
+}
+
+RadosStats::ThreadSlot::~ThreadSlot() {
+  if (counters == nullptr) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(threads_mutex);
+  add_counters(*counters, &retired);
+  threads.remove(counters);
+  delete counters;
+  counters = nullptr;
+}
+
+RadosStats::ThreadCounters *RadosStats::get_thread_counters() {
+  ThreadCounters *counters = thread_slot.counters;
+  if (counters == nullptr) {
+    counters = new ThreadCounters();
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    threads.push_back(counters);
+    thread_slot.counters = counters;
+  }
+  return counters;
+}
+
+int RadosStats::histogram_bucket(uint64_t usecs) {
+  int bucket = 0;
+  while (usecs > 1 && bucket < HISTOGRAM_BUCKETS - 1) {
+    usecs >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+void RadosStats::record(rbox_rados_op op, uint64_t usecs, uint64_t bytes, int ret) {
+  Counters &counters = get_thread_counters()->ops[op];
+  inc(&counters.count, 1);
+  inc(&counters.usecs, usecs);
+  inc(&counters.histogram[histogram_bucket(usecs)], 1);
+  if (bytes > 0) {
+    inc(&counters.bytes, bytes);
+  }
+  if (ret < 0) {
+    inc(&counters.errors, 1);
+  }
+}
+
+void RadosStats::record_retry(rbox_rados_op op) { inc(&get_thread_counters()->ops[op].retries, 1); }
+
+void RadosStats::record_bytes(rbox_rados_op op, uint64_t bytes) { inc(&get_thread_counters()->ops[op].bytes, bytes); }
+
+void RadosStats::add_counters(const ThreadCounters &counters, Snapshot *snapshot) {
+  for (int i = 0; i < RADOS_OP_COUNT; i++) {
+    const Counters &c = counters.ops[i];
+    OpStats &s = snapshot->ops[i];
+    s.count += c.count.load(std::memory_order_relaxed);
+    s.errors += c.errors.load(std::memory_order_relaxed);
+    s.retries += c.retries.load(std::memory_order_relaxed);
+    s.bytes += c.bytes.load(std::memory_order_relaxed);
+    s.usecs += c.usecs.load(std::memory_order_relaxed);
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+      s.histogram[b] += c.histogram[b].load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void RadosStats::snapshot(Snapshot *snapshot) {
+  *snapshot = Snapshot();
+  std::lock_guard<std::mutex> lock(threads_mutex);
+  snapshot->add(retired);
+  for (auto counters : threads) {
+    add_counters(*counters, snapshot);
+  }
+}
+
+void RadosStats::reset() {
+  Snapshot current;
+  snapshot(&current);
+  // counters are owned by their threads, remember the current values as offset instead
+  std::lock_guard<std::mutex> lock(threads_mutex);
+  retired.subtract(current);
+}
+
+const char *RadosStats::op_name(rbox_rados_op op) { return op < RADOS_OP_COUNT ? op_names[op] : "unknown"; }
+
+uint64_t RadosStats::percentile(const OpStats &op, unsigned int pct) {
+  if (op.count == 0) {
+    return 0;
+  }
+  uint64_t limit = (op.count * pct + 99) / 100;
+  uint64_t sum = 0;
+  for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+    sum += op.histogram[b];
+    if (sum >= limit) {
+      return 1ULL << (b + 1);
+    }
+  }
+  return 1ULL << HISTOGRAM_BUCKETS;
+}
+
+std::string RadosStats::to_string(const Snapshot &snapshot) {
+  std::ostringstream ss;
+  for (int i = 0; i < RADOS_OP_COUNT; i++) {
+    const OpStats &op = snapshot.ops[i];
+    if (op.count == 0 && op.retries == 0) {
+      continue;
+    }
+    ss << op_names[i] << ": count=" << op.count << " errors=" << op.errors << " retries=" << op.retries
+       << " bytes=" << op.bytes << " usecs=" << op.usecs << " p50=" << percentile(op, 50)
+       << " p99=" << percentile(op, 99) << " histogram=";
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+      ss << (b > 0 ? "," : "") << op.histogram[b];
+    }
+    ss << std::endl;
+  }
+  return ss.str();
+}
+
+RadosStatsAioTimer *RadosStatsAioTimer::start(rbox_rados_op op, const std::string &oid, librados::AioCompletion *c) {
+  RadosStatsAioTimer *timer = new RadosStatsAioTimer(op, oid, c);
+  c->set_complete_callback(timer, complete_callback);
+  return timer;
+}
+
+void RadosStatsAioTimer::cancel(int ret) {
+  completion->set_complete_callback(nullptr, nullptr);
+  done(ret);
+  delete this;
+}
+
+void RadosStatsAioTimer::done(int ret) {
+  auto usecs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - submitted);
+  RadosStats::record(op, usecs.count(), 0, ret);
+  if (traced) {
+    RadosTrace::record(parent, RadosStats::op_name(op), &oid, usecs.count(), 0, ret);
+  }
+}
+
+void RadosStatsAioTimer::complete_callback(librados::completion_t cb, void *arg) {
+  // runs on a librados thread, the AioCompletion wrapper may already be released
+  RadosStatsAioTimer *timer = static_cast<RadosStatsAioTimer *>(arg);
+  timer->done(rados_aio_get_return_value(cb));
+  delete timer;
+}
+
+}  // namespace librmb
@@ -0,0 +1,192 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_STATS_H_
+#define SRC_LIBRMB_RADOS_STATS_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <list>
+#include <string>
+#include <mutex>  // NOLINT
+
+#include <rados/librados.hpp>
+
+#include "rados-trace.h"
+
+namespace librmb {
+
+enum rbox_rados_op {
+  RADOS_OP_READ = 0,
+  RADOS_OP_STAT,
+  RADOS_OP_GETXATTRS,
+  RADOS_OP_WRITE,
+  RADOS_OP_APPEND,
+  RADOS_OP_REMOVE,
+  RADOS_OP_COPY_FROM,
+  RADOS_OP_OMAP_GET,
+  RADOS_OP_OMAP_SET,
+  RADOS_OP_OMAP_RM,
+  RADOS_OP_EXEC,
+  RADOS_OP_COUNT
+};
+
+/**
+ * Rados Stats
+ *
+ * Process wide rados operation statistics. Every thread updates its own
+ * counters without locking, readers sum up the counters of all threads.
+ */
+class RadosStats {
+ public:
+  // bucket i counts operations taking [2^i, 2^(i+1)) usecs, the last bucket everything above.
+  static const int HISTOGRAM_BUCKETS = 24;
+
+  struct OpStats {
+    uint64_t count;
+    uint64_t errors;
+    uint64_t retries;
+    uint64_t bytes;
+    uint64_t usecs;
+    uint64_t histogram[HISTOGRAM_BUCKETS];
+  };
+
+  struct Snapshot {
+    Snapshot();
+    void add(const Snapshot &other);
+    void subtract(const Snapshot &other);
+    OpStats ops[RADOS_OP_COUNT];
+  };
+
+  /*!
+   * @param[in] ret return value of the operation, negative values are counted as errors.
+   */
+  static void record(rbox_rados_op op, uint64_t usecs, uint64_t bytes, int ret);
+  static void record_retry(rbox_rados_op op);
+  /*!
+   * add bytes to an operation recorded without knowing its payload size.
+   */
+  static void record_bytes(rbox_rados_op op, uint64_t bytes);
+  static void snapshot(Snapshot *snapshot);
+  static void reset();
+  static const char *op_name(rbox_rados_op op);
+  static int histogram_bucket(uint64_t usecs);
+  /*!
+   * approximate percentile (0-100) in usecs, upper bound of the matching bucket.
+   */
+  static uint64_t percentile(const OpStats &op, unsigned int pct);
+  static std::string to_string(const Snapshot &snapshot);
+
+ private:
+  struct Counters {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> errors;
+    std::atomic<uint64_t> retries;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> usecs;
+    std::atomic<uint64_t> histogram[HISTOGRAM_BUCKETS];
+  };
+  struct ThreadCounters {
+    ThreadCounters();
+    Counters ops[RADOS_OP_COUNT];
+  };
+  class ThreadSlot {
+   public:
+    ThreadSlot() : counters(nullptr) {}
+    ~ThreadSlot();
+    ThreadCounters *counters;
+  };
+
+  static ThreadCounters *get_thread_counters();
+  static void add_counters(const ThreadCounters &counters, Snapshot *snapshot);
+  static void inc(std::atomic<uint64_t> *counter, uint64_t value) {
+    // only the owning thread writes, no read-modify-write needed
+    counter->store(counter->load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+  }
+
+ private:
+  static thread_local ThreadSlot thread_slot;
+  static std::list<ThreadCounters *> threads;
+  // counters of threads which have exited
+  static Snapshot retired;
+  static std::mutex threads_mutex;
+};
+
+/**
+ * measures one rados operation, usage: return timer.done(io_ctx->read(...), bytes);
+ */
+class RadosStatsTimer {
+ public:
+  explicit RadosStatsTimer(rbox_rados_op op_) : op(op_), oid(nullptr), start(std::chrono::steady_clock::now()) {}
+  /*!
+   * @param[in] oid_ object of the operation for the trace span, needs to outlive the timer
+   */
+  RadosStatsTimer(rbox_rados_op op_, const std::string &oid_)
+      : op(op_), oid(&oid_), start(std::chrono::steady_clock::now()) {}
+
+  int done(int ret, uint64_t bytes = 0) {
+    auto usecs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    RadosStats::record(op, usecs.count(), bytes, ret);
+    if (RadosTrace::is_active()) {
+      RadosTrace::record(RadosStats::op_name(op), oid, usecs.count(), bytes, ret);
+    }
+    return ret;
+  }
+
+ private:
+  rbox_rados_op op;
+  const std::string *oid;
+  std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * measures an asynchronous rados operation from submit to completion, usage:
+ *   RadosStatsAioTimer *timer = RadosStatsAioTimer::start(op, oid, completion);
+ *   int ret = io_ctx->aio_operate(oid, completion, ...);
+ *   if (ret < 0) timer->cancel(ret);
+ * The operation is recorded by the complete callback of the completion,
+ * its trace span as child of the span active on the submitting thread.
+ */
+class RadosStatsAioTimer {
+ public:
+  /*!
+   * sets the complete callback of c, c must not have a callback of its own.
+   * @return timer, deleted when c completes or by cancel
+   */
+  static RadosStatsAioTimer *start(rbox_rados_op op, const std::string &oid, librados::AioCompletion *c);
+  /*!
+   * records the failed submit and deletes the timer, c will not complete.
+   */
+  void cancel(int ret);
+
+ private:
+  RadosStatsAioTimer(rbox_rados_op op_, const std::string &oid_, librados::AioCompletion *c)
+      : op(op_), oid(oid_), completion(c), submitted(std::chrono::steady_clock::now()) {
+    traced = RadosTrace::get_active(&parent);
+  }
+  static void complete_callback(librados::completion_t cb, void *arg);
+  void done(int ret);
+
+ private:
+  rbox_rados_op op;
+  std::string oid;
+  librados::AioCompletion *completion;
+  std::chrono::steady_clock::time_point submitted;
+  // span active on the submitting thread, parent of the operation's span
+  bool traced;
+  RadosTraceSpan parent;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_STATS_H_
@@ -18,8 +18,12 @@
 #include <utility>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
 
 #include "rados-util.h"
+#include "rados-stats.h"
 
 #include <rados/librados.hpp>
 
@@ -121,7 +125,8 @@ int RadosStorageImpl::split_buffer_and_exec_op(RadosMail *current_object,
 }
 
 int RadosStorageImpl::save_mail(const std::string &oid, librados::bufferlist &buffer) {
-  return get_io_ctx().write_full(oid, buffer);
+  RadosStatsTimer timer(RADOS_OP_WRITE, oid);
+  return timer.done(get_io_ctx().write_full(oid, buffer), buffer.length());
 }
 
 int RadosStorageImpl::read_mail(const std::string &oid, librados::bufferlist *buffer) {
@@ -129,7 +134,9 @@ int RadosStorageImpl::read_mail(const std::string &oid, librados::bufferlist *bu
     return -1;
   }
   size_t max = INT_MAX;
-  return get_io_ctx().read(oid, *buffer, max, 0);
+  RadosStatsTimer timer(RADOS_OP_READ, oid);
+  int ret = get_io_ctx().read(oid, *buffer, max, 0);
+  return timer.done(ret, ret > 0 ? ret : 0);
 }
 
 int RadosStorageImpl::delete_mail(RadosMail *mail) {
@@ -144,27 +151,43 @@ int RadosStorageImpl::delete_mail(const std::string &oid) {
   if (!cluster->is_connected() || oid.empty() || !io_ctx_created) {
     return -1;
   }
-  return get_io_ctx().remove(oid);
+  RadosStatsTimer timer(RADOS_OP_REMOVE, oid);
+  return timer.done(get_io_ctx().remove(oid));
 }
 
 bool RadosStorageImpl::execute_operation(std::string &oid, librados::ObjectWriteOperation *write_op_xattr) {
   if (!cluster->is_connected() || !io_ctx_created) {
     return false;
   }
-  return get_io_ctx().operate(oid, write_op_xattr) >=0 ? true : false;
+  RadosStatsTimer timer(RADOS_OP_WRITE, oid);
+  return timer.done(get_io_ctx().operate(oid, write_op_xattr)) >= 0 ? true : false;
 }
 
 bool RadosStorageImpl::append_to_object(std::string &oid, librados::bufferlist &bufferlist, int length) {
   if (!cluster->is_connected() || !io_ctx_created) {
     return false;
   }
-  return get_io_ctx().append(oid, bufferlist, length) >=0 ? true : false;
+  RadosStatsTimer timer(RADOS_OP_APPEND, oid);
+  return timer.done(get_io_ctx().append(oid, bufferlist, length), length) >= 0 ? true : false;
 }
 int RadosStorageImpl::read_operate(const std::string &oid, librados::ObjectReadOperation *read_operation, librados::bufferlist *bufferlist) {
 if (!cluster->is_connected() || !io_ctx_created) {
     return -1;
   }
-  return get_io_ctx().operate(oid, read_operation, bufferlist);
+  RadosStatsTimer timer(RADOS_OP_READ, oid);
+  int ret = get_io_ctx().operate(oid, read_operation, bufferlist);
+  return timer.done(ret, bufferlist != nullptr ? bufferlist->length() : 0);
+}
+
+void RadosStorageImpl::prepare_write(librados::ObjectWriteOperation *write_op, uint64_t offset,
+                                     librados::bufferlist &buffer) {
+  write_op->write(offset, buffer);
+}
+
+void RadosStorageImpl::prepare_read(librados::ObjectReadOperation *read_op, librados::bufferlist *buffer,
+                                    int *read_err, uint64_t *psize, time_t *pmtime, int *stat_err) {
+  read_op->read(0, INT_MAX, buffer, read_err);
+  read_op->stat(psize, pmtime, stat_err);
 }
 
 int RadosStorageImpl::aio_operate(librados::IoCtx *io_ctx_, const std::string &oid, librados::AioCompletion *c,
@@ -172,19 +195,25 @@ int RadosStorageImpl::aio_operate(librados::IoCtx *io_ctx_, const std::string &o
   if (!cluster->is_connected() || !io_ctx_created) {
     return -1;
   }
+  return aio_submit(io_ctx_, oid, c, op, RADOS_OP_WRITE);
+}
 
-  if (io_ctx_ != nullptr) {
-    return io_ctx_->aio_operate(oid, c, op);
-  } else {
-    return get_io_ctx().aio_operate(oid, c, op);
+int RadosStorageImpl::aio_submit(librados::IoCtx *io_ctx_, const std::string &oid, librados::AioCompletion *c,
+                                 librados::ObjectWriteOperation *op, rbox_rados_op op_type) {
+  RadosStatsAioTimer *timer = RadosStatsAioTimer::start(op_type, oid, c);
+  int ret = (io_ctx_ != nullptr ? io_ctx_ : &get_io_ctx())->aio_operate(oid, c, op);
+  if (ret < 0) {
+    timer->cancel(ret);
   }
+  return ret;
 }
 
 int RadosStorageImpl::stat_mail(const std::string &oid, uint64_t *psize, time_t *pmtime) {
   if (!cluster->is_connected() || !io_ctx_created) {
     return -1;
   }
-  return get_io_ctx().stat(oid, psize, pmtime);
+  RadosStatsTimer timer(RADOS_OP_STAT, oid);
+  return timer.done(get_io_ctx().stat(oid, psize, pmtime));
 }
 
 void RadosStorageImpl::set_namespace(const std::string &_nspace) {
@@ -296,6 +325,107 @@ std::set<std::string> RadosStorageImpl::find_mails_async(const RadosMetadata *at
     }   
     return oid_list;
 }
+int RadosStorageImpl::find_mails_parallel(const RadosMetadata *attr, unsigned int list_threads, size_t batch_size,
+                                          const std::function<bool(std::vector<std::string> *)> &consumer) {
+  if (!cluster->is_connected() || !io_ctx_created) {
+    return -1;
+  }
+  if (list_threads == 0) {
+    list_threads = 1;
+  }
+  if (batch_size == 0) {
+    batch_size = 1;
+  }
+  ceph::bufferlist filter_bl;
+  if (attr != nullptr) {
+    std::string filter_name = PLAIN_FILTER_NAME;
+    encode(filter_name, filter_bl);
+    encode("_" + attr->key, filter_bl);
+    encode(attr->bl.to_str(), filter_bl);
+  }
+
+  std::mutex mutex;
+  // signals a queued batch, a consumed batch, a finished lister or stop
+  std::condition_variable cond;
+  std::deque<std::vector<std::string>> batches;
+  unsigned int running = list_threads;
+  bool stop = false;
+  int error = 0;
+
+  librados::IoCtx &ctx = get_io_ctx();
+  librados::ObjectCursor begin = ctx.object_list_begin();
+  librados::ObjectCursor end = ctx.object_list_end();
+
+  auto queue_batch = [&](std::vector<std::string> *batch) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [&] { return stop || batches.size() < list_threads; });
+    if (!stop) {
+      batches.push_back(std::move(*batch));
+      cond.notify_all();
+    }
+    batch->clear();
+    return !stop;
+  };
+  auto list_slice = [&](unsigned int slice) {
+    librados::ObjectCursor cursor;
+    librados::ObjectCursor finish;
+    ctx.object_list_slice(begin, end, slice, list_threads, &cursor, &finish);
+
+    std::vector<std::string> batch;
+    int ret = 0;
+    bool go_on = true;
+    while (go_on && !ctx.object_list_is_end(cursor) && cursor < finish) {
+      std::vector<librados::ObjectItem> items;
+      ret = ctx.object_list(cursor, finish, batch_size, filter_bl, &items, &cursor);
+      if (ret < 0) {
+        break;
+      }
+      for (auto &item : items) {
+        batch.push_back(item.oid);
+        if (batch.size() >= batch_size && !(go_on = queue_batch(&batch))) {
+          break;
+        }
+      }
+    }
+    if (ret >= 0 && go_on && !batch.empty()) {
+      queue_batch(&batch);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ret < 0 && error == 0) {
+      error = ret;
+      stop = true;
+    }
+    running--;
+    cond.notify_all();
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned int i = 0; i < list_threads; i++) {
+    threads.push_back(std::thread(list_slice, i));
+  }
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    cond.wait(lock, [&] { return stop || !batches.empty() || running == 0; });
+    if (stop || batches.empty()) {
+      break;
+    }
+    std::vector<std::string> batch = std::move(batches.front());
+    batches.pop_front();
+    cond.notify_all();
+    lock.unlock();
+    bool go_on = consumer(&batch);
+    lock.lock();
+    if (!go_on) {
+      stop = true;
+      cond.notify_all();
+    }
+  }
+  lock.unlock();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  return error;
+}
 librados::IoCtx &RadosStorageImpl::get_io_ctx() { return io_ctx; }
 librados::IoCtx &RadosStorageImpl::get_recovery_io_ctx() { return recovery_io_ctx; }
 
@@ -431,7 +561,14 @@ bool RadosStorageImpl::wait_for_rados_operations(const std::list<librmb::RadosMa
   return ctx_failed;
 }
 
-// assumes that destination io ctx is current io_ctx;
+int RadosStorageImpl::get_shared_io_ctx(const std::string &ns, librados::IoCtx **io_ctx_r) {
+  if (ns == nspace) {
+    *io_ctx_r = &io_ctx;
+    return 0;
+  }
+  return cluster->io_ctx_get(pool_name, ns, io_ctx_r);
+}
+
 int RadosStorageImpl::move(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
                            std::list<RadosMetadata> &to_update, bool delete_source) {
   if (!cluster->is_connected() || !io_ctx_created) {
@@ -440,28 +577,30 @@ int RadosStorageImpl::move(std::string &src_oid, const char *src_ns, std::string
 
   int ret = 0;
   librados::ObjectWriteOperation write_op;
-  librados::IoCtx src_io_ctx, dest_io_ctx;
-
-  librados::AioCompletion *completion = librados::Rados::aio_create_completion();
+  librados::IoCtx *src_io_ctx = nullptr;
+  librados::IoCtx *dest_io_ctx = nullptr;
 
-  // destination io_ctx is current io_ctx
-  dest_io_ctx = io_ctx;
+  // shared io contexts, the namespace of the current io_ctx is not touched
+  ret = get_shared_io_ctx(dest_ns, &dest_io_ctx);
+  if (ret < 0) {
+    return ret;
+  }
+  ret = get_shared_io_ctx(src_ns, &src_io_ctx);
+  if (ret < 0) {
+    return ret;
+  }
 
   if (strcmp(src_ns, dest_ns) != 0) {
-    src_io_ctx.dup(dest_io_ctx);
-    src_io_ctx.set_namespace(src_ns);
-    dest_io_ctx.set_namespace(dest_ns);
-
 #if LIBRADOS_VERSION_CODE >= 30000
-    write_op.copy_from(src_oid, src_io_ctx, 0, 0);
+    write_op.copy_from(src_oid, *src_io_ctx, 0, 0);
 #else
-    write_op.copy_from(src_oid, src_io_ctx, 0);
+    write_op.copy_from(src_oid, *src_io_ctx, 0);
 #endif
   } else {
-    src_io_ctx = dest_io_ctx;
     time_t t;
     uint64_t size;
-    ret = src_io_ctx.stat(src_oid, &size, &t);
+    RadosStatsTimer stat_timer(RADOS_OP_STAT);
+    ret = stat_timer.done(src_io_ctx->stat(src_oid, &size, &t));
     if (ret < 0) {
       return ret;
     }
@@ -478,45 +617,45 @@ int RadosStorageImpl::move(std::string &src_oid, const char *src_ns, std::string
   for (std::list<RadosMetadata>::iterator it = to_update.begin(); it != to_update.end(); ++it) {
     write_op.setxattr((*it).key.c_str(), (*it).bl);
   }
-  ret = aio_operate(&dest_io_ctx, dest_oid, completion, &write_op);
+  librados::AioCompletion *completion = librados::Rados::aio_create_completion();
+  ret = aio_submit(dest_io_ctx, dest_oid, completion, &write_op,
+                   strcmp(src_ns, dest_ns) != 0 ? RADOS_OP_COPY_FROM : RADOS_OP_WRITE);
   if (ret >= 0) {
     completion->wait_for_complete();
     ret = completion->get_return_value();
-    if (delete_source && strcmp(src_ns, dest_ns) != 0 && ret == 0) {
-      ret = src_io_ctx.remove(src_oid);
-    }
+  }
+  if (ret == 0 && delete_source && strcmp(src_ns, dest_ns) != 0) {
+    RadosStatsTimer remove_timer(RADOS_OP_REMOVE);
+    ret = remove_timer.done(src_io_ctx->remove(src_oid));
   }
   completion->release();
-  // reset io_ctx
-  dest_io_ctx.set_namespace(dest_ns);
   return ret;
 }
 
-// assumes that destination io ctx is current io_ctx;
-int RadosStorageImpl::copy(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
-                           std::list<RadosMetadata> &to_update) {
+int RadosStorageImpl::aio_copy(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+                               std::list<RadosMetadata> &to_update, librados::ObjectWriteOperation *write_op,
+                               librados::AioCompletion *completion) {
   if (!cluster->is_connected() || !io_ctx_created) {
     return -1;
   }
 
-  librados::ObjectWriteOperation write_op;
-  librados::IoCtx src_io_ctx, dest_io_ctx;
-
-  // destination io_ctx is current io_ctx
-  dest_io_ctx = io_ctx;
+  librados::IoCtx *src_io_ctx = nullptr;
+  librados::IoCtx *dest_io_ctx = nullptr;
 
-  if (strcmp(src_ns, dest_ns) != 0) {
-    src_io_ctx.dup(dest_io_ctx);
-    src_io_ctx.set_namespace(src_ns);
-    dest_io_ctx.set_namespace(dest_ns);
-  } else {
-    src_io_ctx = dest_io_ctx;
+  // shared io contexts, the namespace of the current io_ctx is not touched
+  int ret = get_shared_io_ctx(dest_ns, &dest_io_ctx);
+  if (ret < 0) {
+    return ret;
+  }
+  ret = get_shared_io_ctx(src_ns, &src_io_ctx);
+  if (ret < 0) {
+    return ret;
   }
 
 #if LIBRADOS_VERSION_CODE >= 30000
-  write_op.copy_from(src_oid, src_io_ctx, 0, 0);
+  write_op->copy_from(src_oid, *src_io_ctx, 0, 0);
 #else
-  write_op.copy_from(src_oid, src_io_ctx, 0);
+  write_op->copy_from(src_oid, *src_io_ctx, 0);
 #endif
 
   // because we create a copy, save date needs to be updated
@@ -524,23 +663,38 @@ int RadosStorageImpl::copy(std::string &src_oid, const char *src_ns, std::string
   // and restore it in read_metadata function. => save_date of copy/move will be same as source.
   // write_op.mtime(&ctx->data.save_date);
   time_t save_time = time(NULL);
-  write_op.mtime(&save_time);
+  write_op->mtime(&save_time);
 
   // update metadata
   for (std::list<RadosMetadata>::iterator it = to_update.begin(); it != to_update.end(); ++it) {
-    write_op.setxattr((*it).key.c_str(), (*it).bl);
+    write_op->setxattr((*it).key.c_str(), (*it).bl);
   }
-  int ret = 0;
+  return aio_submit(dest_io_ctx, dest_oid, completion, write_op, RADOS_OP_COPY_FROM);
+}
+
+int RadosStorageImpl::aio_wait(librados::AioCompletion *completion) {
+  completion->wait_for_complete();
+  return completion->get_return_value();
+}
+
+bool RadosStorageImpl::aio_is_complete(librados::AioCompletion *completion) { return completion->is_complete(); }
+
+int RadosStorageImpl::copy(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+                           std::list<RadosMetadata> &to_update) {
+  if (!cluster->is_connected() || !io_ctx_created) {
+    return -1;
+  }
+
+  librados::ObjectWriteOperation write_op;
+  // recorded by aio_copy
   librados::AioCompletion *completion = librados::Rados::aio_create_completion();
-  ret = aio_operate(&dest_io_ctx, dest_oid, completion, &write_op);
+  int ret = aio_copy(src_oid, src_ns, dest_oid, dest_ns, to_update, &write_op, completion);
   if (ret >= 0) {
     ret = completion->wait_for_complete();
     // cppcheck-suppress redundantAssignment
     ret = completion->get_return_value();
   }
   completion->release();
-  // reset io_ctx
-  dest_io_ctx.set_namespace(dest_ns);
   return ret;
 }
 
@@ -599,25 +753,29 @@ void RadosStorageImpl::free_rados_mail(librmb::RadosMail *mail) {
 uint64_t RadosStorageImpl::ceph_index_size(){
   uint64_t psize;
   time_t pmtime;
-  get_recovery_io_ctx().stat(get_namespace(), &psize, &pmtime);
+  RadosStatsTimer timer(RADOS_OP_STAT);
+  timer.done(get_recovery_io_ctx().stat(get_namespace(), &psize, &pmtime));
   return psize;
 }
 
 int RadosStorageImpl::ceph_index_append(const std::string &oid) {  
   librados::bufferlist bl;
   bl.append(RadosUtils::convert_to_ceph_index(oid));
-  return get_recovery_io_ctx().append( get_namespace(),bl, bl.length());
+  RadosStatsTimer timer(RADOS_OP_APPEND);
+  return timer.done(get_recovery_io_ctx().append(get_namespace(), bl, bl.length()), bl.length());
 }
 
 int RadosStorageImpl::ceph_index_append(const std::set<std::string> &oids) {
   librados::bufferlist bl;
   bl.append(RadosUtils::convert_to_ceph_index(oids));
-  return get_recovery_io_ctx().append( get_namespace(),bl, bl.length());
+  RadosStatsTimer timer(RADOS_OP_APPEND);
+  return timer.done(get_recovery_io_ctx().append(get_namespace(), bl, bl.length()), bl.length());
 }
 int RadosStorageImpl::ceph_index_overwrite(const std::set<std::string> &oids) {
   librados::bufferlist bl;
   bl.append(RadosUtils::convert_to_ceph_index(oids));
-  return get_recovery_io_ctx().write_full( get_namespace(),bl);
+  RadosStatsTimer timer(RADOS_OP_WRITE);
+  return timer.done(get_recovery_io_ctx().write_full(get_namespace(), bl), bl.length());
 }
 std::set<std::string> RadosStorageImpl::ceph_index_read() {
   std::set<std::string> index;
@@ -625,12 +783,15 @@ std::set<std::string> RadosStorageImpl::ceph_index_read() {
   size_t max = INT_MAX;
   int64_t psize;
   time_t pmtime;
-  get_recovery_io_ctx().stat(get_namespace(), &psize, &pmtime);
+  RadosStatsTimer stat_timer(RADOS_OP_STAT);
+  stat_timer.done(get_recovery_io_ctx().stat(get_namespace(), &psize, &pmtime));
   if(psize <=0){
     return index;
   }
   //std::cout << " NAMESPACE: " << get_namespace() << " exist? " << exist << " size : " << psize << std::endl;
+  RadosStatsTimer timer(RADOS_OP_READ);
   int ret = get_recovery_io_ctx().read(get_namespace(),bl, max,0);
+  timer.done(ret, ret > 0 ? ret : 0);
 
 
   if(ret < 0){
@@ -640,6 +801,7 @@ std::set<std::string> RadosStorageImpl::ceph_index_read() {
   return index;
 }
 int RadosStorageImpl::ceph_index_delete() {
-  return get_recovery_io_ctx().remove(get_namespace());
+  RadosStatsTimer timer(RADOS_OP_REMOVE);
+  return timer.done(get_recovery_io_ctx().remove(get_namespace()));
 }
 
@@ -25,6 +25,8 @@
 
 #include "rados-mail.h"
 #include "rados-storage.h"
+#include "rados-stats.h"
+
 namespace librmb {
 
 class RadosStorageImpl : public RadosStorage {
@@ -56,6 +58,8 @@ class RadosStorageImpl : public RadosStorage {
   librados::NObjectIterator find_mails(const RadosMetadata *attr) override;
   
   std::set<std::string> find_mails_async(const RadosMetadata *attr, std::string &pool_name, int num_threads, void (*ptr)(std::string&)) override;
+  int find_mails_parallel(const RadosMetadata *attr, unsigned int list_threads, size_t batch_size,
+                          const std::function<bool(std::vector<std::string> *)> &consumer) override;
 
   int open_connection(const std::string &poolname) override;
   int open_connection(const std::string &poolname, const std::string &index_pool) override;
@@ -77,6 +81,11 @@ class RadosStorageImpl : public RadosStorage {
            std::list<RadosMetadata> &to_update, bool delete_source) override;
   int copy(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
            std::list<RadosMetadata> &to_update) override;
+  int aio_copy(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+               std::list<RadosMetadata> &to_update, librados::ObjectWriteOperation *write_op,
+               librados::AioCompletion *completion) override;
+  int aio_wait(librados::AioCompletion *completion) override;
+  bool aio_is_complete(librados::AioCompletion *completion) override;
 
   int save_mail(const std::string &oid, librados::bufferlist &buffer) override;
   bool save_mail(RadosMail *mail) override;
@@ -95,9 +104,23 @@ class RadosStorageImpl : public RadosStorage {
   bool execute_operation(std::string &oid, librados::ObjectWriteOperation *write_op_xattr) override;
   bool append_to_object(std::string &oid, librados::bufferlist &bufferlist, int length) override;
   int read_operate(const std::string &oid, librados::ObjectReadOperation *read_operation, librados::bufferlist *bufferlist) override;
+  void prepare_write(librados::ObjectWriteOperation *write_op, uint64_t offset, librados::bufferlist &buffer) override;
+  void prepare_read(librados::ObjectReadOperation *read_op, librados::bufferlist *buffer, int *read_err,
+                    uint64_t *psize, time_t *pmtime, int *stat_err) override;
 
  private:
   int create_connection(const std::string &poolname,const std::string &index_pool);
+  /*!
+   * io_ctx for namespace ns: the current io_ctx or the cluster's shared io_ctx of the pool.
+   * @return linux error code or 0 if successful
+   */
+  int get_shared_io_ctx(const std::string &ns, librados::IoCtx **io_ctx_r);
+  /*!
+   * submit op, it is recorded as op_type from submit to completion.
+   * @return linux error code or 0 if successful
+   */
+  int aio_submit(librados::IoCtx *io_ctx_, const std::string &oid, librados::AioCompletion *c,
+                 librados::ObjectWriteOperation *op, rbox_rados_op op_type);
 
  private:
   RadosCluster *cluster;
@@ -0,0 +1,551 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-storage-memory.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rados-stats.h"
+#include "rados-util.h"
+
+namespace librmb {
+
+RadosStorageMemory::RadosStorageMemory(RadosClusterMemory *cluster_)
+    : cluster(cluster_),
+      backend(cluster_->get_backend()),
+      max_write_size(10),
+      max_object_size(134217728),
+      connected(false) {}
+
+RadosStorageMemory::~RadosStorageMemory() {}
+
+int RadosStorageMemory::open_connection(const std::string &poolname) { return open_connection(poolname, poolname); }
+
+int RadosStorageMemory::open_connection(const std::string &poolname, const std::string &index_pool_) {
+  if (connected) {
+    // cluster is already connected!
+    return 1;
+  }
+  if (cluster->init() < 0) {
+    return -1;
+  }
+  int err = cluster->pool_create(poolname);
+  if (err < 0) {
+    return err;
+  }
+  err = cluster->pool_create(index_pool_);
+  if (err < 0) {
+    return err;
+  }
+  std::string value;
+  if (cluster->get_config_option("osd_max_write_size", &value) == 0) {
+    max_write_size = std::stoi(value);
+  }
+  if (cluster->get_config_option("osd_max_object_size", &value) == 0) {
+    max_object_size = std::stoi(value);
+  }
+  pool_name = poolname;
+  index_pool = index_pool_;
+  connected = true;
+  return 0;
+}
+
+int RadosStorageMemory::open_connection(const std::string &poolname, const std::string &index_pool_,
+                                        const std::string &clustername, const std::string &rados_username) {
+  return open_connection(poolname, index_pool_);
+}
+
+int RadosStorageMemory::open_connection(const std::string &poolname, const std::string &clustername,
+                                        const std::string &rados_username) {
+  return open_connection(poolname, poolname);
+}
+
+void RadosStorageMemory::close_connection() {
+  if (connected) {
+    cluster->deinit();
+    connected = false;
+  }
+}
+
+int RadosStorageMemory::stat_mail(const std::string &oid, uint64_t *psize, time_t *pmtime) {
+  if (!connected) {
+    return -1;
+  }
+  RadosStatsTimer timer(RADOS_OP_STAT, oid);
+  int ret = backend->inject(RADOS_OP_STAT);
+  if (ret == 0) {
+    ret = backend->stat(pool_name, nspace, oid, psize, pmtime);
+  }
+  return timer.done(ret);
+}
+
+int RadosStorageMemory::read_mail(const std::string &oid, librados::bufferlist *buffer) {
+  if (!connected) {
+    return -1;
+  }
+  RadosStatsTimer timer(RADOS_OP_READ, oid);
+  int ret = backend->inject(RADOS_OP_READ);
+  if (ret == 0) {
+    ret = backend->read(pool_name, nspace, oid, buffer);
+  }
+  return timer.done(ret, ret > 0 ? ret : 0);
+}
+
+int RadosStorageMemory::save_mail(const std::string &oid, librados::bufferlist &buffer) {
+  RadosStatsTimer timer(RADOS_OP_WRITE, oid);
+  int ret = backend->inject(RADOS_OP_WRITE);
+  if (ret == 0) {
+    ret = backend->write_full(pool_name, nspace, oid, buffer);
+  }
+  return timer.done(ret, buffer.length());
+}
+
+int RadosStorageMemory::save_mail_object(const std::string &ns, RadosMail *mail) {
+  RadosMemoryObject object;
+  if (mail->get_mail_buffer() != nullptr) {
+    object.data = *mail->get_mail_buffer();
+  }
+  object.xattrs = *mail->get_metadata();
+  object.omap = *mail->get_extended_metadata();
+  object.mtime = mail->get_rados_save_date();
+
+  RadosStatsTimer timer(RADOS_OP_WRITE, *mail->get_oid());
+  int ret = backend->inject(RADOS_OP_WRITE);
+  if (ret == 0) {
+    ret = backend->write_object(pool_name, ns, *mail->get_oid(), object);
+  }
+  return timer.done(ret, object.data.length());
+}
+
+bool RadosStorageMemory::save_mail(RadosMail *mail) {
+  if (!connected || mail == nullptr) {
+    return false;
+  }
+  return save_mail_object(nspace, mail) == 0;
+}
+
+bool RadosStorageMemory::save_mail(librados::ObjectWriteOperation *write_op_xattr, RadosMail *mail) {
+  if (!connected || write_op_xattr == nullptr || mail == nullptr) {
+    return false;
+  }
+  int ret = split_buffer_and_exec_op(mail, write_op_xattr, get_max_write_size_bytes());
+  if (ret != 0) {
+    mail->set_active_op(0);
+  }
+  return ret == 0;
+}
+
+void RadosStorageMemory::aio_save_mail(RadosMail *mail, RadosMemoryCompletion *completion) {
+  if (!connected || mail == nullptr) {
+    completion->complete(-ENOTCONN);
+    return;
+  }
+  std::string ns = nspace;
+  backend->aio_submit([this, ns, mail]() { return save_mail_object(ns, mail); }, completion);
+}
+
+void RadosStorageMemory::aio_read_mail(const std::string &oid, librados::bufferlist *buffer,
+                                       RadosMemoryCompletion *completion) {
+  if (!connected) {
+    completion->complete(-ENOTCONN);
+    return;
+  }
+  std::string ns = nspace;
+  backend->aio_submit(
+      [this, ns, oid, buffer]() {
+        RadosStatsTimer timer(RADOS_OP_READ);
+        int ret = backend->inject(RADOS_OP_READ);
+        if (ret == 0) {
+          ret = backend->read(pool_name, ns, oid, buffer);
+        }
+        return timer.done(ret, ret > 0 ? ret : 0);
+      },
+      completion);
+}
+
+int RadosStorageMemory::delete_mail(RadosMail *mail) {
+  if (mail == nullptr) {
+    return -1;
+  }
+  return delete_mail(*mail->get_oid());
+}
+
+int RadosStorageMemory::delete_mail(const std::string &oid) {
+  if (!connected || oid.empty()) {
+    return -1;
+  }
+  RadosStatsTimer timer(RADOS_OP_REMOVE, oid);
+  int ret = backend->inject(RADOS_OP_REMOVE);
+  if (ret == 0) {
+    ret = backend->remove(pool_name, nspace, oid);
+  }
+  return timer.done(ret);
+}
+
+int RadosStorageMemory::move(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+                             std::list<RadosMetadata> &to_update, bool delete_source) {
+  if (!connected) {
+    return -1;
+  }
+  bool same_ns = strcmp(src_ns, dest_ns) == 0;
+  RadosStatsTimer timer(same_ns ? RADOS_OP_WRITE : RADOS_OP_COPY_FROM, dest_oid);
+  int ret = backend->inject(same_ns ? RADOS_OP_WRITE : RADOS_OP_COPY_FROM);
+  if (ret == 0 && !same_ns) {
+    ret = backend->copy(pool_name, src_ns, src_oid, dest_ns, dest_oid);
+  } else if (ret == 0) {
+    ret = backend->stat(pool_name, src_ns, src_oid, nullptr, nullptr);
+  }
+  if (ret == 0 && !to_update.empty()) {
+    std::map<std::string, librados::bufferlist> xattrs;
+    for (auto &m : to_update) {
+      xattrs[m.key] = m.bl;
+    }
+    ret = backend->setxattrs(pool_name, dest_ns, dest_oid, xattrs);
+  }
+  timer.done(ret);
+  if (ret == 0 && delete_source && !same_ns) {
+    RadosStatsTimer remove_timer(RADOS_OP_REMOVE);
+    ret = backend->inject(RADOS_OP_REMOVE);
+    if (ret == 0) {
+      ret = backend->remove(pool_name, src_ns, src_oid);
+    }
+    remove_timer.done(ret);
+  }
+  return ret;
+}
+
+int RadosStorageMemory::copy(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+                             std::list<RadosMetadata> &to_update) {
+  if (!connected) {
+    return -1;
+  }
+  RadosStatsTimer timer(RADOS_OP_COPY_FROM, dest_oid);
+  int ret = backend->inject(RADOS_OP_COPY_FROM);
+  if (ret == 0) {
+    ret = backend->copy(pool_name, src_ns, src_oid, dest_ns, dest_oid);
+  }
+  if (ret == 0 && !to_update.empty()) {
+    std::map<std::string, librados::bufferlist> xattrs;
+    for (auto &m : to_update) {
+      xattrs[m.key] = m.bl;
+    }
+    ret = backend->setxattrs(pool_name, dest_ns, dest_oid, xattrs);
+  }
+  return timer.done(ret);
+}
+
+int RadosStorageMemory::find_mails(const RadosMetadata *attr, std::set<std::string> *oids) {
+  if (!connected) {
+    return -1;
+  }
+  std::set<std::string> all;
+  int ret = backend->list(pool_name, nspace, &all);
+  if (ret < 0 || attr == nullptr) {
+    oids->insert(all.begin(), all.end());
+    return ret;
+  }
+  for (auto &oid : all) {
+    std::map<std::string, librados::bufferlist> xattrs;
+    if (backend->getxattrs(pool_name, nspace, oid, &xattrs) < 0) {
+      continue;
+    }
+    auto it = xattrs.find(attr->key);
+    if (it != xattrs.end() && it->second.contents_equal(attr->bl)) {
+      oids->insert(oid);
+    }
+  }
+  return 0;
+}
+
+librados::NObjectIterator RadosStorageMemory::find_mails(const RadosMetadata *attr) {
+  return librados::NObjectIterator::__EndObjectIterator;
+}
+
+std::set<std::string> RadosStorageMemory::find_mails_async(const RadosMetadata *attr, std::string &pool_name_,
+                                                           int num_threads, void (*ptr)(std::string &)) {
+  std::set<std::string> oids;
+  find_mails(attr, &oids);
+  return oids;
+}
+
+int RadosStorageMemory::find_mails_parallel(const RadosMetadata *attr, unsigned int list_threads, size_t batch_size,
+                                            const std::function<bool(std::vector<std::string> *)> &consumer) {
+  std::set<std::string> oids;
+  int ret = find_mails(attr, &oids);
+  if (ret < 0) {
+    return ret;
+  }
+  std::vector<std::string> batch;
+  for (auto &oid : oids) {
+    batch.push_back(oid);
+    if (batch.size() >= batch_size) {
+      if (!consumer(&batch)) {
+        return 0;
+      }
+      batch.clear();
+    }
+  }
+  if (!batch.empty()) {
+    consumer(&batch);
+  }
+  return 0;
+}
+
+bool RadosStorageMemory::append_to_object(std::string &oid, librados::bufferlist &bufferlist, int length) {
+  if (!connected) {
+    return false;
+  }
+  librados::bufferlist bl;
+  bl.substr_of(bufferlist, 0, length);
+  RadosStatsTimer timer(RADOS_OP_APPEND, oid);
+  int ret = backend->inject(RADOS_OP_APPEND);
+  if (ret == 0) {
+    ret = backend->append(pool_name, nspace, oid, bl);
+  }
+  return timer.done(ret, length) >= 0;
+}
+
+int RadosStorageMemory::split_buffer_and_exec_op(RadosMail *current_object,
+                                                 librados::ObjectWriteOperation *write_op_xattr,
+                                                 const uint64_t &max_write) {
+  if (!connected || current_object->get_mail_size() == 0 || max_write == 0) {
+    return -1;
+  }
+  // the object is written at once, the recorded metadata is merged into it
+  RadosMemoryWrite write;
+  take_recorded(write_op_xattr, &write);
+  int ret = save_mail_object(nspace, current_object);
+  if (ret == 0 && (!write.xattrs.empty() || !write.omap.empty())) {
+    write.mtime = current_object->get_rados_save_date();
+    ret = backend->operate(pool_name, nspace, *current_object->get_oid(), write);
+  }
+  return ret < 0 ? -1 : 0;
+}
+
+void RadosStorageMemory::prepare_write(librados::ObjectWriteOperation *write_op, uint64_t offset,
+                                       librados::bufferlist &buffer) {
+  std::lock_guard<std::mutex> lock(record_mutex);
+  recorded_writes[write_op].writes.push_back(std::make_pair(offset, buffer));
+}
+
+void RadosStorageMemory::prepare_read(librados::ObjectReadOperation *read_op, librados::bufferlist *buffer,
+                                      int *read_err, uint64_t *psize, time_t *pmtime, int *stat_err) {
+  std::lock_guard<std::mutex> lock(record_mutex);
+  RecordedRead &read = recorded_reads[read_op];
+  read.buffer = buffer;
+  read.read_err = read_err;
+  read.psize = psize;
+  read.pmtime = pmtime;
+  read.stat_err = stat_err;
+}
+
+void RadosStorageMemory::record_metadata(librados::ObjectWriteOperation *write_op, RadosMail *mail) {
+  std::lock_guard<std::mutex> lock(record_mutex);
+  RadosMemoryWrite &write = recorded_writes[write_op];
+  write = RadosMemoryWrite();
+  write.xattrs = *mail->get_metadata();
+  write.omap = *mail->get_extended_metadata();
+  write.mtime = mail->get_rados_save_date();
+}
+
+bool RadosStorageMemory::take_recorded(const void *op, RadosMemoryWrite *write) {
+  std::lock_guard<std::mutex> lock(record_mutex);
+  auto it = recorded_writes.find(op);
+  if (it == recorded_writes.end()) {
+    return false;
+  }
+  *write = it->second;
+  recorded_writes.erase(it);
+  return true;
+}
+
+int RadosStorageMemory::operate_recorded(const std::string &oid, librados::ObjectWriteOperation *write_op) {
+  RadosMemoryWrite write;
+  if (!take_recorded(write_op, &write)) {
+    return -EOPNOTSUPP;
+  }
+  uint64_t bytes = 0;
+  for (auto &w : write.writes) {
+    bytes += w.second.length();
+  }
+  RadosStatsTimer timer(RADOS_OP_WRITE, oid);
+  int ret = backend->inject(RADOS_OP_WRITE);
+  if (ret == 0) {
+    ret = backend->operate(pool_name, nspace, oid, write);
+  }
+  return timer.done(ret, bytes);
+}
+
+void RadosStorageMemory::set_aio_result(librados::AioCompletion *completion, int ret) {
+  std::lock_guard<std::mutex> lock(record_mutex);
+  // several operations can share a completion, keep the first error
+  auto it = aio_results.find(completion);
+  if (it == aio_results.end()) {
+    aio_results[completion] = ret;
+  } else if (it->second == 0) {
+    it->second = ret;
+  }
+}
+
+int RadosStorageMemory::aio_operate(librados::IoCtx *io_ctx_, const std::string &oid, librados::AioCompletion *c,
+                                    librados::ObjectWriteOperation *op) {
+  if (!connected) {
+    return -1;
+  }
+  int ret = operate_recorded(oid, op);
+  if (ret == -EOPNOTSUPP) {
+    return ret;
+  }
+  set_aio_result(c, ret);
+  return 0;
+}
+
+int RadosStorageMemory::aio_copy(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+                                 std::list<RadosMetadata> &to_update, librados::ObjectWriteOperation *write_op,
+                                 librados::AioCompletion *completion) {
+  if (!connected) {
+    return -1;
+  }
+  set_aio_result(completion, copy(src_oid, src_ns, dest_oid, dest_ns, to_update));
+  return 0;
+}
+
+int RadosStorageMemory::aio_wait(librados::AioCompletion *completion) {
+  std::lock_guard<std::mutex> lock(record_mutex);
+  auto it = aio_results.find(completion);
+  if (it == aio_results.end()) {
+    // nothing was sent with this completion
+    return -EINVAL;
+  }
+  int ret = it->second;
+  aio_results.erase(it);
+  return ret;
+}
+
+bool RadosStorageMemory::aio_is_complete(librados::AioCompletion *completion) {
+  std::lock_guard<std::mutex> lock(record_mutex);
+  return aio_results.find(completion) != aio_results.end();
+}
+
+bool RadosStorageMemory::execute_operation(std::string &oid, librados::ObjectWriteOperation *write_op_xattr) {
+  if (!connected) {
+    return false;
+  }
+  return operate_recorded(oid, write_op_xattr) >= 0;
+}
+
+int RadosStorageMemory::read_operate(const std::string &oid, librados::ObjectReadOperation *read_operation,
+                                     librados::bufferlist *bufferlist) {
+  if (!connected) {
+    return -1;
+  }
+  RecordedRead read;
+  {
+    std::lock_guard<std::mutex> lock(record_mutex);
+    auto it = recorded_reads.find(read_operation);
+    if (it == recorded_reads.end()) {
+      return -EOPNOTSUPP;
+    }
+    read = it->second;
+    recorded_reads.erase(it);
+  }
+  RadosStatsTimer timer(RADOS_OP_READ, oid);
+  int ret = backend->inject(RADOS_OP_READ);
+  if (ret == 0) {
+    ret = backend->read(pool_name, nspace, oid, read.buffer);
+  }
+  if (read.read_err != nullptr) {
+    *read.read_err = ret < 0 ? ret : 0;
+  }
+  if (ret >= 0) {
+    ret = backend->stat(pool_name, nspace, oid, read.psize, read.pmtime);
+    if (read.stat_err != nullptr) {
+      *read.stat_err = ret;
+    }
+  }
+  return timer.done(ret, bufferlist != nullptr ? bufferlist->length() : 0);
+}
+
+bool RadosStorageMemory::wait_for_write_operations_complete(librados::AioCompletion *completion,
+                                                            librados::ObjectWriteOperation *write_operation) {
+  if (completion == nullptr) {
+    return true;  // failed!
+  }
+  bool failed = aio_wait(completion) < 0;
+  completion->release();
+  return failed;
+}
+
+bool RadosStorageMemory::wait_for_rados_operations(const std::list<librmb::RadosMail *> &object_list) {
+  bool ctx_failed = false;
+  for (std::list<librmb::RadosMail *>::const_iterator it = object_list.begin(); it != object_list.end(); ++it) {
+    if ((*it)->has_active_op()) {
+      bool op_failed = wait_for_write_operations_complete((*it)->get_completion(), (*it)->get_write_operation());
+      ctx_failed = ctx_failed || op_failed;
+      (*it)->set_active_op(0);
+      (*it)->set_write_operation(nullptr);
+    }
+    delete (*it)->get_mail_buffer();
+  }
+  return ctx_failed;
+}
+
+uint64_t RadosStorageMemory::ceph_index_size() {
+  uint64_t psize = 0;
+  backend->stat(index_pool, "", nspace, &psize, nullptr);
+  return psize;
+}
+
+int RadosStorageMemory::ceph_index_append(const std::string &oid) {
+  librados::bufferlist bl;
+  bl.append(RadosUtils::convert_to_ceph_index(oid));
+  RadosStatsTimer timer(RADOS_OP_APPEND);
+  return timer.done(backend->append(index_pool, "", nspace, bl), bl.length());
+}
+
+int RadosStorageMemory::ceph_index_append(const std::set<std::string> &oids) {
+  librados::bufferlist bl;
+  bl.append(RadosUtils::convert_to_ceph_index(oids));
+  RadosStatsTimer timer(RADOS_OP_APPEND);
+  return timer.done(backend->append(index_pool, "", nspace, bl), bl.length());
+}
+
+int RadosStorageMemory::ceph_index_overwrite(const std::set<std::string> &oids) {
+  librados::bufferlist bl;
+  bl.append(RadosUtils::convert_to_ceph_index(oids));
+  RadosStatsTimer timer(RADOS_OP_WRITE);
+  return timer.done(backend->write_full(index_pool, "", nspace, bl), bl.length());
+}
+
+std::set<std::string> RadosStorageMemory::ceph_index_read() {
+  librados::bufferlist bl;
+  RadosStatsTimer timer(RADOS_OP_READ);
+  int ret = timer.done(backend->read(index_pool, "", nspace, &bl));
+  if (ret <= 0) {
+    return std::set<std::string>();
+  }
+  return RadosUtils::ceph_index_to_set(bl.to_str());
+}
+
+int RadosStorageMemory::ceph_index_delete() {
+  RadosStatsTimer timer(RADOS_OP_REMOVE);
+  return timer.done(backend->remove(index_pool, "", nspace));
+}
+
+}  // namespace librmb
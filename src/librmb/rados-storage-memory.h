@@ -0,0 +1,182 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_STORAGE_MEMORY_H_
+#define SRC_LIBRMB_RADOS_STORAGE_MEMORY_H_
+
+#include <list>
+#include <map>
+#include <mutex>  // NOLINT
+#include <set>
+#include <string>
+
+#include <rados/librados.hpp>
+
+#include "rados-cluster-memory.h"
+#include "rados-memory-backend.h"
+#include "rados-mail.h"
+#include "rados-storage.h"
+
+namespace librmb {
+
+/**
+ * Rados Storage Memory
+ *
+ * RadosStorage on top of a RadosMemoryBackend for tests and benchmarks
+ * without a ceph cluster.
+ *
+ * librados operations are opaque, so their content is recorded while they
+ * are built: by prepare_write, prepare_read and the memory metadata module
+ * (record_metadata). execute_operation, aio_operate and read_operate apply
+ * the recorded content and fail with -EOPNOTSUPP for operations which were
+ * not recorded. Operations sent with aio_operate and aio_copy run
+ * synchronously, aio_wait and aio_is_complete return their result; the
+ * librados completion itself never completes.
+ *
+ * find_mails returning an iterator is not supported, use find_mails_parallel.
+ * get_io_ctx returns an unconnected io_ctx which must not be used.
+ */
+class RadosStorageMemory : public RadosStorage {
+ public:
+  explicit RadosStorageMemory(RadosClusterMemory *cluster_);
+  virtual ~RadosStorageMemory();
+
+  librados::IoCtx &get_io_ctx() override { return io_ctx; }
+  librados::IoCtx &get_recovery_io_ctx() override { return io_ctx; }
+
+  int stat_mail(const std::string &oid, uint64_t *psize, time_t *pmtime) override;
+  void set_namespace(const std::string &_nspace) override { nspace = _nspace; }
+  std::string get_namespace() override { return nspace; }
+  std::string get_pool_name() override { return pool_name; }
+
+  void set_ceph_wait_method(enum rbox_ceph_aio_wait_method wait_method_) override {}
+  int get_max_write_size() override { return max_write_size; }
+  int get_max_write_size_bytes() override { return max_write_size * 1024 * 1024; }
+  int get_max_object_size() override { return max_object_size; }
+
+  int split_buffer_and_exec_op(RadosMail *current_object, librados::ObjectWriteOperation *write_op_xattr,
+                               const uint64_t &max_write) override;
+
+  int delete_mail(RadosMail *mail) override;
+  int delete_mail(const std::string &oid) override;
+
+  int aio_operate(librados::IoCtx *io_ctx_, const std::string &oid, librados::AioCompletion *c,
+                  librados::ObjectWriteOperation *op) override;
+  librados::NObjectIterator find_mails(const RadosMetadata *attr) override;
+  std::set<std::string> find_mails_async(const RadosMetadata *attr, std::string &pool_name_, int num_threads,
+                                         void (*ptr)(std::string &)) override;
+  int find_mails_parallel(const RadosMetadata *attr, unsigned int list_threads, size_t batch_size,
+                          const std::function<bool(std::vector<std::string> *)> &consumer) override;
+
+  int open_connection(const std::string &poolname) override;
+  int open_connection(const std::string &poolname, const std::string &index_pool) override;
+  int open_connection(const std::string &poolname, const std::string &index_pool, const std::string &clustername,
+                      const std::string &rados_username) override;
+  int open_connection(const std::string &poolname, const std::string &clustername,
+                      const std::string &rados_username) override;
+  void close_connection() override;
+
+  bool wait_for_write_operations_complete(librados::AioCompletion *completion,
+                                          librados::ObjectWriteOperation *write_operation) override;
+  bool wait_for_rados_operations(const std::list<librmb::RadosMail *> &object_list) override;
+
+  int read_mail(const std::string &oid, librados::bufferlist *buffer) override;
+  int move(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+           std::list<RadosMetadata> &to_update, bool delete_source) override;
+  int copy(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+           std::list<RadosMetadata> &to_update) override;
+  int aio_copy(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+               std::list<RadosMetadata> &to_update, librados::ObjectWriteOperation *write_op,
+               librados::AioCompletion *completion) override;
+  int aio_wait(librados::AioCompletion *completion) override;
+  bool aio_is_complete(librados::AioCompletion *completion) override;
+
+  int save_mail(const std::string &oid, librados::bufferlist &buffer) override;
+  bool save_mail(RadosMail *mail) override;
+  bool save_mail(librados::ObjectWriteOperation *write_op_xattr, RadosMail *mail) override;
+  librmb::RadosMail *alloc_rados_mail() override { return new librmb::RadosMail(); }
+  void free_rados_mail(librmb::RadosMail *mail) override { delete mail; }
+
+  uint64_t ceph_index_size() override;
+  int ceph_index_append(const std::string &oid) override;
+  int ceph_index_append(const std::set<std::string> &oids) override;
+  int ceph_index_overwrite(const std::set<std::string> &oids) override;
+  std::set<std::string> ceph_index_read() override;
+  int ceph_index_delete() override;
+
+  bool execute_operation(std::string &oid, librados::ObjectWriteOperation *write_op_xattr) override;
+  bool append_to_object(std::string &oid, librados::bufferlist &bufferlist, int length) override;
+  int read_operate(const std::string &oid, librados::ObjectReadOperation *read_operation,
+                   librados::bufferlist *bufferlist) override;
+  void prepare_write(librados::ObjectWriteOperation *write_op, uint64_t offset, librados::bufferlist &buffer) override;
+  void prepare_read(librados::ObjectReadOperation *read_op, librados::bufferlist *buffer, int *read_err,
+                    uint64_t *psize, time_t *pmtime, int *stat_err) override;
+
+  /*!
+   * records the metadata, extended metadata and save date of mail as content of write_op,
+   * replacing previously recorded content.
+   */
+  void record_metadata(librados::ObjectWriteOperation *write_op, RadosMail *mail);
+
+  /*!
+   * find the mails of the current namespace
+   * @param[in] attr if set, only mails with a matching xattr
+   * @return linux error code or 0 if successful
+   */
+  int find_mails(const RadosMetadata *attr, std::set<std::string> *oids);
+  /*!
+   * saves mail buffer, metadata and extended metadata asynchronously.
+   * mail and its buffer need to be valid until completion is complete.
+   */
+  void aio_save_mail(RadosMail *mail, RadosMemoryCompletion *completion);
+  void aio_read_mail(const std::string &oid, librados::bufferlist *buffer, RadosMemoryCompletion *completion);
+
+  RadosMemoryBackend *get_backend() { return backend; }
+
+ private:
+  struct RecordedRead {
+    librados::bufferlist *buffer;
+    int *read_err;
+    uint64_t *psize;
+    time_t *pmtime;
+    int *stat_err;
+  };
+
+  int save_mail_object(const std::string &ns, RadosMail *mail);
+  /*!
+   * removes and returns the recorded content of op
+   * @return false if nothing was recorded
+   */
+  bool take_recorded(const void *op, RadosMemoryWrite *write);
+  int operate_recorded(const std::string &oid, librados::ObjectWriteOperation *write_op);
+  void set_aio_result(librados::AioCompletion *completion, int ret);
+
+ private:
+  RadosClusterMemory *cluster;
+  RadosMemoryBackend *backend;
+  librados::IoCtx io_ctx;
+  std::string nspace;
+  std::string pool_name;
+  std::string index_pool;
+  int max_write_size;
+  int max_object_size;
+  bool connected;
+
+  // recorded operations, the key is the address of the operation
+  std::map<const void *, RadosMemoryWrite> recorded_writes;
+  std::map<const void *, RecordedRead> recorded_reads;
+  std::map<librados::AioCompletion *, int> aio_results;
+  std::mutex record_mutex;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_STORAGE_MEMORY_H_
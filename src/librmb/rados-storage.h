@@ -12,9 +12,11 @@
 #ifndef SRC_LIBRMB_INTERFACES_RADOS_STORAGE_INTERFACE_H_
 #define SRC_LIBRMB_INTERFACES_RADOS_STORAGE_INTERFACE_H_
 
+#include <functional>
 #include <string>
 #include <map>
 #include <list>
+#include <vector>
 
 #include <rados/librados.hpp>
 #include "rados-cluster.h"
@@ -130,6 +132,16 @@ underTest.ceph_index_add("dkfkjdf")
                                                  int num_threads,
                                                  void (*ptr)(std::string&)) = 0;
 
+  /*! list the mails of the current namespace in parallel. The object listing is split into
+   * list_threads slices, each listed by its own thread.
+   * @param[in] attr filter attribute or nullptr
+   * @param[in] consumer called from the calling thread with batches of at most batch_size oids,
+   *            returns false to stop the listing. At most list_threads batches are buffered.
+   * @return linux error code or 0 if successful
+   */
+  virtual int find_mails_parallel(const RadosMetadata *attr, unsigned int list_threads, size_t batch_size,
+                                  const std::function<bool(std::vector<std::string> *)> &consumer) = 0;
+
 
   /*! open the rados connections with default cluster and username
    * @param[in] poolname the poolname to connect to, in case this one does not exists, it will be created.
@@ -242,6 +254,28 @@ underTest.ceph_index_add("dkfkjdf")
    * */
   virtual int read_operate(const std::string &oid, librados::ObjectReadOperation *read_operation, librados::bufferlist *bufferlist) = 0;
 
+  /*! add a write of buffer at offset to write_op, used instead of write_op->write
+   *  so that storages which cannot interpret librados operations can record it.
+   *
+   * @param[in] write_op operation for execute_operation or aio_operate
+   * @param[in] offset offset in the object
+   * @param[in] buffer data to write, needs to be valid until the operation is executed.
+   * */
+  virtual void prepare_write(librados::ObjectWriteOperation *write_op, uint64_t offset,
+                             librados::bufferlist &buffer) = 0;
+
+  /*! add a read of the complete object and a stat to read_op, see prepare_write.
+   *
+   * @param[in] read_op operation for read_operate
+   * @param[out] buffer object data
+   * @param[out] read_err result of the read
+   * @param[out] psize object size
+   * @param[out] pmtime object modification time
+   * @param[out] stat_err result of the stat
+   * */
+  virtual void prepare_read(librados::ObjectReadOperation *read_op, librados::bufferlist *buffer, int *read_err,
+                            uint64_t *psize, time_t *pmtime, int *stat_err) = 0;
+
   /*! move a object from the given namespace to the other, updates the metadata given in to_update list
    *
    * @param[in] src_oid unique identifier of source object
@@ -265,6 +299,24 @@ underTest.ceph_index_add("dkfkjdf")
    */
   virtual int copy(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
                    std::list<RadosMetadata> &to_update) = 0;
+  /*! send a copy like copy, without waiting for it
+   * @param[in] write_op operation of the copy, needs to be valid until completion is complete.
+   * @param[in] completion valid completion, wait_for_complete and get_return_value give the result.
+   * @return linux errorcode or 0 if the copy was sent
+   */
+  virtual int aio_copy(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+                       std::list<RadosMetadata> &to_update, librados::ObjectWriteOperation *write_op,
+                       librados::AioCompletion *completion) = 0;
+  /*! wait for an operation sent with aio_copy or aio_operate
+   * @param[in] completion completion of the operation, released by the caller.
+   * @return return value of the operation
+   */
+  virtual int aio_wait(librados::AioCompletion *completion) = 0;
+  /*! check if an operation sent with aio_copy or aio_operate is complete
+   * @param[in] completion completion of the operation
+   * @return true if the operation is complete
+   */
+  virtual bool aio_is_complete(librados::AioCompletion *completion) = 0;
   /*! save the mail
    * @param[in] mail valid rados mail.   
    * @return false in case of error
@@ -0,0 +1,222 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rados-trace.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace librmb {
+
+std::atomic<bool> RadosTrace::enabled(false);
+std::atomic<bool> RadosTrace::dump_requested(false);
+std::atomic<uint64_t> RadosTrace::threshold(0);
+std::atomic<uint64_t> RadosTrace::next_id(1);
+std::atomic<uint64_t> RadosTrace::head(0);
+RadosTrace::Slot RadosTrace::ring[RadosTrace::RING_SIZE];
+std::mutex RadosTrace::file_mutex;
+std::string RadosTrace::trace_file;
+thread_local unsigned int RadosTrace::depth = 0;
+thread_local RadosTrace::OpenSpan RadosTrace::open_spans[RadosTrace::MAX_DEPTH];
+
+template <size_t N>
+static void copy_str(char (&dest)[N], const char *src) {
+  strncpy(dest, src, N - 1);
+  dest[N - 1] = '\0';
+}
+
+void RadosTrace::configure(bool enabled_, uint64_t threshold_usecs, const std::string &file) {
+  {
+    std::lock_guard<std::mutex> lock(file_mutex);
+    trace_file = file;
+  }
+  threshold.store(threshold_usecs, std::memory_order_relaxed);
+  enabled.store(enabled_, std::memory_order_relaxed);
+}
+
+uint64_t RadosTrace::now_usecs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+uint64_t RadosTrace::begin(const char *name, const std::string &pool, const std::string &oid) {
+  if (!is_enabled() || depth >= MAX_DEPTH) {
+    return 0;
+  }
+  OpenSpan &open = open_spans[depth];
+  RadosTraceSpan &span = open.span;
+  span.span_id = next_id.fetch_add(1, std::memory_order_relaxed);
+  if (depth == 0) {
+    span.trace_id = span.span_id;
+    span.parent_id = 0;
+  } else {
+    span.trace_id = open_spans[depth - 1].span.trace_id;
+    span.parent_id = open_spans[depth - 1].span.span_id;
+  }
+  copy_str(span.name, name);
+  copy_str(span.pool, pool.c_str());
+  copy_str(span.oid, oid.c_str());
+  span.start = now_usecs();
+  span.usecs = 0;
+  span.bytes = 0;
+  span.ret = 0;
+  open.start = std::chrono::steady_clock::now();
+  depth++;
+  return span.span_id;
+}
+
+void RadosTrace::end(uint64_t span_id, uint64_t bytes, int ret) {
+  if (depth == 0 || open_spans[depth - 1].span.span_id != span_id) {
+    return;
+  }
+  depth--;
+  OpenSpan &open = open_spans[depth];
+  open.span.usecs =
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - open.start).count();
+  open.span.bytes = bytes;
+  open.span.ret = ret;
+  push(open.span);
+
+  if (depth > 0) {
+    return;
+  }
+  uint64_t limit = threshold.load(std::memory_order_relaxed);
+  bool slow = limit > 0 && open.span.usecs > limit;
+  bool requested = dump_requested.exchange(false, std::memory_order_relaxed);
+  if (!slow && !requested) {
+    return;
+  }
+  std::string file;
+  {
+    std::lock_guard<std::mutex> lock(file_mutex);
+    file = trace_file;
+  }
+  if (file.empty()) {
+    return;
+  }
+  if (requested) {
+    dump(file);
+  } else {
+    dump_trace(open.span.trace_id, file);
+  }
+}
+
+void RadosTrace::record(const char *name, const std::string *oid, uint64_t usecs, uint64_t bytes, int ret) {
+  if (depth == 0) {
+    return;
+  }
+  record(open_spans[depth - 1].span, name, oid, usecs, bytes, ret);
+}
+
+bool RadosTrace::get_active(RadosTraceSpan *parent) {
+  if (depth == 0) {
+    return false;
+  }
+  *parent = open_spans[depth - 1].span;
+  return true;
+}
+
+void RadosTrace::record(const RadosTraceSpan &parent, const char *name, const std::string *oid, uint64_t usecs,
+                        uint64_t bytes, int ret) {
+  RadosTraceSpan span;
+  span.trace_id = parent.trace_id;
+  span.span_id = next_id.fetch_add(1, std::memory_order_relaxed);
+  span.parent_id = parent.span_id;
+  copy_str(span.name, name);
+  copy_str(span.pool, parent.pool);
+  copy_str(span.oid, oid != nullptr ? oid->c_str() : "");
+  span.usecs = usecs;
+  span.start = now_usecs() - usecs;
+  span.bytes = bytes;
+  span.ret = ret;
+  push(span);
+}
+
+void RadosTrace::push(const RadosTraceSpan &span) {
+  // seqlock per slot: odd while the slot is written, readers retry or skip
+  uint64_t idx = head.fetch_add(1, std::memory_order_relaxed);
+  Slot &slot = ring[idx % RING_SIZE];
+  slot.seq.store(idx * 2 + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.span = span;
+  slot.seq.store(idx * 2 + 2, std::memory_order_release);
+}
+
+void RadosTrace::snapshot(std::vector<RadosTraceSpan> *spans) {
+  uint64_t end = head.load(std::memory_order_acquire);
+  uint64_t begin = end > RING_SIZE ? end - RING_SIZE : 0;
+  spans->reserve(spans->size() + (end - begin));
+  for (uint64_t idx = begin; idx < end; idx++) {
+    Slot &slot = ring[idx % RING_SIZE];
+    uint64_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq != idx * 2 + 2) {
+      // overwritten or still being written
+      continue;
+    }
+    RadosTraceSpan span = slot.span;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) == seq) {
+      spans->push_back(span);
+    }
+  }
+}
+
+void RadosTrace::clear() {
+  uint64_t end = head.load(std::memory_order_acquire);
+  for (unsigned int i = 0; i < RING_SIZE; i++) {
+    ring[i].seq.store(0, std::memory_order_relaxed);
+  }
+  // slots of older indexes are never valid again
+  head.store(end + RING_SIZE, std::memory_order_release);
+}
+
+static int write_spans(const std::vector<RadosTraceSpan> &spans, uint64_t trace_id, const std::string &file) {
+  std::ofstream out(file.c_str(), std::ios::out | std::ios::app);
+  if (!out.is_open()) {
+    return errno != 0 ? -errno : -EIO;
+  }
+  for (auto &span : spans) {
+    if (trace_id == 0 || span.trace_id == trace_id) {
+      out << RadosTrace::to_string(span) << std::endl;
+    }
+  }
+  return out.good() ? 0 : -EIO;
+}
+
+int RadosTrace::dump(const std::string &file) {
+  std::vector<RadosTraceSpan> spans;
+  snapshot(&spans);
+  std::lock_guard<std::mutex> lock(file_mutex);
+  return write_spans(spans, 0, file);
+}
+
+int RadosTrace::dump_trace(uint64_t trace_id, const std::string &file) {
+  std::vector<RadosTraceSpan> spans;
+  snapshot(&spans);
+  std::lock_guard<std::mutex> lock(file_mutex);
+  return write_spans(spans, trace_id, file);
+}
+
+std::string RadosTrace::to_string(const RadosTraceSpan &span) {
+  std::ostringstream ss;
+  ss << "trace=" << span.trace_id << " span=" << span.span_id << " parent=" << span.parent_id
+     << " name=" << span.name << " pool=" << span.pool << " oid=" << span.oid << " start=" << span.start
+     << " usecs=" << span.usecs << " bytes=" << span.bytes << " ret=" << span.ret;
+  return ss.str();
+}
+
+}  // namespace librmb
@@ -0,0 +1,173 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_RADOS_TRACE_H_
+#define SRC_LIBRMB_RADOS_TRACE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <mutex>  // NOLINT
+#include <string>
+#include <vector>
+
+namespace librmb {
+
+struct RadosTraceSpan {
+  uint64_t trace_id;
+  uint64_t span_id;
+  // 0 for the root span of a trace
+  uint64_t parent_id;
+  char name[24];
+  char pool[40];
+  char oid[80];
+  // usecs since epoch
+  uint64_t start;
+  uint64_t usecs;
+  uint64_t bytes;
+  int ret;
+};
+
+/**
+ * Rados Trace
+ *
+ * Span tracing of mail storage operations. A trace starts with the
+ * outermost RadosTraceScope of a thread, nested scopes and every rados
+ * operation measured with a RadosStatsTimer while the trace is active are
+ * recorded as its child spans. Asynchronous operations record their span
+ * on completion as child of the span active when they were sent.
+ *
+ * Spans are written to a fixed size lock free ring buffer, older spans are
+ * overwritten. The ring buffer can be dumped on demand (dump,
+ * request_dump), and traces exceeding the latency threshold are appended
+ * to the trace file automatically.
+ *
+ * Tracing is disabled by default and costs one atomic load per scope then.
+ */
+class RadosTrace {
+ public:
+  static const unsigned int RING_SIZE = 8192;
+  static const unsigned int MAX_DEPTH = 16;
+
+  /*!
+   * @param[in] threshold_usecs dump traces taking longer, 0 disables automatic dumps
+   * @param[in] file traces are appended to this file, empty disables dumps
+   */
+  static void configure(bool enabled, uint64_t threshold_usecs, const std::string &file);
+  static bool is_enabled() { return enabled.load(std::memory_order_relaxed); }
+  /*!
+   * true if a trace is active on the calling thread
+   */
+  static bool is_active() { return depth > 0; }
+
+  /*!
+   * start a span, a new trace if none is active on the calling thread.
+   * Spans need to be ended in reverse order.
+   * @return span id or 0 if tracing is disabled
+   */
+  static uint64_t begin(const char *name, const std::string &pool, const std::string &oid);
+  static void end(uint64_t span_id, uint64_t bytes, int ret);
+  /*!
+   * record a finished child span of the active span of the calling thread.
+   */
+  static void record(const char *name, const std::string *oid, uint64_t usecs, uint64_t bytes, int ret);
+  /*!
+   * copy the active span of the calling thread, to record children of it on other threads.
+   * @return false if no trace is active
+   */
+  static bool get_active(RadosTraceSpan *parent);
+  /*!
+   * record a finished child span of parent, see get_active. Thread safe.
+   */
+  static void record(const RadosTraceSpan &parent, const char *name, const std::string *oid, uint64_t usecs,
+                     uint64_t bytes, int ret);
+
+  /*!
+   * consistent copy of the spans in the ring buffer, oldest first
+   */
+  static void snapshot(std::vector<RadosTraceSpan> *spans);
+  /*!
+   * append all spans in the ring buffer to file
+   * @return linux error code or 0 if successful
+   */
+  static int dump(const std::string &file);
+  /*!
+   * append the spans of the given trace to file
+   * @return linux error code or 0 if successful
+   */
+  static int dump_trace(uint64_t trace_id, const std::string &file);
+  /*!
+   * dump the ring buffer to the trace file when the next trace ends.
+   * Async signal safe.
+   */
+  static void request_dump() { dump_requested.store(true, std::memory_order_relaxed); }
+  static void clear();
+
+  static std::string to_string(const RadosTraceSpan &span);
+
+ private:
+  static void push(const RadosTraceSpan &span);
+  static uint64_t now_usecs();
+
+ private:
+  struct Slot {
+    std::atomic<uint64_t> seq;
+    RadosTraceSpan span;
+  };
+  struct OpenSpan {
+    RadosTraceSpan span;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  static std::atomic<bool> enabled;
+  static std::atomic<bool> dump_requested;
+  static std::atomic<uint64_t> threshold;
+  static std::atomic<uint64_t> next_id;
+  static std::atomic<uint64_t> head;
+  static Slot ring[RING_SIZE];
+
+  static std::mutex file_mutex;
+  static std::string trace_file;
+
+  static thread_local unsigned int depth;
+  static thread_local OpenSpan open_spans[MAX_DEPTH];
+};
+
+/**
+ * traces the lifetime of the scope as span, see RadosTrace::begin.
+ */
+class RadosTraceScope {
+ public:
+  RadosTraceScope(const char *name, const std::string &pool, const std::string &oid = "")
+      : span_id(RadosTrace::begin(name, pool, oid)), bytes(0), ret(0) {}
+  ~RadosTraceScope() { finish(); }
+
+  void set_result(int ret_, uint64_t bytes_ = 0) {
+    ret = ret_;
+    bytes = bytes_;
+  }
+  void finish() {
+    if (span_id != 0) {
+      RadosTrace::end(span_id, bytes, ret);
+      span_id = 0;
+    }
+  }
+
+ private:
+  uint64_t span_id;
+  uint64_t bytes;
+  int ret;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_RADOS_TRACE_H_
@@ -122,5 +122,9 @@ static const char *rbox_metadata_key_to_char(rbox_metadata_key type) {
   }
 }
 enum rbox_ceph_aio_wait_method { WAIT_FOR_COMPLETE_AND_CB, WAIT_FOR_SAFE_AND_CB };
+/**
+ * connection state of a prewarmed cluster
+ */
+enum rbox_cluster_state { CLUSTER_STATE_DISABLED, CLUSTER_STATE_CONNECTING, CLUSTER_STATE_READY, CLUSTER_STATE_FAILED };
 }  // namespace
 #endif /* SRC_LIBRMB_RADOS_TYPES_H_ */
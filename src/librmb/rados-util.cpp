@@ -14,6 +14,7 @@
 #endif
 
 #include "rados-util.h"
+#include "rados-stats.h"
 #include <limits.h>
 #include <string>
 #include <list>
@@ -116,11 +117,12 @@ namespace librmb {
   #else
     first_read.omap_get_keys("", LONG_MAX, &extended_keys, &err);
   #endif
+    RadosStatsTimer timer(RADOS_OP_OMAP_GET);
     int ret = io_ctx->operate(oid.c_str(), &first_read, NULL);
     if (ret < 0) {
-      return ret;
+      return timer.done(ret);
     }
-    return io_ctx->omap_get_vals_by_keys(oid, extended_keys, kv_map);
+    return timer.done(io_ctx->omap_get_vals_by_keys(oid, extended_keys, kv_map));
   }
 
   void RadosUtils::resolve_flags(const uint8_t &flags, std::string *flat) {
@@ -158,7 +160,8 @@ namespace librmb {
 
     encode(stream.str(), in);
 
-    return ioctx->exec(oid, "numops", "add", in, out);
+    RadosStatsTimer timer(RADOS_OP_EXEC);
+    return timer.done(ioctx->exec(oid, "numops", "add", in, out));
   }
 
   int RadosUtils::osd_sub(librados::IoCtx *ioctx, const std::string &oid, const std::string &key,
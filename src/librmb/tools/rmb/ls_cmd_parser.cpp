@@ -11,6 +11,8 @@
 
 #include "ls_cmd_parser.h"
 
+#include <stdlib.h>
+
 #include <iostream>
 #include <string>
 
@@ -28,17 +30,109 @@ Predicate *CmdLineParser::create_predicate(const std::string &_ls_value) {
   size_t pos = _ls_value.find("=");
   pos = (pos == std::string::npos) ? _ls_value.find(">") : pos;
   pos = (pos == std::string::npos) ? _ls_value.find("<") : pos;
+  if (pos == std::string::npos || pos == 0) {
+    std::cerr << "search criteria: '" << _ls_value << "' is not of the form key=value, key>value or key<value"
+              << std::endl;
+    return p;
+  }
 
   p->key = _ls_value.substr(0, pos);
   p->op = _ls_value[pos];
   p->value = _ls_value.substr(pos + 1, _ls_value.length());
-  p->valid = true;
-
-  this->keys += p->key + " ";
+  p->valid = p->compile();
+  if (p->valid) {
+    this->keys += p->key + " ";
+  }
   // std::cout << " predicate: key " << p->key << " op " << p->op << " value " << p->value << std::endl;
   return p;
 }
 
+bool Predicate::compile() {
+  compiled = true;
+  op_code = op.empty() ? '=' : op[0];
+  rbox_metadata_key rbox_key = static_cast<librmb::rbox_metadata_key>(*key.c_str());
+
+  if (rbox_key == RBOX_METADATA_RECEIVED_TIME || rbox_key == RBOX_METADATA_OLDV1_SAVE_TIME) {
+    type = PREDICATE_DATE;
+    time_t query_date = 0;
+    // seconds are optional
+    if (!convert_str_to_time_t(value, &query_date) && !convert_str_to_time_t(value + ":00", &query_date)) {
+      std::cerr << "search criteria: " << key << " value " << value << " is not a date (%Y-%m-%d %H:%M[:%S])"
+                << std::endl;
+      return false;
+    }
+    num_value = query_date;
+  } else if (rbox_key == RBOX_METADATA_VIRTUAL_SIZE || rbox_key == RBOX_METADATA_PHYSICAL_SIZE ||
+             rbox_key == RBOX_METADATA_MAIL_UID) {
+    type = PREDICATE_NUMBER;
+    char *end = NULL;
+    num_value = strtoll(value.c_str(), &end, 10);
+    if (end == value.c_str() || *end != '\0') {
+      std::cerr << "search criteria: " << key << " value " << value << " is not a number" << std::endl;
+      return false;
+    }
+  } else {
+    // only = is supported for strings
+    type = PREDICATE_STRING;
+    if (op_code != '=') {
+      std::cerr << "search criteria: " << key << op << value << " only = is supported for strings" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Predicate::eval(const char *_p_value) {
+  if (!compiled) {
+    compile();
+  }
+  if (type == PREDICATE_STRING) {
+    return value.compare(_p_value) == 0;
+  }
+  char *end = NULL;
+  int64_t obj_value = strtoll(_p_value, &end, 10);
+  if (end == _p_value) {
+    std::cerr << "eval: search criteria: " << key << " '" << _p_value << "' is not a number" << std::endl;
+    return false;
+  }
+  return compare(obj_value);
+}
+
+bool CmdLineParser::matches(librmb::RadosMail *mail) {
+  if (is_match_all()) {
+    return true;
+  }
+  if (is_mailbox_list()) {
+    return false;
+  }
+  std::map<std::string, ceph::bufferlist> *metadata = mail->get_metadata();
+  for (std::map<std::string, Predicate *>::iterator it = predicates.begin(); it != predicates.end(); ++it) {
+    std::map<std::string, ceph::bufferlist>::iterator attr = metadata->find(it->first);
+    if (attr == metadata->end() || !it->second->eval(attr->second.c_str())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CmdLineParser::get_xattr_filter(librmb::RadosMetadata *attr) {
+  Predicate *filter = nullptr;
+  for (std::map<std::string, Predicate *>::iterator it = predicates.begin(); it != predicates.end(); ++it) {
+    if (it->second->key.size() != 1 || !it->second->is_string_equality()) {
+      continue;
+    }
+    if (filter == nullptr ||
+        it->second->key[0] == static_cast<char>(librmb::RBOX_METADATA_MAILBOX_GUID)) {
+      filter = it->second;
+    }
+  }
+  if (filter == nullptr) {
+    return false;
+  }
+  attr->convert(static_cast<librmb::rbox_metadata_key>(filter->key[0]), filter->value);
+  return true;
+}
+
 void CmdLineParser::set_output_dir(const std::string& out) {
   if (out.length() > 0 && out.at(0) == '~') {
     // Convert tilde to $HOME path (if exists)
@@ -62,37 +156,34 @@ void CmdLineParser::set_output_dir(const std::string& out) {
 }
 
 bool CmdLineParser::parse_ls_string() {
-  std::string pred_sep = ";";
-
-  size_t pos = ls_value.find(pred_sep);
-  if (pos == std::string::npos) {
-    // single condition.
-    Predicate *p = create_predicate(ls_value);
-    if (p->valid) {
-      predicates[p->key] = p;
+  if (is_match_all() || is_mailbox_list()) {
+    return true;
+  }
+  const char pred_sep = ';';
+  bool valid = true;
+  size_t offset = 0;
+  while (offset <= ls_value.length()) {
+    size_t pos = ls_value.find(pred_sep, offset);
+    if (pos == std::string::npos) {
+      pos = ls_value.length();
     }
-    return p->valid;
-
-  } else {
-    int offset = 0;
-    std::string tmp = ls_value;
-    while (pos != std::string::npos) {
-      tmp = tmp.substr(0, pos);
-
-      Predicate *p = create_predicate(tmp);
-      if (p->valid) {
-        predicates[p->key] = p;
-      }
-
-      tmp = ls_value.substr(offset + pos + 1, ls_value.length());
-      offset += pos + 1;
-      pos = tmp.find(pred_sep);
+    std::string condition = ls_value.substr(offset, pos - offset);
+    offset = pos + 1;
+    if (condition.empty()) {
+      continue;
+    }
+    Predicate *p = create_predicate(condition);
+    if (!p->valid) {
+      delete p;
+      valid = false;
+      continue;
     }
-    Predicate *p = create_predicate(tmp);
-    if (p->valid) {
-      predicates[p->key] = p;
+    auto it = predicates.find(p->key);
+    if (it != predicates.end()) {
+      delete it->second;
     }
-    return p->valid;
+    predicates[p->key] = p;
   }
+  return valid && !predicates.empty();
 }
 }  // namespace librmb
@@ -12,6 +12,7 @@
 #ifndef SRC_LIBRMB_TOOLS_RMB_LS_CMD_PARSER_H_
 #define SRC_LIBRMB_TOOLS_RMB_LS_CMD_PARSER_H_
 
+#include <stdint.h>
 #include <string>
 #include <list>
 #include <iostream>
@@ -19,6 +20,7 @@
 #include <map>
 
 #include "../../rados-mail.h"
+#include "../../rados-metadata.h"
 #include "rados-util.h"
 
 #ifndef PATH_MAX
@@ -29,67 +31,29 @@ namespace librmb {
 
 class Predicate {
  public:
+  Predicate() : valid(false), compiled(false), type(PREDICATE_STRING), op_code('='), num_value(0) {}
+
   std::string key;
   std::string op;
   std::string value;  // value to check against e.g. key > value
   bool valid;
 
-  bool eval(const std::string &_p_value) {
-    rbox_metadata_key rbox_key = static_cast<librmb::rbox_metadata_key>(*key.c_str());
-
-    if (rbox_key == RBOX_METADATA_RECEIVED_TIME || rbox_key == RBOX_METADATA_OLDV1_SAVE_TIME) {
-      // ref value
-      time_t query_date = 0;
-      convert_str_to_time_t(this->value, &query_date);
-
-      uint64_t val2 = -1;
-      try {
-        val2 = std::stol(_p_value);
-      } catch (std::exception &e) {
-        std::cerr << "eval: search criteria: RBOX_METADATA_RECEIVED_TIME or RBOX_METADATA_OLDV1_SAVE_TIME '" << _p_value
-                  << "' is not a number " << std::endl;
-      }
-      time_t obj_date = static_cast<time_t>(val2);
-
-      double diff = difftime(obj_date, query_date);
-      // std::cout << " comparing : " << query_date << " " << obj_date << std::endl;
-      if (this->op.compare("=") == 0) {
-        return diff == 0;
-      } else if (this->op.compare(">") == 0) {
-        return diff > 0;
-      } else {
-        return diff < 0;
-      }
-      // time
-      return true;
-    } else if (rbox_key == RBOX_METADATA_VIRTUAL_SIZE || rbox_key == RBOX_METADATA_PHYSICAL_SIZE ||
-               rbox_key == RBOX_METADATA_MAIL_UID) {
-      uint64_t val = -1;
-      uint64_t val2 = -1;
-      try {
-        val = std::stol(_p_value);
-        val2 = std::stol(this->value);
-      } catch (std::exception &e) {
-        std::cerr << "eval: search criteria: RBOX_METADATA_VIRTUAL_SIZE or RBOX_METADATA_PHYSICAL_SIZE or "
-                     "RBOX_METADATA_MAIL_UID: _p_value "
-                  << _p_value << " or " << this->value << " is not a number" << std::endl;
-      }
-
-      if (this->op.compare("=") == 0) {
-        // numeric
-        return val == val2;
-      } else if (this->op.compare(">") == 0) {
-        return val > val2;
-      } else {
-        return val < val2;
-      }
-
-    } else {
-      // string
-      // std::cout << " comparing : " << this->value << " with " << _p_value << std::endl;
-      return this->value.compare(_p_value) == 0;
+  /*!
+   * parse the value once according to the type of key (number, date or
+   * string). Called by the parser, eval compiles on first use otherwise.
+   * @return false if the value does not fit the type of key
+   */
+  bool compile();
+  bool eval(const std::string &_p_value) { return eval(_p_value.c_str()); }
+  bool eval(const char *_p_value);
+  /*!
+   * true for = on a string attribute, these can be evaluated by the osd
+   */
+  bool is_string_equality() {
+    if (!compiled) {
+      compile();
     }
-    return false;
+    return type == PREDICATE_STRING && op_code == '=';
   }
 
   bool convert_str_to_time_t(const std::string &date, time_t *val) {
@@ -98,6 +62,25 @@ class Predicate {
   int convert_time_t_to_str(const time_t &t, std::string *ret_val) {
     return librmb::RadosUtils::convert_time_t_to_str(t, ret_val);
   }
+
+ private:
+  enum predicate_type { PREDICATE_STRING, PREDICATE_NUMBER, PREDICATE_DATE };
+
+  bool compare(int64_t obj_value) const {
+    if (op_code == '=') {
+      return obj_value == num_value;
+    } else if (op_code == '>') {
+      return obj_value > num_value;
+    }
+    return obj_value < num_value;
+  }
+
+ private:
+  bool compiled;
+  predicate_type type;
+  char op_code;
+  // number or date (time_t) to compare with
+  int64_t num_value;
 };
 
 class CmdLineParser {
@@ -110,15 +93,35 @@ class CmdLineParser {
     this->ls_value = _ls_value;
   }
   ~CmdLineParser();
+  /*!
+   * parse the ; separated conditions of the search string, - and all match every mail,
+   * mb matches none so only the mailboxes are listed.
+   * @return false if a condition is invalid
+   */
   bool parse_ls_string();
   std::map<std::string, Predicate *> &get_predicates() { return this->predicates; }
 
   bool contains_key(const std::string &key) { return keys.find(key) != keys.npos ? true : false; }
   Predicate *get_predicate(const std::string &key) { return predicates[key]; }
   Predicate *create_predicate(const std::string &ls_value);
+  /*!
+   * true if the metadata of mail contain all keys of the predicates and all predicates match
+   */
+  bool matches(librmb::RadosMail *mail);
+  /*!
+   * the predicate the object listing can be filtered with on the osd
+   * (PLAIN_FILTER_NAME): the mailbox guid or any other string attribute
+   * compared with =. Only usable if each metadata key is a xattr.
+   * @return false if there is no such predicate
+   */
+  bool get_xattr_filter(librmb::RadosMetadata *attr);
 
   void set_output_dir(const std::string &out);
   std::string &get_output_dir() { return this->out_dir; }
+  /* - and all list every mail */
+  bool is_match_all() const { return ls_value.compare("-") == 0 || ls_value.compare("all") == 0; }
+  /* mb lists the mailboxes without their mails */
+  bool is_mailbox_list() const { return ls_value.compare("mb") == 0; }
 
  private:
   std::map<std::string, Predicate *> predicates;
@@ -11,6 +11,11 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <fstream>
 #include <iostream>
@@ -19,7 +24,8 @@
 
 namespace librmb {
 
-MailboxTools::MailboxTools(librmb::RadosMailBox* mailbox, const std::string& base) : mbox(mailbox), base_path(base) {
+MailboxTools::MailboxTools(librmb::RadosMailBox* mailbox, const std::string& base, rmb_mailbox_format format_)
+    : mbox(mailbox), base_path(base), format(format_) {
   if (base_path.empty()) {
     mailbox_path = this->mbox->get_mailbox_guid();
   } else if (base_path[base_path.length() - 1] == '/') {
@@ -29,18 +35,49 @@ MailboxTools::MailboxTools(librmb::RadosMailBox* mailbox, const std::string& bas
   }
 }
 
-int MailboxTools::init_mailbox_dir() {
-  struct stat st = {0};
+MailboxTools::~MailboxTools() {
+  if (mbox_file.is_open()) {
+    // unfinished export, keep only the temporary file
+    mbox_file.close();
+  }
+}
+
+bool MailboxTools::parse_format(const std::string& name, rmb_mailbox_format* format) {
+  if (name.compare("files") == 0) {
+    *format = RMB_MAILBOX_FORMAT_FILES;
+  } else if (name.compare("maildir") == 0) {
+    *format = RMB_MAILBOX_FORMAT_MAILDIR;
+  } else if (name.compare("mbox") == 0) {
+    *format = RMB_MAILBOX_FORMAT_MBOX;
+  } else {
+    return false;
+  }
+  return true;
+}
 
-  if (stat(this->base_path.c_str(), &st) == -1) {
-    if (mkdir(this->base_path.c_str(), 0700) < 0) {
+static int create_dir(const std::string& path) {
+  struct stat st = {0};
+  if (stat(path.c_str(), &st) == -1) {
+    if (mkdir(path.c_str(), 0700) < 0) {
       return -1;
     }
   }
+  return 0;
+}
 
-  st = {0};
-  if (stat(mailbox_path.c_str(), &st) == -1) {
-    if (mkdir(mailbox_path.c_str(), 0700) < 0) {
+int MailboxTools::init_mailbox_dir() {
+  if (!base_path.empty() && create_dir(base_path) < 0) {
+    return -1;
+  }
+  if (format == RMB_MAILBOX_FORMAT_MBOX) {
+    return 0;
+  }
+  if (create_dir(mailbox_path) < 0) {
+    return -1;
+  }
+  if (format == RMB_MAILBOX_FORMAT_MAILDIR) {
+    if (create_dir(mailbox_path + "/tmp") < 0 || create_dir(mailbox_path + "/new") < 0 ||
+        create_dir(mailbox_path + "/cur") < 0) {
       return -1;
     }
   }
@@ -55,7 +92,8 @@ int MailboxTools::delete_mail(librmb::RadosMail* mail_obj) {
   if (build_filename(mail_obj, &filename) < 0) {
     return -1;
   }
-  std::string file_path = mailbox_path + "/" + filename;
+  std::string file_path =
+      mailbox_path + (format == RMB_MAILBOX_FORMAT_MAILDIR ? "/new/" : "/") + filename;
   return unlink(file_path.c_str());
 }
 
@@ -63,6 +101,21 @@ int MailboxTools::delete_mailbox_dir() {
   if (this->mailbox_path.empty() || this->base_path.empty()) {
     return -1;
   }
+  if (format == RMB_MAILBOX_FORMAT_MBOX) {
+    std::string mbox_path = mailbox_path + ".mbox";
+    if (unlink(mbox_path.c_str()) < 0 && errno != ENOENT) {
+      return -1;
+    }
+    return rmdir(this->base_path.c_str()) < 0 ? -1 : 0;
+  }
+  if (format == RMB_MAILBOX_FORMAT_MAILDIR) {
+    std::string sub_dirs[] = {"/tmp", "/new", "/cur"};
+    for (auto& sub_dir : sub_dirs) {
+      if (rmdir((mailbox_path + sub_dir).c_str()) < 0) {
+        return -1;
+      }
+    }
+  }
   if (rmdir(this->mailbox_path.c_str()) < 0) {
     return -1;
   }
@@ -81,13 +134,96 @@ int MailboxTools::save_mail(librmb::RadosMail* mail_obj) {
     return -1;
   }
 
-  std::string file_path = mailbox_path + "/" + filename;
-  std::ofstream myfile(file_path, std::ofstream::binary | std::ofstream::out);
+  if (format == RMB_MAILBOX_FORMAT_MBOX) {
+    return save_mbox(mail_obj);
+  }
+
+  std::string file_path;
+  std::string tmp_path;
+  if (format == RMB_MAILBOX_FORMAT_MAILDIR) {
+    file_path = mailbox_path + "/new/" + filename;
+    tmp_path = mailbox_path + "/tmp/" + filename;
+  } else {
+    file_path = mailbox_path + "/" + filename;
+    tmp_path = mailbox_path + "/." + filename + ".tmp";
+  }
+  std::ofstream myfile(tmp_path, std::ofstream::binary | std::ofstream::out);
   if (!myfile.is_open()) {
     return -1;
   }
-  myfile.write(mail_obj->get_mail_buffer()->to_str().c_str(), mail_obj->get_mail_size());
+  myfile.write(mail_obj->get_mail_buffer()->c_str(), mail_obj->get_mail_size());
   myfile.close();
+  if (myfile.fail()) {
+    unlink(tmp_path.c_str());
+    return -1;
+  }
+  if (rename(tmp_path.c_str(), file_path.c_str()) < 0) {
+    int ret = -errno;
+    unlink(tmp_path.c_str());
+    return ret;
+  }
+  return 0;
+}
+
+int MailboxTools::save_mbox(librmb::RadosMail* mail_obj) {
+  if (!mbox_file.is_open()) {
+    std::string tmp_path = mailbox_path + ".mbox.tmp";
+    mbox_file.open(tmp_path, std::ofstream::binary | std::ofstream::out | std::ofstream::trunc);
+    if (!mbox_file.is_open()) {
+      return -1;
+    }
+  }
+
+  time_t received = 0;
+  char* received_str = NULL;
+  RadosUtils::get_metadata(librmb::RBOX_METADATA_RECEIVED_TIME, mail_obj->get_metadata(), &received_str);
+  if (received_str != NULL) {
+    received = strtol(received_str, NULL, 10);
+  }
+  struct tm tm_received;
+  char date[64];
+  gmtime_r(&received, &tm_received);
+  strftime(date, sizeof(date), "%a %b %e %H:%M:%S %Y", &tm_received);
+  mbox_file << "From MAILER-DAEMON " << date << "\n";
+
+  // mboxrd: quote lines matching ^>*From with one more >
+  const char* data = mail_obj->get_mail_buffer()->c_str();
+  size_t size = mail_obj->get_mail_size();
+  size_t line_start = 0;
+  while (line_start < size) {
+    size_t pos = line_start;
+    while (pos < size && data[pos] == '>') {
+      pos++;
+    }
+    if (size - pos >= 5 && memcmp(data + pos, "From ", 5) == 0) {
+      mbox_file.put('>');
+    }
+    const void* eol = memchr(data + line_start, '\n', size - line_start);
+    size_t line_end = eol == NULL ? size : static_cast<const char*>(eol) - data + 1;
+    mbox_file.write(data + line_start, line_end - line_start);
+    line_start = line_end;
+  }
+  if (size > 0 && data[size - 1] != '\n') {
+    mbox_file.put('\n');
+  }
+  mbox_file.put('\n');
+  return mbox_file.fail() ? -1 : 0;
+}
+
+int MailboxTools::finish() {
+  if (format != RMB_MAILBOX_FORMAT_MBOX || !mbox_file.is_open()) {
+    return 0;
+  }
+  mbox_file.close();
+  std::string tmp_path = mailbox_path + ".mbox.tmp";
+  if (mbox_file.fail()) {
+    unlink(tmp_path.c_str());
+    return -1;
+  }
+  std::string mbox_path = mailbox_path + ".mbox";
+  if (rename(tmp_path.c_str(), mbox_path.c_str()) < 0) {
+    return -errno;
+  }
   return 0;
 }
 
@@ -12,19 +12,41 @@
 #ifndef SRC_LIBRMB_TOOLS_RMB_MAILBOX_TOOLS_H_
 #define SRC_LIBRMB_TOOLS_RMB_MAILBOX_TOOLS_H_
 
+#include <fstream>
 #include <string>
 
 #include "../../rados-mail.h"
 #include "rados-mail-box.h"
 
 namespace librmb {
+
+enum rmb_mailbox_format {
+  // one file per mail in <base>/<mailbox_guid>
+  RMB_MAILBOX_FORMAT_FILES = 0,
+  // maildir <base>/<mailbox_guid>/{tmp,new,cur}
+  RMB_MAILBOX_FORMAT_MAILDIR,
+  // mboxrd file <base>/<mailbox_guid>.mbox
+  RMB_MAILBOX_FORMAT_MBOX
+};
+
 class MailboxTools {
  public:
-  MailboxTools(librmb::RadosMailBox* mailbox, const std::string& base);
-  ~MailboxTools() {}
+  MailboxTools(librmb::RadosMailBox* mailbox, const std::string& base,
+               rmb_mailbox_format format_ = RMB_MAILBOX_FORMAT_FILES);
+  ~MailboxTools();
 
   int init_mailbox_dir();
+  /*!
+   * mails are written to a temporary file and renamed when complete. mbox
+   * files are renamed by finish.
+   * @return linux error code or 0 if successful
+   */
   int save_mail(librmb::RadosMail* mail_obj);
+  /*!
+   * complete the export of the mailbox.
+   * @return linux error code or 0 if successful
+   */
+  int finish();
   int delete_mailbox_dir();
   int delete_mail(librmb::RadosMail* mail_obj);
 
@@ -32,10 +54,20 @@ class MailboxTools {
 
   std::string& get_mailbox_path() { return this->mailbox_path; }
 
+  /*!
+   * parse files, maildir or mbox
+   */
+  static bool parse_format(const std::string& name, rmb_mailbox_format* format);
+
+ private:
+  int save_mbox(librmb::RadosMail* mail_obj);
+
  private:
   librmb::RadosMailBox* mbox;
   std::string base_path;
   std::string mailbox_path;
+  rmb_mailbox_format format;
+  std::ofstream mbox_file;
 };
 };  // namespace librmb
 
@@ -32,34 +32,14 @@ class RadosMailBox {
   }
   virtual ~RadosMailBox() {}
 
-  void add_mail(RadosMail *mail) {
+  /* counts the mail, it is listed if it is invalid or matches the xattr filter. return true if listed */
+  bool add_mail(RadosMail *mail) {
     total_mails++;
-    if (!mail->is_valid()) {
-      mails.push_back(mail);
-      return;
-    }
-    if (parser == nullptr) {
-      mails.push_back(mail);
-      return;
-    }
-    if (parser->get_predicates().size() == 0) {
-      mails.push_back(mail);
-      return;
-    }
-    for (std::map<std::string, Predicate *>::iterator it = parser->get_predicates().begin();
-         it != parser->get_predicates().end(); ++it) {
-      if (mail->get_metadata()->find(it->first) != mail->get_metadata()->end()) {
-        std::string key = it->first;
-        char *value;
-        RadosUtils::get_metadata(key, mail->get_metadata(), &value);
-        if (it->second->eval(value)) {
-          mails.push_back(mail);
-        }
-        return;
-      } else if (it->first.compare("-") == 0) {
-        mails.push_back(mail);
-      }
+    if (mail->is_valid() && parser != nullptr && !parser->matches(mail)) {
+      return false;
     }
+    mails.push_back(mail);
+    return true;
   }
 
   inline std::string to_string() {
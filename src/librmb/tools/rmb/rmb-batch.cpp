@@ -0,0 +1,182 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rmb-batch.h"
+
+#include <errno.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <mutex>  // NOLINT
+#include <sstream>
+#include <thread>  // NOLINT
+
+namespace librmb {
+
+bool RmbBatch::set_options(const Options &options_) {
+  if (options_.threads <= 0) {
+    return false;
+  }
+  options = options_;
+  return true;
+}
+
+void RmbBatch::read_users(std::istream &in, std::vector<std::string> *users) {
+  std::string line;
+  while (std::getline(in, line)) {
+    size_t begin = line.find_first_not_of(" \t\r");
+    if (begin == std::string::npos || line[begin] == '#') {
+      continue;
+    }
+    size_t end = line.find_last_not_of(" \t\r");
+    users->push_back(line.substr(begin, end - begin + 1));
+  }
+}
+
+static std::string json_escape(const std::string &value) {
+  std::string escaped;
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      escaped += buf;
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+std::string RmbBatch::to_json(const RmbBatchResult &result) {
+  const char *status = result.timed_out ? "timeout" : (result.ret < 0 ? "error" : "ok");
+  std::ostringstream ss;
+  ss << "{\"user\":\"" << json_escape(result.user) << "\",\"status\":\"" << status << "\",\"ret\":" << result.ret
+     << ",\"objects\":" << result.objects << ",\"bytes\":" << result.bytes << ",\"invalid\":" << result.invalid
+     << ",\"usecs\":" << result.usecs << "}";
+  return ss.str();
+}
+
+int RmbBatch::run(const std::vector<std::string> &users, std::ostream &progress, std::ostream *summary) {
+  size_t thread_count = std::min(static_cast<size_t>(options.threads), std::max(users.size(), static_cast<size_t>(1)));
+  std::vector<RmbBatchWorker *> workers;
+
+  // connecting is not thread safe, workers are created here
+  for (size_t i = 0; i < thread_count; i++) {
+    RmbBatchWorker *worker = create_worker();
+    if (worker == nullptr) {
+      for (auto w : workers) {
+        delete w;
+      }
+      return -ENOTCONN;
+    }
+    workers.push_back(worker);
+  }
+
+  std::atomic<size_t> next(0);
+  std::mutex mutex;
+  std::condition_variable done_cond;
+  size_t done = 0;
+  uint64_t errors = 0;
+  uint64_t timeouts = 0;
+  RmbBatchResult totals;
+  auto start = std::chrono::steady_clock::now();
+
+  auto run_worker = [&](RmbBatchWorker *worker) {
+    for (size_t idx = next++; idx < users.size(); idx = next++) {
+      RmbBatchResult result;
+      result.user = users[idx];
+      RmbBatchDeadline deadline(options.timeout_secs);
+      auto user_start = std::chrono::steady_clock::now();
+      result.ret = worker->run(result.user, deadline, &result);
+      result.timed_out = result.ret == -ETIMEDOUT;
+      result.usecs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - user_start)
+                         .count();
+
+      std::lock_guard<std::mutex> lock(mutex);
+      done++;
+      if (result.timed_out) {
+        timeouts++;
+      } else if (result.ret < 0) {
+        errors++;
+      }
+      totals.objects += result.objects;
+      totals.bytes += result.bytes;
+      totals.invalid += result.invalid;
+      if (summary != nullptr) {
+        *summary << to_json(result) << std::endl;
+      }
+      done_cond.notify_one();
+    }
+  };
+
+  size_t prefetched = 0;
+  auto prefetch_ahead = [&]() {
+    while (prefetch && prefetch_window > 0 && prefetched < users.size() && prefetched < next + prefetch_window) {
+      size_t end = std::min(users.size(), prefetched + prefetch_window);
+      prefetch(std::vector<std::string>(users.begin() + prefetched, users.begin() + end));
+      prefetched = end;
+    }
+  };
+  prefetch_ahead();
+
+  std::vector<std::thread> threads;
+  for (auto worker : workers) {
+    threads.push_back(std::thread(run_worker, worker));
+  }
+
+  auto print_progress = [&]() {
+    auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start).count();
+    progress << "progress: " << done << "/" << users.size() << " users, " << errors << " errors, " << timeouts
+             << " timeouts, " << totals.objects << " objects, elapsed " << elapsed << "s" << std::endl;
+  };
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (done < users.size()) {
+      if (prefetch && prefetched < users.size()) {
+        lock.unlock();
+        prefetch_ahead();
+        lock.lock();
+        if (done >= users.size()) {
+          break;
+        }
+      }
+      if (options.progress_secs == 0) {
+        done_cond.wait(lock);
+      } else if (done_cond.wait_for(lock, std::chrono::seconds(options.progress_secs)) == std::cv_status::timeout) {
+        print_progress();
+      }
+    }
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  for (auto worker : workers) {
+    delete worker;
+  }
+
+  print_progress();
+  if (summary != nullptr) {
+    totals.usecs =
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    *summary << "{\"users\":" << users.size() << ",\"ok\":" << (users.size() - errors - timeouts)
+             << ",\"errors\":" << errors << ",\"timeouts\":" << timeouts << ",\"objects\":" << totals.objects
+             << ",\"bytes\":" << totals.bytes << ",\"invalid\":" << totals.invalid << ",\"usecs\":" << totals.usecs
+             << "}" << std::endl;
+  }
+  return errors + timeouts;
+}
+
+}  // namespace librmb
@@ -0,0 +1,120 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_TOOLS_RMB_RMB_BATCH_H_
+#define SRC_LIBRMB_TOOLS_RMB_RMB_BATCH_H_
+
+#include <stdint.h>
+
+#include <chrono>  // NOLINT
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace librmb {
+
+struct RmbBatchResult {
+  RmbBatchResult() : ret(0), timed_out(false), objects(0), bytes(0), invalid(0), usecs(0) {}
+
+  std::string user;
+  int ret;
+  bool timed_out;
+  uint64_t objects;
+  uint64_t bytes;
+  // objects without valid metadata
+  uint64_t invalid;
+  uint64_t usecs;
+};
+
+/**
+ * per user time limit of a batch run. Jobs check it between operations,
+ * a user running into it is stopped and reported as timed out.
+ */
+class RmbBatchDeadline {
+ public:
+  explicit RmbBatchDeadline(unsigned int timeout_secs)
+      : unlimited(timeout_secs == 0), end(std::chrono::steady_clock::now() + std::chrono::seconds(timeout_secs)) {}
+  bool expired() const { return !unlimited && std::chrono::steady_clock::now() >= end; }
+
+ private:
+  bool unlimited;
+  std::chrono::steady_clock::time_point end;
+};
+
+/**
+ * processes the users of a batch run, one instance per thread.
+ */
+class RmbBatchWorker {
+ public:
+  virtual ~RmbBatchWorker() {}
+  /*!
+   * @return linux error code or 0 if successful
+   */
+  virtual int run(const std::string &user, const RmbBatchDeadline &deadline, RmbBatchResult *result) = 0;
+};
+
+/**
+ * rmb batch
+ *
+ * Runs a maintenance job (RmbBatchWorker) for a list of users with a fixed
+ * number of threads. Workers are created on the calling thread and share
+ * the process wide rados connection. Progress is written periodically, the
+ * summary is written as one json object per user followed by the totals.
+ */
+class RmbBatch {
+ public:
+  struct Options {
+    Options() : threads(4), timeout_secs(0), progress_secs(10) {}
+
+    int threads;
+    // per user, 0 = no limit
+    unsigned int timeout_secs;
+    // 0 = no progress output
+    unsigned int progress_secs;
+  };
+
+  explicit RmbBatch(std::function<RmbBatchWorker *()> create_worker_)
+      : create_worker(create_worker_), prefetch_window(0) {}
+
+  bool set_options(const Options &options_);
+  /*!
+   * called on the calling thread with the next users before the workers reach them,
+   * e.g. to read their namespace mappings in parallel.
+   * @param[in] window number of users passed per call and kept ahead of the workers
+   */
+  void set_prefetch(std::function<void(const std::vector<std::string> &users)> prefetch_, size_t window) {
+    prefetch = prefetch_;
+    prefetch_window = window;
+  }
+
+  /*!
+   * @param[out] summary json lines, may be nullptr
+   * @return number of users which failed or timed out, linux error code if the workers cannot be created
+   */
+  int run(const std::vector<std::string> &users, std::ostream &progress, std::ostream *summary);
+
+  /*!
+   * read one user per line, empty lines and lines starting with # are skipped
+   */
+  static void read_users(std::istream &in, std::vector<std::string> *users);
+  static std::string to_json(const RmbBatchResult &result);
+
+ private:
+  std::function<RmbBatchWorker *()> create_worker;
+  std::function<void(const std::vector<std::string> &users)> prefetch;
+  size_t prefetch_window;
+  Options options;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_TOOLS_RMB_RMB_BATCH_H_
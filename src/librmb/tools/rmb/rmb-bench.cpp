@@ -0,0 +1,352 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rmb-bench.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cmath>
+#include <iomanip>
+#include <list>
+#include <random>
+#include <sstream>
+#include <thread>  // NOLINT
+
+#include "rados-mail.h"
+#include "rados-metadata.h"
+#include "rados-stats.h"
+#include "rados-util.h"
+
+namespace librmb {
+
+static const char *bench_op_names[RMB_BENCH_OP_COUNT] = {"deliver", "fetch",  "fetch_metadata",
+                                                         "flags",   "copy",   "expunge"};
+
+// relative weights of the operations per workload, mixed roughly follows an imap/lmtp server
+static const struct {
+  const char *name;
+  uint64_t weights[RMB_BENCH_OP_COUNT];
+} bench_workloads[] = {
+    {"deliver", {1, 0, 0, 0, 0, 0}}, {"fetch", {0, 1, 0, 0, 0, 0}},   {"fetch_metadata", {0, 0, 1, 0, 0, 0}},
+    {"flags", {0, 0, 0, 1, 0, 0}},   {"copy", {0, 0, 0, 0, 1, 0}},    {"expunge", {0, 0, 0, 0, 0, 1}},
+    {"mixed", {20, 35, 15, 15, 5, 10}},
+};
+
+RmbBench::RmbBench(std::function<RadosStorage *()> create_storage_,
+                   std::function<RadosStorageMetadataModule *(RadosStorage *)> create_metadata_,
+                   std::function<void(RadosStorage *)> free_storage_)
+    : create_storage(create_storage_), create_metadata(create_metadata_), free_storage(free_storage_), populating(0) {
+  set_workload("mixed");
+  parse_size_distribution(options.mail_size, &size_dist);
+}
+
+const char *RmbBench::op_name(rmb_bench_op op) { return bench_op_names[op]; }
+
+bool RmbBench::set_workload(const std::string &workload) {
+  for (auto &w : bench_workloads) {
+    if (workload == w.name) {
+      uint64_t total = 0;
+      for (int i = 0; i < RMB_BENCH_OP_COUNT; i++) {
+        total += w.weights[i];
+        op_weights[i] = total;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+bool RmbBench::set_options(const Options &options_) {
+  std::vector<std::pair<uint64_t, uint64_t>> dist;
+  if (options_.threads <= 0 || options_.mails < 0 || !parse_size_distribution(options_.mail_size, &dist)) {
+    return false;
+  }
+  options = options_;
+  size_dist = dist;
+  return true;
+}
+
+bool RmbBench::parse_size_distribution(const std::string &spec, std::vector<std::pair<uint64_t, uint64_t>> *dist) {
+  std::stringstream ss(spec);
+  std::string item;
+  uint64_t total = 0;
+  dist->clear();
+  while (std::getline(ss, item, ',')) {
+    char *end = nullptr;
+    uint64_t size = strtoull(item.c_str(), &end, 10);
+    uint64_t weight = 1;
+    if (*end == ':') {
+      weight = strtoull(end + 1, &end, 10);
+    }
+    if (*end != '\0' || size == 0 || weight == 0) {
+      return false;
+    }
+    total += weight;
+    dist->push_back(std::make_pair(size, total));
+  }
+  return !dist->empty();
+}
+
+uint64_t RmbBench::percentile(const std::vector<uint64_t> &latencies, double pct) {
+  if (latencies.empty()) {
+    return 0;
+  }
+  // nearest rank, the epsilon keeps e.g. 99.9% of 1000 at rank 999 despite the rounding of pct
+  size_t idx = static_cast<size_t>(std::ceil(pct * latencies.size() / 100.0 - 1e-9));
+  return latencies[idx > 0 ? idx - 1 : 0];
+}
+
+void RmbBench::run_thread(int thread_id, RadosStorage *storage, RadosStorageMetadataModule *ms,
+                          ThreadResult *result) {
+  std::string ns = options.ns_prefix + "_" + std::to_string(thread_id);
+  storage->set_namespace(ns);
+
+  std::mt19937_64 rng(options.seed + thread_id);
+  uint64_t max_size = 0;
+  for (auto &s : size_dist) {
+    max_size = std::max(max_size, s.first);
+  }
+  std::string body;
+  body.reserve(max_size);
+  body = "From: bench@example.com\r\nTo: rmb@example.com\r\nSubject: rmb bench\r\n\r\n";
+  while (body.size() < max_size) {
+    body += "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt.\r\n";
+  }
+
+  std::vector<std::string> oids;
+  uint64_t next_uid = 1;
+  size_t scan_pos = 0;
+
+  auto new_mail = [&](RadosMail *mail, uint64_t size) {
+    std::string oid = ns + "_" + std::to_string(next_uid);
+    mail->set_oid(oid);
+    mail->set_mail_size(size);
+    mail->set_rados_save_date(time(nullptr));
+    mail->add_metadata(RadosMetadata(RBOX_METADATA_GUID, oid));
+    mail->add_metadata(RadosMetadata(RBOX_METADATA_MAIL_UID, static_cast<uint>(next_uid)));
+    mail->add_metadata(RadosMetadata(RBOX_METADATA_RECEIVED_TIME, time(nullptr)));
+    mail->add_metadata(RadosMetadata(RBOX_METADATA_PHYSICAL_SIZE, static_cast<size_t>(size)));
+    mail->add_metadata(RadosMetadata(RBOX_METADATA_VIRTUAL_SIZE, static_cast<size_t>(size)));
+    mail->add_metadata(RadosMetadata(RBOX_METADATA_MAILBOX_GUID, "4dc4fa0e56f0c15a5f4a0000c8b9eb23"));
+    mail->add_metadata(RadosMetadata(RBOX_METADATA_ORIG_MAILBOX, "INBOX"));
+    next_uid++;
+  };
+
+  auto deliver = [&](uint64_t *bytes) {
+    uint64_t r = rng() % size_dist.back().second;
+    uint64_t size = size_dist.back().first;
+    for (auto &s : size_dist) {
+      if (r < s.second) {
+        size = s.first;
+        break;
+      }
+    }
+    librados::bufferlist bl;
+    bl.append(body.c_str(), size);
+    RadosMail mail;
+    new_mail(&mail, size);
+    mail.set_mail_buffer(&bl);
+    bool saved = storage->save_mail(&mail);
+    mail.set_mail_buffer(nullptr);
+    if (!saved) {
+      return -1;
+    }
+    oids.push_back(*mail.get_oid());
+    *bytes = size;
+    return 0;
+  };
+
+  // failed deliveries (e.g. injected errors) are skipped, the workload delivers if no mail is left
+  uint64_t bytes = 0;
+  for (int i = 0; i < options.mails; i++) {
+    deliver(&bytes);
+  }
+
+  {
+    // wait for the other threads, the last one to finish populating starts the clock
+    std::unique_lock<std::mutex> lock(start_mutex);
+    if (--populating == 0) {
+      start_time = std::chrono::steady_clock::now();
+      start_cond.notify_all();
+    } else {
+      start_cond.wait(lock, [this] { return populating == 0; });
+    }
+  }
+
+  for (uint64_t i = 0; i < options.ops; i++) {
+    uint64_t r = rng() % op_weights[RMB_BENCH_OP_COUNT - 1];
+    int op = 0;
+    while (r >= op_weights[op]) {
+      op++;
+    }
+    if (oids.empty()) {
+      op = RMB_BENCH_DELIVER;
+    }
+    size_t idx = oids.empty() ? 0 : rng() % oids.size();
+    int ret = 0;
+    bytes = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    switch (op) {
+      case RMB_BENCH_DELIVER:
+        ret = deliver(&bytes);
+        break;
+      case RMB_BENCH_FETCH: {
+        librados::bufferlist bl;
+        ret = storage->read_mail(oids[idx], &bl);
+        if (ret >= 0) {
+          bytes = bl.length();
+          RadosMail mail;
+          mail.set_oid(oids[idx]);
+          ret = ms->load_metadata(&mail);
+        }
+        break;
+      }
+      case RMB_BENCH_FETCH_METADATA: {
+        // sequential scan, like a mailbox sync
+        RadosMail mail;
+        mail.set_oid(oids[scan_pos++ % oids.size()]);
+        ret = ms->load_metadata(&mail);
+        break;
+      }
+      case RMB_BENCH_FLAGS: {
+        std::string flags;
+        RadosUtils::flags_to_string(static_cast<uint8_t>(rng() & 0x3f), &flags);
+        std::list<RadosMetadata> to_update;
+        to_update.push_back(RadosMetadata(RBOX_METADATA_OLDV1_FLAGS, flags));
+        ret = ms->update_metadata(oids[idx], to_update) ? 0 : -1;
+        break;
+      }
+      case RMB_BENCH_COPY: {
+        std::string src_oid = oids[idx];
+        std::string dest_oid = ns + "_" + std::to_string(next_uid);
+        std::list<RadosMetadata> to_update;
+        to_update.push_back(RadosMetadata(RBOX_METADATA_GUID, dest_oid));
+        to_update.push_back(RadosMetadata(RBOX_METADATA_MAIL_UID, static_cast<uint>(next_uid++)));
+        ret = storage->copy(src_oid, ns.c_str(), dest_oid, ns.c_str(), to_update);
+        if (ret >= 0) {
+          oids.push_back(dest_oid);
+        }
+        break;
+      }
+      case RMB_BENCH_EXPUNGE:
+        ret = storage->delete_mail(oids[idx]);
+        if (ret >= 0) {
+          oids[idx] = oids.back();
+          oids.pop_back();
+        }
+        break;
+    }
+    uint64_t usecs =
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    result->latencies[op].push_back(usecs);
+    result->bytes[op] += bytes;
+    if (ret < 0) {
+      result->errors[op]++;
+    }
+  }
+
+  result->end = std::chrono::steady_clock::now();
+
+  // cleanup is not measured
+  for (auto &oid : oids) {
+    storage->delete_mail(oid);
+  }
+}
+
+void RmbBench::print_results(std::ostream &out, std::vector<ThreadResult> &results, uint64_t elapsed_usecs) {
+  double secs = elapsed_usecs / 1000000.0;
+  uint64_t total_ops = 0;
+
+  out << std::left << std::setw(16) << "op" << std::right << std::setw(10) << "count" << std::setw(8) << "errors"
+      << std::setw(12) << "ops/s" << std::setw(10) << "MB/s" << std::setw(10) << "p50(us)" << std::setw(10)
+      << "p99(us)" << std::setw(10) << "p999(us)" << std::setw(10) << "max(us)" << std::endl;
+  for (int op = 0; op < RMB_BENCH_OP_COUNT; op++) {
+    std::vector<uint64_t> latencies;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+    for (auto &r : results) {
+      latencies.insert(latencies.end(), r.latencies[op].begin(), r.latencies[op].end());
+      errors += r.errors[op];
+      bytes += r.bytes[op];
+    }
+    if (latencies.empty()) {
+      continue;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    total_ops += latencies.size();
+    out << std::left << std::setw(16) << op_name(static_cast<rmb_bench_op>(op)) << std::right << std::setw(10)
+        << latencies.size() << std::setw(8) << errors << std::setw(12) << std::fixed << std::setprecision(1)
+        << latencies.size() / secs << std::setw(10) << std::setprecision(2) << bytes / secs / (1024 * 1024)
+        << std::setw(10) << percentile(latencies, 50) << std::setw(10) << percentile(latencies, 99)
+        << std::setw(10) << percentile(latencies, 99.9) << std::setw(10) << latencies.back() << std::endl;
+  }
+  out << "total: " << total_ops << " ops in " << std::setprecision(3) << secs << "s, " << std::setprecision(1)
+      << total_ops / secs << " ops/s, " << results.size() << " threads" << std::endl;
+}
+
+int RmbBench::run(std::ostream &out) {
+  std::vector<ThreadResult> results(options.threads);
+  std::vector<std::thread> threads;
+  std::vector<RadosStorage *> storages;
+  std::vector<RadosStorageMetadataModule *> modules;
+  int ret = 0;
+
+  // connecting is not thread safe, each thread gets its own storage
+  for (int i = 0; i < options.threads; i++) {
+    RadosStorage *storage = create_storage();
+    if (storage == nullptr) {
+      ret = -1;
+      break;
+    }
+    storages.push_back(storage);
+    modules.push_back(create_metadata(storage));
+  }
+
+  RadosStats::reset();
+  populating = options.threads;
+  if (ret == 0) {
+    for (int i = 0; i < options.threads; i++) {
+      threads.push_back(std::thread(&RmbBench::run_thread, this, i, storages[i], modules[i], &results[i]));
+    }
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  // only the workload is measured, from the common start to the last thread finishing it
+  uint64_t elapsed = 0;
+  for (auto &r : results) {
+    if (ret == 0 && r.end > start_time) {
+      elapsed = std::max<uint64_t>(
+          elapsed, std::chrono::duration_cast<std::chrono::microseconds>(r.end - start_time).count());
+    }
+  }
+
+  for (size_t i = 0; i < storages.size(); i++) {
+    delete modules[i];
+    free_storage(storages[i]);
+  }
+  if (ret < 0) {
+    return ret;
+  }
+  print_results(out, results, elapsed > 0 ? elapsed : 1);
+
+  RadosStats::Snapshot snapshot;
+  RadosStats::snapshot(&snapshot);
+  out << std::endl << "rados operations (incl. setup and cleanup):" << std::endl << RadosStats::to_string(snapshot);
+  return 0;
+}
+
+} /* namespace librmb */
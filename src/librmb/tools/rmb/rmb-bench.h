@@ -0,0 +1,135 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_TOOLS_RMB_RMB_BENCH_H_
+#define SRC_LIBRMB_TOOLS_RMB_RMB_BENCH_H_
+
+#include <stdint.h>
+
+#include <chrono>  // NOLINT
+#include <condition_variable>  // NOLINT
+#include <functional>
+#include <iostream>
+#include <mutex>  // NOLINT
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rados-storage.h"
+#include "rados-metadata-storage-module.h"
+
+namespace librmb {
+
+enum rmb_bench_op {
+  RMB_BENCH_DELIVER = 0,
+  RMB_BENCH_FETCH,
+  RMB_BENCH_FETCH_METADATA,
+  RMB_BENCH_FLAGS,
+  RMB_BENCH_COPY,
+  RMB_BENCH_EXPUNGE,
+  RMB_BENCH_OP_COUNT
+};
+
+/**
+ * rmb bench
+ *
+ * Replays mail workloads against librmb the way the rbox storage uses it:
+ * deliveries (save mail with metadata), fetches (read mail and metadata),
+ * metadata scans, flag updates, copies and expunges. Each thread works in
+ * its own namespace with its own storage instance and the mails it
+ * created, so threads do not contend on objects.
+ */
+class RmbBench {
+ public:
+  struct Options {
+    Options()
+        : threads(1), ops(1000), mails(100), seed(1), ns_prefix("rmb_bench"),
+          mail_size("2048:40,8192:30,32768:20,262144:8,2097152:2") {}
+
+    int threads;
+    // operations per thread
+    uint64_t ops;
+    // mails delivered per thread before the workload starts
+    int mails;
+    unsigned int seed;
+    std::string ns_prefix;
+    // size[:weight],... e.g. "4096" or "2048:40,8192:30"
+    std::string mail_size;
+  };
+
+  /*!
+   * @param[in] create_storage returns a connected storage, one per thread
+   * @param[in] create_metadata returns the metadata module of a storage
+   * @param[in] free_storage closes and deletes a storage
+   */
+  RmbBench(std::function<RadosStorage *()> create_storage,
+           std::function<RadosStorageMetadataModule *(RadosStorage *)> create_metadata,
+           std::function<void(RadosStorage *)> free_storage);
+
+  /*!
+   * set the workload: deliver, fetch, fetch_metadata, flags, copy, expunge or mixed
+   * @return false if the workload is unknown
+   */
+  bool set_workload(const std::string &workload);
+  /*!
+   * @return false if the size distribution is invalid
+   */
+  bool set_options(const Options &options_);
+
+  /*!
+   * run the workload and print the results
+   * @return linux error code or 0 if successful
+   */
+  int run(std::ostream &out);
+
+  static const char *op_name(rmb_bench_op op);
+  /*!
+   * @param[in] latencies sorted latencies
+   * @param[in] pct 0-100
+   */
+  static uint64_t percentile(const std::vector<uint64_t> &latencies, double pct);
+  /*!
+   * parse size[:weight],... into (size, cumulated weight) pairs
+   */
+  static bool parse_size_distribution(const std::string &spec, std::vector<std::pair<uint64_t, uint64_t>> *dist);
+
+ private:
+  struct ThreadResult {
+    std::vector<uint64_t> latencies[RMB_BENCH_OP_COUNT];
+    uint64_t errors[RMB_BENCH_OP_COUNT] = {0};
+    uint64_t bytes[RMB_BENCH_OP_COUNT] = {0};
+    // end of the thread's workload, the cleanup is not measured
+    std::chrono::steady_clock::time_point end;
+  };
+
+  void run_thread(int thread_id, RadosStorage *storage, RadosStorageMetadataModule *ms, ThreadResult *result);
+  void print_results(std::ostream &out, std::vector<ThreadResult> &results, uint64_t elapsed_usecs);
+
+ private:
+  std::function<RadosStorage *()> create_storage;
+  std::function<RadosStorageMetadataModule *(RadosStorage *)> create_metadata;
+  std::function<void(RadosStorage *)> free_storage;
+
+  Options options;
+  // cumulated weights of the operations of the workload
+  uint64_t op_weights[RMB_BENCH_OP_COUNT];
+  std::vector<std::pair<uint64_t, uint64_t>> size_dist;
+
+  // the workload starts once all threads delivered their initial mails
+  std::mutex start_mutex;
+  std::condition_variable start_cond;
+  int populating;
+  std::chrono::steady_clock::time_point start_time;
+};
+
+} /* namespace librmb */
+
+#endif /* SRC_LIBRMB_TOOLS_RMB_RMB_BENCH_H_ */
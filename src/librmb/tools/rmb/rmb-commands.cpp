@@ -10,9 +10,16 @@
  */
 
 #include "rmb-commands.h"
+#include <errno.h>
+#include <limits.h>
 #include <time.h>
 #include <algorithm>  // std::sort
+#include <chrono>  // NOLINT
 #include <cstdio>
+#include <deque>
+#include <set>
+#include <thread>  // NOLINT
+#include <utility>
 
 #include "../../rados-cluster-impl.h"
 #include "../../rados-storage-impl.h"
@@ -20,9 +27,13 @@
 #include "rados-dovecot-config.h"
 #include "rados-dovecot-ceph-cfg-impl.h"
 #include "rados-namespace-manager.h"
+#include "rados-dictionary-impl.h"
 #include "rados-metadata-storage-ima.h"
 #include "rados-metadata-storage-default.h"
 #include "ls_cmd_parser.h"
+#include "rmb-export.h"
+#include "rmb-migrate.h"
+#include "rados-stats.h"
 
 namespace librmb {
 
@@ -31,8 +42,21 @@ RmbCommands::RmbCommands(librmb::RadosStorage *storage_, librmb::RadosCluster *c
   this->storage = storage_;
   this->cluster = cluster_;
   this->opts = opts_;
+  this->aio_window = DEFAULT_AIO_WINDOW;
+  this->list_threads = DEFAULT_LIST_THREADS;
+  this->batch_size = DEFAULT_BATCH_SIZE;
+  this->xattr_metadata = false;
   if (this->opts != nullptr) {
     is_debug = ((*opts).find("debug") != (*opts).end()) ? true : false;
+    if ((*opts).find("aio_window") != (*opts).end() && std::stoi((*opts)["aio_window"]) > 0) {
+      aio_window = std::stoi((*opts)["aio_window"]);
+    }
+    if ((*opts).find("list_threads") != (*opts).end() && std::stoi((*opts)["list_threads"]) > 0) {
+      list_threads = std::stoi((*opts)["list_threads"]);
+    }
+    if ((*opts).find("batch_size") != (*opts).end() && std::stoi((*opts)["batch_size"]) > 0) {
+      batch_size = std::stoi((*opts)["batch_size"]);
+    }
   }
 }
 RmbCommands::~RmbCommands() {}
@@ -42,16 +66,111 @@ void RmbCommands::print_debug(const std::string &msg) {
     std::cout << msg << std::endl;
   }
 }
+enum save_log_revert_stage { REVERT_DELETE, REVERT_STAT, REVERT_WRITE, REVERT_REMOVE_SOURCE };
+
+/* revert of one save log entry, a move runs in up to three aio stages */
+struct SaveLogRevert {
+  librmb::RadosSaveLogEntry entry;
+  // io_ctx of the entry namespace and of the namespace a moved mail is restored to
+  librados::IoCtx *io_ctx = nullptr;
+  librados::IoCtx *src_io_ctx = nullptr;
+  save_log_revert_stage stage = REVERT_DELETE;
+  librados::AioCompletion *completion = nullptr;
+  librados::ObjectWriteOperation write_op;
+  uint64_t size = 0;
+  time_t mtime = 0;
+  time_t save_time = 0;
+  int ret = 0;
+  bool done = false;
+};
+
+static void issue_revert_stage(SaveLogRevert *op, save_log_revert_stage stage) {
+  op->stage = stage;
+  op->completion = librados::Rados::aio_create_completion();
+  int ret = 0;
+  librmb::RadosStatsAioTimer *timer = nullptr;
+  switch (stage) {
+    case REVERT_DELETE:
+      timer = librmb::RadosStatsAioTimer::start(librmb::RADOS_OP_REMOVE, op->entry.oid, op->completion);
+      ret = op->io_ctx->aio_remove(op->entry.oid, op->completion);
+      break;
+    case REVERT_STAT:
+      timer = librmb::RadosStatsAioTimer::start(librmb::RADOS_OP_STAT, op->entry.oid, op->completion);
+      ret = op->io_ctx->aio_stat(op->entry.oid, op->completion, &op->size, &op->mtime);
+      break;
+    case REVERT_WRITE:
+      if (op->entry.ns.compare(op->entry.src_ns) != 0) {
+#if LIBRADOS_VERSION_CODE >= 30000
+        op->write_op.copy_from(op->entry.oid, *op->io_ctx, 0, 0);
+#else
+        op->write_op.copy_from(op->entry.oid, *op->io_ctx, 0);
+#endif
+      }
+      op->save_time = time(NULL);
+      op->write_op.mtime(&op->save_time);
+      for (std::list<librmb::RadosMetadata>::iterator it = op->entry.metadata.begin();
+           it != op->entry.metadata.end(); ++it) {
+        op->write_op.setxattr((*it).key.c_str(), (*it).bl);
+      }
+      timer = librmb::RadosStatsAioTimer::start(
+          op->entry.ns.compare(op->entry.src_ns) != 0 ? librmb::RADOS_OP_COPY_FROM : librmb::RADOS_OP_WRITE,
+          op->entry.src_oid, op->completion);
+      ret = op->src_io_ctx->aio_operate(op->entry.src_oid, op->completion, &op->write_op);
+      break;
+    case REVERT_REMOVE_SOURCE:
+      timer = librmb::RadosStatsAioTimer::start(librmb::RADOS_OP_REMOVE, op->entry.oid, op->completion);
+      ret = op->io_ctx->aio_remove(op->entry.oid, op->completion);
+      break;
+    default:
+      ret = -EINVAL;
+      break;
+  }
+  if (ret < 0) {
+    if (timer != nullptr) {
+      timer->cancel(ret);
+    }
+    op->completion->release();
+    op->completion = nullptr;
+    op->ret = ret;
+    op->done = true;
+  }
+}
+
+/* waits for the current stage and issues the next one */
+static void step_revert(SaveLogRevert *op) {
+  op->completion->wait_for_complete();
+  int ret = op->completion->get_return_value();
+  op->completion->release();
+  op->completion = nullptr;
+
+  if (ret < 0 || op->stage == REVERT_DELETE || op->stage == REVERT_REMOVE_SOURCE) {
+    op->ret = ret;
+    op->done = true;
+  } else if (op->stage == REVERT_STAT) {
+    issue_revert_stage(op, REVERT_WRITE);
+  } else if (op->entry.ns.compare(op->entry.src_ns) != 0) {
+    // copied back, remove the moved mail
+    issue_revert_stage(op, REVERT_REMOVE_SOURCE);
+  } else {
+    op->ret = ret;
+    op->done = true;
+  }
+}
+
+static std::string revert_object_key(const std::string &pool, const std::string &ns, const std::string &oid) {
+  return pool + '\0' + ns + '\0' + oid;
+}
+
 int RmbCommands::delete_with_save_log(const std::string &save_log, const std::string &rados_cluster,
                                       const std::string &rados_user,
-                                      std::map<std::string, std::list<librmb::RadosSaveLogEntry>> *moved_items) {
-  librmb::RadosClusterImpl cluster;
-  librmb::RadosStorageImpl storage(&cluster);
-  int count = 0;
-
+                                      std::map<std::string, std::list<librmb::RadosSaveLogEntry>> *moved_items,
+                                      unsigned int aio_window) {
   if (moved_items == nullptr) {
     return -1;
   }
+  if (aio_window == 0) {
+    aio_window = 1;
+  }
 
   /** check content **/
   std::ifstream read(save_log);
@@ -59,6 +178,8 @@ int RmbCommands::delete_with_save_log(const std::string &save_log, const std::st
     std::cerr << " path to log file not valid " << std::endl;
     return -1;
   }
+  // parse the log once, entries are grouped by pool in log order.
+  std::map<std::string, std::list<librmb::RadosSaveLogEntry>> entries_by_pool;
   int line_count = 0;
   while (true) {
     line_count++;
@@ -71,46 +192,103 @@ int RmbCommands::delete_with_save_log(const std::string &save_log, const std::st
       std::cout << "Objectentry at line '" << line_count << "' is not valid: " << std::endl;
       break;
     }
+    entries_by_pool[entry.pool].push_back(entry);
+  }
+  read.close();
+  if (entries_by_pool.empty()) {
+    return 0;
+  }
 
-    if (storage.get_pool_name().compare(entry.pool) != 0) {
-      // close connection before open a new one.
-      // TODO(jrse): worst case are alternating pool entries e.g. mail_storage ,
-      //       mail_storage_alt.... maybe we should group the entries by pool...
-      storage.close_connection();
-      int open_connection = storage.open_connection(entry.pool, rados_cluster, rados_user);
-      if (open_connection < 0) {
-        std::cerr << " error opening rados connection. Errorcode: " << open_connection << std::endl;
-        cluster.deinit();
-        return -1;
-      }
-    }
-    storage.set_namespace(entry.ns);
+  librmb::RadosClusterImpl cluster;
+  if (cluster.init(rados_cluster, rados_user) < 0) {
+    std::cerr << " error initializing rados cluster " << std::endl;
+    return -1;
+  }
+  int ret = cluster.connect();
+  if (ret < 0) {
+    std::cerr << " error opening rados connection. Errorcode: " << ret << std::endl;
+    cluster.deinit();
+    return -1;
+  }
+
+  int count = 0;
+  std::deque<SaveLogRevert *> in_flight;
+  // objects touched by in flight operations
+  std::set<std::string> busy_objects;
+
+  auto finish_revert = [&](SaveLogRevert *op) {
+    librmb::RadosSaveLogEntry &entry = op->entry;
+    busy_objects.erase(revert_object_key(entry.pool, entry.ns, entry.oid));
     if (entry.op.compare("save") == 0 || entry.op.compare("cpy") == 0) {
-      int ret_delete = storage.delete_mail(entry.oid);
-      if (ret_delete < 0) {
-        std::cout << "Object " << entry.oid << " not deleted: errorcode: " << ret_delete << std::endl;
+      if (op->ret < 0) {
+        std::cout << "Object " << entry.oid << " not deleted: errorcode: " << op->ret << std::endl;
       } else {
         std::cout << "Object " << entry.oid << " successfully deleted" << std::endl;
         count++;
       }
     } else {
-      int ret = storage.move(entry.oid, entry.ns.c_str(), entry.src_oid, entry.src_ns.c_str(), entry.metadata, true);
-      if (ret < 0) {
-        std::cerr << "moving : " << entry.oid << " to " << entry.src_oid << " failed ! ret code: " << ret << std::endl;
+      busy_objects.erase(revert_object_key(entry.pool, entry.src_ns, entry.src_oid));
+      if (op->ret < 0) {
+        std::cerr << "moving : " << entry.oid << " to " << entry.src_oid << " failed ! ret code: " << op->ret
+                  << std::endl;
       } else {
-        if (moved_items->find(entry.src_user) == moved_items->end()) {
-          std::list<librmb::RadosSaveLogEntry> entries;
-          entries.push_back(entry);
-          (*moved_items)[entry.src_user] = entries;
-        } else {
-          (*moved_items)[entry.src_user].push_back(entry);
-        }
+        (*moved_items)[entry.src_user].push_back(entry);
       }
       count++;
     }
+    delete op;
+  };
+  // advance completed stages, report finished entries in log order and wait until less than limit are in flight
+  auto pump = [&](size_t limit) {
+    while (!in_flight.empty()) {
+      for (auto op : in_flight) {
+        if (!op->done && op->completion->is_complete()) {
+          step_revert(op);
+        }
+      }
+      while (!in_flight.empty() && in_flight.front()->done) {
+        finish_revert(in_flight.front());
+        in_flight.pop_front();
+      }
+      if (in_flight.size() < limit) {
+        break;
+      }
+      step_revert(in_flight.front());
+    }
+  };
+
+  for (auto &pool : entries_by_pool) {
+    for (auto &entry : pool.second) {
+      SaveLogRevert *op = new SaveLogRevert();
+      op->entry = entry;
+      bool is_delete = entry.op.compare("save") == 0 || entry.op.compare("cpy") == 0;
+      std::string key = revert_object_key(entry.pool, entry.ns, entry.oid);
+      std::string src_key = is_delete ? key : revert_object_key(entry.pool, entry.src_ns, entry.src_oid);
+      if (busy_objects.count(key) > 0 || busy_objects.count(src_key) > 0) {
+        // keep the log order for operations on the same object
+        pump(1);
+      }
+      busy_objects.insert(key);
+      busy_objects.insert(src_key);
+
+      op->ret = cluster.io_ctx_get(entry.pool, entry.ns, &op->io_ctx);
+      if (op->ret == 0 && !is_delete) {
+        op->ret = cluster.io_ctx_get(entry.pool, entry.src_ns, &op->src_io_ctx);
+      }
+      if (op->ret < 0) {
+        op->done = true;
+      } else if (is_delete) {
+        issue_revert_stage(op, REVERT_DELETE);
+      } else if (entry.ns.compare(entry.src_ns) != 0) {
+        issue_revert_stage(op, REVERT_WRITE);
+      } else {
+        issue_revert_stage(op, REVERT_STAT);
+      }
+      in_flight.push_back(op);
+      pump(aio_window);
+    }
   }
-  read.close();
-  storage.close_connection();
+  pump(1);
   cluster.deinit();
   return count;
 }
@@ -134,36 +312,117 @@ int RmbCommands::lspools() {
   return 0;
 }
 
-int RmbCommands::delete_namespace(librmb::RadosStorageMetadataModule *ms, std::list<librmb::RadosMail *> &mail_objects,
-                                  librmb::RadosCephConfig *cfg, bool confirmed) {
-  if (ms == nullptr || cfg == nullptr) {
+int RmbCommands::remove_objects(uint64_t max_ops_per_sec, uint64_t *removed, uint64_t *failed) {
+  print_debug("entry: remove_objects");
+  if (storage == nullptr || removed == nullptr || failed == nullptr) {
     return -1;
   }
+  std::deque<std::pair<std::string, librados::AioCompletion *>> in_flight;
+  auto start = std::chrono::steady_clock::now();
+  auto last_report = start;
+  uint64_t submitted = 0;
 
-  librmb::CmdLineParser parser("-");
-  if (parser.parse_ls_string()) {
-    std::string sort_type = "uid";
-    int ret = load_objects(ms, mail_objects, sort_type);
-    if (ret < 0 || mail_objects.size() == 0) {
-      return ret;
+  auto print_progress = [&](std::chrono::steady_clock::time_point now) {
+    double secs = std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count() / 1000.0;
+    std::cout << " deleted " << *removed << " objects, " << *failed << " failed in " << secs << "s ("
+              << (secs > 0 ? static_cast<uint64_t>(*removed / secs) : *removed) << " objects/s)" << std::endl;
+  };
+  auto finish_oldest = [&]() {
+    std::pair<std::string, librados::AioCompletion *> &oldest = in_flight.front();
+    oldest.second->wait_for_complete();
+    int ret = oldest.second->get_return_value();
+    oldest.second->release();
+    // already removed counts as removed
+    if (ret < 0 && ret != -ENOENT) {
+      std::cerr << " unable to delete object " << oldest.first << ", ret code: " << ret << std::endl;
+      (*failed)++;
+    } else {
+      (*removed)++;
     }
+    in_flight.pop_front();
+  };
 
-    for (std::list<librmb::RadosMail *>::iterator it_mail = mail_objects.begin(); it_mail != mail_objects.end();
-         ++it_mail) {
-      (*opts)["to_delete"] = *(*it_mail)->get_oid();
-      delete_mail(confirmed);
+  librados::NObjectIterator iter(storage->find_mails(nullptr));
+  while (iter != librados::NObjectIterator::__EndObjectIterator) {
+    std::string oid = iter->get_oid();
+    ++iter;
+    if (max_ops_per_sec > 0) {
+      // pace the submissions, sleeps only while ahead of the rate
+      std::this_thread::sleep_until(start + std::chrono::microseconds(submitted * 1000000 / max_ops_per_sec));
+    }
+    librados::AioCompletion *completion = librados::Rados::aio_create_completion();
+    librmb::RadosStatsAioTimer *timer = librmb::RadosStatsAioTimer::start(librmb::RADOS_OP_REMOVE, oid, completion);
+    int ret = storage->get_io_ctx().aio_remove(oid, completion);
+    if (ret < 0) {
+      timer->cancel(ret);
+      completion->release();
+      std::cerr << " unable to delete object " << oid << ", ret code: " << ret << std::endl;
+      (*failed)++;
+      continue;
     }
-    if (cfg->is_user_mapping()) {
-      // delete namespace object also.
-      std::cout << "user mapping active " << std::endl;
-      std::string indirect_ns = (*opts)["namespace"] + cfg->get_user_suffix();
-      (*opts)["to_delete"] = indirect_ns;
-      storage->set_namespace("users");
-      delete_mail(confirmed);
+    submitted++;
+    in_flight.push_back(std::make_pair(oid, completion));
+    while (!in_flight.empty() && (in_flight.size() >= aio_window || in_flight.front().second->is_complete())) {
+      finish_oldest();
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_report >= std::chrono::seconds(10)) {
+      print_progress(now);
+      last_report = now;
+    }
+  }
+  while (!in_flight.empty()) {
+    finish_oldest();
+  }
+  print_progress(std::chrono::steady_clock::now());
+  print_debug("end: remove_objects");
+  return *failed > 0 ? -EIO : 0;
+}
+
+int RmbCommands::delete_namespace(librmb::RadosCephConfig *cfg, bool confirmed) {
+  if (cfg == nullptr) {
+    return -1;
+  }
+  if (!confirmed) {
+    std::cout << "WARNING: Deleting the namespace will remove all mail objects of the "
+                 "user from ceph, but not from dovecot index, this "
+                 "may lead to corrupt mailboxes\n"
+              << " add --yes-i-really-really-mean-it to confirm the delete " << std::endl;
+    return 0;
+  }
+
+  uint64_t max_ops_per_sec = 0;
+  if ((*opts).find("rate") != (*opts).end()) {
+    max_ops_per_sec = std::stoull((*opts)["rate"]);
+  }
+  std::cout << " deleting namespace : " << storage->get_pool_name() << " ns: " << storage->get_namespace() << std::endl;
+  uint64_t removed = 0;
+  uint64_t failed = 0;
+  int ret = remove_objects(max_ops_per_sec, &removed, &failed);
+  if (ret < 0) {
+    // keep the index and the user mapping, the delete can be repeated
+    return ret;
+  }
+
+  ret = remove_ceph_object_index();
+  if (ret < 0 && ret != -ENOENT) {
+    std::cerr << " unable to delete ceph index object, ret code: " << ret << std::endl;
+    return ret;
+  }
+  if (cfg->is_user_mapping()) {
+    // delete namespace object also.
+    std::cout << "user mapping active " << std::endl;
+    std::string indirect_ns = (*opts)["namespace"] + cfg->get_user_suffix();
+    storage->set_namespace(cfg->get_user_ns());
+    ret = storage->delete_mail(indirect_ns);
+    if (ret < 0 && ret != -ENOENT) {
+      std::cerr << " unable to delete user mapping object " << indirect_ns << ", ret code: " << ret << std::endl;
+      return ret;
     }
   }
   return 0;
 }
+
 int RmbCommands::delete_mail(bool confirmed) {
   int ret = -1;
   print_debug("entry: delete_mail");
@@ -185,15 +444,173 @@ int RmbCommands::delete_mail(bool confirmed) {
   return ret;
 }
 
-int RmbCommands::rename_user(librmb::RadosCephConfig *cfg, bool confirmed, const std::string &uid) {
-  print_debug("entry: rename_user");
+int RmbCommands::migrate_objects(const std::string &src_ns, const std::string &dest_pool, const std::string &dest_ns,
+                                 unsigned int grace, const std::function<int()> &switch_over) {
+  librmb::RmbMigrate::Options options;
+  options.aio_window = aio_window;
+  options.list_threads = list_threads;
+  options.batch_size = batch_size;
+  librmb::RmbMigrate migrate(storage, cluster, options);
+  std::string src_pool = storage->get_pool_name();
+
+  // copy until a pass finds no changes
+  int ret = 0;
+  for (unsigned int pass = 1; pass <= MIGRATE_MAX_PASSES; pass++) {
+    uint64_t copied = 0;
+    uint64_t removed = 0;
+    ret = migrate.copy_pass(src_ns, dest_pool, dest_ns, &copied, &removed);
+    std::cout << " pass " << pass << ": copied " << copied << " objects, removed " << removed << ", "
+              << migrate.get_failed() << " failed" << std::endl;
+    if (ret < 0 && ret != -EIO) {
+      return ret;
+    }
+    if (ret == 0 && copied == 0 && removed == 0) {
+      break;
+    }
+  }
+  if (ret < 0) {
+    std::cerr << " objects failed to copy, the namespace is not switched" << std::endl;
+    return ret;
+  }
+
+  if (src_ns.compare(dest_ns) != 0) {
+    // the ceph index object is named after the namespace
+    librados::ObjectWriteOperation index_op;
+#if LIBRADOS_VERSION_CODE >= 30000
+    index_op.copy_from(src_ns, storage->get_recovery_io_ctx(), 0, 0);
+#else
+    index_op.copy_from(src_ns, storage->get_recovery_io_ctx(), 0);
+#endif
+    ret = storage->get_recovery_io_ctx().operate(dest_ns, &index_op);
+    if (ret < 0 && ret != -ENOENT) {
+      std::cerr << " unable to copy the ceph index, use create ceph index -r, ret code: " << ret << std::endl;
+    }
+  }
+
+  ret = switch_over();
+  if (ret < 0) {
+    std::cerr << " switching the namespace failed, ret code: " << ret << std::endl;
+    return ret;
+  }
+
+  if (grace > 0) {
+    // processes which cached the old mapping keep using the source namespace until it expires
+    std::cout << " waiting " << grace << "s until the old namespace mapping is no longer cached" << std::endl;
+    std::this_thread::sleep_for(std::chrono::seconds(grace));
+  }
+
+  // mails saved, updated or expunged by sessions which still used the old namespace
+  uint64_t copied = 0;
+  uint64_t removed = 0;
+  ret = migrate.copy_pass(src_ns, dest_pool, dest_ns, &copied, &removed);
+  std::cout << " final pass: copied " << copied << " objects, removed " << removed << std::endl;
+  std::cout << " migrated " << migrate.get_copied() << " objects, " << migrate.get_bytes() << " bytes from "
+            << src_pool << "/" << src_ns << " to " << dest_pool << "/" << dest_ns << std::endl;
+  if (ret < 0) {
+    std::cerr << " objects failed to copy in the final pass, the source objects are kept" << std::endl;
+    return ret;
+  }
+
+  storage->set_namespace(src_ns);
+  if ((*opts).find("delete_source") == (*opts).end()) {
+    std::cout << " the source objects are kept, remove them with: rmb -p " << src_pool << " -N " << src_ns
+              << " delete - (after all sessions of the user are closed)" << std::endl;
+    return 0;
+  }
+  uint64_t deleted = 0;
+  uint64_t delete_failed = 0;
+  ret = remove_objects(0, &deleted, &delete_failed);
+  if (ret == 0 && src_ns.compare(dest_ns) != 0) {
+    ret = remove_ceph_object_index();
+    ret = ret == -ENOENT ? 0 : ret;
+  }
+  return ret;
+}
+
+int RmbCommands::migrate_user(librmb::RadosCephConfig *cfg, bool confirmed) {
+  print_debug("entry: migrate_user");
   if (cfg == nullptr) {
     return -1;
   }
-  if (!cfg->is_user_mapping()) {
-    std::cout << "Error: To be able to rename a user, the configuration option generate_namespace needs to be active"
-              << std::endl;
-    print_debug("end: rename_user");
+  std::string src_pool = storage->get_pool_name();
+  std::string src_ns = storage->get_namespace();
+  std::string dest_pool = (*opts).find("to_pool") != (*opts).end() ? (*opts)["to_pool"] : src_pool;
+  std::string dest_ns = (*opts).find("to_ns") != (*opts).end() ? (*opts)["to_ns"] : src_ns;
+
+  if (!cfg->is_user_mapping() && dest_ns.compare(src_ns) != 0) {
+    std::cout << "Error: without generate_namespace the namespace is given by the user name, use rename" << std::endl;
+    return -1;
+  }
+  if (dest_pool.compare(src_pool) == 0 && dest_ns.compare(src_ns) == 0) {
+    std::cout << "Error: pass a different pool (--to_pool) or namespace (--to_ns)" << std::endl;
+    return -1;
+  }
+  // the source is removed only after no process uses the old mapping any more
+  bool delete_source = (*opts).find("delete_source") != (*opts).end();
+  // rbox_namespace_cache_ttl of the rados config, shared with the dovecot processes
+  unsigned int cache_ttl = cfg->get_namespace_cache_ttl();
+  unsigned int grace = cache_ttl;
+  if ((*opts).find("grace") != (*opts).end()) {
+    grace = std::stoul((*opts)["grace"]);
+  }
+  if (delete_source && (!cfg->is_user_mapping() || dest_pool.compare(src_pool) != 0)) {
+    std::cout << "Error: --delete_source requires a user mapping switched by migrate (generate_namespace, same pool), "
+              << "remove the source objects after the user is switched" << std::endl;
+    return -1;
+  }
+  if (delete_source && grace < cache_ttl) {
+    std::cout << "Error: --delete_source requires a grace period of at least the namespace cache ttl ("
+              << cache_ttl << "s)" << std::endl;
+    return -1;
+  }
+  if (!confirmed) {
+    std::cout << "WARNING: migrating a user copies all objects of " << src_pool << "/" << src_ns << " to "
+              << dest_pool << "/" << dest_ns << " and switches the user to it.\n add "
+              << "--yes-i-really-really-mean-it to confirm " << std::endl;
+    return -1;
+  }
+
+  std::string mapping_oid = (*opts)["namespace"] + cfg->get_user_suffix();
+  auto switch_over = [&]() {
+    if (!cfg->is_user_mapping()) {
+      std::cout << " switch the user to pool " << dest_pool << " (rbox_pool_name) to complete the migration"
+                << std::endl;
+      return 0;
+    }
+    librados::IoCtx *mapping_io_ctx = nullptr;
+    int ret = cluster->io_ctx_get(dest_pool, cfg->get_user_ns(), &mapping_io_ctx);
+    if (ret < 0) {
+      return ret;
+    }
+    librados::bufferlist bl;
+    bl.append(dest_ns);
+    librados::ObjectWriteOperation op;
+    if (dest_pool.compare(src_pool) == 0) {
+      // fails if the mapping changed since it was read
+      librados::bufferlist current;
+      ret = mapping_io_ctx->read(mapping_oid, current, INT_MAX, 0);
+      if (ret < 0) {
+        return ret;
+      }
+      if (current.to_str().compare(src_ns) != 0) {
+        return -ECANCELED;
+      }
+      op.assert_version(mapping_io_ctx->get_last_version());
+    } else {
+      std::cout << " switch the user to pool " << dest_pool << " (rbox_pool_name) to complete the migration"
+                << std::endl;
+    }
+    op.write_full(bl);
+    return mapping_io_ctx->operate(mapping_oid, &op);
+  };
+  int ret = migrate_objects(src_ns, dest_pool, dest_ns, grace, switch_over);
+  print_debug("end: migrate_user");
+  return ret;
+}
+
+int RmbCommands::rename_user(librmb::RadosCephConfig *cfg, bool confirmed, const std::string &uid) {
+  print_debug("entry: rename_user");
+  if (cfg == nullptr) {
     return -1;
   }
   if (!confirmed) {
@@ -211,28 +628,36 @@ int RmbCommands::rename_user(librmb::RadosCephConfig *cfg, bool confirmed, const
     print_debug("end: rename_user");
     return -1;
   }
-  std::list<librmb::RadosMetadata> list;
-  std::cout << " copy namespace configuration src " << src_ << " to dest " << dest_ << " in namespace "
-            << cfg->get_user_ns() << std::endl;
+  if (!cfg->is_user_mapping()) {
+    // the namespace is given by the user name, copy the objects
+    std::cout << " copy namespace " << src_ << " to " << dest_ << std::endl;
+    int ret = migrate_objects(src_, storage->get_pool_name(), dest_, 0, []() { return 0; });
+    print_debug("end: rename_user");
+    return ret;
+  }
+
+  std::cout << " link namespace of " << src_ << " to " << dest_ << " in namespace " << cfg->get_user_ns()
+            << std::endl;
   storage->set_namespace(cfg->get_user_ns());
 
-  uint64_t size = -1;
-  time_t save_time = -1;
-  int exist = storage->stat_mail(src_, &size, &save_time);
-  if (exist < 0) {
+  librados::bufferlist bl;
+  int ret = storage->read_mail(src_, &bl);
+  if (ret < 0) {
     std::cout << "Error there does not exist a mail object with oid " << src_ << std::endl;
     print_debug("end: rename_user");
     return -1;
   }
 
-  exist = storage->stat_mail(dest_, &size, &save_time);
-  if (exist >= 0) {
+  // exclusive create, a user logged in with the new name in the meantime keeps its mapping
+  librados::ObjectWriteOperation op;
+  op.create(true);
+  op.write_full(bl);
+  ret = storage->get_io_ctx().operate(dest_, &op);
+  if (ret == -EEXIST) {
     std::cout << "Error: there already exists a mail object with oid: " << dest_ << std::endl;
     print_debug("end: rename_user");
     return -1;
   }
-
-  int ret = storage->copy(src_, cfg->get_user_ns().c_str(), dest_, cfg->get_user_ns().c_str(), list);
   if (ret == 0) {
     ret = storage->delete_mail(src_);
     if (ret != 0) {
@@ -246,6 +671,38 @@ int RmbCommands::rename_user(librmb::RadosCephConfig *cfg, bool confirmed, const
   return ret;
 }
 
+int RmbCommands::migrate_dict_shards(const std::string &cfg_object_name, bool confirmed) {
+  print_debug("entry: migrate_dict_shards");
+  // rmb validates the option, other callers of RmbCommands may not
+  char *end = nullptr;
+  long shards = strtol((*opts)["dict_shards"].c_str(), &end, 10);  // NOLINT
+  if (end == nullptr || *end != '\0' || shards <= 1 || shards > INT_MAX) {
+    std::cout << "Error: number of shards needs to be > 1" << std::endl;
+    print_debug("end: migrate_dict_shards");
+    return -1;
+  }
+  if (!confirmed) {
+    std::cout << "WARNING: all dictionary processes need to use dict_shared_shards=" << shards
+              << " before migrating. Do you really really want to do this? \n add "
+                 "--yes-i-really-really-mean-it to confirm "
+              << std::endl;
+    print_debug("end: migrate_dict_shards");
+    return -1;
+  }
+  std::string oid = opts->find("dict_oid") != opts->end() ? (*opts)["dict_oid"] : "";
+
+  librmb::RadosDictionaryImpl dict(cluster, storage->get_pool_name(), "", oid, nullptr, cfg_object_name);
+  dict.set_shared_shard_count(static_cast<unsigned int>(shards));
+  int ret = dict.migrate_shared_shards(1000);
+  if (ret < 0) {
+    std::cout << "Error migrating dictionary oid: " << oid << " errorcode: " << ret << std::endl;
+  } else {
+    std::cout << "dictionary oid: " << oid << " migrated to " << shards << " shards" << std::endl;
+  }
+  print_debug("end: migrate_dict_shards");
+  return ret;
+}
+
 int RmbCommands::configuration(bool confirmed, librmb::RadosCephConfig &ceph_cfg) {
   print_debug("entry: configuration");
   bool has_update = (*opts).find("update") != (*opts).end();
@@ -385,42 +842,57 @@ bool RmbCommands::sort_save_date(librmb::RadosMail *i, librmb::RadosMail *j) {
 
 struct AioStat {
   librmb::RadosMail *mail;
-  std::list<librmb::RadosMail *> *mail_objects;
   uint64_t object_size = 0;
-  time_t save_date_rados;
-  librmb::RadosStorageMetadataModule *ms;
-  bool load_metadata;
+  time_t save_date_rados = 0;
+  // xattrs and omap values are read with the stat, so the metadata is loaded in the same round trip
+  std::map<std::string, ceph::bufferlist> xattrs;
+  std::map<std::string, ceph::bufferlist> omap;
+  int xattrs_err = 0;
+  int omap_err = 0;
+  bool omap_more = false;
+  librados::ObjectReadOperation read_op;
   librados::AioCompletion *completion;
 };
 
-static void aio_cb(rados_completion_t cb, void *arg) {
-  if (arg == nullptr) {
-    return;
-  }
-  AioStat *stat = static_cast<AioStat *>(arg);
-  if (stat->completion == nullptr || stat->mail == nullptr || stat->ms == nullptr || stat->mail_objects == nullptr) {
-    std::cout << "aio_cb callback failed, invalid stat object" << std::endl;
-    return;
-  }
+/* waits for the stat operation, loads the metadata and hands the mail over to consumer */
+static bool finish_aio_stat(AioStat *stat, librmb::RadosStorageMetadataModule *ms, bool load_metadata,
+                            const std::function<bool(librmb::RadosMail *)> &consumer) {
+  stat->completion->wait_for_complete();
+  int ret = stat->completion->get_return_value();
+  stat->completion->release();
 
-  if (stat->completion->get_return_value() == 0 && stat->object_size > 0) {
-    stat->mail->set_mail_size(stat->object_size);
-    stat->mail->set_rados_save_date(stat->save_date_rados);
-    if (stat->load_metadata) {
-      if (stat->ms->load_metadata(stat->mail) < 0) {
-        stat->mail->set_valid(false);
+  librmb::RadosMail *mail = stat->mail;
+  if (ret == 0 && stat->object_size > 0) {
+    mail->set_mail_size(stat->object_size);
+    mail->set_rados_save_date(stat->save_date_rados);
+    if (load_metadata) {
+      int load_ret = stat->xattrs_err < 0 ? stat->xattrs_err : stat->omap_err;
+      if (load_ret >= 0) {
+        // more omap values than one read returns: fall back to reading them again
+        load_ret = stat->omap_more ? ms->load_metadata(mail) : ms->load_metadata(mail, &stat->xattrs, &stat->omap);
       }
-      if (stat->mail->get_metadata()->empty()) {
-        stat->mail->set_valid(false);
+      if (load_ret < 0) {
+        mail->set_valid(false);
       }
-      if (!librmb::RadosUtils::validate_metadata(stat->mail->get_metadata())) {
-        stat->mail->set_valid(false);
+      if (mail->get_metadata()->empty()) {
+        mail->set_valid(false);
+      }
+      if (!librmb::RadosUtils::validate_metadata(mail->get_metadata())) {
+        mail->set_valid(false);
       }
     }
   } else {
-    stat->mail->set_valid(false);
+    mail->set_valid(false);
   }
-  stat->mail_objects->push_back(stat->mail);
+  delete stat;
+  return consumer(mail);
+}
+
+static void cancel_aio_stat(AioStat *stat) {
+  // the operation writes to stat, wait before freeing it
+  stat->completion->wait_for_complete();
+  stat->completion->release();
+  delete stat->mail;
   delete stat;
 }
 
@@ -452,65 +924,156 @@ int RmbCommands::append_ceph_object_index(const std::set<std::string> &mail_oids
   return storage->ceph_index_append(mail_oids);
 }
 
-int RmbCommands::load_objects(librmb::RadosStorageMetadataModule *ms, std::list<librmb::RadosMail *> &mail_objects,
-                              std::string &sort_string, bool load_metadata) {
-  time_t begin = time(NULL);
+int RmbCommands::rebuild_ceph_object_index(librmb::RadosStorageMetadataModule *ms, uint64_t *indexed,
+                                           const std::function<bool(librmb::RadosMail *)> &observer) {
+  int ret = remove_ceph_object_index();
+  if (ret < 0 && ret != -ENOENT) {
+    return ret;
+  }
+  std::set<std::string> batch;
+  uint64_t count = 0;
+  int append_ret = 0;
+  auto append_batch = [&]() {
+    append_ret = append_ceph_object_index(batch);
+    if (append_ret < 0) {
+      std::cerr << " error appending to ceph index, ret code: " << append_ret << std::endl;
+      return false;
+    }
+    count += batch.size();
+    batch.clear();
+    return true;
+  };
+  ret = stream_objects(ms, [&](librmb::RadosMail *mail) {
+    bool go_on = !observer || observer(mail);
+    if (mail->is_valid()) {
+      batch.insert(*mail->get_oid());
+    } else {
+      std::cerr << "metadata for object : " << mail->get_oid()->c_str() << " is not valid, skipping object "
+                << std::endl;
+    }
+    delete mail;
+    if (batch.size() >= batch_size && !append_batch()) {
+      return false;
+    }
+    return go_on;
+  });
+  if (append_ret == 0 && !batch.empty()) {
+    append_batch();
+  }
+  if (indexed != nullptr) {
+    *indexed = count;
+  }
+  if (ret < 0) {
+    return ret;
+  }
+  return append_ret;
+}
 
-  print_debug("entry: load_objects");
+int RmbCommands::stream_objects(librmb::RadosStorageMetadataModule *ms,
+                                const std::function<bool(librmb::RadosMail *)> &consumer, bool load_metadata,
+                                const librmb::RadosMetadata *filter) {
+  print_debug("entry: stream_objects");
   if (ms == nullptr || storage == nullptr) {
-    print_debug("end: load_objects");
+    print_debug("end: stream_objects");
     return -1;
   }
-  // TODO(jrse): Fix completions.....
-  std::list<librados::AioCompletion *> completions;
-  // load all objects metadata into memory
-  librados::NObjectIterator iter(storage->find_mails(nullptr));
-  while (iter != librados::NObjectIterator::__EndObjectIterator) {
-    librmb::RadosMail *mail = new librmb::RadosMail();
+  // oldest first, at most aio_window entries
+  std::deque<AioStat *> in_flight;
+  bool stop = false;
+
+  auto stat_object = [&](const std::string &oid) {
     AioStat *stat = new AioStat();
-    stat->mail = mail;
-    stat->mail_objects = &mail_objects;
-    stat->load_metadata = load_metadata;
-    stat->ms = ms;
-    std::string oid = iter->get_oid();
-    stat->completion = librados::Rados::aio_create_completion(static_cast<void *>(stat), aio_cb, NULL);
-    int ret = storage->get_io_ctx().aio_stat(oid, stat->completion, &stat->object_size, &stat->save_date_rados);
+    stat->mail = new librmb::RadosMail();
+    stat->completion = librados::Rados::aio_create_completion();
+    stat->read_op.stat(&stat->object_size, &stat->save_date_rados, nullptr);
+    if (load_metadata) {
+      stat->read_op.getxattrs(&stat->xattrs, &stat->xattrs_err);
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_OMAP_GET_VALS2
+      stat->read_op.omap_get_vals2("", MAX_OMAP_VALS, &stat->omap, &stat->omap_more, &stat->omap_err);
+#else
+      stat->read_op.omap_get_vals("", MAX_OMAP_VALS, &stat->omap, &stat->omap_err);
+#endif
+    }
+    librmb::RadosStatsAioTimer *timer = librmb::RadosStatsAioTimer::start(
+        load_metadata ? librmb::RADOS_OP_GETXATTRS : librmb::RADOS_OP_STAT, oid, stat->completion);
+    int ret = storage->get_io_ctx().aio_operate(oid, stat->completion, &stat->read_op, nullptr);
     if (ret != 0) {
+      timer->cancel(ret);
       std::cout << " object '" << oid << "' is not a valid mail object, size = 0, ret code: " << ret << std::endl;
-      ++iter;
-      delete mail;
+      stat->completion->release();
+      delete stat->mail;
       delete stat;
-      continue;
+      return;
     }
-    mail->set_oid(oid);
-    completions.push_back(stat->completion);
-
-    ++iter;
+    stat->mail->set_oid(oid);
+    in_flight.push_back(stat);
     if (is_debug) {
-      std::cout << "added: mail " << *mail->get_oid() << std::endl;
+      std::cout << "added: mail " << oid << std::endl;
     }
-  }
 
-  for (std::list<librados::AioCompletion *>::iterator it = completions.begin(); it != completions.end(); ++it) {
-    (*it)->wait_for_complete_and_cb();
-    (*it)->release();
+    // release finished operations right away, block only if the window is full
+    while (!stop && !in_flight.empty() &&
+           (in_flight.size() >= aio_window || in_flight.front()->completion->is_complete())) {
+      AioStat *oldest = in_flight.front();
+      in_flight.pop_front();
+      stop = !finish_aio_stat(oldest, ms, load_metadata, consumer);
+    }
+  };
+
+  int list_ret = 0;
+  if (list_threads > 1) {
+    list_ret = storage->find_mails_parallel(filter, list_threads, batch_size,
+                                            [&](std::vector<std::string> *batch) {
+                                              for (auto it = batch->begin(); !stop && it != batch->end(); ++it) {
+                                                stat_object(*it);
+                                              }
+                                              return !stop;
+                                            });
+    if (list_ret < 0) {
+      std::cerr << " error listing objects, ret code: " << list_ret << std::endl;
+      stop = true;
+    }
+  } else {
+    librados::NObjectIterator iter(storage->find_mails(filter));
+    while (!stop && iter != librados::NObjectIterator::__EndObjectIterator) {
+      std::string oid = iter->get_oid();
+      ++iter;
+      stat_object(oid);
+    }
   }
 
-  if (load_metadata) {
-    if (sort_string.compare("uid") == 0) {
-      mail_objects.sort(sort_uid);
-      // std::sort(mail_objects.begin(), mail_objects.end(), sort_uid);
-    } else if (sort_string.compare("recv_date") == 0) {
-      mail_objects.sort(sort_recv_date);
-      // std::sort(mail_objects.begin(), mail_objects.end(), sort_recv_date);
-    } else if (sort_string.compare("phy_size") == 0) {
-      mail_objects.sort(sort_phy_size);
-      //   std::sort(mail_objects.begin(), mail_objects.end(), sort_phy_size);
+  while (!in_flight.empty()) {
+    AioStat *oldest = in_flight.front();
+    in_flight.pop_front();
+    if (stop) {
+      cancel_aio_stat(oldest);
     } else {
-      mail_objects.sort(sort_save_date);
-      //  std::sort(mail_objects.begin(), mail_objects.end(), sort_save_date);
+      stop = !finish_aio_stat(oldest, ms, load_metadata, consumer);
     }
   }
+  print_debug("end: stream_objects");
+  return list_ret < 0 ? list_ret : 0;
+}
+
+int RmbCommands::load_objects(librmb::RadosStorageMetadataModule *ms, std::list<librmb::RadosMail *> &mail_objects,
+                              std::string &sort_string, bool load_metadata, const librmb::RadosMetadata *filter) {
+  time_t begin = time(NULL);
+
+  print_debug("entry: load_objects");
+  int ret = stream_objects(ms,
+                           [&mail_objects](librmb::RadosMail *mail) {
+                             mail_objects.push_back(mail);
+                             return true;
+                           },
+                           load_metadata, filter);
+  if (ret < 0) {
+    print_debug("end: load_objects");
+    return ret;
+  }
+
+  if (load_metadata) {
+    sort_mails(&mail_objects, sort_string);
+  }
   time_t end = time(NULL);
 
   print_debug("end: load_objects");
@@ -518,36 +1081,124 @@ int RmbCommands::load_objects(librmb::RadosStorageMetadataModule *ms, std::list<
   return 0;
 }
 
+void RmbCommands::sort_mails(std::list<librmb::RadosMail *> *mails, const std::string &sort_string) {
+  if (sort_string.compare("uid") == 0) {
+    mails->sort(sort_uid);
+  } else if (sort_string.compare("recv_date") == 0) {
+    mails->sort(sort_recv_date);
+  } else if (sort_string.compare("phy_size") == 0) {
+    mails->sort(sort_phy_size);
+  } else {
+    mails->sort(sort_save_date);
+  }
+}
+
+int RmbCommands::load_mailboxes(librmb::RadosStorageMetadataModule *ms, librmb::CmdLineParser *parser,
+                                const std::string &sort_string,
+                                std::map<std::string, librmb::RadosMailBox *> *mailboxes,
+                                const std::function<void(librmb::RadosMail *)> &observer) {
+  time_t begin = time(NULL);
+  print_debug("entry: load_mailboxes");
+
+  librmb::RadosMetadata filter;
+  bool use_filter = is_xattr_filter_supported() && parser->get_xattr_filter(&filter);
+  int ret = stream_objects(ms,
+                           [&](librmb::RadosMail *mail) {
+                             if (observer) {
+                               observer(mail);
+                             }
+                             // only listed mails are kept
+                             if (!add_to_mailbox(mailboxes, mail, parser)) {
+                               delete mail;
+                             }
+                             return true;
+                           },
+                           true, use_filter ? &filter : nullptr);
+
+  for (auto &it : *mailboxes) {
+    sort_mails(&it.second->get_mails(), sort_string);
+  }
+  time_t end = time(NULL);
+
+  print_debug("end: load_mailboxes");
+  std::cout << " time elapsed loading objects: " << (end - begin) << std::endl;
+  return ret;
+}
+
+void RmbCommands::free_mailboxes(std::map<std::string, librmb::RadosMailBox *> *mailboxes) {
+  for (auto &it : *mailboxes) {
+    for (auto mail : it.second->get_mails()) {
+      delete mail;
+    }
+    delete it.second;
+  }
+  mailboxes->clear();
+}
+
+bool RmbCommands::add_to_mailbox(std::map<std::string, librmb::RadosMailBox *> *mailboxes,
+                                 librmb::RadosMail *mail, librmb::CmdLineParser *parser) {
+  std::string mailbox_key = std::string(1, static_cast<char>(librmb::RBOX_METADATA_MAILBOX_GUID));
+  char *mailbox_guid = NULL;
+  RadosUtils::get_metadata(mailbox_key, mail->get_metadata(), &mailbox_guid);
+  std::string mailbox_orig_name_key = std::string(1, static_cast<char>(librmb::RBOX_METADATA_ORIG_MAILBOX));
+  char *mailbox_orig_name = NULL;
+  RadosUtils::get_metadata(mailbox_orig_name_key, mail->get_metadata(), &mailbox_orig_name);
+
+  if (mailbox_guid == NULL || mailbox_orig_name == NULL) {
+    std::cout << " mail " << *mail->get_oid() << " with empty mailbox guid is not valid: " << std::endl;
+    return false;
+  }
+
+  if (parser->contains_key(mailbox_key)) {
+    librmb::Predicate *p = parser->get_predicate(mailbox_key);
+    if (!p->eval(mailbox_guid)) {
+      return false;
+    }
+  }
+  librmb::RadosMailBox *mailbox;
+  auto it = mailboxes->find(mailbox_guid);
+  if (it != mailboxes->end()) {
+    mailbox = it->second;
+  } else {
+    mailbox = new librmb::RadosMailBox(mailbox_guid, 1, mailbox_orig_name);
+    mailbox->set_xattr_filter(parser);
+    (*mailboxes)[mailbox_guid] = mailbox;
+  }
+  mailbox->add_to_mailbox_size(mail->get_mail_size());
+  return mailbox->add_mail(mail);
+}
+
 int RmbCommands::print_mail(std::map<std::string, librmb::RadosMailBox *> *mailbox, std::string &output_dir,
                             bool download) {
   print_debug("entry:: print_mail");
-  for (std::map<std::string, librmb::RadosMailBox *>::iterator it = mailbox->begin(); it != mailbox->end(); ++it) {
-    if (it->second->get_mail_count() == 0) {
-      continue;
-    }
-    std::cout << it->second->to_string() << std::endl;
-    if (!download) {
-      continue;
-    }
-    librmb::MailboxTools tools(it->second, output_dir);
-    if (tools.init_mailbox_dir() < 0) {
-      std::cout << " error initializing output dir : " << output_dir << std::endl;
-      break;
-    }
-    for (std::list<librmb::RadosMail *>::iterator it_mail = it->second->get_mails().begin();
-         it_mail != it->second->get_mails().end(); ++it_mail) {
-      const std::string oid = *(*it_mail)->get_oid();
-      librados::bufferlist bl;
-      (*it_mail)->set_mail_buffer(&bl);
-      if (storage->read_mail(oid, (*it_mail)->get_mail_buffer()) > 0) {
-        if (tools.save_mail((*it_mail)) < 0) {
-          std::cout << " error saving mail : " << oid << " to " << tools.get_mailbox_path() << std::endl;
-        }
+  if (!download) {
+    for (std::map<std::string, librmb::RadosMailBox *>::iterator it = mailbox->begin(); it != mailbox->end(); ++it) {
+      if (it->second->get_mail_count() > 0) {
+        std::cout << it->second->to_string() << std::endl;
       }
     }
+    print_debug("end: print_mail");
+    return 0;
+  }
+
+  librmb::RmbExport::Options options;
+  options.aio_window = aio_window;
+  if ((*opts).find("format") != (*opts).end() &&
+      !librmb::MailboxTools::parse_format((*opts)["format"], &options.format)) {
+    std::cerr << " unknown export format : " << (*opts)["format"] << std::endl;
+    return -1;
   }
+  if ((*opts).find("export_buffer") != (*opts).end()) {
+    uint64_t buffer_mb = std::stoull((*opts)["export_buffer"]);
+    if (buffer_mb > MAX_EXPORT_BUFFER_MB) {
+      buffer_mb = MAX_EXPORT_BUFFER_MB;
+    }
+    options.max_buffer_bytes = buffer_mb * 1024 * 1024;
+  }
+  librmb::RmbExport exporter(storage, options);
+  int ret = exporter.run(mailbox, output_dir);
   print_debug("end: print_mail");
-  return 0;
+  return ret;
 }
 
 int RmbCommands::query_mail_storage(std::list<librmb::RadosMail *> *mail_objects, librmb::CmdLineParser *parser,
@@ -556,33 +1207,7 @@ int RmbCommands::query_mail_storage(std::list<librmb::RadosMail *> *mail_objects
 
   std::map<std::string, librmb::RadosMailBox *> mailbox;
   for (std::list<librmb::RadosMail *>::iterator it = mail_objects->begin(); it != mail_objects->end(); ++it) {
-    std::string mailbox_key = std::string(1, static_cast<char>(librmb::RBOX_METADATA_MAILBOX_GUID));
-    char *mailbox_guid = NULL;
-    RadosUtils::get_metadata(mailbox_key, (*it)->get_metadata(), &mailbox_guid);
-    std::string mailbox_orig_name_key = std::string(1, static_cast<char>(librmb::RBOX_METADATA_ORIG_MAILBOX));
-    char *mailbox_orig_name = NULL;
-    RadosUtils::get_metadata(mailbox_orig_name_key, (*it)->get_metadata(), &mailbox_orig_name);
-
-    if (mailbox_guid == NULL || mailbox_orig_name == NULL) {
-      std::cout << " mail " << *(*it)->get_oid() << " with empty mailbox guid is not valid: " << std::endl;
-      continue;
-    }
-
-    if (parser->contains_key(mailbox_key)) {
-      librmb::Predicate *p = parser->get_predicate(mailbox_key);
-      if (!p->eval(mailbox_guid)) {
-        continue;
-      }
-    }
-    if (mailbox.count(mailbox_guid) > 0) {
-      mailbox[mailbox_guid]->add_mail((*it));
-      mailbox[mailbox_guid]->add_to_mailbox_size((*it)->get_mail_size());
-    } else {
-      mailbox[mailbox_guid] = new librmb::RadosMailBox(mailbox_guid, 1, mailbox_orig_name);
-      mailbox[mailbox_guid]->set_xattr_filter(parser);
-      mailbox[mailbox_guid]->add_mail((*it));
-      mailbox[mailbox_guid]->add_to_mailbox_size((*it)->get_mail_size());
-    }
+    add_to_mailbox(&mailbox, *it, parser);
   }
   int ret = 0;
   if (!silent) {
@@ -596,6 +1221,20 @@ int RmbCommands::query_mail_storage(std::list<librmb::RadosMail *> *mail_objects
   return ret;
 }
 
+int RmbCommands::query_mail_storage(librmb::RadosStorageMetadataModule *ms, librmb::CmdLineParser *parser,
+                                    const std::string &sort_string, bool download) {
+  print_debug("entry: query_mail_storage");
+  std::map<std::string, librmb::RadosMailBox *> mailbox;
+  int ret = load_mailboxes(ms, parser, sort_string, &mailbox);
+  if (ret == 0) {
+    std::cout << "mailbox_count: " << mailbox.size() << std::endl;
+    ret = print_mail(&mailbox, parser->get_output_dir(), download);
+  }
+  free_mailboxes(&mailbox);
+  print_debug("end: query_mail_storage");
+  return ret;
+}
+
 RadosStorageMetadataModule *RmbCommands::init_metadata_storage_module(librmb::RadosCephConfig &ceph_cfg,
                                                                       std::string *uid) {
   print_debug("entry: init_metadata_storage_module");
@@ -618,6 +1257,7 @@ RadosStorageMetadataModule *RmbCommands::init_metadata_storage_module(librmb::Ra
     ms = new librmb::RadosMetadataStorageIma(&storage->get_io_ctx(), &cfg);
   } else {
     ms = new librmb::RadosMetadataStorageDefault(&storage->get_io_ctx());
+    xattr_metadata = true;
   }
   if (!(*opts)["namespace"].empty()) {
     *uid = (*opts)["namespace"] + cfg.get_user_suffix();
@@ -13,6 +13,7 @@
 #define SRC_LIBRMB_TOOLS_RMB_RMB_COMMANDS_H_
 #include <stdlib.h>
 
+#include <functional>
 #include <iostream>
 #include <map>
 #include <string>
@@ -38,25 +39,104 @@ class RmbCommands {
               std::map<std::string, std::string> *opts_);
   virtual ~RmbCommands();
 
+  /*!
+   * revert the entries of a save log: saved and copied mails are removed, moved mails are moved back.
+   * Entries are grouped by pool and reverted with at most aio_window operations in flight, processing
+   * stops at the first invalid entry.
+   * @param[out] moved_items moved back entries by user
+   * @return number of reverted entries or -1 if the log or the cluster cannot be opened
+   */
   static int delete_with_save_log(const std::string &save_log, const std::string &rados_cluster,
                                   const std::string &rados_user,
-                                  std::map<std::string, std::list<librmb::RadosSaveLogEntry>> *moved_items);
+                                  std::map<std::string, std::list<librmb::RadosSaveLogEntry>> *moved_items,
+                                  unsigned int aio_window = DEFAULT_AIO_WINDOW);
   void print_debug(const std::string &msg);
   static int lspools();
   int delete_mail(bool confirmed);
-  int delete_namespace(librmb::RadosStorageMetadataModule *ms, std::list<librmb::RadosMail *> &mail_objects,
-                       librmb::RadosCephConfig *cfg, bool confirmed);
+  /*!
+   * remove all objects of the namespace, then its ceph index and user mapping object.
+   * @return linux error code or 0 if successful
+   */
+  int delete_namespace(librmb::RadosCephConfig *cfg, bool confirmed);
+  /*!
+   * remove all objects of the namespace with at most aio_window remove
+   * operations in flight and at most max_ops_per_sec (0 = unlimited) removes per second.
+   * @param[out] removed removed objects, objects already gone are counted as removed
+   * @return linux error code or 0 if successful
+   */
+  int remove_objects(uint64_t max_ops_per_sec, uint64_t *removed, uint64_t *failed);
 
+  /*!
+   * rename user uid to opts["to_rename"]. With generate_namespace the namespace is relinked to the new
+   * user, otherwise the objects are copied to the namespace of the new user.
+   * @return linux error code or 0 if successful
+   */
   int rename_user(librmb::RadosCephConfig *cfg, bool confirmed, const std::string &uid);
+  /*!
+   * migrate the user opts["namespace"] to pool opts["to_pool"] and/or namespace opts["to_ns"] online:
+   * the objects are copied and verified, then the user mapping is switched. After opts["grace"] seconds,
+   * default: the namespace cache ttl, a final pass copies the changes made with the old mapping.
+   * The source objects are removed with opts["delete_source"], which is refused if the grace period is
+   * shorter than the cache ttl or the mapping is not switched by migrate.
+   * @return linux error code or 0 if successful
+   */
+  int migrate_user(librmb::RadosCephConfig *cfg, bool confirmed);
+  /*!
+   * move the shared keys of the dictionary object opts["dict_oid"] to opts["dict_shards"] shard objects.
+   */
+  int migrate_dict_shards(const std::string &cfg_object_name, bool confirmed);
 
   int configuration(bool confirmed, librmb::RadosCephConfig &ceph_cfg);
 
   int load_objects(librmb::RadosStorageMetadataModule *ms, std::list<librmb::RadosMail *> &mail_objects,
-                   std::string &sort_string, bool load_metadata = true);
+                   std::string &sort_string, bool load_metadata = true, const librmb::RadosMetadata *filter = nullptr);
+  /*!
+   * stat and load the metadata of all objects in the namespace, with at most
+   * aio_window operations in flight. The xattrs and omap values are read with the stat, so
+   * no metadata is read synchronously per object. With list_threads > 1 the objects are listed
+   * in parallel slices. consumer is called with each mail
+   * as soon as it is loaded and takes ownership of it, return false to stop.
+   * @param[in] filter list only objects with this xattr value, may be nullptr
+   * @return linux error code or 0 if successful
+   */
+  int stream_objects(librmb::RadosStorageMetadataModule *ms, const std::function<bool(librmb::RadosMail *)> &consumer,
+                     bool load_metadata = true, const librmb::RadosMetadata *filter = nullptr);
+  /*!
+   * true if the metadata module stores each metadata key as xattr, so
+   * objects can be filtered by the osd while listing.
+   */
+  bool is_xattr_filter_supported() { return xattr_metadata; }
   int update_attributes(librmb::RadosStorageMetadataModule *ms, std::map<std::string, std::string> *metadata);
   int print_mail(std::map<std::string, librmb::RadosMailBox *> *mailbox, std::string &output_dir, bool download);
   int query_mail_storage(std::list<librmb::RadosMail *> *mail_objects, librmb::CmdLineParser *parser, bool download,
                          bool silent);
+  /*!
+   * stream the objects of the namespace into their mailboxes (see load_mailboxes), then print
+   * or download (export) them.
+   * @return linux error code or 0 if successful
+   */
+  int query_mail_storage(librmb::RadosStorageMetadataModule *ms, librmb::CmdLineParser *parser,
+                         const std::string &sort_string, bool download);
+  /*!
+   * stream the objects of the namespace (see stream_objects) into their mailboxes. A mail is released
+   * as soon as it is loaded unless it is listed by parser, so only the listed mails are kept in memory.
+   * The mails of each mailbox are sorted by sort_string.
+   * @param[out] mailboxes mailbox guid => mailbox, release them with free_mailboxes.
+   * @param[in] observer called with each loaded mail before it is filtered, may be empty.
+   * @return linux error code or 0 if successful
+   */
+  int load_mailboxes(librmb::RadosStorageMetadataModule *ms, librmb::CmdLineParser *parser,
+                     const std::string &sort_string, std::map<std::string, librmb::RadosMailBox *> *mailboxes,
+                     const std::function<void(librmb::RadosMail *)> &observer = nullptr);
+  /* release the mailboxes and their mails */
+  static void free_mailboxes(std::map<std::string, librmb::RadosMailBox *> *mailboxes);
+  /*!
+   * add mail to its mailbox if it matches the mailbox predicate of parser, the mailbox is created on first use.
+   * @return true if the mail is listed in the mailbox, which does not take ownership of it.
+   */
+  static bool add_to_mailbox(std::map<std::string, librmb::RadosMailBox *> *mailboxes, librmb::RadosMail *mail,
+                             librmb::CmdLineParser *parser);
+  static void sort_mails(std::list<librmb::RadosMail *> *mails, const std::string &sort_string);
   librmb::RadosStorageMetadataModule *init_metadata_storage_module(librmb::RadosCephConfig &ceph_cfg, std::string *uid);
   static bool sort_uid(librmb::RadosMail *i, librmb::RadosMail *j);
   static bool sort_recv_date(librmb::RadosMail *i, librmb::RadosMail *j);
@@ -69,11 +149,45 @@ class RmbCommands {
   std::set<std::string> load_objects(librmb::RadosStorageMetadataModule *ms);
   int remove_ceph_object_index();
   int append_ceph_object_index(const std::set<std::string> &mail_oids);
+  /*!
+   * copy the objects of src_ns until a pass finds no changes, call switch_over, wait grace seconds and
+   * copy the changes made in the meantime.
+   */
+  int migrate_objects(const std::string &src_ns, const std::string &dest_pool, const std::string &dest_ns,
+                      unsigned int grace, const std::function<int()> &switch_over);
+  /*!
+   * rebuild the ceph index of the namespace from the objects with valid metadata. Objects are
+   * listed with opts["list_threads"] parallel listings and appended to the index in batches of
+   * opts["batch_size"] oids, so memory does not grow with the number of mails.
+   * @param[in] observer called with each loaded mail before it is indexed, may be empty. return false to stop.
+   * @param[out] indexed number of oids written to the index
+   * @return linux error code or 0 if successful
+   */
+  int rebuild_ceph_object_index(librmb::RadosStorageMetadataModule *ms, uint64_t *indexed,
+                                const std::function<bool(librmb::RadosMail *)> &observer = nullptr);
+
+  static const unsigned int DEFAULT_AIO_WINDOW = 64;
+  static const unsigned int DEFAULT_LIST_THREADS = 1;
+  static const unsigned int DEFAULT_BATCH_SIZE = 1024;
+  // omap values read with the metadata of a listed object, objects with more are read again
+  static const unsigned int MAX_OMAP_VALS = 1024;
+  // upper limit of opts["export_buffer"] in MB, larger values are clamped
+  static const uint64_t MAX_EXPORT_BUFFER_MB = 1024 * 1024;
+  // copy passes before the namespace is switched
+  static const unsigned int MIGRATE_MAX_PASSES = 5;
+
  private:
   std::map<std::string, std::string> *opts;
   librmb::RadosStorage *storage;
   librmb::RadosCluster *cluster;
   bool is_debug;
+  // max. rados operations in flight (opts["aio_window"])
+  unsigned int aio_window;
+  // parallel object listings (opts["list_threads"]) and oids per listing / index batch (opts["batch_size"])
+  unsigned int list_threads;
+  unsigned int batch_size;
+  // set by init_metadata_storage_module
+  bool xattr_metadata;
 };
 
 } /* namespace librmb */
@@ -0,0 +1,180 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rmb-export.h"
+
+#include <errno.h>
+#include <limits.h>
+
+#include <iostream>
+#include <list>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "../../rados-stats.h"
+
+namespace librmb {
+
+RmbExport::RmbExport(RadosStorage *storage_, const Options &options_)
+    : storage(storage_), options(options_), reading_done(false), reserved_bytes(0), exported(0), failed(0), bytes(0) {
+  if (options.aio_window == 0) {
+    options.aio_window = 1;
+  }
+}
+
+void RmbExport::hand_over(std::deque<Item> *pending) {
+  std::lock_guard<std::mutex> lock(mutex);
+  while (!pending->empty()) {
+    queue.push_back(pending->front());
+    pending->pop_front();
+  }
+  queue_cond.notify_one();
+}
+
+void RmbExport::reserve(uint64_t size, std::deque<Item> *pending) {
+  std::unique_lock<std::mutex> lock(mutex);
+  if (reserved_bytes > 0 && reserved_bytes + size > options.max_buffer_bytes) {
+    // the writer can only release budget for mails it got
+    lock.unlock();
+    hand_over(pending);
+    lock.lock();
+    budget_cond.wait(lock, [&] { return reserved_bytes == 0 || reserved_bytes + size <= options.max_buffer_bytes; });
+  }
+  reserved_bytes += size;
+}
+
+void RmbExport::write_item(const Item &item) {
+  if (item.mail == nullptr) {
+    // end of mailbox
+    if (item.tools->finish() < 0) {
+      std::cerr << " error finishing mailbox : " << item.tools->get_mailbox_path() << std::endl;
+    }
+    return;
+  }
+  const std::string oid = *item.mail->get_oid();
+  int ret = -EIO;
+  if (item.completion != nullptr) {
+    item.completion->wait_for_complete();
+    ret = item.completion->get_return_value();
+    item.completion->release();
+  }
+  if (ret < 0) {
+    std::cerr << " error reading mail : " << oid << " ret code: " << ret << std::endl;
+    failed++;
+  } else if (ret == 0) {
+    // a mail object without content can not be exported
+    std::cerr << " error reading mail : " << oid << " is empty" << std::endl;
+    failed++;
+  } else {
+    item.mail->set_mail_buffer(item.buffer);
+    if (item.tools->save_mail(item.mail) < 0) {
+      std::cerr << " error saving mail : " << oid << " to " << item.tools->get_mailbox_path() << std::endl;
+      failed++;
+    } else {
+      exported++;
+      bytes += ret;
+    }
+    item.mail->set_mail_buffer(nullptr);
+  }
+  delete item.buffer;
+}
+
+void RmbExport::write_items() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    queue_cond.wait(lock, [&] { return !queue.empty() || reading_done; });
+    if (queue.empty()) {
+      break;
+    }
+    Item item = queue.front();
+    queue.pop_front();
+    lock.unlock();
+    write_item(item);
+    lock.lock();
+    reserved_bytes -= item.reserved;
+    budget_cond.notify_one();
+  }
+}
+
+int RmbExport::run(std::map<std::string, RadosMailBox *> *mailboxes, const std::string &output_dir) {
+  if (storage == nullptr || mailboxes == nullptr) {
+    return -1;
+  }
+  std::vector<MailboxTools *> tools_list;
+  std::deque<Item> pending;
+  int ret = 0;
+
+  std::thread writer(&RmbExport::write_items, this);
+  for (std::map<std::string, RadosMailBox *>::iterator it = mailboxes->begin(); it != mailboxes->end(); ++it) {
+    if (it->second->get_mail_count() == 0) {
+      continue;
+    }
+    std::cout << it->second->to_string() << std::endl;
+    MailboxTools *tools = new MailboxTools(it->second, output_dir, options.format);
+    tools_list.push_back(tools);
+    if (tools->init_mailbox_dir() < 0) {
+      std::cout << " error initializing output dir : " << output_dir << std::endl;
+      ret = -1;
+      break;
+    }
+    for (std::list<RadosMail *>::iterator it_mail = it->second->get_mails().begin();
+         it_mail != it->second->get_mails().end(); ++it_mail) {
+      Item item;
+      item.mail = *it_mail;
+      item.tools = tools;
+      item.reserved = (*it_mail)->get_mail_size() > 0 ? (*it_mail)->get_mail_size() : 0;
+      reserve(item.reserved, &pending);
+
+      item.buffer = new librados::bufferlist();
+      item.completion = librados::Rados::aio_create_completion();
+      RadosStatsAioTimer *timer = RadosStatsAioTimer::start(RADOS_OP_READ, *(*it_mail)->get_oid(), item.completion);
+      int read_ret =
+          storage->get_io_ctx().aio_read(*(*it_mail)->get_oid(), item.completion, item.buffer, INT_MAX, 0);
+      if (read_ret < 0) {
+        timer->cancel(read_ret);
+        item.completion->release();
+        item.completion = nullptr;
+      }
+      pending.push_back(item);
+      // pass completed reads on in list order, wait for the oldest one if the window is full
+      while (!pending.empty() && (pending.size() >= options.aio_window || pending.front().completion == nullptr ||
+                                  pending.front().completion->is_complete())) {
+        if (pending.front().completion != nullptr) {
+          pending.front().completion->wait_for_complete();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(pending.front());
+        pending.pop_front();
+        queue_cond.notify_one();
+      }
+    }
+    Item end_of_mailbox = {nullptr, tools, nullptr, nullptr, 0};
+    pending.push_back(end_of_mailbox);
+  }
+  hand_over(&pending);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    reading_done = true;
+    queue_cond.notify_one();
+  }
+  writer.join();
+
+  for (auto tools : tools_list) {
+    delete tools;
+  }
+  std::cout << " exported " << exported << " mails, " << bytes << " bytes, " << failed << " failed" << std::endl;
+  if (ret == 0 && failed > 0) {
+    ret = -EIO;
+  }
+  return ret;
+}
+
+}  // namespace librmb
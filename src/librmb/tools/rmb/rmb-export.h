@@ -0,0 +1,94 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_TOOLS_RMB_RMB_EXPORT_H_
+#define SRC_LIBRMB_TOOLS_RMB_RMB_EXPORT_H_
+
+#include <stdint.h>
+
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <map>
+#include <mutex>  // NOLINT
+#include <string>
+
+#include "rados-storage.h"
+#include "mailbox_tools.h"
+#include "rados-mail-box.h"
+
+namespace librmb {
+
+/**
+ * rmb get
+ *
+ * Exports the mails of mailboxes to the file system. Mails are read with up
+ * to aio_window rados reads in flight, a writer thread stores them in the
+ * order they were listed. Mails which are read but not yet written are
+ * limited to max_buffer_bytes, a single mail larger than the budget is
+ * exported on its own.
+ */
+class RmbExport {
+ public:
+  struct Options {
+    Options() : aio_window(64), max_buffer_bytes(64 * 1024 * 1024), format(RMB_MAILBOX_FORMAT_FILES) {}
+
+    unsigned int aio_window;
+    uint64_t max_buffer_bytes;
+    rmb_mailbox_format format;
+  };
+
+  RmbExport(RadosStorage *storage_, const Options &options_);
+
+  /*!
+   * export the mails of all mailboxes with mails to output_dir
+   * @return linux error code or 0 if successful
+   */
+  int run(std::map<std::string, RadosMailBox *> *mailboxes, const std::string &output_dir);
+
+  uint64_t get_exported() const { return exported; }
+  uint64_t get_failed() const { return failed; }
+  uint64_t get_bytes() const { return bytes; }
+
+ private:
+  struct Item {
+    RadosMail *mail;
+    MailboxTools *tools;
+    librados::AioCompletion *completion;
+    librados::bufferlist *buffer;
+    // bytes reserved of the buffer budget
+    uint64_t reserved;
+  };
+
+  void reserve(uint64_t size, std::deque<Item> *pending);
+  void hand_over(std::deque<Item> *pending);
+  void write_items();
+  void write_item(const Item &item);
+
+ private:
+  RadosStorage *storage;
+  Options options;
+
+  std::mutex mutex;
+  std::condition_variable queue_cond;
+  std::condition_variable budget_cond;
+  std::deque<Item> queue;
+  bool reading_done;
+  uint64_t reserved_bytes;
+
+  // written by the writer thread, read after it finished
+  uint64_t exported;
+  uint64_t failed;
+  uint64_t bytes;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_TOOLS_RMB_RMB_EXPORT_H_
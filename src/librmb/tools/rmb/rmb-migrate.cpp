@@ -0,0 +1,258 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "rmb-migrate.h"
+
+#include <errno.h>
+
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "../../rados-stats.h"
+
+namespace librmb {
+
+RmbMigrate::RmbMigrate(RadosStorage *storage_, RadosCluster *cluster_, const Options &options_)
+    : storage(storage_),
+      cluster(cluster_),
+      options(options_),
+      src_io_ctx(nullptr),
+      dest_io_ctx(nullptr),
+      pass(0),
+      failed(0),
+      bytes(0) {
+  if (options.aio_window == 0) {
+    options.aio_window = 1;
+  }
+}
+
+void RmbMigrate::issue(Copy *copy, copy_stage stage) {
+  copy->stage = stage;
+  copy->completion = librados::Rados::aio_create_completion();
+  int ret = 0;
+  RadosStatsAioTimer *timer = nullptr;
+  switch (stage) {
+    case COPY_STAT_SOURCE:
+      copy->src_read_op.getxattrs(&copy->src_xattrs, nullptr);
+      copy->src_read_op.stat(&copy->src_size, &copy->src_mtime, nullptr);
+      timer = RadosStatsAioTimer::start(RADOS_OP_GETXATTRS, copy->oid, copy->completion);
+      ret = src_io_ctx->aio_operate(copy->oid, copy->completion, &copy->src_read_op, &copy->unused);
+      break;
+    case COPY_WRITE:
+      // copies data, xattrs and mtime on the osd
+#if LIBRADOS_VERSION_CODE >= 30000
+      copy->write_op.copy_from(copy->oid, *src_io_ctx, 0, 0);
+#else
+      copy->write_op.copy_from(copy->oid, *src_io_ctx, 0);
+#endif
+      timer = RadosStatsAioTimer::start(RADOS_OP_COPY_FROM, copy->oid, copy->completion);
+      ret = dest_io_ctx->aio_operate(copy->oid, copy->completion, &copy->write_op);
+      break;
+    case COPY_VERIFY:
+      copy->dest_read_op.getxattrs(&copy->dest_xattrs, nullptr);
+      copy->dest_read_op.stat(&copy->dest_size, &copy->dest_mtime, nullptr);
+      timer = RadosStatsAioTimer::start(RADOS_OP_GETXATTRS, copy->oid, copy->completion);
+      ret = dest_io_ctx->aio_operate(copy->oid, copy->completion, &copy->dest_read_op, &copy->unused);
+      break;
+    default:
+      ret = -EINVAL;
+      break;
+  }
+  if (ret < 0) {
+    if (timer != nullptr) {
+      timer->cancel(ret);
+    }
+    copy->completion->release();
+    copy->completion = nullptr;
+    copy->ret = ret;
+    copy->done = true;
+  }
+}
+
+static bool xattrs_equal(const std::map<std::string, librados::bufferlist> &a,
+                         const std::map<std::string, librados::bufferlist> &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (auto it_a = a.begin(), it_b = b.begin(); it_a != a.end(); ++it_a, ++it_b) {
+    if (it_a->first.compare(it_b->first) != 0 || !it_a->second.contents_equal(it_b->second)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static size_t hash_xattrs(const std::map<std::string, librados::bufferlist> &xattrs) {
+  std::hash<std::string> hasher;
+  size_t hash = 0;
+  for (auto &it : xattrs) {
+    hash = hash * 31 + hasher(it.first);
+    hash = hash * 31 + hasher(it.second.to_str());
+  }
+  return hash;
+}
+
+void RmbMigrate::step(Copy *copy) {
+  copy->completion->wait_for_complete();
+  int ret = copy->completion->get_return_value();
+  copy->completion->release();
+  copy->completion = nullptr;
+
+  if (ret < 0) {
+    copy->ret = ret;
+    copy->done = true;
+  } else if (copy->stage == COPY_STAT_SOURCE) {
+    auto it = copied_objects.find(copy->oid);
+    if (it != copied_objects.end() && it->second.size == copy->src_size && it->second.mtime == copy->src_mtime &&
+        it->second.xattrs_hash == hash_xattrs(copy->src_xattrs)) {
+      copy->unchanged = true;
+      copy->done = true;
+    } else {
+      issue(copy, COPY_WRITE);
+    }
+  } else if (copy->stage == COPY_WRITE) {
+    issue(copy, COPY_VERIFY);
+  } else {
+    if (copy->dest_size != copy->src_size || !xattrs_equal(copy->src_xattrs, copy->dest_xattrs)) {
+      copy->ret = -EIO;
+    }
+    copy->done = true;
+  }
+}
+
+void RmbMigrate::finish(Copy *copy, uint64_t *copied) {
+  if (copy->ret == -ENOENT && copy->stage == COPY_STAT_SOURCE) {
+    // expunged since it was listed, an earlier copy is removed
+    auto it = copied_objects.find(copy->oid);
+    if (it != copied_objects.end()) {
+      it->second.pass = 0;
+    }
+  } else if (copy->ret < 0) {
+    std::cerr << " copying object " << copy->oid << " failed, ret code: " << copy->ret << std::endl;
+    failed++;
+  } else if (!copy->unchanged) {
+    CopiedObject &copied_object = copied_objects[copy->oid];
+    copied_object.size = copy->src_size;
+    copied_object.mtime = copy->src_mtime;
+    copied_object.xattrs_hash = hash_xattrs(copy->src_xattrs);
+    copied_object.pass = pass;
+    bytes += copy->src_size;
+    (*copied)++;
+  }
+  delete copy;
+}
+
+int RmbMigrate::remove_stale_copies(uint64_t *removed) {
+  std::deque<std::pair<std::string, librados::AioCompletion *>> in_flight;
+  uint64_t failed_before = failed;
+  auto finish_remove = [&]() {
+    librados::AioCompletion *completion = in_flight.front().second;
+    completion->wait_for_complete();
+    int ret = completion->get_return_value();
+    completion->release();
+    if (ret < 0 && ret != -ENOENT) {
+      std::cerr << " removing copy " << in_flight.front().first << " failed, ret code: " << ret << std::endl;
+      failed++;
+    } else {
+      copied_objects.erase(in_flight.front().first);
+      (*removed)++;
+    }
+    in_flight.pop_front();
+  };
+
+  for (auto &it : copied_objects) {
+    if (it.second.pass == pass) {
+      continue;
+    }
+    librados::AioCompletion *completion = librados::Rados::aio_create_completion();
+    RadosStatsAioTimer *timer = RadosStatsAioTimer::start(RADOS_OP_REMOVE, it.first, completion);
+    int ret = dest_io_ctx->aio_remove(it.first, completion);
+    if (ret < 0) {
+      timer->cancel(ret);
+      completion->release();
+      std::cerr << " removing copy " << it.first << " failed, ret code: " << ret << std::endl;
+      failed++;
+      continue;
+    }
+    in_flight.push_back(std::make_pair(it.first, completion));
+    if (in_flight.size() >= options.aio_window) {
+      finish_remove();
+    }
+  }
+  while (!in_flight.empty()) {
+    finish_remove();
+  }
+  return failed > failed_before ? -EIO : 0;
+}
+
+int RmbMigrate::copy_pass(const std::string &src_ns, const std::string &dest_pool, const std::string &dest_ns,
+                          uint64_t *copied, uint64_t *removed) {
+  *copied = 0;
+  *removed = 0;
+  int ret = cluster->io_ctx_get(storage->get_pool_name(), src_ns, &src_io_ctx);
+  if (ret < 0) {
+    return ret;
+  }
+  ret = cluster->io_ctx_get(dest_pool, dest_ns, &dest_io_ctx);
+  if (ret < 0) {
+    return ret;
+  }
+  uint64_t failed_before = failed;
+  pass++;
+
+  std::deque<Copy *> in_flight;
+  // advance completed stages and finish copies oldest first until less than limit are in flight
+  auto pump = [&](size_t limit) {
+    while (!in_flight.empty()) {
+      for (auto copy : in_flight) {
+        if (!copy->done && copy->completion->is_complete()) {
+          step(copy);
+        }
+      }
+      while (!in_flight.empty() && in_flight.front()->done) {
+        finish(in_flight.front(), copied);
+        in_flight.pop_front();
+      }
+      if (in_flight.size() < limit) {
+        break;
+      }
+      step(in_flight.front());
+    }
+  };
+
+  storage->set_namespace(src_ns);
+  ret = storage->find_mails_parallel(nullptr, options.list_threads, options.batch_size,
+                                     [&](std::vector<std::string> *batch) {
+                                       for (auto &oid : *batch) {
+                                         auto it = copied_objects.find(oid);
+                                         if (it != copied_objects.end()) {
+                                           it->second.pass = pass;
+                                         }
+                                         Copy *copy = new Copy();
+                                         copy->oid = oid;
+                                         issue(copy, COPY_STAT_SOURCE);
+                                         in_flight.push_back(copy);
+                                         pump(options.aio_window);
+                                       }
+                                       return true;
+                                     });
+  pump(1);
+  if (ret < 0) {
+    return ret;
+  }
+  // the listing is complete, copies whose source was not listed are stale
+  remove_stale_copies(removed);
+  return failed > failed_before ? -EIO : 0;
+}
+
+}  // namespace librmb
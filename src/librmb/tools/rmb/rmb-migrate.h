@@ -0,0 +1,122 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_LIBRMB_TOOLS_RMB_RMB_MIGRATE_H_
+#define SRC_LIBRMB_TOOLS_RMB_RMB_MIGRATE_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+#include "rados-cluster.h"
+#include "rados-storage.h"
+
+namespace librmb {
+
+/**
+ * Namespace migration
+ *
+ * Copies the objects of a namespace to another namespace and/or pool with
+ * server side copy_from, at most aio_window objects in flight. Each copy is
+ * verified: size and xattrs of the copy need to match the source.
+ *
+ * A later pass stats each source object and only copies objects which are new
+ * or whose size, mtime or xattrs changed since they were copied. Copies of
+ * objects removed from the source are removed as well. So a user can be
+ * migrated online: copy until a pass finds no changes, switch the namespace
+ * mapping and run a last pass for mails saved, updated or expunged by sessions
+ * which still used the old mapping.
+ */
+class RmbMigrate {
+ public:
+  struct Options {
+    Options() : aio_window(64), list_threads(1), batch_size(1024) {}
+
+    unsigned int aio_window;
+    unsigned int list_threads;
+    unsigned int batch_size;
+  };
+
+  /*!
+   * @param[in] storage connected to the source pool, its namespace is set to the source namespace.
+   * @param[in] cluster io contexts of the destination
+   */
+  RmbMigrate(RadosStorage *storage_, RadosCluster *cluster_, const Options &options_);
+
+  /*!
+   * copy all objects of src_ns which are new or changed since an earlier pass and remove the
+   * copies of objects which are no longer in src_ns.
+   * @param[out] copied objects copied by this pass
+   * @param[out] removed copies removed by this pass
+   * @return linux error code or 0 if successful, -EIO if an object failed
+   */
+  int copy_pass(const std::string &src_ns, const std::string &dest_pool, const std::string &dest_ns,
+                uint64_t *copied, uint64_t *removed);
+
+  uint64_t get_copied() const { return copied_objects.size(); }
+  uint64_t get_failed() const { return failed; }
+  uint64_t get_bytes() const { return bytes; }
+
+ private:
+  enum copy_stage { COPY_STAT_SOURCE, COPY_WRITE, COPY_VERIFY };
+
+  struct Copy {
+    std::string oid;
+    copy_stage stage = COPY_STAT_SOURCE;
+    librados::AioCompletion *completion = nullptr;
+    librados::ObjectReadOperation src_read_op;
+    librados::ObjectWriteOperation write_op;
+    librados::ObjectReadOperation dest_read_op;
+    librados::bufferlist unused;
+    std::map<std::string, librados::bufferlist> src_xattrs;
+    std::map<std::string, librados::bufferlist> dest_xattrs;
+    uint64_t src_size = 0;
+    uint64_t dest_size = 0;
+    time_t src_mtime = 0;
+    time_t dest_mtime = 0;
+    int ret = 0;
+    bool done = false;
+    // the source did not change since it was copied
+    bool unchanged = false;
+  };
+
+  // state of the source object when it was copied
+  struct CopiedObject {
+    uint64_t size = 0;
+    time_t mtime = 0;
+    size_t xattrs_hash = 0;
+    // last pass which listed the source object
+    uint64_t pass = 0;
+  };
+
+  void issue(Copy *copy, copy_stage stage);
+  void step(Copy *copy);
+  void finish(Copy *copy, uint64_t *copied);
+  /* remove the copies of source objects not listed by this pass */
+  int remove_stale_copies(uint64_t *removed);
+
+ private:
+  RadosStorage *storage;
+  RadosCluster *cluster;
+  Options options;
+
+  librados::IoCtx *src_io_ctx;
+  librados::IoCtx *dest_io_ctx;
+  std::map<std::string, CopiedObject> copied_objects;
+  uint64_t pass;
+  uint64_t failed;
+  uint64_t bytes;
+};
+
+}  // namespace librmb
+
+#endif  // SRC_LIBRMB_TOOLS_RMB_RMB_MIGRATE_H_
@@ -18,6 +18,9 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <fstream>
+#include <memory>
+#include <set>
 
 #include <limits>
 
@@ -36,6 +39,10 @@
 #include "rados-dovecot-ceph-cfg-impl.h"
 #include "rados-metadata-storage-default.h"
 #include "rmb-commands.h"
+#include "rmb-bench.h"
+#include "rmb-batch.h"
+#include "rados-storage-memory.h"
+#include "rados-metadata-storage-memory.h"
 #undef PACKAGE_BUGREPORT
 #undef PACKAGE_NAME
 #undef PACKAGE_STRING
@@ -165,26 +172,40 @@ static void usage(std::ostream &out) {
          "   -c    rados cluster name, default: 'ceph'\n"
          "   -u    rados user name, default: 'client.admin' \n"
          "   -D    debug output \n"
+         "   -d    dictionary object oid, default: ''\n"
          "   -r    save log with objects to delete => deletes all entries (save,mv,cp) from object store, use with \n"
+         "   --save_log_csv file  print the save log (csv or binary) as csv\n"
          "   -v    print plugin version\n"
+         "   -w    max. rados operations in flight when loading objects (ls, get, delete, -r), default: 64\n"
+         "   --list_threads n  list the objects in n parallel slices (ls, get, batch), default: 1\n"
+         "   --batch_size n    oids per listing batch and per ceph index append (batch index), default: 1024\n"
          "care!!!! \n "
          "\n"
          "\nMAIL COMMANDS\n"
          "    ls -    list all mails and mailbox statistic\n"
          "            use Metadata value to filter results \n"
          "            filter: e.g. U=7, \"U<7\", \"U>7\"\n"
-         "            date format:  %Y-%m-%d %H:%M:%S e.g. (\"R=2017-08-22 14:30\")\n"
+         "            date format:  %Y-%m-%d %H:%M[:%S] e.g. (\"R=2017-08-22 14:30\")\n"
          "            comparison operators: =,>,< for strings only = is supported.\n"
          "    get -   download mails to file\n"
          "            filter: e.g. U=7, \"U<7\", \"U>7\"\n"
-         "            date format: %Y-%m-%d %H:%M:%S e.g. (\"R=2017-08-22 14:30\")\n"
+         "            date format: %Y-%m-%d %H:%M[:%S] e.g. (\"R=2017-08-22 14:30\")\n"
          "            comparison operators: =,>,< for strings only = is supported.\n"
+         "          --format f        files (default), maildir or mbox\n"
+         "          --export_buffer n max. MB read but not yet written, default: 64\n"
          "    set     oid metadata value   e.g. U 1 B INBOX R \"2017-08-22 14:30\"\n"
          "    sort    values: uid, recv_date, save_date, phy_size\n"
          "    lspools list all available pools\n"
          "\n"
          "    delete  deletes the ceph object, use oid attribute to identify mail.\n"
+         "    delete - deletes all objects of namespace -N, its ceph index and user mapping\n"
+         "          --rate n        max. objects deleted per second, default: unlimited\n"
          "    rename  dovecot_user_name, rename a user\n"
+         "    migrate             copy the objects of user -N to another pool or namespace and switch the user\n"
+         "          --to_pool pool  destination pool, default: -p\n"
+         "          --to_ns ns      destination namespace (generate_namespace only), default: current namespace\n"
+         "          --grace secs    wait after the switch before the final pass, default: rbox_namespace_cache_ttl\n"
+         "          --delete_source remove the source objects after the migration, requires the full grace period\n"
 
          "\nMAILBOX COMMANDS\n"
          "    ls     mb  -N user        list all mailboxes\n"
@@ -193,6 +214,27 @@ static void usage(std::ostream &out) {
          "    cfg show              print configuration to screen\n"
          "    cfg update key=value  sets the configuration value key=value\n"
          "                          e.g. user_mapping=true\n"
+         "\nBENCHMARK COMMANDS\n"
+         "    bench workload        replay a workload against pool -p in namespaces <-N>_<thread>\n"
+         "                          workloads: deliver, fetch, fetch_metadata, flags, copy, expunge, mixed\n"
+         "          --threads n     number of threads, default: 1\n"
+         "          --ops n         operations per thread, default: 1000\n"
+         "          --mails n       mails delivered per thread before the workload, default: 100\n"
+         "          --mail_size s   mail size distribution size[:weight],...\n"
+         "                          default: 2048:40,8192:30,32768:20,262144:8,2097152:2\n"
+         "          --memory        use the in-memory backend instead of the ceph cluster\n"
+         "          --latency op=us[:jitter_us[:error_rate]],...  inject latency and errors (--memory only)\n"
+         "\nBATCH COMMANDS\n"
+         "    batch ls|index        run for many users in parallel, ls: count objects and invalid metadata,\n"
+         "                          index: rebuild the ceph index from the mail objects\n"
+         "          --users file    users to process, one per line, - for stdin\n"
+         "          -A              all users of pool -p\n"
+         "          --threads n     users processed in parallel, default: 4\n"
+         "          --timeout s     time limit per user, default: none\n"
+         "          --summary file  write a json line per user and the totals to file\n"
+         "\nDICTIONARY COMMANDS\n"
+         "    shards n [-d oid]     move the shared keys of the dictionary object oid in pool -p\n"
+         "                          to n shard objects (dict_shared_shards=n)\n"
          "\n";
 }
 
@@ -242,8 +284,22 @@ static void parse_cmd_line_args(std::map<std::string, std::string> *opts, bool &
       (*opts)["rados_user"] = val;
     } else if (ceph_argparse_flag(*args, i, "-D", "--debug", static_cast<char>(NULL))) {
       (*opts)["debug"] = "true";
+    } else if (ceph_argparse_witharg(args, &i, &val, "-w", "--aio_window", static_cast<char>(NULL))) {
+      (*opts)["aio_window"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "--list_threads", static_cast<char>(NULL))) {
+      (*opts)["list_threads"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "--batch_size", static_cast<char>(NULL))) {
+      (*opts)["batch_size"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "--format", static_cast<char>(NULL))) {
+      (*opts)["format"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "--export_buffer", static_cast<char>(NULL))) {
+      (*opts)["export_buffer"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "--rate", static_cast<char>(NULL))) {
+      (*opts)["rate"] = val;
     } else if (ceph_argparse_witharg(args, &i, &val, "-r", "--remove", static_cast<char>(NULL))) {
       (*opts)["remove_save_log"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "--save_log_csv", static_cast<char>(NULL))) {
+      (*opts)["save_log_csv"] = val;
     } else if (ceph_argparse_witharg(args, &i, &val, "ls", "--ls", static_cast<char>(NULL))) {
       (*opts)["ls"] = val;
     } else if (ceph_argparse_witharg(args, &i, &val, "get", "--get", static_cast<char>(NULL))) {
@@ -269,6 +325,44 @@ static void parse_cmd_line_args(std::map<std::string, std::string> *opts, bool &
     } else if (ceph_argparse_witharg(args, &i, &val, "rename", "--rename", static_cast<char>(NULL))) {
       // rename
       (*opts)["to_rename"] = val;
+    } else if (ceph_argparse_flag(*args, i, "migrate", "--migrate", static_cast<char>(NULL))) {
+      (*opts)["migrate"] = "true";
+    } else if (ceph_argparse_witharg(args, &i, &val, "--to_pool", static_cast<char>(NULL))) {
+      (*opts)["to_pool"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "--to_ns", static_cast<char>(NULL))) {
+      (*opts)["to_ns"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "--grace", static_cast<char>(NULL))) {
+      (*opts)["grace"] = val;
+    } else if (ceph_argparse_flag(*args, i, "--delete_source", static_cast<char>(NULL))) {
+      (*opts)["delete_source"] = "true";
+    } else if (ceph_argparse_witharg(args, &i, &val, "shards", "--shards", static_cast<char>(NULL))) {
+      (*opts)["dict_shards"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "-d", "--dict_oid", static_cast<char>(NULL))) {
+      (*opts)["dict_oid"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "bench", "--bench", static_cast<char>(NULL))) {
+      (*opts)["bench"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "--threads", static_cast<char>(NULL))) {
+      (*opts)["threads"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "--ops", static_cast<char>(NULL))) {
+      (*opts)["bench_ops"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "--mails", static_cast<char>(NULL))) {
+      (*opts)["bench_mails"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "--mail_size", static_cast<char>(NULL))) {
+      (*opts)["bench_mail_size"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "--latency", static_cast<char>(NULL))) {
+      (*opts)["bench_latency"] = val;
+    } else if (ceph_argparse_flag(*args, i, "--memory", static_cast<char>(NULL))) {
+      (*opts)["bench_memory"] = "true";
+    } else if (ceph_argparse_witharg(args, &i, &val, "batch", "--batch", static_cast<char>(NULL))) {
+      (*opts)["batch"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "--users", static_cast<char>(NULL))) {
+      (*opts)["batch_users"] = val;
+    } else if (ceph_argparse_flag(*args, i, "-A", "--all_users", static_cast<char>(NULL))) {
+      (*opts)["batch_all_users"] = "true";
+    } else if (ceph_argparse_witharg(args, &i, &val, "--timeout", static_cast<char>(NULL))) {
+      (*opts)["batch_timeout"] = val;
+    } else if (ceph_argparse_witharg(args, &i, &val, "--summary", static_cast<char>(NULL))) {
+      (*opts)["batch_summary"] = val;
     } else {
       if (idx + 1 < (*args).size()) {
         std::string m_idx((*args)[idx]);
@@ -281,6 +375,349 @@ static void parse_cmd_line_args(std::map<std::string, std::string> *opts, bool &
   }
 }
 
+/*!
+ * parses the numeric value of opts[key], prints an error and the usage if it is invalid.
+ * @param[in] name option name for the error message
+ * @param[in] max largest valid value
+ * @return false if the value is not a number in [0, max]
+ */
+static bool parse_number_option(std::map<std::string, std::string> &opts, const std::string &key, const char *name,
+                                uint64_t max, uint64_t *value) {
+  const std::string &str = opts[key];
+  char *end = nullptr;
+  errno = 0;
+  unsigned long long number = strtoull(str.c_str(), &end, 10);  // NOLINT
+  if (str.empty() || str.find('-') != std::string::npos || *end != '\0' || errno == ERANGE || number > max) {
+    std::cerr << "invalid " << name << ": '" << str << "'" << std::endl;
+    usage(std::cerr);
+    return false;
+  }
+  *value = number;
+  return true;
+}
+
+/*!
+ * validate the numeric options which RmbCommands reads from opts.
+ * @return false if an option is not a number in its range
+ */
+static bool parse_command_number_options(std::map<std::string, std::string> &opts) {
+  static const struct {
+    const char *key;
+    const char *name;
+    uint64_t max;
+  } number_options[] = {
+      {"aio_window", "--aio_window", static_cast<uint64_t>(std::numeric_limits<int>::max())},
+      {"list_threads", "--list_threads", static_cast<uint64_t>(std::numeric_limits<int>::max())},
+      {"batch_size", "--batch_size", static_cast<uint64_t>(std::numeric_limits<int>::max())},
+      {"rate", "--rate", std::numeric_limits<uint64_t>::max()},
+      {"export_buffer", "--export_buffer", std::numeric_limits<uint64_t>::max()},
+      {"dict_shards", "shards", static_cast<uint64_t>(std::numeric_limits<int>::max())},
+  };
+  for (auto &option : number_options) {
+    uint64_t value = 0;
+    if (opts.find(option.key) != opts.end() && !parse_number_option(opts, option.key, option.name, option.max, &value)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool parse_bench_faults(const std::string &spec, librmb::RadosMemoryBackend *backend) {
+  std::stringstream ss(spec);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    size_t pos = item.find('=');
+    if (pos == std::string::npos) {
+      return false;
+    }
+    std::string name = item.substr(0, pos);
+    int op = 0;
+    while (op < librmb::RADOS_OP_COUNT && name != librmb::RadosStats::op_name(static_cast<librmb::rbox_rados_op>(op))) {
+      op++;
+    }
+    if (op == librmb::RADOS_OP_COUNT) {
+      return false;
+    }
+    librmb::RadosMemoryFault fault;
+    char *end = nullptr;
+    fault.latency_usecs = strtoul(item.c_str() + pos + 1, &end, 10);
+    if (*end == ':') {
+      fault.jitter_usecs = strtoul(end + 1, &end, 10);
+    }
+    if (*end == ':') {
+      fault.error_rate = strtod(end + 1, &end);
+    }
+    if (*end != '\0') {
+      return false;
+    }
+    backend->set_fault(static_cast<librmb::rbox_rados_op>(op), fault);
+  }
+  return true;
+}
+
+static int run_bench(std::map<std::string, std::string> &opts, const std::string &pool_name,
+                     const std::string &rados_cluster, const std::string &rados_user) {
+  bool memory = opts.find("bench_memory") != opts.end();
+  librmb::RadosMemoryBackend backend;
+  librmb::RadosClusterMemory memory_cluster(&backend);
+  librmb::RadosClusterImpl cluster;
+
+  auto create_storage = [&]() -> librmb::RadosStorage * {
+    librmb::RadosStorage *storage = nullptr;
+    int ret;
+    if (memory) {
+      storage = new librmb::RadosStorageMemory(&memory_cluster);
+      ret = storage->open_connection(pool_name);
+    } else {
+      storage = new librmb::RadosStorageImpl(&cluster);
+      ret = storage->open_connection(pool_name, rados_cluster, rados_user);
+    }
+    if (ret < 0) {
+      std::cerr << " error opening rados connection. Errorcode: " << ret << std::endl;
+      delete storage;
+      return nullptr;
+    }
+    return storage;
+  };
+  auto create_metadata = [&](librmb::RadosStorage *storage) -> librmb::RadosStorageMetadataModule * {
+    if (memory) {
+      return new librmb::RadosMetadataStorageMemory(static_cast<librmb::RadosStorageMemory *>(storage));
+    }
+    return new librmb::RadosMetadataStorageDefault(&storage->get_io_ctx());
+  };
+  auto free_storage = [](librmb::RadosStorage *storage) {
+    storage->close_connection();
+    delete storage;
+  };
+
+  librmb::RmbBench bench(create_storage, create_metadata, free_storage);
+  if (!bench.set_workload(opts["bench"])) {
+    std::cerr << "unknown workload: " << opts["bench"] << std::endl;
+    return -1;
+  }
+  librmb::RmbBench::Options options;
+  if (opts.find("namespace") != opts.end()) {
+    options.ns_prefix = opts["namespace"];
+  }
+  uint64_t value = 0;
+  if (opts.find("threads") != opts.end()) {
+    if (!parse_number_option(opts, "threads", "--threads", std::numeric_limits<int>::max(), &value)) {
+      return -1;
+    }
+    options.threads = value;
+  }
+  if (opts.find("bench_ops") != opts.end()) {
+    if (!parse_number_option(opts, "bench_ops", "--ops", std::numeric_limits<uint64_t>::max(), &value)) {
+      return -1;
+    }
+    options.ops = value;
+  }
+  if (opts.find("bench_mails") != opts.end()) {
+    if (!parse_number_option(opts, "bench_mails", "--mails", std::numeric_limits<int>::max(), &value)) {
+      return -1;
+    }
+    options.mails = value;
+  }
+  if (opts.find("bench_mail_size") != opts.end()) {
+    options.mail_size = opts["bench_mail_size"];
+  }
+  if (!bench.set_options(options)) {
+    std::cerr << "invalid bench options" << std::endl;
+    return -1;
+  }
+  if (opts.find("bench_latency") != opts.end()) {
+    if (!memory || !parse_bench_faults(opts["bench_latency"], &backend)) {
+      std::cerr << "invalid --latency, e.g. read=500:100:0.01 (requires --memory)" << std::endl;
+      return -1;
+    }
+  }
+  return bench.run(std::cout);
+}
+
+// namespace mappings read ahead of the batch workers, below the size of the namespace cache
+#define BATCH_PREFETCH_WINDOW 512
+#define BATCH_PREFETCH_IN_FLIGHT 64
+
+/* scans the objects of one user at a time with its own storage on the shared cluster connection */
+class RmbBatchScanWorker : public librmb::RmbBatchWorker {
+ public:
+  RmbBatchScanWorker(librmb::RadosCluster *cluster_, bool rebuild_index_, const std::map<std::string, std::string> &opts_)
+      : cluster(cluster_), storage(cluster_), rebuild_index(rebuild_index_), opts(opts_) {}
+
+  int open(const std::string &pool_name, const std::string &rados_cluster, const std::string &rados_user,
+           const std::string &config_obj) {
+    int ret = storage.open_connection(pool_name, rados_cluster, rados_user);
+    if (ret < 0) {
+      return ret;
+    }
+    ceph_cfg.set_io_ctx(&storage.get_io_ctx());
+    ceph_cfg.set_cfg_object_name(config_obj);
+    return ceph_cfg.load_cfg();
+  }
+
+  int run(const std::string &user, const librmb::RmbBatchDeadline &deadline, librmb::RmbBatchResult *result) override {
+    std::map<std::string, std::string> user_opts(opts);
+    user_opts["namespace"] = user;
+    librmb::RmbCommands rmb_commands(&storage, cluster, &user_opts);
+
+    std::string uid;
+    std::unique_ptr<librmb::RadosStorageMetadataModule> ms(rmb_commands.init_metadata_storage_module(ceph_cfg, &uid));
+    if (ms == nullptr) {
+      return -ENOENT;
+    }
+    bool timed_out = false;
+    auto count = [&](librmb::RadosMail *mail) {
+      result->objects++;
+      result->bytes += mail->get_mail_size();
+      if (!mail->is_valid()) {
+        result->invalid++;
+      }
+      timed_out = deadline.expired();
+      return !timed_out;
+    };
+    int ret;
+    if (rebuild_index) {
+      // the mails are appended to the index in batches while they are listed
+      uint64_t indexed = 0;
+      ret = rmb_commands.rebuild_ceph_object_index(ms.get(), &indexed, count);
+    } else {
+      ret = rmb_commands.stream_objects(ms.get(), [&](librmb::RadosMail *mail) {
+        bool go_on = count(mail);
+        delete mail;
+        return go_on;
+      });
+    }
+    if (ret < 0) {
+      return ret;
+    }
+    return timed_out ? -ETIMEDOUT : 0;
+  }
+
+  ~RmbBatchScanWorker() { storage.close_connection(); }
+
+ private:
+  librmb::RadosCluster *cluster;
+  librmb::RadosStorageImpl storage;
+  librmb::RadosCephConfig ceph_cfg;
+  bool rebuild_index;
+  std::map<std::string, std::string> opts;
+};
+
+/* users of the pool: the mapping objects with user mapping, the namespaces otherwise */
+static int list_all_users(librmb::RadosStorage *storage, librmb::RadosCephConfig *ceph_cfg,
+                          std::vector<std::string> *users) {
+  librados::IoCtx &io_ctx = storage->get_io_ctx();
+  std::string suffix = ceph_cfg->get_user_suffix();
+  std::set<std::string> found;
+
+  io_ctx.set_namespace(ceph_cfg->is_user_mapping() ? ceph_cfg->get_user_ns() : librados::all_nspaces);
+  for (librados::NObjectIterator it = io_ctx.nobjects_begin(); it != io_ctx.nobjects_end(); ++it) {
+    std::string name = ceph_cfg->is_user_mapping() ? it->get_oid() : it->get_nspace();
+    if (name.empty() || (!ceph_cfg->is_user_mapping() && name == ceph_cfg->get_user_ns())) {
+      continue;
+    }
+    if (!suffix.empty() && name.size() > suffix.size() &&
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+      name.erase(name.size() - suffix.size());
+    }
+    found.insert(name);
+  }
+  io_ctx.set_namespace("");
+  users->assign(found.begin(), found.end());
+  return 0;
+}
+
+static int run_batch(std::map<std::string, std::string> &opts, librmb::RadosCluster *cluster,
+                     librmb::RadosStorage *storage, librmb::RadosCephConfig *ceph_cfg, const std::string &pool_name,
+                     const std::string &rados_cluster, const std::string &rados_user, const std::string &config_obj) {
+  bool rebuild_index = opts["batch"] == "index";
+  if (!rebuild_index && opts["batch"] != "ls") {
+    std::cerr << "unknown batch command: " << opts["batch"] << std::endl;
+    return -1;
+  }
+
+  std::vector<std::string> users;
+  if (opts.find("batch_all_users") != opts.end()) {
+    list_all_users(storage, ceph_cfg, &users);
+  } else if (opts.find("batch_users") == opts.end()) {
+    std::cerr << "batch requires --users file or -A" << std::endl;
+    return -1;
+  } else if (opts["batch_users"] == "-") {
+    librmb::RmbBatch::read_users(std::cin, &users);
+  } else {
+    std::ifstream in(opts["batch_users"]);
+    if (!in.is_open()) {
+      std::cerr << "unable to open user list " << opts["batch_users"] << std::endl;
+      return -1;
+    }
+    librmb::RmbBatch::read_users(in, &users);
+  }
+
+  librmb::RmbBatch::Options options;
+  uint64_t value = 0;
+  if (opts.find("threads") != opts.end()) {
+    if (!parse_number_option(opts, "threads", "--threads", std::numeric_limits<int>::max(), &value)) {
+      return -1;
+    }
+    options.threads = value;
+  }
+  if (opts.find("batch_timeout") != opts.end()) {
+    if (!parse_number_option(opts, "batch_timeout", "--timeout", std::numeric_limits<unsigned int>::max(), &value)) {
+      return -1;
+    }
+    options.timeout_secs = value;
+  }
+
+  librmb::RmbBatch batch([&]() -> librmb::RmbBatchWorker * {
+    RmbBatchScanWorker *worker = new RmbBatchScanWorker(cluster, rebuild_index, opts);
+    int ret = worker->open(pool_name, rados_cluster, rados_user, config_obj);
+    if (ret < 0) {
+      std::cerr << " error opening rados connection. Errorcode: " << ret << std::endl;
+      delete worker;
+      return nullptr;
+    }
+    return worker;
+  });
+  if (!batch.set_options(options)) {
+    std::cerr << "invalid batch options" << std::endl;
+    return -1;
+  }
+
+  // read the namespace mappings of the next users in parallel, the workers find them in the process wide cache
+  librmb::RadosConfig dovecot_cfg;
+  dovecot_cfg.set_config_valid(true);
+  librmb::RadosDovecotCephCfgImpl prefetch_cfg(dovecot_cfg, *ceph_cfg);
+  librmb::RadosNamespaceManager prefetch_mgr(&prefetch_cfg);
+  librados::IoCtx *user_io_ctx = nullptr;
+  if (ceph_cfg->is_user_mapping() && cluster->io_ctx_get(pool_name, ceph_cfg->get_user_ns(), &user_io_ctx) == 0) {
+    batch.set_prefetch(
+        [&](const std::vector<std::string> &next_users) {
+          std::list<std::string> uids;
+          for (auto &user : next_users) {
+            uids.push_back(user + ceph_cfg->get_user_suffix());
+          }
+          prefetch_mgr.prefetch_keys(user_io_ctx, uids, BATCH_PREFETCH_IN_FLIGHT);
+        },
+        BATCH_PREFETCH_WINDOW);
+  }
+
+  std::ofstream summary;
+  if (opts.find("batch_summary") != opts.end()) {
+    summary.open(opts["batch_summary"].c_str(), std::ios::out | std::ios::trunc);
+    if (!summary.is_open()) {
+      std::cerr << "unable to open summary file " << opts["batch_summary"] << std::endl;
+      return -1;
+    }
+  }
+  std::cout << "processing " << users.size() << " users with " << options.threads << " threads" << std::endl;
+  int failed = batch.run(users, std::cout, summary.is_open() ? &summary : nullptr);
+  if (failed < 0) {
+    return failed;
+  }
+  std::cout << failed << " of " << users.size() << " users failed" << std::endl;
+  return failed > 0 ? 1 : 0;
+}
+
 int main(int argc, const char **argv) {
   std::list<librmb::RadosMail *> mail_objects;
   std::vector<const char *> args;
@@ -320,11 +757,37 @@ int main(int argc, const char **argv) {
   rados_cluster = (opts.find("clustername") != opts.end()) ? opts["clustername"] : "ceph";
   rados_user = (opts.find("rados_user") != opts.end()) ? opts["rados_user"] : "client.admin";
   remove_save_log = (opts.find("remove_save_log") != opts.end()) ? opts["remove_save_log"] : "";
+  if (!parse_command_number_options(opts)) {
+    return -1;
+  }
 
+  if (opts.find("save_log_csv") != opts.end()) {
+    std::ifstream save_log(opts["save_log_csv"], std::ifstream::binary);
+    if (!save_log.is_open()) {
+      std::cerr << " path to log file not valid " << std::endl;
+      return -1;
+    }
+    int count = librmb::RadosSaveLog::convert_to_csv(save_log, std::cout);
+    if (count < 0) {
+      std::cerr << " save log contains an invalid entry " << std::endl;
+    }
+    return count < 0 ? -1 : 0;
+  }
   if (!remove_save_log.empty()) {
     if (confirmed) {
       std::map<std::string, std::list<librmb::RadosSaveLogEntry>> moved_items;
-      return librmb::RmbCommands::delete_with_save_log(remove_save_log, rados_cluster, rados_user, &moved_items);
+      unsigned int aio_window = librmb::RmbCommands::DEFAULT_AIO_WINDOW;
+      if (opts.find("aio_window") != opts.end()) {
+        uint64_t value = 0;
+        if (!parse_number_option(opts, "aio_window", "-w", std::numeric_limits<unsigned int>::max(), &value)) {
+          return -1;
+        }
+        if (value > 0) {
+          aio_window = value;
+        }
+      }
+      return librmb::RmbCommands::delete_with_save_log(remove_save_log, rados_cluster, rados_user, &moved_items,
+                                                       aio_window);
     } else {
       std::cout << "WARNING:" << std::endl;
       std::cout << "Performing this command, will delete all mail objects from ceph object store which are "
@@ -341,6 +804,10 @@ int main(int argc, const char **argv) {
     return librmb::RmbCommands::lspools();
   }
 
+  if (opts.find("bench") != opts.end()) {
+    return run_bench(opts, pool_name, rados_cluster, rados_user);
+  }
+
   librmb::RadosClusterImpl cluster;
   librmb::RadosStorageImpl storage(&cluster);
   int open_connection = storage.open_connection(pool_name, rados_cluster, rados_user);
@@ -386,6 +853,22 @@ int main(int argc, const char **argv) {
     exit(0);
   }
 
+  if (opts.find("dict_shards") != opts.end()) {
+    if (rmb_commands->migrate_dict_shards(config_obj, confirmed) < 0) {
+      std::cerr << "error migrating dictionary shards" << std::endl;
+    }
+    delete rmb_commands;
+    release_exit(nullptr, &cluster, false);
+    exit(0);
+  }
+
+  if (opts.find("batch") != opts.end()) {
+    int ret = run_batch(opts, &cluster, &storage, &ceph_cfg, pool_name, rados_cluster, rados_user, config_obj);
+    delete rmb_commands;
+    release_exit(nullptr, &cluster, false);
+    return ret < 0 ? 1 : ret;
+  }
+
   // namespace (user) needs to be set
   if (opts.find("namespace") == opts.end()) {
     usage_exit();
@@ -404,7 +887,7 @@ int main(int argc, const char **argv) {
 
   if (delete_mail_option) {
     if (opts["to_delete"].size() == 1 && opts["to_delete"].compare("-") == 0) {
-      if (rmb_commands->delete_namespace(ms, mail_objects, &ceph_cfg, confirmed) < 0) {
+      if (rmb_commands->delete_namespace(&ceph_cfg, confirmed) < 0) {
         std::cerr << "error deleting namespace " << std::endl;
         release_exit(&mail_objects, &cluster, false);
       }
@@ -419,27 +902,38 @@ int main(int argc, const char **argv) {
     exit(0);
 
   } else if (rename_user_option) {
-    if (rmb_commands->rename_user(&ceph_cfg, confirmed, uid) < 0) {
+    // rename_user appends the user suffix itself
+    if (rmb_commands->rename_user(&ceph_cfg, confirmed, opts["namespace"]) < 0) {
       std::cerr << "error renaming user" << std::endl;
     }
+  } else if (opts.find("migrate") != opts.end()) {
+    uint64_t grace = 0;
+    bool valid_grace = opts.find("grace") == opts.end() ||
+                       parse_number_option(opts, "grace", "--grace", std::numeric_limits<unsigned int>::max(), &grace);
+    if (valid_grace && rmb_commands->migrate_user(&ceph_cfg, confirmed) < 0) {
+      std::cerr << "error migrating user" << std::endl;
+    }
   } else if (opts.find("ls") != opts.end()) {
     librmb::CmdLineParser parser(opts["ls"]);
-    if (opts["ls"].compare("all") == 0 || opts["ls"].compare("-") == 0 || parser.parse_ls_string()) {
-      rmb_commands->load_objects(ms, mail_objects, sort_type);
-      rmb_commands->query_mail_storage(&mail_objects, &parser, false, false);
+    if (parser.parse_ls_string()) {
+      // objects are streamed, only the listed mails are kept in memory
+      rmb_commands->query_mail_storage(ms, &parser, sort_type, false);
       std::cout << " NOTE: rmb tool does not have access to dovecot index. so all objects are set  <<<   MAIL OBJECT "
                    "HAS NO INDEX REFERENCE <<<< use doveadm rmb ls - instead "
                 << std::endl;
+    } else {
+      std::cerr << "invalid ls search query: " << opts["ls"] << std::endl;
     }
   } else if (opts.find("get") != opts.end()) {
     librmb::CmdLineParser parser(opts["get"]);
 
     rmb_commands->set_output_path(&parser);
 
-    if (opts["get"].compare("all") == 0 || opts["get"].compare("-") == 0 || parser.parse_ls_string()) {
-      // get load all objects metadata into memory
-      rmb_commands->load_objects(ms, mail_objects, sort_type);
-      rmb_commands->query_mail_storage(&mail_objects, &parser, true, false);
+    if (parser.parse_ls_string()) {
+      // objects are streamed, only the mails to download are kept in memory
+      rmb_commands->query_mail_storage(ms, &parser, sort_type, true);
+    } else {
+      std::cerr << "invalid get search query: " << opts["get"] << std::endl;
     }
   } else if (opts.find("set") != opts.end()) {
     rmb_commands->update_attributes(ms, &metadata);
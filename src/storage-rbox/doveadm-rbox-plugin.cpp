@@ -15,6 +15,7 @@
 #include <map>
 #include <string>
 #include <list>
+#include <unordered_map>
 
 extern "C" {
 
@@ -59,8 +60,9 @@ extern "C" {
 #include "rbox-save.h"
 #include "rbox-storage.hpp"
 
-int check_namespace_mailboxes(const struct mail_namespace *ns, const std::list<librmb::RadosMail *> &mail_objects);
-static int iterate_list_objects(struct mail_namespace* ns, const struct mailbox_info *info, std::set<std::string> &object_list);
+int check_namespace_mailboxes(const struct mail_namespace *ns, std::unordered_map<std::string, bool> *index_refs);
+static int iterate_list_objects(struct mail_namespace *ns, const struct mailbox_info *info,
+                                librmb::RmbCommands *rmb_cmds, uint64_t *indexed);
 
 class RboxDoveadmPlugin {
  public:
@@ -141,6 +143,31 @@ static int open_connection_load_config(RboxDoveadmPlugin *plugin) {
   }
   return ret;
 }
+/* ls, check indices and create ceph index run once per user with -A or -F.
+   While such a command runs it keeps a reference on the process wide rados
+   connection, so the users share it instead of connecting and shutting
+   down the cluster connection per user. */
+static RboxDoveadmPlugin *shared_connection = nullptr;
+
+static void cmd_rmb_hold_connection(void) {
+  if (shared_connection != nullptr) {
+    return;
+  }
+  shared_connection = new RboxDoveadmPlugin();
+  if (open_connection_load_config(shared_connection) < 0) {
+    // the users report the connection error
+    delete shared_connection;
+    shared_connection = nullptr;
+  }
+}
+
+static void cmd_rmb_release_connection(struct doveadm_mail_cmd_context *ctx ATTR_UNUSED) {
+  if (shared_connection != nullptr) {
+    delete shared_connection;
+    shared_connection = nullptr;
+  }
+}
+
 static int cmd_rmb_config(std::map<std::string, std::string> &opts) {
   RboxDoveadmPlugin plugin;
   plugin.read_doveadm_plugin_configuration();
@@ -158,9 +185,29 @@ static int cmd_rmb_config(std::map<std::string, std::string> &opts) {
   }
   return 0;
 }
+/* marks the mails that are referenced by an index of the user, return true if an object has no index reference */
+static bool check_index_refs(struct mail_user *user, const std::list<librmb::RadosMail *> &mail_objects,
+                             std::unordered_map<std::string, bool> *index_refs) {
+  if (user->namespaces != NULL) {
+    struct mail_namespace *ns = mail_namespace_find_inbox(user->namespaces);
+    for (; ns != NULL; ns = ns->next) {
+      check_namespace_mailboxes(ns, index_refs);
+    }
+  }
+  for (auto mo : mail_objects) {
+    mo->set_index_ref((*index_refs)[*mo->get_oid()]);
+  }
+  return std::find_if(index_refs->begin(), index_refs->end(),
+                      [](const std::pair<const std::string, bool> &ref) { return !ref.second; }) != index_refs->end();
+}
+
+/*
+ * with mail_objects all objects are loaded without metadata into mail_objects. Otherwise the objects are
+ * streamed into their mailboxes, only the mails matching parser are kept and printed or downloaded.
+ */
 static int cmd_rmb_search_run(std::map<std::string, std::string> &opts, struct mail_user *user, bool download,
-                              librmb::CmdLineParser &parser, std::list<librmb::RadosMail *> &mail_objects, bool silent,
-                              bool load_metadata = true) {
+                              librmb::CmdLineParser &parser, std::list<librmb::RadosMail *> *mail_objects,
+                              bool *unreferenced) {
   RboxDoveadmPlugin plugin;
   int open = open_connection_load_config(&plugin);
   if (open < 0) {
@@ -181,27 +228,52 @@ static int cmd_rmb_search_run(std::map<std::string, std::string> &opts, struct m
     return -1;
   }
 
-  int ret = rmb_cmds.load_objects(ms, mail_objects, opts["sort"], load_metadata);
-  if (ret < 0) {
-    i_error("Error loading ceph objects. Errorcode: %d", ret);
-    delete ms;
-    return ret;
-  }
-  if (user->namespaces != NULL) {
-    struct mail_namespace *ns = mail_namespace_find_inbox(user->namespaces);
-    for (; ns != NULL; ns = ns->next) {
-      check_namespace_mailboxes(ns, mail_objects);
+  // oid => referenced by an index, for all objects of the namespace
+  std::unordered_map<std::string, bool> index_refs;
+  if (mail_objects != nullptr) {
+    int ret = rmb_cmds.load_objects(ms, *mail_objects, opts["sort"], false);
+    if (ret < 0) {
+      i_error("Error loading ceph objects. Errorcode: %d", ret);
+      delete ms;
+      return ret;
+    }
+    index_refs.reserve(mail_objects->size());
+    for (auto mo : *mail_objects) {
+      index_refs.emplace(*mo->get_oid(), false);
+    }
+    bool has_unreferenced = check_index_refs(user, *mail_objects, &index_refs);
+    if (unreferenced != nullptr) {
+      *unreferenced = has_unreferenced;
     }
+    delete ms;
+    return 0;
   }
+
   if (download) {
     rmb_cmds.set_output_path(&parser);
   }
-  if (load_metadata) {
-    ret = rmb_cmds.query_mail_storage(&mail_objects, &parser, download, silent);
+  std::map<std::string, librmb::RadosMailBox *> mailboxes;
+  int ret = rmb_cmds.load_mailboxes(ms, &parser, opts["sort"], &mailboxes, [&index_refs](librmb::RadosMail *mail) {
+    index_refs.emplace(*mail->get_oid(), false);
+  });
+  if (ret < 0) {
+    i_error("Error loading ceph objects. Errorcode: %d", ret);
+  } else {
+    std::list<librmb::RadosMail *> listed;
+    for (auto &it : mailboxes) {
+      listed.insert(listed.end(), it.second->get_mails().begin(), it.second->get_mails().end());
+    }
+    bool has_unreferenced = check_index_refs(user, listed, &index_refs);
+    if (unreferenced != nullptr) {
+      *unreferenced = has_unreferenced;
+    }
+    std::cout << "mailbox_count: " << mailboxes.size() << std::endl;
+    ret = rmb_cmds.print_mail(&mailboxes, parser.get_output_dir(), download);
     if (ret < 0) {
       i_error("Error query mail storage. Errorcode: %d", ret);
     }
   }
+  librmb::RmbCommands::free_mailboxes(&mailboxes);
   delete ms;
 
   return ret;
@@ -222,21 +294,12 @@ static int cmd_rmb_ls_run(struct doveadm_mail_cmd_context *ctx, struct mail_user
   opts["sort"] = sort != NULL ? sort : "uid";
   librmb::CmdLineParser parser(opts["ls"]);
 
-  if (opts["ls"].compare("all") == 0 || opts["ls"].compare("-") == 0 || parser.parse_ls_string()) {
-    std::list<librmb::RadosMail *> mail_objects;
-
-    ctx->exit_code = cmd_rmb_search_run(opts, user, false, parser, mail_objects, false);
-
-    auto it_mail = std::find_if(mail_objects.begin(), mail_objects.end(),
-                                [](librmb::RadosMail *n) -> bool { return n->is_index_ref() == false; });
-
-    if (it_mail != mail_objects.end()) {
+  if (parser.parse_ls_string()) {
+    bool unreferenced = false;
+    ctx->exit_code = cmd_rmb_search_run(opts, user, false, parser, nullptr, &unreferenced);
+    if (unreferenced) {
       std::cout << "There are unreferenced objects " << std::endl;
     }
-
-    for (auto mo : mail_objects) {
-      delete mo;
-    }
   } else {
     i_error("invalid ls search query, %s", search_query);
     ctx->exit_code = -1;
@@ -248,9 +311,8 @@ static int cmd_rmb_ls_mb_run(struct doveadm_mail_cmd_context *ctx, struct mail_u
   opts["ls"] = "mb";
   opts["sort"] = "uid";
   librmb::CmdLineParser parser(opts["ls"]);
-  if (opts["ls"].compare("all") == 0 || opts["ls"].compare("-") == 0 || parser.parse_ls_string()) {
-    std::list<librmb::RadosMail *> mail_objects;
-    ctx->exit_code = cmd_rmb_search_run(opts, user, false, parser, mail_objects, false);
+  if (parser.parse_ls_string()) {
+    ctx->exit_code = cmd_rmb_search_run(opts, user, false, parser, nullptr, nullptr);
   } else {
     i_error("invalid ls search query");
     ctx->exit_code = -1;
@@ -276,13 +338,8 @@ static int cmd_rmb_get_run(struct doveadm_mail_cmd_context *ctx, struct mail_use
   opts["sort"] = "uid";
 
   librmb::CmdLineParser parser(opts["get"]);
-  if (opts["get"].compare("all") == 0 || opts["ls"].compare("-") == 0 || parser.parse_ls_string()) {
-    std::list<librmb::RadosMail *> mail_objects;
-    ctx->exit_code = cmd_rmb_search_run(opts, user, true, parser, mail_objects, false);
-    for (auto mo : mail_objects) {
-      delete mo;
-    }
-
+  if (parser.parse_ls_string()) {
+    ctx->exit_code = cmd_rmb_search_run(opts, user, true, parser, nullptr, nullptr);
   } else {
     i_error("invalid search query %s", search_query);
     ctx->exit_code = -1;
@@ -610,7 +667,7 @@ static int cmd_rmb_revert_log_run(struct doveadm_mail_cmd_context *ctx, struct m
 }
 
 static int iterate_mailbox(const struct mail_namespace *ns, const struct mailbox_info *info,
-                           const std::list<librmb::RadosMail *> &mail_objects) {
+                           std::unordered_map<std::string, bool> *index_refs) {
   int ret = 0;
   struct mailbox_transaction_context *mailbox_transaction;
   struct mail_search_context *search_ctx;
@@ -664,17 +721,15 @@ static int iterate_mailbox(const struct mail_namespace *ns, const struct mailbox
     std::string guid = guid_128_to_string(obox_rec->guid);
     std::string oid = guid_128_to_string(obox_rec->oid);
 
-    auto it_mail = std::find_if(mail_objects.begin(), mail_objects.end(),
-                                [oid](librmb::RadosMail *m) { return m->get_oid()->compare(oid) == 0; });
+    auto it_mail = index_refs->find(oid);
 
-    if (it_mail == mail_objects.end()) {
+    if (it_mail == index_refs->end()) {
       std::cout << "   missing mail object: uid=" << mail->uid << " guid=" << guid << " oid : " << oid
-                    << " available: " << (it_mail != mail_objects.end()) << std::endl;
+                    << " available: " << (it_mail != index_refs->end()) << std::endl;
 
       ++mail_count_missing;
     } else {
-      (*it_mail)->set_index_ref(true);
-      // mail_objects.erase(it_mail);  // calls destructor of RadosMail*
+      it_mail->second = true;
     }
   }
   if (mailbox_search_deinit(&search_ctx) < 0) {
@@ -693,15 +748,17 @@ static int iterate_mailbox(const struct mail_namespace *ns, const struct mailbox
   return ret;
 }
 
-int check_namespace_mailboxes(const struct mail_namespace *ns, const std::list<librmb::RadosMail *> &mail_objects) {
+/* index_refs: oid => referenced, index records are looked up by oid, one hash lookup per record */
+int check_namespace_mailboxes(const struct mail_namespace *ns, std::unordered_map<std::string, bool> *index_refs) {
   struct mailbox_list_iterate_context *iter;
   const struct mailbox_info *info;
   int ret = 0;
+
   iter = mailbox_list_iter_init(ns->list, "*", static_cast<enum mailbox_list_iter_flags>(
                                                    MAILBOX_LIST_ITER_RAW_LIST | MAILBOX_LIST_ITER_RETURN_NO_FLAGS));
   while ((info = mailbox_list_iter_next(iter)) != NULL) {
     if ((info->flags & (MAILBOX_NONEXISTENT | MAILBOX_NOSELECT)) == 0) {
-      ret = iterate_mailbox(ns, info, mail_objects);
+      ret = iterate_mailbox(ns, info, index_refs);
       if (ret < 0) {
         ret = -1;
         break;
@@ -722,7 +779,7 @@ static int cmd_rmb_check_indices_run(struct doveadm_mail_cmd_context *ctx, struc
   librmb::CmdLineParser parser(opts["ls"]);
   parser.parse_ls_string();
   std::list<librmb::RadosMail *> mail_objects;
-  ctx->exit_code = cmd_rmb_search_run(opts, user, false, parser, mail_objects, true, false);
+  ctx->exit_code = cmd_rmb_search_run(opts, user, false, parser, &mail_objects, nullptr);
   if (ctx->exit_code < 0) {
     return 0;
   }
@@ -778,7 +835,6 @@ static int cmd_rmb_check_indices_run(struct doveadm_mail_cmd_context *ctx, struc
 static int cmd_rmb_create_ceph_index_run(struct doveadm_mail_cmd_context *_ctx, struct mail_user *user) {
   int ret = 0;
   struct create_ceph_index_cmd_context *ctx = (struct create_ceph_index_cmd_context *)_ctx;
-  std::set<std::string> mail_objects;
 
   RboxDoveadmPlugin plugin;
   plugin.read_plugin_configuration(user);
@@ -792,6 +848,7 @@ static int cmd_rmb_create_ceph_index_run(struct doveadm_mail_cmd_context *_ctx,
   i_info("connection to rados open");
   std::map<std::string, std::string> opts;
   opts["namespace"] = user->username;
+  opts["list_threads"] = std::to_string(ctx->list_threads);
   librmb::RmbCommands rmb_cmds(plugin.storage, plugin.cluster, &opts);
 
   std::string uid;
@@ -804,14 +861,15 @@ static int cmd_rmb_create_ceph_index_run(struct doveadm_mail_cmd_context *_ctx,
     _ctx->exit_code = -1;
     return -1;
   }
-  if(rmb_cmds.remove_ceph_object_index() < 0){
-    i_debug(" Error overwriting ceph object index");
-  }
-    
+
   if (user->namespaces != NULL) {
     struct mail_namespace *ns = mail_namespace_find_inbox(user->namespaces);
-    
+    uint64_t indexed = 0;
+
     if(!ctx->full_refresh){
+      if(rmb_cmds.remove_ceph_object_index() < 0){
+        i_debug(" Error overwriting ceph object index");
+      }
       for (; ns != NULL; ns = ns->next) {
         struct mailbox_list_iterate_context *iter;
         const struct mailbox_info *info;
@@ -820,35 +878,29 @@ static int cmd_rmb_create_ceph_index_run(struct doveadm_mail_cmd_context *_ctx,
                                                         MAILBOX_LIST_ITER_RAW_LIST | MAILBOX_LIST_ITER_RETURN_NO_FLAGS));
         while ((info = mailbox_list_iter_next(iter)) != NULL) {
           if ((info->flags & (MAILBOX_NONEXISTENT | MAILBOX_NOSELECT)) == 0) {
-      
-            ret = iterate_list_objects(ns, info, mail_objects);
+            uint64_t mailbox_indexed = 0;
+            ret = iterate_list_objects(ns, info, &rmb_cmds, &mailbox_indexed);
       
             if (ret < 0) {
               ret = -1;
               break;
             }
-
-            //append to index.
-            i_info("found %s mails in namespace %d",info->vname, mail_objects.size());
-            if(rmb_cmds.append_ceph_object_index(mail_objects) < 0){
-                i_error(" Error overwriting ceph object index");
-                delete ms;
-                _ctx->exit_code = -1;
-                return -1;
-            }
-            mail_objects.clear();
+            indexed += mailbox_indexed;
+            i_info("found %s mails in namespace %lu", info->vname, mailbox_indexed);
           }
         }
       } // end of for     
       
     }else{
-        mail_objects = rmb_cmds.load_objects(ms);
-        if(rmb_cmds.overwrite_ceph_object_index(mail_objects) < 0){
+        // objects are listed in parallel and appended to the index in batches
+        ret = rmb_cmds.rebuild_ceph_object_index(ms, &indexed);
+        if (ret < 0) {
           i_error(" Error overwriting ceph object index");
           delete ms;
+          _ctx->exit_code = -1;
           return -1;
         }
-        i_info("found %d mails in namespace",mail_objects.size());
+        i_info("found %lu mails in namespace", indexed);
     }
     delete ms;
   }
@@ -857,7 +909,11 @@ static int cmd_rmb_create_ceph_index_run(struct doveadm_mail_cmd_context *_ctx,
 
   return ret;
 }
-static int iterate_list_objects(struct mail_namespace* ns, const struct mailbox_info *info, std::set<std::string> &object_list){
+/* appends the oids of the mailbox to the ceph index in batches of DEFAULT_BATCH_SIZE */
+static int iterate_list_objects(struct mail_namespace *ns, const struct mailbox_info *info,
+                                librmb::RmbCommands *rmb_cmds, uint64_t *indexed) {
+  std::set<std::string> object_list;
+  int ret = 0;
 
   struct mailbox_transaction_context *mailbox_transaction;
   struct mail_search_context *search_ctx;
@@ -899,6 +955,21 @@ static int iterate_list_objects(struct mail_namespace* ns, const struct mailbox_
     }    
     std::string oid = guid_128_to_string(obox_rec->oid);
     object_list.insert(oid);
+    if (object_list.size() >= librmb::RmbCommands::DEFAULT_BATCH_SIZE) {
+      if (rmb_cmds->append_ceph_object_index(object_list) < 0) {
+        ret = -1;
+        break;
+      }
+      *indexed += object_list.size();
+      object_list.clear();
+    }
+  }
+  if (ret == 0 && !object_list.empty()) {
+    if (rmb_cmds->append_ceph_object_index(object_list) < 0) {
+      ret = -1;
+    } else {
+      *indexed += object_list.size();
+    }
   }
   if (mailbox_search_deinit(&search_ctx) < 0) {
     return -1;
@@ -910,7 +981,7 @@ static int iterate_list_objects(struct mail_namespace* ns, const struct mailbox_
 
   mailbox_free(&box);
   
-  return 0;
+  return ret;
 }
 static int i_strcmp_reverse_p(const char *const *s1, const char *const *s2) { return -strcmp(*s1, *s2); }
 static int get_child_mailboxes(struct mail_user *user, ARRAY_TYPE(const_string) * mailboxes, const char *name) {
@@ -1034,6 +1105,7 @@ static void cmd_rmb_ls_init(struct doveadm_mail_cmd_context *ctx ATTR_UNUSED, co
   if (args[0] == NULL) {
     doveadm_mail_help_name("rmb ls");
   }
+  cmd_rmb_hold_connection();
 }
 static void cmd_rmb_get_init(struct doveadm_mail_cmd_context *ctx ATTR_UNUSED, const char *const args[]) {
   if (args[0] == NULL || args[1] == NULL) {
@@ -1071,11 +1143,13 @@ static void cmd_rmb_check_indices_init(struct doveadm_mail_cmd_context *ctx ATTR
   if (args[0] != NULL) {
     doveadm_mail_help_name("rmb check indices");
   }
+  cmd_rmb_hold_connection();
 }
 static void cmd_rmb_create_ceph_index_init(struct doveadm_mail_cmd_context *ctx ATTR_UNUSED, const char *const args[]) {
   if (args[0] != NULL) {
     doveadm_mail_help_name("rmb create ceph index");
   }
+  cmd_rmb_hold_connection();
 }
 static void cmd_rmb_mailbox_delete_init(struct doveadm_mail_cmd_context *_ctx ATTR_UNUSED, const char *const args[]) {
   struct delete_cmd_context *ctx = (struct delete_cmd_context *)_ctx;
@@ -1098,6 +1172,7 @@ struct doveadm_mail_cmd_context *cmd_rmb_ls_alloc(void) {
   ctx = doveadm_mail_cmd_alloc(struct doveadm_mail_cmd_context);
   ctx->v.run = cmd_rmb_ls_run;
   ctx->v.init = cmd_rmb_ls_init;
+  ctx->v.deinit = cmd_rmb_release_connection;
   return ctx;
 }
 
@@ -1164,6 +1239,12 @@ static bool cmd_create_ceph_index_parse_arg(struct doveadm_mail_cmd_context *_ct
     case 'r':      
       ctx->full_refresh = true;
       break;
+    case 't':
+      if (str_to_uint(optarg, &ctx->list_threads) < 0 || ctx->list_threads == 0) {
+        i_error("Invalid number of list threads: %s", optarg);
+        return false;
+      }
+      break;
     default:
       break;
   }
@@ -1174,6 +1255,7 @@ struct doveadm_mail_cmd_context *cmd_rmb_check_indices_alloc(void) {
   ctx = doveadm_mail_cmd_alloc(struct check_indices_cmd_context);
   ctx->ctx.v.run = cmd_rmb_check_indices_run;
   ctx->ctx.v.init = cmd_rmb_check_indices_init;
+  ctx->ctx.v.deinit = cmd_rmb_release_connection;
   ctx->ctx.v.parse_arg = cmd_check_indices_parse_arg;
   ctx->ctx.getopt_args = "d";
   return &ctx->ctx;
@@ -1185,8 +1267,10 @@ struct doveadm_mail_cmd_context *cmd_rmb_create_ceph_index_alloc(void) {
   ctx = doveadm_mail_cmd_alloc(struct create_ceph_index_cmd_context);
   ctx->ctx.v.run = cmd_rmb_create_ceph_index_run;
   ctx->ctx.v.init = cmd_rmb_create_ceph_index_init;
+  ctx->ctx.v.deinit = cmd_rmb_release_connection;
   ctx->ctx.v.parse_arg = cmd_create_ceph_index_parse_arg;
-  ctx->ctx.getopt_args = "r";
+  ctx->ctx.getopt_args = "rt:";
+  ctx->list_threads = CEPH_INDEX_LIST_THREADS;
   return &ctx->ctx;
 }
 
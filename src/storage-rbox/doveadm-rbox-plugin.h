@@ -17,9 +17,13 @@ struct check_indices_cmd_context {
   bool delete_not_referenced_objects;
 };
 
+#define CEPH_INDEX_LIST_THREADS 4
+
 struct create_ceph_index_cmd_context {
   struct doveadm_mail_cmd_context ctx;
   bool full_refresh;
+  // parallel object listings with -r
+  unsigned int list_threads;
 };
 
 struct delete_cmd_context {
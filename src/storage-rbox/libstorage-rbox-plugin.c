@@ -35,10 +35,14 @@ void storage_rbox_plugin_init(struct module *module ATTR_UNUSED) {
   if (refcount++ > 0)
     return;
   mail_storage_class_register(&rbox_storage);
+  if (rbox_storage_prewarm() == 0 && strcmp(rbox_storage_get_cluster_state(), "ready") == 0) {
+    i_info("rbox: rados cluster connection prewarmed");
+  }
 }
 
 void storage_rbox_plugin_deinit(void) {
   if (--refcount > 0)
     return;
+  rbox_storage_prewarm_deinit();
   mail_storage_class_unregister(&rbox_storage);
 }
@@ -30,6 +30,7 @@ extern "C" {
 #include "rbox-sync.h"
 #include "rbox-copy.h"
 #include "rados-util.h"
+#include "../librmb/rados-trace.h"
 
 const char *SETTINGS_RBOX_UPDATE_IMMUTABLE = "rbox_update_immutable";
 const char *SETTINGS_DEF_UPDATE_IMMUTABLE = "false";
@@ -177,6 +178,64 @@ static void mail_copy_set_failed(struct mail_save_context *ctx, struct mail *mai
   errstr = mail_storage_get_last_error(mail->box->storage, &error);
   mail_storage_set_error(ctx->transaction->box->storage, error, t_strdup_printf("%s (%s)", errstr, func));
 }
+static int copy_finish(struct rbox_storage *r_storage, struct rbox_pending_copy *copy) {
+  int ret_val = copy->storage->aio_wait(copy->completion);
+  copy->completion->release();
+
+  if (copy->src_mail != NULL) {
+    copy->src_mail->pending_copy = NULL;
+  }
+  if (ret_val < 0) {
+    if (ret_val == -ENOENT) {
+      i_debug(
+          "copy mail failed from namespace: %s to namespace %s: src_oid: %s, des_oid: %s, error_code: %d, "
+          "storage_pool: %s , most likely concurrency issue",
+          copy->ns_src.c_str(), copy->ns_dest.c_str(), copy->src_oid.c_str(), copy->dest_oid.c_str(), ret_val,
+          copy->storage->get_pool_name().c_str());
+      // the source was expunged by another session
+      if (copy->src_mail != NULL) {
+        rbox_mail_set_expunged(copy->src_mail);
+      }
+    } else {
+      i_error(
+          "copy mail failed: from namespace: %s to namespace %s: src_oid: %s, des_oid: %s, error_code: %d, "
+          "storage_pool: %s",
+          copy->ns_src.c_str(), copy->ns_dest.c_str(), copy->src_oid.c_str(), copy->dest_oid.c_str(), ret_val,
+          copy->storage->get_pool_name().c_str());
+    }
+  } else {
+    if (r_storage->save_log->is_open()) {
+      r_storage->save_log->append(librmb::RadosSaveLogEntry(copy->dest_oid, copy->ns_dest,
+                                                            copy->storage->get_pool_name(),
+                                                            librmb::RadosSaveLogEntry::op_cpy()));
+    }
+#ifdef DEBUG
+    i_debug("copy successfully finished: from src %s to oid = %s", copy->src_oid.c_str(), copy->dest_oid.c_str());
+#endif
+  }
+  delete copy;
+  return ret_val;
+}
+
+int rbox_copy_wait(struct mail_save_context *ctx, unsigned int max_in_flight) {
+  struct rbox_save_context *r_ctx = (struct rbox_save_context *)ctx;
+  struct rbox_storage *r_storage = (struct rbox_storage *)&r_ctx->mbox->storage->storage;
+  int ret = 0;
+
+  // finish copies in send order, wait for the oldest one while too many are in flight
+  while (!r_ctx->pending_copies.empty()) {
+    struct rbox_pending_copy *copy = r_ctx->pending_copies.front();
+    if (r_ctx->pending_copies.size() <= max_in_flight && !copy->storage->aio_is_complete(copy->completion)) {
+      break;
+    }
+    if (copy_finish(r_storage, copy) < 0) {
+      ret = -1;
+    }
+    r_ctx->pending_copies.pop_front();
+  }
+  return ret;
+}
+
 static int copy_mail(struct mail_save_context *ctx, librmb::RadosStorage *rados_storage, struct rbox_mail *rmail,
                      const std::string *ns_src, const std::string *ns_dest) {
   struct rbox_save_context *r_ctx = (struct rbox_save_context *)ctx;
@@ -191,38 +250,43 @@ static int copy_mail(struct mail_save_context *ctx, librmb::RadosStorage *rados_
 
   set_mailbox_metadata(ctx, &metadata_update);
 
-  int ret_val = rados_storage->copy(src_oid, ns_src->c_str(), dest_oid, ns_dest->c_str(), metadata_update);
+  // the copy is finished by rbox_copy_wait, at the latest in rbox_transaction_save_commit_pre
+  struct rbox_pending_copy *copy = new rbox_pending_copy(src_oid, dest_oid, *ns_src, *ns_dest, rados_storage);
+  copy->completion = librados::Rados::aio_create_completion();
+  int ret_val = rados_storage->aio_copy(copy->src_oid, ns_src->c_str(), copy->dest_oid, ns_dest->c_str(),
+                                        metadata_update, &copy->write_op, copy->completion);
   if (ret_val < 0) {
-    if (ret_val == -ENOENT) {
-      i_debug(
-          "copy mail failed from namespace: %s to namespace %s: src_oid: %s, des_oid: %s, error_code: %d, "
-          "storage_pool: %s , most likely concurrency issue => marking mail as expunged",
-          ns_src->c_str(), ns_dest->c_str(), src_oid.c_str(), dest_oid.c_str(), ret_val,
-          rados_storage->get_pool_name().c_str());
-      rbox_mail_set_expunged(rmail);
-    } else {
-      i_error(
-          "copy mail failed: from namespace: %s to namespace %s: src_oid: %s, des_oid: %s, error_code: %d, "
-          "storage_pool: %s",
-          ns_src->c_str(), ns_dest->c_str(), src_oid.c_str(), dest_oid.c_str(), ret_val,
-          rados_storage->get_pool_name().c_str());
-    }
-    FUNC_END_RET("ret == -1, rados_storage->copy failed");
+    i_error(
+        "copy mail failed: from namespace: %s to namespace %s: src_oid: %s, des_oid: %s, error_code: %d, "
+        "storage_pool: %s",
+        ns_src->c_str(), ns_dest->c_str(), src_oid.c_str(), dest_oid.c_str(), ret_val,
+        rados_storage->get_pool_name().c_str());
+    copy->completion->release();
+    delete copy;
+    FUNC_END_RET("ret == -1, rados_storage->aio_copy failed");
     rados_storage->free_rados_mail(r_ctx->rados_mail);
     r_ctx->rados_mail = nullptr;
     mail_copy_set_failed(ctx, (struct mail *)rmail, "stream");
     return -1;
   }
-  r_ctx->failed = ret_val < 0 ? true : false;
+  r_ctx->failed = false;
 
   rbox_add_to_index(ctx);
-  if (r_storage->save_log->is_open()) {
-    r_storage->save_log->append(librmb::RadosSaveLogEntry(dest_oid, *ns_dest, rados_storage->get_pool_name(),
-                                                          librmb::RadosSaveLogEntry::op_cpy()));
+  r_ctx->pending_copies.push_back(copy);
+  // the mail is linked to its latest copy only
+  if (rmail->pending_copy != NULL) {
+    rmail->pending_copy->src_mail = NULL;
+  }
+  rmail->pending_copy = copy;
+  copy->src_mail = rmail;
+
+  int copy_window = r_storage->config->get_copy_aio_window();
+  if (rbox_copy_wait(ctx, copy_window > 0 ? copy_window : 1) < 0) {
+    // a copy of this transaction failed, the transaction is rolled back
+    r_ctx->failed = true;
+    mail_copy_set_failed(ctx, (struct mail *)rmail, "stream");
+    return -1;
   }
-#ifdef DEBUG
-  i_debug("copy successfully finished: from src %s to oid = %s", src_oid.c_str(), dest_oid.c_str());
-#endif
   return 0;
 }
 
@@ -330,7 +394,10 @@ int rbox_mail_storage_copy(struct mail_save_context *ctx, struct mail *mail) {
 #endif
 
   } else {
+    struct rbox_storage *r_storage = (struct rbox_storage *)dest_mbox->storage;
+    librmb::RadosTraceScope trace("copy", r_storage->s->get_pool_name());
     if (rbox_mail_storage_try_copy(&ctx, mail, alt_storage) < 0) {
+      trace.set_result(-1);
       if (ctx != NULL) {
         //  mailbox_save_cancel(&ctx);
         index_save_context_free(ctx);
@@ -13,6 +13,9 @@
 #define SRC_STORAGE_RBOX_RBOX_COPY_H_
 
 int rbox_mail_copy(struct mail_save_context *_ctx, struct mail *mail);
+/* finish sent copies of the save context until at most max_in_flight are left,
+   returns -1 if one of them failed */
+int rbox_copy_wait(struct mail_save_context *ctx, unsigned int max_in_flight);
 bool rbox_is_op_on_shared_folder(struct mail *src_mail, struct mailbox *dest_mbox);
 
 #endif /* SRC_STORAGE_RBOX_RBOX_COPY_H_ */
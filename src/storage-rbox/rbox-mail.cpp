@@ -40,8 +40,10 @@ extern "C" {
 #include "../librmb/rados-mail.h"
 #include "rbox-storage.hpp"
 #include "../librmb/rados-storage-impl.h"
+#include "../librmb/rados-trace.h"
 #include "istream-bufferlist.h"
 #include "rbox-mail.h"
+#include "rbox-save.h"
 #include "rados-util.h"
 
 using librmb::RadosMail;
@@ -452,8 +454,8 @@ static int read_mail_from_storage(librmb::RadosStorage *rados_storage,
 
     /* duplicate code: get_attribute */
     librados::ObjectReadOperation *read_mail = new librados::ObjectReadOperation();
-    read_mail->read(0, INT_MAX, rmail->rados_mail->get_mail_buffer(), &read_err);
-    read_mail->stat(psize, save_date, &stat_err);
+    rados_storage->prepare_read(read_mail, rmail->rados_mail->get_mail_buffer(), &read_err, psize, save_date,
+                                &stat_err);
 
     int ret = rados_storage->read_operate(*rmail->rados_mail->get_oid(), read_mail,
                                                   rmail->rados_mail->get_mail_buffer());
@@ -502,6 +504,7 @@ static int rbox_mail_get_stream(struct mail *_mail, bool get_body ATTR_UNUSED, s
         return -1;
       }
     }
+    librmb::RadosTraceScope trace("fetch", rados_storage->get_pool_name(), *rmail->rados_mail->get_oid());
     // create mail buffer!
     rmail->rados_mail->set_mail_buffer(new librados::bufferlist());
 
@@ -509,6 +512,7 @@ static int rbox_mail_get_stream(struct mail *_mail, bool get_body ATTR_UNUSED, s
     time_t save_date;
 
     ret = read_mail_from_storage(rados_storage, rmail,&psize,&save_date);
+    trace.set_result(ret);
 
     if (ret < 0) {
       if (ret == -ENOENT) {
@@ -552,6 +556,7 @@ static int rbox_mail_get_stream(struct mail *_mail, bool get_body ATTR_UNUSED, s
         return -1;
       }
     }
+    trace.set_result(0, psize);
     int physical_size = psize;
     rmail->rados_mail->set_mail_size(psize);
     rmail->rados_mail->set_rados_save_date(save_date);
@@ -869,6 +874,11 @@ static void rbox_mail_close(struct mail *_mail) {
     r_storage->s->free_rados_mail(rmail_->rados_mail);
     rmail_->rados_mail = nullptr;
   }
+  // the copy may finish after the mail is closed or set to another sequence
+  if (rmail_->pending_copy != NULL) {
+    rmail_->pending_copy->src_mail = NULL;
+    rmail_->pending_copy = NULL;
+  }
 
   index_mail_close(_mail);
 }
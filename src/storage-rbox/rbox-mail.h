@@ -16,6 +16,8 @@
 #include <rados/librados.hpp>
 #include "../librmb/rados-mail.h"
 
+struct rbox_pending_copy;
+
 /**
  * @brief: holds the rados mail object.
  */
@@ -27,6 +29,8 @@ struct rbox_mail {
   /** refrence to rados mail object **/
   librmb::RadosMail *rados_mail;
   uint32_t last_seq;  // TODO(jrse): init with -1
+  /** latest copy of this mail in flight, unlinked when it finishes or the mail is closed **/
+  struct rbox_pending_copy *pending_copy;
 };
 extern void rbox_mail_set_expunged(struct rbox_mail *mail);
 extern int rbox_get_index_record(struct mail *_mail);
@@ -36,10 +36,13 @@ extern "C" {
 }
 
 #include "../librmb/rados-mail.h"
+#include "../librmb/rados-stats.h"
+#include "../librmb/rados-trace.h"
 #include "rbox-storage.hpp"
 #include "rbox-save.h"
 #include "rados-util.h"
 #include "rbox-mail.h"
+#include "rbox-copy.h"
 #include "ostream-bufferlist.h"
 
 using ceph::bufferlist;
@@ -510,8 +513,12 @@ int save_mail_write_append(RadosStorage *rados_storage,
     }
 
     if (div == 1) {
-      write_op.write(0, *current_object->get_mail_buffer());
+      rados_storage->prepare_write(&write_op, 0, *current_object->get_mail_buffer());
       ret_val = rados_storage->execute_operation(*current_object->get_oid(), &write_op) ? 0 : -1;
+      if (ret_val == 0) {
+        // execute_operation does not know the payload size
+        librmb::RadosStats::record_bytes(librmb::RADOS_OP_WRITE, write_buffer_size);
+      }
     } else {
       i_debug("write chunk size %d, offset=%d,lenght=%d",write_buffer_size,offset,length);      
       if(offset + length > write_buffer_size){
@@ -625,6 +632,7 @@ int rbox_save_finish(struct mail_save_context *_ctx) {
 
       librados::ObjectWriteOperation write_op;
       struct rbox_storage *r_storage = (struct rbox_storage *)&r_ctx->mbox->storage->storage;
+      librmb::RadosTraceScope trace("save", r_storage->s->get_pool_name(), *r_ctx->rados_mail->get_oid());
 
       r_storage->ms->get_storage()->save_metadata(&write_op, r_ctx->rados_mail);
 
@@ -649,6 +657,7 @@ int rbox_save_finish(struct mail_save_context *_ctx) {
           r_ctx->failed = ret < 0;
           i_debug("SAVE_MAIL result: %d", r_ctx->failed);        
       }
+      trace.set_result(r_ctx->failed ? -1 : 0, r_ctx->rados_mail->get_mail_size());
       if (r_ctx->failed) {
         i_error("saved mail: %s failed. Metadata_count %ld, mail_size (%d)", r_ctx->rados_mail->get_oid()->c_str(),
                 r_ctx->rados_mail->get_metadata()->size(), r_ctx->rados_mail->get_mail_size());
@@ -765,6 +774,14 @@ int rbox_transaction_save_commit_pre(struct mail_save_context *_ctx) {
   struct rbox_save_context *r_ctx = (struct rbox_save_context *)_ctx;
   i_assert(r_ctx->finished);
 
+  // copies need to be complete before their uids are assigned
+  if (rbox_copy_wait(_ctx, 0) < 0) {
+    r_ctx->failed = TRUE;
+    rbox_transaction_save_rollback(_ctx);
+    FUNC_END_RET("ret == -1, copy failed");
+    return -1;
+  }
+
   if (rbox_sync_begin(r_ctx->mbox, &r_ctx->sync_ctx,
                       static_cast<enum rbox_sync_flags>(RBOX_SYNC_FLAG_FORCE | RBOX_SYNC_FLAG_FSYNC)) < 0) {
     r_ctx->failed = TRUE;
@@ -845,6 +862,10 @@ void rbox_transaction_save_rollback(struct mail_save_context *_ctx) {
     rbox_save_cancel(&r_ctx->ctx);
     clean_up_write_finish(_ctx);
   }
+  // copies still in flight would recreate objects removed by the clean up
+  if (rbox_copy_wait(_ctx, 0) < 0) {
+    r_ctx->failed = TRUE;
+  }
 
   if (r_ctx->sync_ctx != NULL)
     (void)rbox_sync_finish(&r_ctx->sync_ctx, FALSE);
@@ -14,11 +14,42 @@
 
 #include <string>
 #include <list>
+#include <deque>
 
 #include "../librmb/rados-storage-impl.h"
 #include "mail-storage-private.h"
 
 #include "../librmb/rados-mail.h"
+
+struct rbox_mail;
+
+/**
+ * @brief: rbox_pending_copy
+ *  copy of a mail sent by rbox_mail_copy, finished by rbox_copy_wait.
+ */
+struct rbox_pending_copy {
+  rbox_pending_copy(const std::string &src_oid_, const std::string &dest_oid_, const std::string &ns_src_,
+                    const std::string &ns_dest_, librmb::RadosStorage *storage_)
+      : src_oid(src_oid_),
+        dest_oid(dest_oid_),
+        ns_src(ns_src_),
+        ns_dest(ns_dest_),
+        storage(storage_),
+        src_mail(NULL),
+        completion(NULL) {}
+
+  std::string src_oid;
+  std::string dest_oid;
+  std::string ns_src;
+  std::string ns_dest;
+  librmb::RadosStorage *storage;
+  // source mail while it is open, marked expunged if its object is gone
+  struct rbox_mail *src_mail;
+  librados::ObjectWriteOperation write_op;
+  // recorded in the stats by aio_copy
+  librados::AioCompletion *completion;
+};
+
 /**
  * @brief: rbox_save_context
  *  class is holding all references to
@@ -75,6 +106,8 @@ class rbox_save_context {
   std::list<librmb::RadosMail *> rados_mails;
   /** current mail in the context **/
   librmb::RadosMail *rados_mail;
+  /** copies in flight, oldest first **/
+  std::deque<rbox_pending_copy *> pending_copies;
 #if DOVECOT_PREREQ(2, 3)
   unsigned int highest_pop3_uidl_seq : 1;
 #endif
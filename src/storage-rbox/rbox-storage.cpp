@@ -24,6 +24,7 @@ extern "C" {
 #include "rbox-sync.h"
 #include "debug-helper.h"
 #include "guid.h"
+#include "lib-signals.h"
 #include "mailbox-list-fs.h"
 #include "macros.h"
 #if DOVECOT_PREREQ(2, 3)
@@ -38,9 +39,13 @@ extern "C" {
 #include "../librmb/rados-cluster-impl.h"
 #include "../librmb/rados-storage-impl.h"
 #include "../librmb/rados-namespace-manager.h"
+#include "../librmb/rados-namespace-cache.h"
 #include "../librmb/rados-dovecot-ceph-cfg-impl.h"
 #include "../librmb/rados-guid-generator.h"
 #include "../librmb/rados-metadata-storage-impl.h"
+#include "../librmb/rados-util.h"
+#include "../librmb/rados-stats.h"
+#include "../librmb/rados-trace.h"
 
 #include "rbox-copy.h"
 #include "rbox-mail.h"
@@ -60,6 +65,59 @@ class RboxGuidGenerator : public librmb::RadosGuidGenerator {
 extern struct mailbox rbox_mailbox;
 extern struct mailbox_vfuncs rbox_mailbox_vfuncs;
 
+// holds the cluster reference of the prewarmed connection
+static librmb::RadosClusterImpl *rbox_prewarm_cluster = nullptr;
+
+int rbox_storage_prewarm(void) {
+  FUNC_START();
+  // process environment (import_environment), plugin settings are not available before the first user.
+  const char *pools_env = getenv("RBOX_PREWARM_POOLS");
+  if (pools_env == NULL || *pools_env == '\0' || rbox_prewarm_cluster != nullptr) {
+    FUNC_END();
+    return 0;
+  }
+  const char *cluster_name = getenv("RBOX_PREWARM_CLUSTER_NAME");
+  const char *rados_username = getenv("RBOX_PREWARM_RADOS_USER_NAME");
+
+  std::list<std::string> pools;
+  for (auto &pool : librmb::RadosUtils::split(pools_env, ',')) {
+    if (!pool.empty()) {
+      pools.push_back(pool);
+    }
+  }
+  rbox_prewarm_cluster = new librmb::RadosClusterImpl();
+  int ret = rbox_prewarm_cluster->prewarm(cluster_name != NULL ? cluster_name : "ceph",
+                                          rados_username != NULL ? rados_username : "client.admin", pools);
+  if (ret < 0) {
+    i_error("rbox: prewarming rados connection failed (pools(%s)) error code: %d", pools_env, ret);
+    delete rbox_prewarm_cluster;
+    rbox_prewarm_cluster = nullptr;
+  }
+  FUNC_END();
+  return ret;
+}
+
+void rbox_storage_prewarm_deinit(void) {
+  if (rbox_prewarm_cluster != nullptr) {
+    rbox_prewarm_cluster->deinit();
+    delete rbox_prewarm_cluster;
+    rbox_prewarm_cluster = nullptr;
+  }
+}
+
+const char *rbox_storage_get_cluster_state(void) {
+  switch (librmb::RadosClusterImpl::get_state()) {
+    case librmb::CLUSTER_STATE_CONNECTING:
+      return "connecting";
+    case librmb::CLUSTER_STATE_READY:
+      return "ready";
+    case librmb::CLUSTER_STATE_FAILED:
+      return "failed";
+    default:
+      return "disabled";
+  }
+}
+
 struct mail_storage *rbox_storage_alloc(void) {
   FUNC_START();
 
@@ -79,6 +137,8 @@ struct mail_storage *rbox_storage_alloc(void) {
 
   // logfile is set when 90-plugin.conf param rados_save_cfg is evaluated.
   r_storage->save_log = new librmb::RadosSaveLog();
+  r_storage->stats_start = new librmb::RadosStats::Snapshot();
+  librmb::RadosStats::snapshot(r_storage->stats_start);
 
   FUNC_END();
   return &r_storage->storage;
@@ -176,10 +236,55 @@ int rbox_storage_create(struct mail_storage *storage, struct mail_namespace *ns,
   return 0;
 }
 
+#if DOVECOT_PREREQ(2, 3)
+/* sends the rados operations of this session as "rbox_rados_stats" event.
+   Stats are process wide, so with several users per process the event
+   includes the operations of the other users too. The state of the
+   prewarmed cluster connection is sent as "cluster_state". */
+static void rbox_storage_send_stats_event(struct rbox_storage *r_storage) {
+  librmb::RadosStats::Snapshot session;
+  librmb::RadosStats::snapshot(&session);
+  session.subtract(*r_storage->stats_start);
+
+  struct event_passthrough *e = event_create_passthrough(r_storage->storage.user->event)->set_name("rbox_rados_stats");
+  e->add_str("cluster_state", rbox_storage_get_cluster_state());
+  bool empty = true;
+  for (int i = 0; i < librmb::RADOS_OP_COUNT; i++) {
+    const librmb::RadosStats::OpStats &op = session.ops[i];
+    if (op.count == 0 && op.retries == 0) {
+      continue;
+    }
+    const char *name = librmb::RadosStats::op_name(static_cast<librmb::rbox_rados_op>(i));
+    e->add_int(t_strdup_printf("%s_count", name), op.count);
+    e->add_int(t_strdup_printf("%s_errors", name), op.errors);
+    e->add_int(t_strdup_printf("%s_retries", name), op.retries);
+    e->add_int(t_strdup_printf("%s_bytes", name), op.bytes);
+    e->add_int(t_strdup_printf("%s_usecs", name), op.usecs);
+    e->add_int(t_strdup_printf("%s_p99_usecs", name), librmb::RadosStats::percentile(op, 99));
+    empty = false;
+  }
+  if (!empty) {
+    e_debug(e->event(), "rados stats (cluster %s):\n%s", rbox_storage_get_cluster_state(),
+            librmb::RadosStats::to_string(session).c_str());
+  }
+}
+#endif
+
 void rbox_storage_destroy(struct mail_storage *storage) {
   FUNC_START();
   struct rbox_storage *r_storage = (struct rbox_storage *)storage;
 
+  if (r_storage->stats_start != nullptr) {
+#if DOVECOT_PREREQ(2, 3)
+    if (storage->user != nullptr) {
+      T_BEGIN { rbox_storage_send_stats_event(r_storage); }
+      T_END;
+    }
+#endif
+    delete r_storage->stats_start;
+    r_storage->stats_start = nullptr;
+  }
+
   if (r_storage->s != nullptr) {
     r_storage->s->close_connection();
     delete r_storage->s;
@@ -398,6 +503,24 @@ static void read_plugin_ceph_client_settings(struct mailbox *box, const char *pr
   }
 }
 
+/* SIGUSR2 dumps the trace ring buffer to rbox_trace_file when the next
+   traced operation ends. Runs in signal context, see RadosTrace::request_dump. */
+static void rbox_trace_dump_signal(const siginfo_t *si ATTR_UNUSED, void *context ATTR_UNUSED) {
+  librmb::RadosTrace::request_dump();
+}
+
+static void rbox_configure_trace(struct rbox_storage *r_storage) {
+  static bool signal_handler_set = false;
+
+  librmb::RadosTrace::configure(r_storage->config->is_trace_enabled(),
+                                static_cast<uint64_t>(r_storage->config->get_trace_threshold()) * 1000,
+                                r_storage->config->get_trace_file());
+  if (r_storage->config->is_trace_enabled() && !signal_handler_set) {
+    lib_signals_set_handler(SIGUSR2, LIBSIG_FLAG_RESTART, rbox_trace_dump_signal, NULL);
+    signal_handler_set = true;
+  }
+}
+
 void read_plugin_configuration(struct mailbox *box) {
   FUNC_START();
   struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
@@ -415,9 +538,22 @@ void read_plugin_configuration(struct mailbox *box) {
     }
     r_storage->config->set_config_valid(true);
     r_storage->save_log->set_save_log_file(r_storage->config->get_rados_save_log_file());
+    librmb::rados_save_log_format save_log_format;
+    if (librmb::RadosSaveLogWriter::parse_format(r_storage->config->get_rados_save_log_format(), &save_log_format)) {
+      r_storage->save_log->set_format(save_log_format);
+    } else {
+      i_warning("invalid rados_save_log_format %s, using csv", r_storage->config->get_rados_save_log_format().c_str());
+    }
+    int save_log_fsync;
+    if (librmb::RadosSaveLogWriter::parse_fsync_policy(r_storage->config->get_rados_save_log_fsync(), &save_log_fsync)) {
+      r_storage->save_log->set_fsync_policy(save_log_fsync);
+    } else {
+      i_warning("invalid rados_save_log_fsync %s, using none", r_storage->config->get_rados_save_log_fsync().c_str());
+    }
     if (!r_storage->save_log->open() && !r_storage->config->get_rados_save_log_file().empty()) {
       i_warning("unable to open the rados save log file %s", r_storage->config->get_rados_save_log_file().c_str());
     }
+    rbox_configure_trace(r_storage);
   }
 
   FUNC_END();
@@ -427,6 +563,18 @@ bool is_alternate_storage_set(uint8_t flags) { return (flags & RBOX_INDEX_FLAG_A
 bool is_alternate_pool_valid(struct mailbox *_box) {
   return _box->list->set.alt_dir != NULL && strlen(_box->list->set.alt_dir) > 0;
 }
+static std::string rbox_get_namespace_uid(struct mailbox *box) {
+  struct rbox_storage *r_storage = (struct rbox_storage *)box->storage;
+  std::string uid;
+  if (box->list->ns->owner != nullptr) {
+    uid = box->list->ns->owner->username;
+    uid += r_storage->config->get_user_suffix();
+  } else {
+    uid = r_storage->config->get_public_namespace();
+  }
+  return uid;
+}
+
 /**TODO: reduce cyclomatic complexity */
 int rbox_open_rados_connection(struct mailbox *box, bool alt_storage) {
   FUNC_START();
@@ -440,6 +588,15 @@ int rbox_open_rados_connection(struct mailbox *box, bool alt_storage) {
     read_plugin_configuration(box);
     // set the ceph client options!
     read_plugin_ceph_client_settings(box, "rbox_ceph_client");
+
+    librmb::RadosClusterImpl *cluster = dynamic_cast<librmb::RadosClusterImpl *>(r_storage->cluster);
+    std::string mismatch;
+    if (cluster != nullptr && !cluster->is_prewarm_compatible(r_storage->config->get_rados_cluster_name(),
+                                                              r_storage->config->get_rados_username(), &mismatch)) {
+      i_warning("rbox: plugin settings differ from the prewarmed rados connection (%s), the prewarmed "
+                "settings are used. Set RBOX_PREWARM_* to the plugin settings.",
+                mismatch.c_str());
+    }
   }
   int ret = 0;
   try {
@@ -487,6 +644,21 @@ int rbox_open_rados_connection(struct mailbox *box, bool alt_storage) {
     return ret;
   }
 
+  // config and user mapping objects are read through the shared io contexts,
+  // the namespace of the storage io_ctx is not touched.
+  rbox->storage->config->set_io_ctx_pool(rbox->storage->cluster, rbox->storage->config->get_pool_name());
+  rbox->storage->config->set_io_ctx_namespace("");
+
+  if (!rbox->storage->config->is_config_valid() && rbox->storage->config->is_user_mapping_prefetch()) {
+    // read the users namespace object while the rados config is loading. The prefetch uses
+    // the default user namespace and suffix, lookup_key ignores it if the config differs.
+    librados::IoCtx *user_io_ctx = nullptr;
+    if (rbox->storage->cluster->io_ctx_get(rbox->storage->config->get_pool_name(),
+                                           rbox->storage->config->get_user_ns(), &user_io_ctx) == 0) {
+      rbox->storage->ns_mgr->prefetch_key(user_io_ctx, rbox_get_namespace_uid(box));
+    }
+  }
+
   ret = rbox->storage->config->load_rados_config();
   if (ret == -ENOENT) {  // config does not exist.
     i_debug("Rados config does not exist, creating default config");
@@ -498,15 +670,11 @@ int rbox_open_rados_connection(struct mailbox *box, bool alt_storage) {
     assert(ret == 0);
     return ret;
   }
+  // rmb migrate waits this long before it expects all processes to use a switched mapping
+  librmb::RadosNamespaceCache::set_ttl(rbox->storage->config->get_namespace_cache_ttl());
   rbox->storage->ms->create_metadata_storage(&rbox->storage->s->get_io_ctx(), rbox->storage->config);
 
-  std::string uid;
-  if (box->list->ns->owner != nullptr) {
-    uid = box->list->ns->owner->username;
-    uid += rbox->storage->config->get_user_suffix();
-  } else {
-    uid = rbox->storage->config->get_public_namespace();
-  }
+  std::string uid = rbox_get_namespace_uid(box);
   std::string ns;
   if (!rbox->storage->ns_mgr->lookup_key(uid, &ns)) {
     RboxGuidGenerator guid_generator;
@@ -919,6 +1087,7 @@ int check_users_mailbox_delete_ns_object(struct mail_user *user, librmb::RadosDo
 #endif
       storage->set_namespace(config->get_user_ns());
       ret = storage->delete_mail(uid);
+      ns_mgr->invalidate_key(uid);
       if (ret < 0) {
         if (ret == -ENOENT) {
 #ifdef DEBUG
@@ -58,6 +58,26 @@ extern int rbox_open_rados_connection(struct mailbox *box, bool alt_storage);
  * @param[in] box mailbox (state open).
  */
 extern void read_plugin_configuration(struct mailbox *box);
+/**
+ * @brief connects the cluster and opens the pools listed in the environment variable
+ *        RBOX_PREWARM_POOLS (comma separated) when the plugin is loaded.
+ *        RBOX_PREWARM_CLUSTER_NAME and RBOX_PREWARM_RADOS_USER_NAME default to ceph and client.admin.
+ *        The connection is shared by all users of the process, so it needs the same cluster name,
+ *        rados user and ceph client options as the plugin settings, differences are logged as warning.
+ *        Mail plugins are loaded with the first user of a process, so only later users of
+ *        the process (service_count != 1) benefit from the prewarmed connection.
+ * @return linux error code or 0 if successful or prewarming is not configured.
+ */
+extern int rbox_storage_prewarm(void);
+/**
+ * @brief releases the prewarmed cluster connection.
+ */
+extern void rbox_storage_prewarm_deinit(void);
+/**
+ * @brief state of the prewarmed cluster connection: disabled, connecting, ready or failed.
+ *        sent as cluster_state field of the rbox_rados_stats event.
+ */
+extern const char *rbox_storage_get_cluster_state(void);
 /**
  * @brief: deletes the given mailbox
  */
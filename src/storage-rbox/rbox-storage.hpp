@@ -30,6 +30,7 @@
 #include "../librmb/rados-dovecot-ceph-cfg.h"
 #include "../librmb/rados-metadata-storage-impl.h"
 #include "../librmb/rados-save-log.h"
+#include "../librmb/rados-stats.h"
 
 #include "rbox-storage-struct.h"
 
@@ -43,6 +44,8 @@ struct rbox_storage {
   librmb::RadosMetadataStorage *ms;
   librmb::RadosStorage *alt;
   librmb::RadosSaveLog *save_log;
+  // rados stats when the storage was created
+  librmb::RadosStats::Snapshot *stats_start;
 
   uint32_t corrupted_rebuild_count;
   bool corrupted;
@@ -10,6 +10,7 @@
  * Foundation.  See file COPYING.
  */
 #include <list>
+#include <vector>
 extern "C" {
 #include "dovecot-all.h"
 
@@ -29,6 +30,8 @@ extern "C" {
 #include "../librmb/rados-util.h"
 #include "rados-types.h"
 
+// oids per batch when listing the namespace
+#define LIST_BATCH_SIZE 1000
 
 using librmb::RadosMail;
 using librmb::rbox_metadata_key;
@@ -480,11 +483,14 @@ int repair_namespace(struct mail_namespace *ns, bool force, struct rbox_storage
           i_debug("processing ceph index done : took: %ld ms", (milli_time));
         }
         else {
-          librados::NObjectIterator iter_guid  = r_storage->s->find_mails(nullptr);
-          while (iter_guid != librados::NObjectIterator::__EndObjectIterator) {
-            mail_list.insert((*iter_guid).get_oid());
-            iter_guid++;
-          } 
+          int list_ret = r_storage->s->find_mails_parallel(nullptr, 1, LIST_BATCH_SIZE,
+                                                           [&mail_list](std::vector<std::string> *oids) {
+                                                             mail_list.insert(oids->begin(), oids->end());
+                                                             return true;
+                                                           });
+          if (list_ret < 0) {
+            i_error("listing mails failed: %d", list_ret);
+          }
         }           
         
         i_info("Loading mail metadata...");
@@ -25,6 +25,7 @@ extern "C" {
 #include "rbox-storage.hpp"
 #include "rbox-mail.h"
 #include "rbox-sync-rebuild.h"
+#include "../librmb/rados-trace.h"
 
 #define RBOX_REBUILD_COUNT 3
 
@@ -550,14 +551,18 @@ int rbox_sync(struct rbox_mailbox *rbox, enum rbox_sync_flags flags) {
   FUNC_START();
 
   struct rbox_sync_context *sync_ctx = NULL;
+  librmb::RadosTraceScope trace("sync", rbox->storage->s->get_pool_name(), rbox->storage->s->get_namespace());
 
   if (rbox_sync_begin(rbox, &sync_ctx, flags) < 0) {
+    trace.set_result(-1);
     FUNC_END_RET("ret == -1");
     return -1;
   }
 
+  int ret = sync_ctx == NULL ? 0 : rbox_sync_finish(&sync_ctx, TRUE);
+  trace.set_result(ret);
   FUNC_END();
-  return sync_ctx == NULL ? 0 : rbox_sync_finish(&sync_ctx, TRUE);
+  return ret;
 }
 
 struct mailbox_sync_context *rbox_storage_sync_init(struct mailbox *box, enum mailbox_sync_flags flags) {
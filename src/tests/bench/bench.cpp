@@ -0,0 +1,142 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "bench.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+// allocations are counted for the whole process, the benchmarks run single threaded.
+static std::atomic<uint64_t> alloc_count(0);
+static std::atomic<uint64_t> alloc_bytes(0);
+
+void *operator new(size_t size) {
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+  void *p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+
+namespace bench {
+
+struct Result {
+  std::string name;
+  uint64_t iterations;
+  double ns_per_op;
+  double allocs_per_op;
+  double alloc_bytes_per_op;
+  double mb_per_sec;
+};
+
+static std::vector<std::pair<std::string, BenchFunc>> &benchmarks() {
+  static std::vector<std::pair<std::string, BenchFunc>> list;
+  return list;
+}
+
+int register_benchmark(const std::string &name, BenchFunc func) {
+  benchmarks().push_back(std::make_pair(name, func));
+  return 0;
+}
+
+static Result run_benchmark(const std::string &name, BenchFunc func, uint64_t min_time_ns) {
+  State state;
+  uint64_t elapsed_ns = 0;
+  uint64_t allocs = 0;
+  uint64_t bytes = 0;
+  state.iterations = 1;
+  for (;;) {
+    state.bytes_per_iteration = 0;
+    uint64_t allocs_start = alloc_count.load(std::memory_order_relaxed);
+    uint64_t bytes_start = alloc_bytes.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    func(&state);
+    elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    allocs = alloc_count.load(std::memory_order_relaxed) - allocs_start;
+    bytes = alloc_bytes.load(std::memory_order_relaxed) - bytes_start;
+    if (elapsed_ns >= min_time_ns || state.iterations >= (1ULL << 40)) {
+      break;
+    }
+    // aim a bit above the minimum time, grow at most 100x per round
+    uint64_t next = elapsed_ns > 0 ? state.iterations * min_time_ns * 12 / 10 / elapsed_ns : state.iterations * 100;
+    if (next > state.iterations * 100) {
+      next = state.iterations * 100;
+    }
+    state.iterations = next > state.iterations ? next : state.iterations * 2;
+  }
+
+  Result r;
+  r.name = name;
+  r.iterations = state.iterations;
+  r.ns_per_op = static_cast<double>(elapsed_ns) / state.iterations;
+  r.allocs_per_op = static_cast<double>(allocs) / state.iterations;
+  r.alloc_bytes_per_op = static_cast<double>(bytes) / state.iterations;
+  r.mb_per_sec = 0;
+  if (state.bytes_per_iteration > 0 && elapsed_ns > 0) {
+    r.mb_per_sec = static_cast<double>(state.bytes_per_iteration) * state.iterations * 1000 / elapsed_ns;
+  }
+  return r;
+}
+
+int run_benchmarks(int argc, char **argv) {
+  std::string filter;
+  uint64_t min_time_ms = 500;
+  bool csv = false;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--filter=", 9) == 0) {
+      filter = argv[i] + 9;
+    } else if (strncmp(argv[i], "--min-time-ms=", 14) == 0) {
+      min_time_ms = strtoull(argv[i] + 14, nullptr, 10);
+    } else if (strcmp(argv[i], "--csv") == 0) {
+      csv = true;
+    } else {
+      fprintf(stderr, "usage: %s [--filter=<name>] [--min-time-ms=<ms>] [--csv]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (csv) {
+    printf("name,iterations,ns_per_op,allocs_per_op,alloc_bytes_per_op,mb_per_sec\n");
+  } else {
+    printf("%-45s %12s %12s %10s %12s %10s\n", "benchmark", "iterations", "ns/op", "allocs/op", "bytes/op", "MB/s");
+  }
+  for (auto &b : benchmarks()) {
+    if (!filter.empty() && b.first.find(filter) == std::string::npos) {
+      continue;
+    }
+    Result r = run_benchmark(b.first, b.second, min_time_ms * 1000000);
+    if (csv) {
+      printf("%s,%llu,%.1f,%.2f,%.1f,%.1f\n", r.name.c_str(), static_cast<unsigned long long>(r.iterations),
+             r.ns_per_op, r.allocs_per_op, r.alloc_bytes_per_op, r.mb_per_sec);
+    } else {
+      printf("%-45s %12llu %12.1f %10.2f %12.1f %10.1f\n", r.name.c_str(),
+             static_cast<unsigned long long>(r.iterations), r.ns_per_op, r.allocs_per_op, r.alloc_bytes_per_op,
+             r.mb_per_sec);
+    }
+    fflush(stdout);
+  }
+  return 0;
+}
+
+}  // namespace bench
@@ -0,0 +1,63 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef SRC_TESTS_BENCH_BENCH_H_
+#define SRC_TESTS_BENCH_BENCH_H_
+
+#include <stdint.h>
+
+#include <string>
+
+namespace bench {
+
+/**
+ * State of a running benchmark, the benchmark body runs the measured
+ * code state.iterations times.
+ */
+struct State {
+  uint64_t iterations;
+  // payload processed per iteration, reported as throughput if set
+  uint64_t bytes_per_iteration;
+};
+
+typedef void (*BenchFunc)(State *state);
+
+int register_benchmark(const std::string &name, BenchFunc func);
+/*!
+ * runs the registered benchmarks, options:
+ *   --filter=<substring of the benchmark name>
+ *   --min-time-ms=<minimum runtime per benchmark, default 500>
+ *   --csv print results as csv
+ * @return 0 if successful
+ */
+int run_benchmarks(int argc, char **argv);
+
+// keeps the compiler from optimizing away the benchmarked value
+template <class T>
+inline void do_not_optimize(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+}  // namespace bench
+
+#define BENCH_CONCAT_(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_(a, b)
+
+/**
+ * BENCHMARK(utils_convert_flags) { for (uint64_t i = 0; i < state->iterations; i++) {...} }
+ */
+#define BENCHMARK(name)                                                                           \
+  static void BENCH_CONCAT(bench_, name)(bench::State * state);                                   \
+  static int BENCH_CONCAT(bench_registered_, name) =                                              \
+      bench::register_benchmark(#name, BENCH_CONCAT(bench_, name));                               \
+  static void BENCH_CONCAT(bench_, name)(bench::State * state)
+
+#endif  // SRC_TESTS_BENCH_BENCH_H_
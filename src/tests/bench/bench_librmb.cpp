@@ -0,0 +1,257 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include <list>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+
+#include <rados/librados.hpp>
+
+#include "bench.h"
+#include "../../librmb/rados-util.h"
+#include "../../librmb/rados-save-log.h"
+#include "../../librmb/rados-mail.h"
+#include "../../librmb/rados-metadata.h"
+#include "../../librmb/rados-metadata-storage-ima.h"
+#include "../../librmb/rados-dovecot-ceph-cfg-impl.h"
+#include "../../librmb/rados-storage-memory.h"
+#include "../../librmb/rados-metadata-storage-memory.h"
+
+static std::set<std::string> make_oids(int count) {
+  std::set<std::string> oids;
+  for (int i = 0; i < count; i++) {
+    std::ostringstream oid;
+    oid << "a0b1c2d3e4f5a6b7c8d9e0f1a2b3c4" << (10000 + i);
+    oids.insert(oid.str());
+  }
+  return oids;
+}
+
+static void fill_mail_metadata(librmb::RadosMail *mail) {
+  librmb::RadosMetadata m;
+  m.convert(librmb::RBOX_METADATA_MAIL_UID, 4711);
+  mail->add_metadata(m);
+  m.convert(librmb::RBOX_METADATA_RECEIVED_TIME, static_cast<time_t>(1500000000));
+  mail->add_metadata(m);
+  m.convert(librmb::RBOX_METADATA_PHYSICAL_SIZE, 2048);
+  mail->add_metadata(m);
+  m.convert(librmb::RBOX_METADATA_VIRTUAL_SIZE, 2100);
+  mail->add_metadata(m);
+  m.convert(librmb::RBOX_METADATA_VERSION, std::string("0.1"));
+  mail->add_metadata(m);
+  m.convert(librmb::RBOX_METADATA_MAILBOX_GUID, std::string("4dc4fa0e56f0c15a5f4a0000c8b9eb23"));
+  mail->add_metadata(m);
+  m.convert(librmb::RBOX_METADATA_GUID, std::string("5dc4fa0e56f0c15a5f4a0000c8b9eb23"));
+  mail->add_metadata(m);
+  m.convert(librmb::RBOX_METADATA_ORIG_MAILBOX, std::string("INBOX"));
+  mail->add_metadata(m);
+  m.convert(librmb::RBOX_METADATA_FROM_ENVELOPE, std::string("sender@example.com"));
+  mail->add_metadata(m);
+  m.convert(librmb::RBOX_METADATA_OLDV1_FLAGS, std::string("09"));
+  mail->add_metadata(m);
+}
+
+BENCHMARK(utils_convert_to_ceph_index_1000) {
+  std::set<std::string> oids = make_oids(1000);
+  for (uint64_t i = 0; i < state->iterations; i++) {
+    std::string index = librmb::RadosUtils::convert_to_ceph_index(oids);
+    bench::do_not_optimize(index);
+    state->bytes_per_iteration = index.size();
+  }
+}
+
+BENCHMARK(utils_ceph_index_to_set_1000) {
+  std::string index = librmb::RadosUtils::convert_to_ceph_index(make_oids(1000));
+  state->bytes_per_iteration = index.size();
+  for (uint64_t i = 0; i < state->iterations; i++) {
+    std::set<std::string> oids = librmb::RadosUtils::ceph_index_to_set(index);
+    bench::do_not_optimize(oids);
+  }
+}
+
+BENCHMARK(utils_flags_roundtrip) {
+  for (uint64_t i = 0; i < state->iterations; i++) {
+    std::string str;
+    uint8_t flags = 0;
+    librmb::RadosUtils::flags_to_string(static_cast<uint8_t>(i & 0x3f), &str);
+    librmb::RadosUtils::string_to_flags(str, &flags);
+    bench::do_not_optimize(flags);
+  }
+}
+
+BENCHMARK(utils_resolve_flags) {
+  for (uint64_t i = 0; i < state->iterations; i++) {
+    std::string flat;
+    librmb::RadosUtils::resolve_flags(static_cast<uint8_t>(i & 0x3f), &flat);
+    bench::do_not_optimize(flat);
+  }
+}
+
+BENCHMARK(utils_validate_metadata) {
+  librmb::RadosMail mail;
+  fill_mail_metadata(&mail);
+  for (uint64_t i = 0; i < state->iterations; i++) {
+    bool valid = librmb::RadosUtils::validate_metadata(mail.get_metadata());
+    bench::do_not_optimize(valid);
+  }
+}
+
+BENCHMARK(utils_convert_string_to_date) {
+  std::string date_str("2018-01-10 11:22:33");
+  for (uint64_t i = 0; i < state->iterations; i++) {
+    std::string date;
+    librmb::RadosUtils::convert_string_to_date(date_str, &date);
+    bench::do_not_optimize(date);
+  }
+}
+
+BENCHMARK(save_log_entry_parse_save) {
+  std::string line("4dc4fa0e56f0c15a5f4a0000c8b9eb23,user_ns,mail_storage,save\n");
+  for (uint64_t i = 0; i < state->iterations; i++) {
+    std::istringstream in(line);
+    librmb::RadosSaveLogEntry entry;
+    in >> entry;
+    bench::do_not_optimize(entry.oid);
+  }
+}
+
+BENCHMARK(save_log_entry_parse_mv) {
+  std::list<librmb::RadosMetadata *> metadata;
+  librmb::RadosMetadata mailbox_guid(librmb::RBOX_METADATA_MAILBOX_GUID, "4dc4fa0e56f0c15a5f4a0000c8b9eb23");
+  librmb::RadosMetadata uid(librmb::RBOX_METADATA_MAIL_UID, "4711");
+  metadata.push_back(&mailbox_guid);
+  metadata.push_back(&uid);
+  std::ostringstream line;
+  line << "5dc4fa0e56f0c15a5f4a0000c8b9eb23,user_ns,mail_storage,"
+       << librmb::RadosSaveLogEntry::op_mv("src_ns", "6dc4fa0e56f0c15a5f4a0000c8b9eb23", "user", metadata) << "\n";
+  std::string str = line.str();
+  for (uint64_t i = 0; i < state->iterations; i++) {
+    std::istringstream in(str);
+    librmb::RadosSaveLogEntry entry;
+    in >> entry;
+    bench::do_not_optimize(entry.metadata);
+  }
+}
+
+BENCHMARK(ima_save_metadata) {
+  librados::IoCtx io_ctx;
+  librmb::RadosDovecotCephCfgImpl cfg(&io_ctx);
+  librmb::RadosMetadataStorageIma ima(&io_ctx, &cfg);
+  librmb::RadosMail mail;
+  fill_mail_metadata(&mail);
+  for (uint64_t i = 0; i < state->iterations; i++) {
+    librados::ObjectWriteOperation write_op;
+    ima.save_metadata(&write_op, &mail);
+  }
+}
+
+// the storage is shared by all runs, so setup is not part of the measurement
+static librmb::RadosStorageMemory *memory_storage() {
+  static librmb::RadosMemoryBackend backend;
+  static librmb::RadosClusterMemory cluster(&backend);
+  static librmb::RadosStorageMemory storage(&cluster);
+  if (storage.open_connection("bench_mail_storage") == 0) {
+    storage.set_namespace("bench_user");
+  }
+  return &storage;
+}
+
+static void save_memory_mails(librmb::RadosStorageMemory *storage, int count, librados::bufferlist *buffer) {
+  for (int i = 0; i < count; i++) {
+    librmb::RadosMail mail;
+    mail.set_oid("mail_" + std::to_string(i));
+    mail.set_mail_buffer(buffer);
+    fill_mail_metadata(&mail);
+    storage->save_mail(&mail);
+    mail.set_mail_buffer(nullptr);
+  }
+}
+
+BENCHMARK(memory_save_mail_4k) {
+  librmb::RadosStorageMemory *storage = memory_storage();
+  librados::bufferlist buffer;
+  buffer.append(std::string(4096, 'x'));
+  librmb::RadosMail mail;
+  mail.set_oid("save_mail");
+  fill_mail_metadata(&mail);
+  mail.set_mail_buffer(&buffer);
+  state->bytes_per_iteration = buffer.length();
+  for (uint64_t i = 0; i < state->iterations; i++) {
+    storage->save_mail(&mail);
+  }
+  mail.set_mail_buffer(nullptr);
+}
+
+BENCHMARK(memory_aio_save_mail_4k_window_32) {
+  librmb::RadosStorageMemory *storage = memory_storage();
+  librados::bufferlist buffer;
+  buffer.append(std::string(4096, 'x'));
+  const int window = 32;
+  librmb::RadosMail mails[window];
+  for (int w = 0; w < window; w++) {
+    mails[w].set_oid("aio_mail_" + std::to_string(w));
+    fill_mail_metadata(&mails[w]);
+    mails[w].set_mail_buffer(&buffer);
+  }
+  state->bytes_per_iteration = buffer.length();
+  uint64_t i = 0;
+  while (i < state->iterations) {
+    librmb::RadosMemoryCompletion completions[window];
+    int n = 0;
+    for (; n < window && i < state->iterations; n++, i++) {
+      storage->aio_save_mail(&mails[n], &completions[n]);
+    }
+    for (int w = 0; w < n; w++) {
+      completions[w].wait_for_complete();
+    }
+  }
+  for (int w = 0; w < window; w++) {
+    mails[w].set_mail_buffer(nullptr);
+  }
+}
+
+BENCHMARK(memory_read_mail_4k) {
+  librmb::RadosStorageMemory *storage = memory_storage();
+  librados::bufferlist buffer;
+  buffer.append(std::string(4096, 'x'));
+  save_memory_mails(storage, 1, &buffer);
+  state->bytes_per_iteration = buffer.length();
+  for (uint64_t i = 0; i < state->iterations; i++) {
+    librados::bufferlist bl;
+    storage->read_mail("mail_0", &bl);
+    bench::do_not_optimize(bl);
+  }
+}
+
+// mailbox sync: list the namespace and load the metadata of 100 mails
+BENCHMARK(memory_sync_100) {
+  librmb::RadosStorageMemory *storage = memory_storage();
+  storage->set_namespace("bench_sync_user");
+  librados::bufferlist buffer;
+  buffer.append(std::string(1024, 'x'));
+  save_memory_mails(storage, 100, &buffer);
+  librmb::RadosMetadataStorageMemory metadata(storage);
+  for (uint64_t i = 0; i < state->iterations; i++) {
+    std::set<std::string> oids;
+    storage->find_mails(nullptr, &oids);
+    for (auto &oid : oids) {
+      librmb::RadosMail mail;
+      mail.set_oid(oid);
+      metadata.load_metadata(&mail);
+      bench::do_not_optimize(mail);
+    }
+  }
+  storage->set_namespace("bench_user");
+}
+
+int main(int argc, char **argv) { return bench::run_benchmarks(argc, argv); }
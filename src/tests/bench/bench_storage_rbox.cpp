@@ -0,0 +1,83 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include <string>
+
+extern "C" {
+#include "lib.h"
+#include "istream.h"
+#include "ostream.h"
+}
+
+#include <rados/librados.hpp>
+
+#include "bench.h"
+#include "istream-bufferlist.h"
+#include "ostream-bufferlist.h"
+#include "../../librmb/rados-mail.h"
+
+#define BENCH_MAIL_SIZE (64 * 1024)
+#define BENCH_CHUNK_SIZE 4096
+
+static std::string make_mail(size_t size) {
+  std::string mail("From: sender@example.com\r\nTo: rcpt@example.com\r\nSubject: bench\r\n\r\n");
+  while (mail.size() < size) {
+    mail.append("Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor.\r\n");
+  }
+  mail.resize(size);
+  return mail;
+}
+
+BENCHMARK(istream_bufferlist_read_64k) {
+  librados::bufferlist data;
+  data.append(make_mail(BENCH_MAIL_SIZE));
+  state->bytes_per_iteration = data.length();
+  for (uint64_t i = 0; i < state->iterations; i++) {
+    // the stream takes ownership of the bufferlist, the copy shares the buffer
+    struct istream *input = i_stream_create_from_bufferlist(new librados::bufferlist(data), data.length());
+    const unsigned char *buf;
+    size_t size;
+    size_t total = 0;
+    while (i_stream_read_data(input, &buf, &size, 0) > 0) {
+      bench::do_not_optimize(buf);
+      total += size;
+      i_stream_skip(input, size);
+    }
+    bench::do_not_optimize(total);
+    i_stream_unref(&input);
+  }
+}
+
+BENCHMARK(ostream_bufferlist_write_64k) {
+  std::string mail = make_mail(BENCH_MAIL_SIZE);
+  librmb::RadosMail rados_mail;
+  librados::bufferlist mail_buffer;
+  rados_mail.set_mail_buffer(&mail_buffer);
+  state->bytes_per_iteration = mail.size();
+  for (uint64_t i = 0; i < state->iterations; i++) {
+    mail_buffer.clear();
+    struct ostream *output = o_stream_create_bufferlist(&rados_mail, nullptr, false);
+    for (size_t offset = 0; offset < mail.size(); offset += BENCH_CHUNK_SIZE) {
+      size_t len = mail.size() - offset < BENCH_CHUNK_SIZE ? mail.size() - offset : BENCH_CHUNK_SIZE;
+      o_stream_send(output, mail.data() + offset, len);
+    }
+    bench::do_not_optimize(mail_buffer.length());
+    o_stream_unref(&output);
+  }
+  rados_mail.set_mail_buffer(nullptr);
+}
+
+int main(int argc, char **argv) {
+  lib_init();
+  int ret = bench::run_benchmarks(argc, argv);
+  lib_deinit();
+  return ret;
+}
@@ -9,6 +9,9 @@
  * Foundation.  See file COPYING.
  */
 
+#include <map>
+#include <string>
+
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
 #include "TestCase.h"
@@ -106,6 +109,159 @@ TEST_F(DictTest, iterate) {
   ASSERT_EQ(dict_iterate_deinit(&iter, &error_r), 0);
 }
 
+TEST_F(DictTest, iterate_paged) {
+  ASSERT_NE(target, nullptr);
+  struct dict *paged_target = nullptr;
+  std::string paged_uri = uri + ":dict_iterate_page_size=2";
+  ASSERT_EQ(dict_driver_rados.v.init(&dict_driver_rados, paged_uri.c_str(), set, &paged_target, &error_r), 0);
+
+  // keys written by the iterate test span several pages of size 2
+  struct dict_iterate_context *iter = dict_iterate_init_multiple(paged_target, OMAP_ITERATE_KEY, dict_iterate_flags(0));
+
+  int i = 0;
+  const char *kr;
+  const char *vr;
+  while (dict_iterate(iter, &kr, &vr)) {
+    EXPECT_STREQ(vr, OMAP_ITERATE_RESULTS[i]);
+    i++;
+  }
+  EXPECT_EQ(i, 3);
+  ASSERT_EQ(dict_iterate_deinit(&iter, &error_r), 0);
+
+  paged_target->v.deinit(paged_target);
+}
+
+TEST_F(DictTest, lookup_cache_invalidation) {
+  ASSERT_NE(target, nullptr);
+  struct dict *cached_target = nullptr;
+  struct dict *writer_target = nullptr;
+  std::string cached_uri = uri + ":dict_cache_ttl=60";
+  ASSERT_EQ(dict_driver_rados.v.init(&dict_driver_rados, cached_uri.c_str(), set, &cached_target, &error_r), 0);
+  ASSERT_EQ(dict_driver_rados.v.init(&dict_driver_rados, cached_uri.c_str(), set, &writer_target, &error_r), 0);
+
+  struct dict_transaction_context *ctx = dict_transaction_begin(writer_target);
+  dict_set(ctx, "shared/cached", "V1");
+  ASSERT_EQ(dict_transaction_commit(&ctx, &error_r), 1);
+  writer_target->v.wait(writer_target);
+
+  const char *v_r;
+#if DOVECOT_PREREQ(2, 3)
+  const char *e_r;
+  ASSERT_EQ(dict_lookup(cached_target, s_test_pool, "shared/cached", &v_r, &e_r), 1);
+#else
+  ASSERT_EQ(dict_lookup(cached_target, s_test_pool, "shared/cached", &v_r, nullptr), 1);
+#endif
+  EXPECT_STREQ("V1", v_r);
+
+  ctx = dict_transaction_begin(writer_target);
+  dict_set(ctx, "shared/cached", "V2");
+  ASSERT_EQ(dict_transaction_commit(&ctx, &error_r), 1);
+  // wait for the notify to be acked by the cached dict
+  writer_target->v.wait(writer_target);
+
+#if DOVECOT_PREREQ(2, 3)
+  ASSERT_EQ(dict_lookup(cached_target, s_test_pool, "shared/cached", &v_r, &e_r), 1);
+#else
+  ASSERT_EQ(dict_lookup(cached_target, s_test_pool, "shared/cached", &v_r, nullptr), 1);
+#endif
+  EXPECT_STREQ("V2", v_r);
+
+  cached_target->v.deinit(cached_target);
+  writer_target->v.deinit(writer_target);
+}
+
+struct lookup_async_result {
+  int found;
+  int not_found;
+};
+
+static void lookup_async_callback(const struct dict_lookup_result *result, void *context) {
+  struct lookup_async_result *r = reinterpret_cast<struct lookup_async_result *>(context);
+  if (result->ret == RADOS_COMMIT_RET_OK) {
+    r->found++;
+  } else if (result->ret == RADOS_COMMIT_RET_NOTFOUND) {
+    r->not_found++;
+  }
+}
+
+TEST_F(DictTest, lookup_async_batch) {
+  ASSERT_NE(target, nullptr);
+
+  // keys written by the iterate test, looked up with one request per object
+  struct lookup_async_result r = {0, 0};
+  for (auto k = OMAP_ITERATE_KEYS; *k != NULL; k++) {
+    dict_lookup_async(target, *k, lookup_async_callback, &r);
+  }
+  dict_lookup_async(target, "priv/does_not_exist", lookup_async_callback, &r);
+  dict_wait(target);
+
+  EXPECT_EQ(r.found, 7);
+  EXPECT_EQ(r.not_found, 1);
+}
+
+TEST_F(DictTest, atomic_inc_moves_legacy_key_to_missing_shard) {
+  ASSERT_NE(target, nullptr);
+  struct dict *sharded_target = nullptr;
+  std::string sharded_uri = uri + ":dict_shared_shards=4";
+  ASSERT_EQ(dict_driver_rados.v.init(&dict_driver_rados, sharded_uri.c_str(), set, &sharded_target, &error_r), 0);
+
+  // written to the unsharded object, the shard objects do not exist yet
+  struct dict_transaction_context *ctx = dict_transaction_begin(target);
+  dict_set(ctx, "shared/legacy_counter", "5");
+  ASSERT_EQ(dict_transaction_commit(&ctx, &error_r), 1);
+
+  ctx = dict_transaction_begin(sharded_target);
+  dict_atomic_inc(ctx, "shared/legacy_counter", 2);
+  ASSERT_EQ(dict_transaction_commit(&ctx, &error_r), 1);
+
+  const char *v_r;
+#if DOVECOT_PREREQ(2, 3)
+  const char *e_r;
+  ASSERT_EQ(dict_lookup(sharded_target, s_test_pool, "shared/legacy_counter", &v_r, &e_r), 1);
+#else
+  ASSERT_EQ(dict_lookup(sharded_target, s_test_pool, "shared/legacy_counter", &v_r, nullptr), 1);
+#endif
+  EXPECT_STREQ("7", v_r);
+
+  sharded_target->v.deinit(sharded_target);
+}
+
+TEST_F(DictTest, iterate_prefers_shard_over_legacy_value) {
+  ASSERT_NE(target, nullptr);
+  struct dict *sharded_target = nullptr;
+  // one key per page, so the legacy keys are filtered page by page
+  std::string sharded_uri = uri + ":dict_shared_shards=4:dict_iterate_page_size=1";
+  ASSERT_EQ(dict_driver_rados.v.init(&dict_driver_rados, sharded_uri.c_str(), set, &sharded_target, &error_r), 0);
+
+  struct dict_transaction_context *ctx = dict_transaction_begin(target);
+  dict_set(ctx, "shared/merge/K1", "legacy");
+  dict_set(ctx, "shared/merge/K2", "legacy-only");
+  ASSERT_EQ(dict_transaction_commit(&ctx, &error_r), 1);
+
+  // K1 is in its shard and in the unsharded object
+  ctx = dict_transaction_begin(sharded_target);
+  dict_set(ctx, "shared/merge/K1", "shard");
+  ASSERT_EQ(dict_transaction_commit(&ctx, &error_r), 1);
+
+  const char *paths[] = {"shared/merge/", NULL};
+  struct dict_iterate_context *iter = dict_iterate_init_multiple(sharded_target, paths, dict_iterate_flags(0));
+  std::map<std::string, std::string> found;
+  int count = 0;
+  const char *kr;
+  const char *vr;
+  while (dict_iterate(iter, &kr, &vr)) {
+    found[kr] = vr;
+    count++;
+  }
+  ASSERT_EQ(dict_iterate_deinit(&iter, &error_r), 0);
+
+  EXPECT_EQ(count, 2);
+  EXPECT_EQ(found["shared/merge/K1"], "shard");
+  EXPECT_EQ(found["shared/merge/K2"], "legacy-only");
+
+  sharded_target->v.deinit(sharded_target);
+}
+
 TEST_F(DictTest, deinit) {
   ASSERT_NE(target, nullptr);
   target->v.deinit(target);
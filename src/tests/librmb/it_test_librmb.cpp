@@ -23,6 +23,7 @@
 #include "../../librmb/rados-util.h"
 #include "../../librmb/tools/rmb/rmb-commands.h"
 #include "../../librmb/rados-save-log.h"
+#include "../../librmb/rados-namespace-manager.h"
 
 using ::testing::AtLeast;
 using ::testing::Return;
@@ -1371,6 +1372,153 @@ TEST(librmb, move_object_delete_with_save_log) {
   EXPECT_EQ(storage.delete_mail("abc3"), 0);  // move does not delete the object
   cluster.deinit();
 }
+/**
+ * shared io contexts are kept per pool and namespace, copy between namespaces
+ * does not change the namespace of the storage.
+ */
+TEST(librmb, shared_io_ctx) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+
+  std::string pool_name("rmb_tool_tests");
+  EXPECT_EQ(0, storage.open_connection(pool_name));
+  storage.set_namespace("ns_1");
+
+  librados::IoCtx *io_ctx_1 = nullptr;
+  librados::IoCtx *io_ctx_2 = nullptr;
+  librados::IoCtx *io_ctx_3 = nullptr;
+  EXPECT_EQ(0, cluster.io_ctx_get(pool_name, "ns_2", &io_ctx_1));
+  EXPECT_EQ(0, cluster.io_ctx_get(pool_name, "ns_2", &io_ctx_2));
+  EXPECT_EQ(0, cluster.io_ctx_get(pool_name, "ns_3", &io_ctx_3));
+  EXPECT_EQ(io_ctx_1, io_ctx_2);
+  EXPECT_NE(io_ctx_1, io_ctx_3);
+  EXPECT_EQ("ns_2", io_ctx_1->get_namespace());
+  EXPECT_EQ("ns_3", io_ctx_3->get_namespace());
+
+  librados::bufferlist bl;
+  bl.append("shared");
+  EXPECT_EQ(0, storage.save_mail("shared_src", bl));
+
+  std::string src_oid("shared_src");
+  std::string dest_oid("shared_dest");
+  std::list<librmb::RadosMetadata> to_update;
+  EXPECT_EQ(0, storage.copy(src_oid, "ns_1", dest_oid, "ns_2", to_update));
+  EXPECT_EQ("ns_1", storage.get_io_ctx().get_namespace());
+
+  uint64_t size;
+  time_t mtime;
+  EXPECT_EQ(0, io_ctx_1->stat(dest_oid, &size, &mtime));
+  EXPECT_EQ(0, io_ctx_1->remove(dest_oid));
+  EXPECT_EQ(0, storage.delete_mail(src_oid));
+  cluster.deinit();
+}
+/**
+ * prefetched user mapping is used if the user namespace matches the configuration.
+ */
+TEST(librmb, namespace_manager_prefetch) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+
+  std::string pool_name("rmb_tool_tests");
+  EXPECT_EQ(0, storage.open_connection(pool_name));
+
+  librmb::RadosDovecotCephCfgImpl cfg(&storage.get_io_ctx());
+  cfg.set_config_valid(true);
+  cfg.get_rados_ceph_cfg()->set_config_valid(true);
+  cfg.set_user_mapping(true);
+  cfg.set_io_ctx_pool(&cluster, pool_name);
+
+  librados::IoCtx *user_io_ctx = nullptr;
+  EXPECT_EQ(0, cluster.io_ctx_get(pool_name, cfg.get_user_ns(), &user_io_ctx));
+  librados::bufferlist bl;
+  bl.append("prefetched_ns");
+  EXPECT_EQ(0, user_io_ctx->write_full("prefetch_u", bl));
+
+  librmb::RadosNamespaceManager mgr(&cfg);
+  EXPECT_EQ(0, mgr.prefetch_key(user_io_ctx, "prefetch_u"));
+  EXPECT_EQ(0, mgr.prefetch_key(user_io_ctx, "prefetch_missing_u"));
+
+  std::string ns;
+  EXPECT_TRUE(mgr.lookup_key("prefetch_u", &ns));
+  EXPECT_EQ("prefetched_ns", ns);
+  EXPECT_FALSE(mgr.lookup_key("prefetch_missing_u", &ns));
+
+  EXPECT_EQ(0, user_io_ctx->remove("prefetch_u"));
+  cluster.deinit();
+}
+/**
+ * configuration is shared between instances until it is changed
+ */
+TEST(librmb, ceph_config_cache) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+
+  std::string pool_name("rmb_tool_tests");
+  EXPECT_EQ(0, storage.open_connection(pool_name));
+
+  librmb::RadosCephConfig writer(&storage.get_io_ctx());
+  writer.set_cfg_object_name("cfg_cache_test");
+  writer.set_user_ns("ns_1");
+  EXPECT_EQ(0, writer.save_cfg());
+
+  librmb::RadosCephConfig cfg_1(&storage.get_io_ctx());
+  cfg_1.set_cfg_object_name("cfg_cache_test");
+  cfg_1.set_io_ctx_pool(&cluster, pool_name);
+  cfg_1.set_io_ctx_namespace("");
+  EXPECT_EQ(0, cfg_1.load_cfg());
+  EXPECT_EQ("ns_1", cfg_1.get_user_ns());
+
+  librmb::RadosCephConfig cfg_2(&storage.get_io_ctx());
+  cfg_2.set_cfg_object_name("cfg_cache_test");
+  cfg_2.set_io_ctx_pool(&cluster, pool_name);
+  cfg_2.set_io_ctx_namespace("");
+  EXPECT_EQ(0, cfg_2.load_cfg());
+  EXPECT_EQ(cfg_1.get_version(), cfg_2.get_version());
+
+  // save_cfg notifies the watchers
+  writer.set_user_ns("ns_2");
+  EXPECT_EQ(0, writer.save_cfg());
+
+  librmb::RadosCephConfig cfg_3(&storage.get_io_ctx());
+  cfg_3.set_cfg_object_name("cfg_cache_test");
+  cfg_3.set_io_ctx_pool(&cluster, pool_name);
+  cfg_3.set_io_ctx_namespace("");
+  EXPECT_EQ(0, cfg_3.load_cfg());
+  EXPECT_EQ("ns_2", cfg_3.get_user_ns());
+  EXPECT_LT(cfg_1.get_version(), cfg_3.get_version());
+
+  EXPECT_EQ(0, storage.delete_mail("cfg_cache_test"));
+  cluster.deinit();
+}
+/**
+ * the shared io_ctx of a config is fetched again after the cluster was torn down
+ */
+TEST(librmb, ceph_config_io_ctx_pool_reinit) {
+  librmb::RadosClusterImpl cluster;
+  librmb::RadosStorageImpl storage(&cluster);
+
+  std::string pool_name("rmb_tool_tests");
+  EXPECT_EQ(0, storage.open_connection(pool_name));
+
+  librmb::RadosCephConfig cfg(&storage.get_io_ctx());
+  cfg.set_cfg_object_name("cfg_pool_reinit_test");
+  cfg.set_io_ctx_pool(&cluster, pool_name);
+  cfg.set_io_ctx_namespace("");
+  EXPECT_EQ(0, cfg.save_cfg());
+  uint64_t generation = cluster.get_io_ctx_pool_generation();
+
+  // last reference, the shared io contexts are destroyed
+  cluster.deinit();
+  EXPECT_NE(generation, cluster.get_io_ctx_pool_generation());
+
+  librmb::RadosStorageImpl storage_2(&cluster);
+  EXPECT_EQ(0, storage_2.open_connection(pool_name));
+  cfg.set_config_valid(false);
+  EXPECT_EQ(0, cfg.load_cfg());
+
+  EXPECT_EQ(0, storage_2.delete_mail("cfg_pool_reinit_test"));
+  cluster.deinit();
+}
 TEST(librmb, mock_obj) {}
 int main(int argc, char **argv) {
   ::testing::InitGoogleMock(&argc, argv);
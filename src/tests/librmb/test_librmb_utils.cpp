@@ -14,7 +14,15 @@
 
 #include "../../librmb/rados-cluster-impl.h"
 #include "../../librmb/rados-ceph-json-config.h"
+#include "../../librmb/rados-ceph-config.h"
 #include "../../librmb/rados-storage-impl.h"
+#include "../../librmb/rados-dictionary-impl.h"
+#include "../../librmb/rados-namespace-cache.h"
+#include "../../librmb/rados-stats.h"
+#include "../../librmb/rados-trace.h"
+#include "../../librmb/rados-storage-memory.h"
+#include "../../librmb/rados-dictionary-memory.h"
+#include "../../librmb/rados-metadata-storage-memory.h"
 #include "mock_test.h"
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
@@ -24,6 +32,9 @@
 #include "rados-mail.h"
 #include <cstdio>
 #include <pthread.h>
+#include <unistd.h>
+#include <thread>
+#include <sstream>
 
 using ::testing::AtLeast;
 using ::testing::Return;
@@ -306,6 +317,7 @@ TEST(librmb, test_mvn_option) {
   EXPECT_EQ(true, log_file.open());
   log_file.append(librmb::RadosSaveLogEntry("dest_oid", "ns_dest", "mail_storage",
                                             librmb::RadosSaveLogEntry::op_mv("ns_src", "src_oid", "user", metadata)));
+  EXPECT_EQ(0, log_file.flush());
   std::ifstream read(test_file_name);
   while (true) {
     librmb::RadosSaveLogEntry entry;
@@ -326,6 +338,66 @@ TEST(librmb, test_mvn_option) {
   std::remove(test_file_name.c_str());
 }
 
+TEST(librmb, save_log_binary_format) {
+  std::list<librmb::RadosMetadata *> metadata;
+  librmb::RadosMetadata guid(librmb::RBOX_METADATA_MAILBOX_GUID, "ABCDEFG");
+  metadata.push_back(&guid);
+
+  std::string test_file_name = "test_binary.log";
+  librmb::RadosSaveLog log_file(test_file_name);
+  log_file.set_format(librmb::RADOS_SAVE_LOG_FORMAT_BINARY);
+  log_file.set_fsync_policy(RADOS_SAVE_LOG_FSYNC_BATCH);
+  EXPECT_EQ(true, log_file.open());
+  log_file.append(librmb::RadosSaveLogEntry("abc", "ns_1", "mail_storage", "save"));
+  log_file.append(librmb::RadosSaveLogEntry("dest_oid", "ns_dest", "mail_storage",
+                                            librmb::RadosSaveLogEntry::op_mv("ns_src", "src_oid", "user", metadata)));
+  EXPECT_EQ(true, log_file.close());
+
+  std::ifstream read(test_file_name, std::ifstream::binary);
+  std::stringstream csv;
+  EXPECT_EQ(2, librmb::RadosSaveLog::convert_to_csv(read, csv));
+  read.close();
+
+  librmb::RadosSaveLogEntry entry;
+  csv >> entry;
+  EXPECT_EQ("save", entry.op);
+  EXPECT_EQ("abc", entry.oid);
+  csv >> entry;
+  EXPECT_EQ("dest_oid", entry.oid);
+  EXPECT_EQ("ns_src", entry.src_ns);
+  EXPECT_EQ("src_oid", entry.src_oid);
+  EXPECT_EQ(1, entry.metadata.size());
+  std::remove(test_file_name.c_str());
+}
+
+TEST(librmb, save_log_shared_writer) {
+  std::string test_file_name = "test_shared.log";
+  librmb::RadosSaveLog log_1(test_file_name);
+  librmb::RadosSaveLog log_2(test_file_name);
+  EXPECT_EQ(true, log_1.open());
+  EXPECT_EQ(true, log_2.open());
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.push_back(std::thread([&log_1, &log_2, t]() {
+      for (int i = 0; i < 100; i++) {
+        (t % 2 == 0 ? log_1 : log_2).append(librmb::RadosSaveLogEntry("abc", "ns_1", "mail_storage", "save"));
+      }
+    }));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(true, log_1.close());
+  EXPECT_EQ(true, log_2.close());
+
+  std::ifstream read(test_file_name);
+  std::stringstream csv;
+  EXPECT_EQ(400, librmb::RadosSaveLog::convert_to_csv(read, csv));
+  read.close();
+  std::remove(test_file_name.c_str());
+}
+
 TEST(librmb, test_max_object_size_calculation) {
     
     bool result = librmb::RadosUtils::object_size_close_to_reach_max(10.0,100.0);
@@ -353,6 +425,434 @@ TEST(librmb, test_max_object_size_calculation) {
 }
 
 
+TEST(librmb, dictionary_shared_shards) {
+  librmbtest::RadosClusterMock cluster;
+  librmb::RadosDictionaryImpl dict(&cluster, "pool", "user", "metadata", nullptr, "rbox_cfg");
+  EXPECT_EQ(dict.get_full_oid("shared/quota"), "metadata");
+  EXPECT_EQ(dict.get_full_oid("priv/quota"), "metadata");
+  EXPECT_FALSE(dict.is_legacy_lookup_required("shared/quota"));
+
+  dict.set_shared_shard_count(8);
+  EXPECT_EQ(dict.get_shared_shard_count(), 8u);
+  EXPECT_EQ(dict.get_full_oid("priv/quota"), "metadata");
+  EXPECT_TRUE(dict.is_legacy_lookup_required("shared/quota"));
+  EXPECT_FALSE(dict.is_legacy_lookup_required("priv/quota"));
+
+  std::set<std::string> shard_oids;
+  for (int i = 0; i < 100; i++) {
+    std::string key = "shared/key" + std::to_string(i);
+    std::string oid = dict.get_full_oid(key);
+    // a key is always mapped to the same shard
+    EXPECT_EQ(oid, dict.get_full_oid(key));
+    shard_oids.insert(oid);
+  }
+  EXPECT_GT(shard_oids.size(), 1u);
+  for (auto &oid : shard_oids) {
+    EXPECT_EQ(oid.compare(0, 9, "metadata."), 0);
+  }
+}
+
+TEST(librmb, namespace_cache_lru) {
+  librmb::RadosNamespaceCache::clear();
+  librmb::RadosNamespaceCache::set_limits(2, 600, 600);
+
+  std::string value;
+  bool exists = true;
+  librmb::RadosNamespaceCache::put("u1", "ns1", true);
+  librmb::RadosNamespaceCache::put("u2", "", false);
+  EXPECT_TRUE(librmb::RadosNamespaceCache::get("u2", &value, &exists));
+  EXPECT_FALSE(exists);
+
+  // u1 is least recently used
+  librmb::RadosNamespaceCache::put("u3", "ns3", true);
+  EXPECT_EQ(2u, librmb::RadosNamespaceCache::size());
+  EXPECT_FALSE(librmb::RadosNamespaceCache::get("u1", &value, &exists));
+  EXPECT_TRUE(librmb::RadosNamespaceCache::get("u3", &value, &exists));
+  EXPECT_TRUE(exists);
+  EXPECT_EQ("ns3", value);
+
+  librmb::RadosNamespaceCache::remove("u3");
+  EXPECT_FALSE(librmb::RadosNamespaceCache::get("u3", &value, &exists));
+
+  // expired entries are not returned
+  librmb::RadosNamespaceCache::set_limits(2, 0, 0);
+  librmb::RadosNamespaceCache::put("u4", "ns4", true);
+  sleep(1);
+  EXPECT_FALSE(librmb::RadosNamespaceCache::get("u4", &value, &exists));
+  EXPECT_EQ(0u, librmb::RadosNamespaceCache::get_ttl());
+
+  librmb::RadosNamespaceCache::set_limits(10000, 600, 10);
+  // migrate waits this long before the final pass
+  EXPECT_EQ(600u, librmb::RadosNamespaceCache::get_ttl());
+  librmb::RadosNamespaceCache::clear();
+}
+
+TEST(librmb, config_namespace_cache_ttl) {
+  librmb::RadosCephConfig cfg;
+  EXPECT_EQ(librmb::RadosNamespaceCache::DEFAULT_TTL, cfg.get_namespace_cache_ttl());
+
+  EXPECT_FALSE(cfg.is_valid_key_value("rbox_namespace_cache_ttl", "-1"));
+  EXPECT_FALSE(cfg.is_valid_key_value("rbox_namespace_cache_ttl", "10m"));
+  EXPECT_TRUE(cfg.is_valid_key_value("rbox_namespace_cache_ttl", "60"));
+  EXPECT_TRUE(cfg.update_valid_key_value("rbox_namespace_cache_ttl", "60"));
+  EXPECT_EQ(60u, cfg.get_namespace_cache_ttl());
+
+  librados::bufferlist bl;
+  EXPECT_TRUE(cfg.get_config()->to_json(&bl));
+  librmb::RadosCephJsonConfig loaded;
+  EXPECT_TRUE(loaded.from_json(&bl));
+  EXPECT_EQ("60", loaded.get_namespace_cache_ttl());
+
+  // configurations written before the setting existed use the default
+  librados::bufferlist old_bl;
+  old_bl.append(
+      "{\"user_mapping\":\"false\",\"user_ns\":\"users\",\"user_suffix\":\"_u\",\"rbox_public_namespace\":"
+      "\"public\",\"rbox_mail_attributes\":\"\",\"rbox_updateable_attributes\":\"\",\"rbox_update_attributes\":"
+      "\"false\",\"rbox_metadata_storage\":\"default\",\"rbox_storage_metadata_attr\":\"ima\"}");
+  librmb::RadosCephJsonConfig old_cfg;
+  EXPECT_TRUE(old_cfg.from_json(&old_bl));
+  EXPECT_EQ("600", old_cfg.get_namespace_cache_ttl());
+}
+TEST(librmb, rados_stats) {
+  librmb::RadosStats::reset();
+
+  librmb::RadosStats::record(librmb::RADOS_OP_READ, 1, 100, 0);
+  librmb::RadosStats::record(librmb::RADOS_OP_READ, 1000, 50, -ENOENT);
+  librmb::RadosStats::record_retry(librmb::RADOS_OP_READ);
+  // counters of exited threads are kept
+  std::thread t([]() { librmb::RadosStats::record(librmb::RADOS_OP_WRITE, 3, 10, 0); });
+  t.join();
+
+  librmb::RadosStats::Snapshot s;
+  librmb::RadosStats::snapshot(&s);
+  const librmb::RadosStats::OpStats &read = s.ops[librmb::RADOS_OP_READ];
+  EXPECT_EQ(2u, read.count);
+  EXPECT_EQ(1u, read.errors);
+  EXPECT_EQ(1u, read.retries);
+  EXPECT_EQ(150u, read.bytes);
+  EXPECT_EQ(1001u, read.usecs);
+  EXPECT_EQ(1u, read.histogram[0]);
+  EXPECT_EQ(1u, read.histogram[librmb::RadosStats::histogram_bucket(1000)]);
+  EXPECT_EQ(2u, librmb::RadosStats::percentile(read, 50));
+  EXPECT_EQ(1024u, librmb::RadosStats::percentile(read, 99));
+  EXPECT_EQ(1u, s.ops[librmb::RADOS_OP_WRITE].count);
+  EXPECT_EQ(0u, s.ops[librmb::RADOS_OP_STAT].count);
+  EXPECT_NE(std::string::npos, librmb::RadosStats::to_string(s).find("read: count=2"));
+
+  librmb::RadosStats::reset();
+  librmb::RadosStats::snapshot(&s);
+  EXPECT_EQ(0u, s.ops[librmb::RADOS_OP_READ].count);
+  EXPECT_EQ(0u, s.ops[librmb::RADOS_OP_WRITE].count);
+}
+TEST(librmb, rados_stats_aio_timer) {
+  librmb::RadosStats::reset();
+
+  // a failed submit is recorded by cancel, the completion never completes
+  librados::AioCompletion *completion = librados::Rados::aio_create_completion();
+  librmb::RadosStatsAioTimer *timer = librmb::RadosStatsAioTimer::start(librmb::RADOS_OP_WRITE, "oid", completion);
+  timer->cancel(-ENOTCONN);
+  completion->release();
+
+  librmb::RadosStats::Snapshot s;
+  librmb::RadosStats::snapshot(&s);
+  EXPECT_EQ(1u, s.ops[librmb::RADOS_OP_WRITE].count);
+  EXPECT_EQ(1u, s.ops[librmb::RADOS_OP_WRITE].errors);
+  librmb::RadosStats::reset();
+}
+TEST(librmb, memory_backend) {
+  librmb::RadosMemoryBackend backend(2);
+  librmb::RadosClusterMemory cluster(&backend);
+  librmb::RadosStorageMemory storage(&cluster);
+  EXPECT_EQ(0, storage.open_connection("mail_storage", "index_storage"));
+  storage.set_namespace("user1");
+
+  librados::bufferlist buffer;
+  buffer.append("hello world");
+  librmb::RadosMail mail;
+  mail.set_oid("oid1");
+  mail.set_mail_buffer(&buffer);
+  librmb::RadosMetadata guid(librmb::RBOX_METADATA_GUID, "abc");
+  mail.add_metadata(guid);
+  EXPECT_TRUE(storage.save_mail(&mail));
+  mail.set_mail_buffer(nullptr);
+
+  librados::bufferlist read;
+  EXPECT_EQ(11, storage.read_mail("oid1", &read));
+  EXPECT_EQ("hello world", read.to_str());
+
+  librmb::RadosMetadataStorageMemory metadata(&storage);
+  librmb::RadosMail loaded;
+  loaded.set_oid("oid1");
+  EXPECT_EQ(0, metadata.load_metadata(&loaded));
+  char *guid_value = nullptr;
+  librmb::RadosUtils::get_metadata(librmb::RBOX_METADATA_GUID, loaded.get_metadata(), &guid_value);
+  EXPECT_STREQ("abc", guid_value);
+
+  // copy to another namespace with updated metadata
+  std::string src_oid = "oid1";
+  std::string dest_oid = "oid2";
+  std::list<librmb::RadosMetadata> to_update;
+  to_update.push_back(librmb::RadosMetadata(librmb::RBOX_METADATA_GUID, "def"));
+  EXPECT_EQ(0, storage.move(src_oid, "user1", dest_oid, "user2", to_update, true));
+  EXPECT_EQ(-ENOENT, storage.stat_mail("oid1", nullptr, nullptr));
+  storage.set_namespace("user2");
+  uint64_t size = 0;
+  EXPECT_EQ(0, storage.stat_mail("oid2", &size, nullptr));
+  EXPECT_EQ(11u, size);
+  loaded.set_oid("oid2");
+  EXPECT_EQ(0, metadata.load_metadata(&loaded));
+  librmb::RadosUtils::get_metadata(librmb::RBOX_METADATA_GUID, loaded.get_metadata(), &guid_value);
+  EXPECT_STREQ("def", guid_value);
+
+  // ceph index
+  EXPECT_EQ(0, storage.ceph_index_append("oid2"));
+  EXPECT_EQ(1u, storage.ceph_index_read().size());
+
+  // aio read on the thread pool
+  librmb::RadosMemoryCompletion completion;
+  librados::bufferlist aio_read;
+  storage.aio_read_mail("oid2", &aio_read, &completion);
+  completion.wait_for_complete();
+  EXPECT_EQ(11, completion.get_return_value());
+  EXPECT_EQ("hello world", aio_read.to_str());
+
+  // fault injection
+  librmb::RadosMemoryFault fault;
+  fault.error_rate = 1.0;
+  fault.error_code = -ETIMEDOUT;
+  backend.set_fault(librmb::RADOS_OP_READ, fault);
+  EXPECT_EQ(-ETIMEDOUT, storage.read_mail("oid2", &read));
+  backend.clear_faults();
+  EXPECT_EQ(11, storage.read_mail("oid2", &read));
+
+  // dictionary
+  librmb::RadosDictionaryMemory dict(&backend, "dict_pool", "user1", "dict_oid");
+  std::string value;
+  EXPECT_EQ(-ENOENT, dict.get("priv/key", &value));
+  EXPECT_EQ(0, dict.set("priv/key", "value"));
+  EXPECT_EQ(0, dict.atomic_inc("shared/counter", 5));
+  EXPECT_EQ(0, dict.atomic_inc("shared/counter", -2));
+  EXPECT_EQ(0, dict.get("priv/key", &value));
+  EXPECT_EQ("value", value);
+  EXPECT_EQ(0, dict.get("shared/counter", &value));
+  EXPECT_EQ("3", value);
+  EXPECT_EQ(0, dict.unset("priv/key"));
+  EXPECT_EQ(-ENOENT, dict.get("priv/key", &value));
+
+  storage.close_connection();
+  EXPECT_FALSE(cluster.is_connected());
+}
+TEST(librmb, memory_backend_find_mails_parallel) {
+  librmb::RadosMemoryBackend backend(1);
+  librmb::RadosClusterMemory cluster(&backend);
+  librmb::RadosStorageMemory storage(&cluster);
+  EXPECT_EQ(0, storage.open_connection("mail_storage", "index_storage"));
+  storage.set_namespace("user1");
+
+  librados::bufferlist buffer;
+  buffer.append("mail");
+  for (int i = 0; i < 5; i++) {
+    librmb::RadosMail mail;
+    mail.set_oid("oid" + std::to_string(i));
+    mail.set_mail_buffer(&buffer);
+    EXPECT_TRUE(storage.save_mail(&mail));
+    mail.set_mail_buffer(nullptr);
+  }
+
+  std::vector<size_t> batch_sizes;
+  std::set<std::string> oids;
+  EXPECT_EQ(0, storage.find_mails_parallel(nullptr, 4, 2, [&](std::vector<std::string> *batch) {
+    batch_sizes.push_back(batch->size());
+    oids.insert(batch->begin(), batch->end());
+    return true;
+  }));
+  EXPECT_EQ(std::vector<size_t>({2, 2, 1}), batch_sizes);
+  EXPECT_EQ(5u, oids.size());
+
+  // the consumer stops the listing
+  batch_sizes.clear();
+  EXPECT_EQ(0, storage.find_mails_parallel(nullptr, 4, 2, [&](std::vector<std::string> *batch) {
+    batch_sizes.push_back(batch->size());
+    return false;
+  }));
+  EXPECT_EQ(1u, batch_sizes.size());
+
+  storage.close_connection();
+}
+TEST(librmb, memory_backend_recorded_ops) {
+  librmb::RadosMemoryBackend backend(1);
+  librmb::RadosClusterMemory cluster(&backend);
+  librmb::RadosStorageMemory storage(&cluster);
+  librmb::RadosMetadataStorageMemory metadata(&storage);
+  EXPECT_EQ(0, storage.open_connection("mail_storage", "index_storage"));
+  storage.set_namespace("user1");
+
+  // save like rbox: metadata operation, then the data
+  librados::bufferlist buffer;
+  buffer.append("hello world");
+  librmb::RadosMail mail;
+  std::string oid = "oid1";
+  mail.set_oid(oid);
+  mail.set_rados_save_date(1000);
+  librmb::RadosMetadata guid(librmb::RBOX_METADATA_GUID, "abc");
+  mail.add_metadata(guid);
+  librados::ObjectWriteOperation write_op_xattr;
+  metadata.save_metadata(&write_op_xattr, &mail);
+  EXPECT_TRUE(storage.execute_operation(oid, &write_op_xattr));
+  librados::ObjectWriteOperation write_op;
+  storage.prepare_write(&write_op, 0, buffer);
+  EXPECT_TRUE(storage.execute_operation(oid, &write_op));
+
+  // not recorded
+  librados::ObjectWriteOperation unknown_op;
+  EXPECT_FALSE(storage.execute_operation(oid, &unknown_op));
+
+  // fetch like rbox
+  librados::ObjectReadOperation read_op;
+  librados::bufferlist read;
+  int read_err = -1;
+  int stat_err = -1;
+  uint64_t size = 0;
+  time_t save_date = 0;
+  storage.prepare_read(&read_op, &read, &read_err, &size, &save_date, &stat_err);
+  EXPECT_EQ(0, storage.read_operate(oid, &read_op, &read));
+  EXPECT_EQ(0, read_err);
+  EXPECT_EQ(0, stat_err);
+  EXPECT_EQ("hello world", read.to_str());
+  EXPECT_EQ(11u, size);
+  EXPECT_LT(0, save_date);
+  librmb::RadosMail loaded;
+  loaded.set_oid(oid);
+  EXPECT_EQ(0, metadata.load_metadata(&loaded));
+  char *guid_value = nullptr;
+  librmb::RadosUtils::get_metadata(librmb::RBOX_METADATA_GUID, loaded.get_metadata(), &guid_value);
+  EXPECT_STREQ("abc", guid_value);
+
+  // copy like rbox
+  std::string dest_oid = "oid2";
+  std::list<librmb::RadosMetadata> to_update;
+  librados::ObjectWriteOperation copy_op;
+  librados::AioCompletion *completion = librados::Rados::aio_create_completion();
+  EXPECT_EQ(0, storage.aio_copy(oid, "user1", dest_oid, "user2", to_update, &copy_op, completion));
+  EXPECT_TRUE(storage.aio_is_complete(completion));
+  EXPECT_EQ(0, storage.aio_wait(completion));
+  std::string missing_oid = "missing";
+  EXPECT_EQ(0, storage.aio_copy(missing_oid, "user1", dest_oid, "user2", to_update, &copy_op, completion));
+  EXPECT_EQ(-ENOENT, storage.aio_wait(completion));
+  completion->release();
+  storage.set_namespace("user2");
+  EXPECT_EQ(0, storage.stat_mail("oid2", &size, nullptr));
+  EXPECT_EQ(11u, size);
+
+  storage.close_connection();
+}
+TEST(librmb, rados_trace) {
+  librmb::RadosMemoryBackend backend(1);
+  librmb::RadosClusterMemory cluster(&backend);
+  librmb::RadosStorageMemory storage(&cluster);
+  EXPECT_EQ(0, storage.open_connection("mail_storage", "index_storage"));
+  storage.set_namespace("user1");
+  librados::bufferlist buffer;
+  buffer.append("hello world");
+  EXPECT_EQ(0, storage.save_mail("oid1", buffer));
+
+  // disabled: no spans
+  librmb::RadosTrace::configure(false, 0, "");
+  librmb::RadosTrace::clear();
+  {
+    librmb::RadosTraceScope scope("fetch", "mail_storage", "oid1");
+    EXPECT_FALSE(librmb::RadosTrace::is_active());
+  }
+  std::vector<librmb::RadosTraceSpan> spans;
+  librmb::RadosTrace::snapshot(&spans);
+  EXPECT_EQ(0u, spans.size());
+
+  librmb::RadosTrace::configure(true, 0, "");
+  {
+    librmb::RadosTraceScope scope("fetch", "mail_storage", "oid1");
+    EXPECT_TRUE(librmb::RadosTrace::is_active());
+    librados::bufferlist read;
+    EXPECT_EQ(11, storage.read_mail("oid1", &read));
+    {
+      librmb::RadosTraceScope nested("parse", "mail_storage");
+      nested.set_result(-EINVAL);
+    }
+    scope.set_result(0, 11);
+  }
+  EXPECT_FALSE(librmb::RadosTrace::is_active());
+  // spans outside of a trace are not recorded
+  librados::bufferlist read;
+  EXPECT_EQ(11, storage.read_mail("oid1", &read));
+
+  librmb::RadosTrace::snapshot(&spans);
+  ASSERT_EQ(3u, spans.size());
+  // spans are pushed when they end, the root span last
+  const librmb::RadosTraceSpan &root = spans[2];
+  EXPECT_STREQ("fetch", root.name);
+  EXPECT_EQ(0u, root.parent_id);
+  EXPECT_EQ(11u, root.bytes);
+  EXPECT_STREQ("read", spans[0].name);
+  EXPECT_STREQ("oid1", spans[0].oid);
+  EXPECT_STREQ("mail_storage", spans[0].pool);
+  EXPECT_EQ(root.span_id, spans[0].parent_id);
+  EXPECT_EQ(11u, spans[0].bytes);
+  EXPECT_STREQ("parse", spans[1].name);
+  EXPECT_EQ(-EINVAL, spans[1].ret);
+  EXPECT_EQ(root.trace_id, spans[1].trace_id);
+
+  std::string test_file_name = "test_trace.log";
+  std::remove(test_file_name.c_str());
+  EXPECT_EQ(0, librmb::RadosTrace::dump_trace(root.trace_id, test_file_name));
+  std::ifstream in(test_file_name.c_str());
+  std::string line;
+  int line_count = 0;
+  while (std::getline(in, line)) {
+    EXPECT_NE(std::string::npos, line.find("trace=" + std::to_string(root.trace_id)));
+    line_count++;
+  }
+  EXPECT_EQ(3, line_count);
+  in.close();
+  std::remove(test_file_name.c_str());
+
+  librmb::RadosTrace::configure(false, 0, "");
+  librmb::RadosTrace::clear();
+  storage.close_connection();
+}
+TEST(librmb, rados_trace_aio) {
+  librmb::RadosTrace::clear();
+  librmb::RadosTrace::configure(true, 0, "");
+
+  // the span of an asynchronous operation is recorded on another thread, after the parent ended
+  librados::AioCompletion *completion = librados::Rados::aio_create_completion();
+  librmb::RadosStatsAioTimer *timer = nullptr;
+  uint64_t root_id = 0;
+  {
+    librmb::RadosTraceScope trace("copy", "mail_storage", "oid1");
+    librmb::RadosTraceSpan active;
+    ASSERT_TRUE(librmb::RadosTrace::get_active(&active));
+    root_id = active.span_id;
+    timer = librmb::RadosStatsAioTimer::start(librmb::RADOS_OP_COPY_FROM, "oid2", completion);
+  }
+  std::thread t([timer]() { timer->cancel(-ENOENT); });
+  t.join();
+  completion->release();
+
+  std::vector<librmb::RadosTraceSpan> spans;
+  librmb::RadosTrace::snapshot(&spans);
+  ASSERT_EQ(2u, spans.size());
+  EXPECT_STREQ("copy", spans[0].name);
+  EXPECT_STREQ("copy_from", spans[1].name);
+  EXPECT_STREQ("oid2", spans[1].oid);
+  EXPECT_STREQ("mail_storage", spans[1].pool);
+  EXPECT_EQ(root_id, spans[1].parent_id);
+  EXPECT_EQ(root_id, spans[1].trace_id);
+  EXPECT_EQ(-ENOENT, spans[1].ret);
+
+  librmb::RadosTrace::configure(false, 0, "");
+  librmb::RadosTrace::clear();
+  librmb::RadosStats::reset();
+}
+
 TEST(librmb, mock_obj) {}
 int main(int argc, char **argv) {
   ::testing::InitGoogleMock(&argc, argv);
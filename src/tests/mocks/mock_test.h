@@ -59,8 +59,14 @@ class RadosStorageMock : public RadosStorage {
   MOCK_METHOD1(open_connection, int(const std::string &poolname));
   MOCK_METHOD2(open_connection, int(const std::string &poolname, const std::string &index_pool));
   MOCK_METHOD3(read_operate, int(const std::string &oid, librados::ObjectReadOperation *read_operation,librados::bufferlist *bufferlist));
+  MOCK_METHOD3(prepare_write,
+               void(librados::ObjectWriteOperation *write_op, uint64_t offset, librados::bufferlist &buffer));
+  MOCK_METHOD6(prepare_read, void(librados::ObjectReadOperation *read_op, librados::bufferlist *buffer, int *read_err,
+                                  uint64_t *psize, time_t *pmtime, int *stat_err));
 
   MOCK_METHOD4(find_mails_async, std::set<std::string>(const RadosMetadata *attr, std::string &pool_name,int num_threads, void (*ptr)(std::string&)));
+  MOCK_METHOD4(find_mails_parallel, int(const RadosMetadata *attr, unsigned int list_threads, size_t batch_size,
+                                        const std::function<bool(std::vector<std::string> *)> &consumer));
 
   MOCK_METHOD4(open_connection,
                int(const std::string &poolname, const std::string &index_pool, const std::string &clustername, const std::string &rados_username));
@@ -76,6 +82,11 @@ class RadosStorageMock : public RadosStorage {
   MOCK_METHOD6(move, int(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
                          std::list<RadosMetadata> &to_update, bool delete_source));
 
+  MOCK_METHOD7(aio_copy, int(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
+                             std::list<RadosMetadata> &to_update, librados::ObjectWriteOperation *write_op,
+                             librados::AioCompletion *completion));
+  MOCK_METHOD1(aio_wait, int(librados::AioCompletion *completion));
+  MOCK_METHOD1(aio_is_complete, bool(librados::AioCompletion *completion));
   MOCK_METHOD5(copy, int(std::string &src_oid, const char *src_ns, std::string &dest_oid, const char *dest_ns,
                          std::list<RadosMetadata> &to_update));
   MOCK_METHOD2(save_mail, int(const std::string &oid, librados::bufferlist &bufferlist));
@@ -100,6 +111,8 @@ class RadosStorageMetadataMock : public RadosStorageMetadataModule {
  public:
   MOCK_METHOD1(set_io_ctx, void(librados::IoCtx *io_ctx));
   MOCK_METHOD1(load_metadata, int(RadosMail *mail));
+  MOCK_METHOD3(load_metadata, int(RadosMail *mail, std::map<std::string, ceph::bufferlist> *xattrs,
+                                  std::map<std::string, ceph::bufferlist> *omap));
   MOCK_METHOD2(set_metadata, int(RadosMail *mail, RadosMetadata &xattr));
   MOCK_METHOD3(set_metadata, int(RadosMail *mail, RadosMetadata &xattr, librados::ObjectWriteOperation *write_op));
 
@@ -140,6 +153,17 @@ class RadosDictionaryMock : public RadosDictionary {
   MOCK_METHOD1(push_back_completion, void(librados::AioCompletion *c));
   MOCK_METHOD0(wait_for_completions, void());
   MOCK_METHOD2(get, int(const std::string &key, std::string *value_r));
+  MOCK_METHOD0(get_shared_shard_count, unsigned int());
+  MOCK_METHOD1(get_shared_shard_oid, const std::string(unsigned int shard));
+  MOCK_METHOD1(is_legacy_lookup_required, bool(const std::string &key));
+  MOCK_METHOD2(get_legacy, int(const std::string &key, std::string *value_r));
+  MOCK_METHOD1(migrate_shared_shards, int(unsigned int page_size));
+  MOCK_METHOD1(move_legacy_values, int(const std::map<std::string, librados::bufferlist> &legacy));
+  MOCK_METHOD3(get_cached, bool(const std::string &key, std::string *value_r, bool *exists_r));
+  MOCK_METHOD0(get_cache_generation, uint64_t());
+  MOCK_METHOD4(add_cached, void(const std::string &key, const std::string &value, bool exists,
+                                uint64_t read_generation));
+  MOCK_METHOD1(notify_changed, void(const std::set<std::string> &keys));
 };
 
 using librmb::RadosCluster;
@@ -154,8 +178,11 @@ class RadosClusterMock : public RadosCluster {
   MOCK_METHOD2(recovery_index_io_ctx, int(const std::string &pool,librados::IoCtx *io_ctx));
 
   MOCK_METHOD2(io_ctx_create, int(const std::string &pool, librados::IoCtx *io_ctx));
+  MOCK_METHOD3(io_ctx_get, int(const std::string &pool, const std::string &ns, librados::IoCtx **io_ctx));
+  MOCK_METHOD0(get_io_ctx_pool_generation, uint64_t());
   MOCK_METHOD2(get_config_option, int(const char *option, std::string *value));
   MOCK_METHOD0(is_connected, bool());
+  MOCK_METHOD0(watch_flush, int());
   MOCK_METHOD2(set_config_option, void(const char *option, const char *value));
   MOCK_METHOD1(list_pgs_for_pool, std::vector<std::string>(std::string &pool_name));
   MOCK_METHOD1(list_pgs_osd_for_pool, std::map<std::string, std::vector<std::string>> (std::string &pool_name));
@@ -168,6 +195,8 @@ class RadosDovecotCephCfgMock : public RadosDovecotCephCfg {
   MOCK_METHOD0(get_rados_cluster_name, const std::string &());
   MOCK_METHOD0(get_rados_username, const std::string &());
   MOCK_METHOD0(get_rados_save_log_file, const std::string &());
+  MOCK_METHOD0(get_rados_save_log_format, const std::string &());
+  MOCK_METHOD0(get_rados_save_log_fsync, const std::string &());
 
   // dovecot configuration
   MOCK_METHOD1(is_mail_attribute, bool(enum librmb::rbox_metadata_key key));
@@ -176,6 +205,11 @@ class RadosDovecotCephCfgMock : public RadosDovecotCephCfg {
   MOCK_METHOD0(is_ceph_posix_bugfix_enabled, bool());
   MOCK_METHOD0(is_ceph_aio_wait_for_safe_and_cb, bool());
   MOCK_METHOD0(is_write_chunks, bool());
+  MOCK_METHOD0(is_user_mapping_prefetch, bool());
+  MOCK_METHOD0(is_trace_enabled, bool());
+  MOCK_METHOD0(get_trace_threshold, int());
+  MOCK_METHOD0(get_trace_file, const std::string &());
+  MOCK_METHOD0(get_copy_aio_window, int());
   MOCK_METHOD0(get_chunk_size,int());
   MOCK_METHOD0(get_write_method,int());
 
@@ -217,12 +251,14 @@ class RadosDovecotCephCfgMock : public RadosDovecotCephCfg {
   MOCK_METHOD0(get_user_suffix, std::string &());
 
   MOCK_METHOD0(get_public_namespace, const std::string &());
+  MOCK_METHOD0(get_namespace_cache_ttl, unsigned int());
   MOCK_METHOD1(update_mail_attributes, void(const std::string &mail_attributes));
 
   MOCK_METHOD1(update_updatable_attributes, void(const std::string &updateable_attributes));
   MOCK_METHOD2(save_object, int(const std::string &oid, librados::bufferlist &buffer));
   MOCK_METHOD2(read_object, int(const std::string &oid, librados::bufferlist *buffer));
   MOCK_METHOD1(set_io_ctx_namespace, void(const std::string &namespace_));
+  MOCK_METHOD2(set_io_ctx_pool, void(librmb::RadosCluster *cluster, const std::string &pool));
   MOCK_METHOD0(get_metadata_storage_module, std::string &());
   MOCK_METHOD0(get_metadata_storage_attribute, std::string &());
 
@@ -9,6 +9,10 @@
  * Foundation.  See file COPYING.
  */
 
+#include <sys/stat.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
 #include <rados/librados.hpp>
@@ -20,6 +24,8 @@
 #include "../../librmb/tools/rmb/ls_cmd_parser.h"
 #include "../../librmb/tools/rmb/mailbox_tools.h"
 #include "../../librmb/tools/rmb/rmb-commands.h"
+#include "../../librmb/tools/rmb/rmb-batch.h"
+#include "../../librmb/tools/rmb/rmb-bench.h"
 #include "mock_test.h"
 #include "../../librmb/rados-types.h"
 using ::testing::Return;
@@ -60,6 +66,81 @@ TEST(rmb, test_cmd_parser) {
   EXPECT_FALSE(p3->eval(value));
 }
 
+/**
+ * Test compiled predicates and the xattr filter
+ */
+TEST(rmb, test_cmd_parser_matches) {
+  librmb::CmdLineParser parser("U>7;M=abc;R<2013-12-04 15:03");
+  EXPECT_TRUE(parser.parse_ls_string());
+
+  librmb::RadosMail mail;
+  librados::bufferlist uid;
+  uid.append("8", 2);
+  (*mail.get_metadata())["U"] = uid;
+  librados::bufferlist guid;
+  guid.append("abc", 4);
+  (*mail.get_metadata())["M"] = guid;
+  librados::bufferlist date;
+  date.append("917378644", 10);
+  (*mail.get_metadata())["R"] = date;
+  EXPECT_TRUE(parser.matches(&mail));
+
+  // all predicates need to match
+  librados::bufferlist uid2;
+  uid2.append("7", 2);
+  (*mail.get_metadata())["U"] = uid2;
+  EXPECT_FALSE(parser.matches(&mail));
+  mail.get_metadata()->erase("U");
+  EXPECT_FALSE(parser.matches(&mail));
+
+  librmb::RadosMetadata filter;
+  EXPECT_TRUE(parser.get_xattr_filter(&filter));
+  EXPECT_EQ("M", filter.key);
+  EXPECT_EQ(guid.to_str(), filter.bl.to_str());
+
+  librmb::CmdLineParser parser2("U=7");
+  EXPECT_TRUE(parser2.parse_ls_string());
+  EXPECT_FALSE(parser2.get_xattr_filter(&filter));
+}
+
+/**
+ * Test match all and invalid search criteria
+ */
+TEST(rmb, test_cmd_parser_match_all) {
+  librmb::RadosMail mail;
+  librados::bufferlist uid;
+  uid.append("8", 2);
+  (*mail.get_metadata())["U"] = uid;
+
+  librmb::CmdLineParser all("-");
+  EXPECT_TRUE(all.parse_ls_string());
+  EXPECT_TRUE(all.get_predicates().empty());
+  EXPECT_TRUE(all.matches(&mail));
+  librmb::RadosMetadata filter;
+  EXPECT_FALSE(all.get_xattr_filter(&filter));
+
+  librmb::CmdLineParser mailboxes("mb");
+  EXPECT_TRUE(mailboxes.parse_ls_string());
+  EXPECT_FALSE(mailboxes.matches(&mail));
+
+  // not a number
+  librmb::CmdLineParser invalid_uid("U>abc");
+  EXPECT_FALSE(invalid_uid.parse_ls_string());
+  EXPECT_TRUE(invalid_uid.get_predicates().empty());
+  // no operator
+  librmb::CmdLineParser no_op("M=abc;U");
+  EXPECT_FALSE(no_op.parse_ls_string());
+  EXPECT_EQ(1u, no_op.get_predicates().size());
+  // not a date
+  librmb::CmdLineParser invalid_date("R>garbage");
+  EXPECT_FALSE(invalid_date.parse_ls_string());
+  librmb::CmdLineParser date_with_seconds("R>2013-12-04 15:03:10");
+  EXPECT_TRUE(date_with_seconds.parse_ls_string());
+  // strings are compared with = only
+  librmb::CmdLineParser string_order("M>abc");
+  EXPECT_FALSE(string_order.parse_ls_string());
+}
+
 /**
  * Test date predicate
  */
@@ -117,6 +198,77 @@ TEST(rmb1, save_mail) {
   EXPECT_EQ(0, ret);
   EXPECT_EQ(0, ret_rm_dir);
 }
+/**
+ * Test mailboxTools.savemail maildir
+ */
+TEST(rmb1, save_mail_maildir) {
+  std::string mbox_guid = "abc";
+  librmb::RadosMailBox mbox(mbox_guid, 1, mbox_guid);
+
+  std::string base_path = "test_maildir";
+  librmb::MailboxTools tools(&mbox, base_path, librmb::RMB_MAILBOX_FORMAT_MAILDIR);
+  EXPECT_EQ(0, tools.init_mailbox_dir());
+
+  librmb::RadosMail mail;
+  librados::bufferlist bl;
+  bl.append("1", 2);
+  (*mail.get_metadata())["U"] = bl;
+  librados::bufferlist buffer;
+  mail.set_mail_buffer(&buffer);
+  mail.get_mail_buffer()->append("hallo welt\n");
+  mail.set_oid("defg");
+  mail.set_mail_size(mail.get_mail_buffer()->length());
+  EXPECT_EQ(0, tools.save_mail(&mail));
+  EXPECT_EQ(0, tools.finish());
+
+  struct stat st;
+  EXPECT_EQ(0, stat("test_maildir/abc/new/1.defg", &st));
+  EXPECT_EQ(11, st.st_size);
+  EXPECT_EQ(-1, stat("test_maildir/abc/tmp/1.defg", &st));
+
+  EXPECT_EQ(0, tools.delete_mail(&mail));
+  EXPECT_EQ(0, tools.delete_mailbox_dir());
+}
+/**
+ * Test mailboxTools.savemail mbox
+ */
+TEST(rmb1, save_mail_mbox) {
+  std::string mbox_guid = "abc";
+  librmb::RadosMailBox mbox(mbox_guid, 1, mbox_guid);
+
+  std::string base_path = "test_mbox";
+  librmb::MailboxTools tools(&mbox, base_path, librmb::RMB_MAILBOX_FORMAT_MBOX);
+  EXPECT_EQ(0, tools.init_mailbox_dir());
+
+  librmb::RadosMail mail;
+  librados::bufferlist bl;
+  bl.append("1", 2);
+  (*mail.get_metadata())["U"] = bl;
+  librados::bufferlist date;
+  date.append("0", 2);
+  (*mail.get_metadata())["R"] = date;
+  librados::bufferlist buffer;
+  mail.set_mail_buffer(&buffer);
+  mail.get_mail_buffer()->append("Subject: test\n\nFrom here\n>From there");
+  mail.set_oid("defg");
+  mail.set_mail_size(mail.get_mail_buffer()->length());
+  EXPECT_EQ(0, tools.save_mail(&mail));
+  EXPECT_EQ(0, tools.save_mail(&mail));
+
+  struct stat st;
+  // renamed on finish
+  EXPECT_EQ(-1, stat("test_mbox/abc.mbox", &st));
+  EXPECT_EQ(0, tools.finish());
+
+  std::ifstream in("test_mbox/abc.mbox");
+  std::stringstream content;
+  content << in.rdbuf();
+  std::string expected_mail =
+      "From MAILER-DAEMON Thu Jan  1 00:00:00 1970\nSubject: test\n\n>From here\n>>From there\n\n";
+  EXPECT_EQ(expected_mail + expected_mail, content.str());
+
+  EXPECT_EQ(0, tools.delete_mailbox_dir());
+}
 /**
  * Test mailbox Tools constructor
  */
@@ -354,6 +506,186 @@ TEST(rmb1, rmb_command_filter_result2) {
   EXPECT_EQ(0, rmb_cmd.query_mail_storage(&mails, &parser, false, false));
 }
 
+/**
+ * Test rmb commands
+ * - only mails of matching mailboxes are kept
+ */
+TEST(rmb1, rmb_command_add_to_mailbox) {
+  librmb::CmdLineParser parser("M=8eed840764b05359f12718004d2485ee");
+  ASSERT_TRUE(parser.parse_ls_string());
+  std::map<std::string, librmb::RadosMailBox *> mailboxes;
+
+  librmb::RadosMail listed;
+  listed.set_oid("oid_1");
+  listed.set_mail_size(200);
+  {
+    librmb::RadosMetadata m(librmb::RBOX_METADATA_MAILBOX_GUID, "8eed840764b05359f12718004d2485ee");
+    listed.add_metadata(m);
+  }
+  {
+    librmb::RadosMetadata m(librmb::RBOX_METADATA_ORIG_MAILBOX, "INBOX");
+    listed.add_metadata(m);
+  }
+  librmb::RadosMail other_mailbox;
+  other_mailbox.set_oid("oid_2");
+  {
+    librmb::RadosMetadata m(librmb::RBOX_METADATA_MAILBOX_GUID, "0000840764b05359f12718004d2485ee");
+    other_mailbox.add_metadata(m);
+  }
+  {
+    librmb::RadosMetadata m(librmb::RBOX_METADATA_ORIG_MAILBOX, "DRAFTS");
+    other_mailbox.add_metadata(m);
+  }
+  librmb::RadosMail no_mailbox;
+  no_mailbox.set_oid("oid_3");
+
+  EXPECT_TRUE(librmb::RmbCommands::add_to_mailbox(&mailboxes, &listed, &parser));
+  EXPECT_FALSE(librmb::RmbCommands::add_to_mailbox(&mailboxes, &other_mailbox, &parser));
+  EXPECT_FALSE(librmb::RmbCommands::add_to_mailbox(&mailboxes, &no_mailbox, &parser));
+
+  ASSERT_EQ(1u, mailboxes.size());
+  librmb::RadosMailBox *mailbox = mailboxes["8eed840764b05359f12718004d2485ee"];
+  ASSERT_NE(nullptr, mailbox);
+  EXPECT_EQ(1u, mailbox->get_mails().size());
+  EXPECT_EQ(&listed, mailbox->get_mails().front());
+  for (auto &it : mailboxes) {
+    delete it.second;
+  }
+}
+
+class TestBatchWorker : public librmb::RmbBatchWorker {
+ public:
+  int run(const std::string &user, const librmb::RmbBatchDeadline &deadline, librmb::RmbBatchResult *result) override {
+    result->objects = 2;
+    result->bytes = 100;
+    if (user == "broken") {
+      return -EIO;
+    }
+    if (user == "slow") {
+      return -ETIMEDOUT;
+    }
+    return 0;
+  }
+};
+
+TEST(rmb1, batch) {
+  std::stringstream list("user1\n\n# comment\n  user2 \nbroken\nslow\n");
+  std::vector<std::string> users;
+  librmb::RmbBatch::read_users(list, &users);
+  ASSERT_EQ(4u, users.size());
+  EXPECT_EQ("user2", users[1]);
+
+  int created = 0;
+  librmb::RmbBatch batch([&created]() -> librmb::RmbBatchWorker * {
+    created++;
+    return new TestBatchWorker();
+  });
+  librmb::RmbBatch::Options options;
+  options.threads = 8;
+  options.progress_secs = 0;
+  EXPECT_TRUE(batch.set_options(options));
+
+  std::stringstream progress;
+  std::stringstream summary;
+  EXPECT_EQ(2, batch.run(users, progress, &summary));
+  // not more workers than users
+  EXPECT_EQ(4, created);
+
+  std::string line;
+  int ok = 0;
+  int errors = 0;
+  int timeouts = 0;
+  std::string totals;
+  while (std::getline(summary, line)) {
+    if (line.find("\"status\":\"ok\"") != std::string::npos) {
+      ok++;
+    } else if (line.find("\"user\":\"broken\",\"status\":\"error\",\"ret\":-5") != std::string::npos) {
+      errors++;
+    } else if (line.find("\"user\":\"slow\",\"status\":\"timeout\"") != std::string::npos) {
+      timeouts++;
+    } else {
+      totals = line;
+    }
+  }
+  EXPECT_EQ(2, ok);
+  EXPECT_EQ(1, errors);
+  EXPECT_EQ(1, timeouts);
+  EXPECT_NE(std::string::npos, totals.find("{\"users\":4,\"ok\":2,\"errors\":1,\"timeouts\":1,\"objects\":8"));
+  EXPECT_NE(std::string::npos, progress.str().find("progress: 4/4 users"));
+
+  librmb::RmbBatchResult result;
+  result.user = "a\"b";
+  EXPECT_NE(std::string::npos, librmb::RmbBatch::to_json(result).find("\"user\":\"a\\\"b\""));
+}
+
+TEST(rmb1, batch_prefetch) {
+  std::vector<std::string> users;
+  for (int i = 0; i < 10; i++) {
+    users.push_back("user" + std::to_string(i));
+  }
+  librmb::RmbBatch batch([]() -> librmb::RmbBatchWorker * { return new TestBatchWorker(); });
+  librmb::RmbBatch::Options options;
+  options.threads = 2;
+  options.progress_secs = 0;
+  EXPECT_TRUE(batch.set_options(options));
+
+  std::vector<std::string> prefetched;
+  size_t calls = 0;
+  batch.set_prefetch(
+      [&](const std::vector<std::string> &next_users) {
+        EXPECT_GE(4u, next_users.size());
+        prefetched.insert(prefetched.end(), next_users.begin(), next_users.end());
+        calls++;
+      },
+      4);
+
+  std::stringstream progress;
+  EXPECT_EQ(0, batch.run(users, progress, nullptr));
+  // the first window before the workers start, then in order while they run
+  ASSERT_LE(4u, prefetched.size());
+  ASSERT_GE(users.size(), prefetched.size());
+  EXPECT_TRUE(std::equal(prefetched.begin(), prefetched.end(), users.begin()));
+  EXPECT_EQ((prefetched.size() + 3) / 4, calls);
+}
+
+TEST(rmb1, bench_percentile) {
+  std::vector<uint64_t> latencies;
+  EXPECT_EQ(0u, librmb::RmbBench::percentile(latencies, 50));
+  latencies.push_back(7);
+  EXPECT_EQ(7u, librmb::RmbBench::percentile(latencies, 0));
+  EXPECT_EQ(7u, librmb::RmbBench::percentile(latencies, 99.9));
+
+  latencies.clear();
+  for (uint64_t i = 1; i <= 1000; i++) {
+    latencies.push_back(i);
+  }
+  EXPECT_EQ(1u, librmb::RmbBench::percentile(latencies, 0));
+  EXPECT_EQ(500u, librmb::RmbBench::percentile(latencies, 50));
+  EXPECT_EQ(990u, librmb::RmbBench::percentile(latencies, 99));
+  EXPECT_EQ(999u, librmb::RmbBench::percentile(latencies, 99.9));
+  EXPECT_EQ(1000u, librmb::RmbBench::percentile(latencies, 100));
+}
+
+TEST(rmb1, bench_parse_size_distribution) {
+  std::vector<std::pair<uint64_t, uint64_t>> dist;
+  EXPECT_TRUE(librmb::RmbBench::parse_size_distribution("2048:40,8192:30,32768", &dist));
+  ASSERT_EQ(3u, dist.size());
+  // cumulated weights, the default weight is 1
+  EXPECT_EQ((std::pair<uint64_t, uint64_t>(2048, 40)), dist[0]);
+  EXPECT_EQ((std::pair<uint64_t, uint64_t>(8192, 70)), dist[1]);
+  EXPECT_EQ((std::pair<uint64_t, uint64_t>(32768, 71)), dist[2]);
+
+  EXPECT_TRUE(librmb::RmbBench::parse_size_distribution("4096", &dist));
+  ASSERT_EQ(1u, dist.size());
+  EXPECT_EQ((std::pair<uint64_t, uint64_t>(4096, 1)), dist[0]);
+
+  EXPECT_FALSE(librmb::RmbBench::parse_size_distribution("", &dist));
+  EXPECT_FALSE(librmb::RmbBench::parse_size_distribution("0", &dist));
+  EXPECT_FALSE(librmb::RmbBench::parse_size_distribution("2048:0", &dist));
+  EXPECT_FALSE(librmb::RmbBench::parse_size_distribution("2k", &dist));
+  EXPECT_FALSE(librmb::RmbBench::parse_size_distribution("2048:40,abc", &dist));
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleMock(&argc, argv);
   return RUN_ALL_TESTS();
@@ -566,7 +566,7 @@ TEST_F(StorageTest, copy_input_to_output_stream) {
 /**
  * Error test:
  *
- * - copy mail fails due to storage.copy call returns -1
+ * - copy mail fails due to storage.aio_copy call returns -1
  */
 TEST_F(StorageTest, mock_copy_failed_due_to_rados_err) {
   struct mailbox_transaction_context *desttrans;
@@ -657,7 +657,7 @@ TEST_F(StorageTest, mock_copy_failed_due_to_rados_err) {
       .WillOnce(Return(test_object2));
 
 
-  EXPECT_CALL(*storage_mock_copy, copy(_, _, _, _, _)).WillRepeatedly(Return(-1));
+  EXPECT_CALL(*storage_mock_copy, aio_copy(_, _, _, _, _, _, _)).WillRepeatedly(Return(-1));
   EXPECT_CALL(*storage_mock_copy, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
 
   storage->s = storage_mock_copy;
@@ -0,0 +1,299 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (c) 2017-2018 Tallence AG and the authors
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include <errno.h>
+
+#include <vector>
+
+#include "../storage-mock-rbox/TestCase.h"
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wshadow"           // turn off warnings for Dovecot :-(
+#pragma GCC diagnostic ignored "-Wundef"            // turn off warnings for Dovecot :-(
+#pragma GCC diagnostic ignored "-Wredundant-decls"  // turn off warnings for Dovecot :-(
+#ifndef __cplusplus
+#pragma GCC diagnostic ignored "-Wdeclaration-after-statement"  // turn off warnings for Dovecot :-(
+#endif
+
+extern "C" {
+#include "lib.h"
+#include "mail-user.h"
+#include "mail-storage.h"
+#include "mail-storage-service.h"
+#include "mail-namespace.h"
+#include "mailbox-list.h"
+#include "ioloop.h"
+#include "istream.h"
+#include "mail-search-build.h"
+#include "ostream.h"
+#include "libdict-rados-plugin.h"
+}
+
+#include "dovecot-ceph-plugin-config.h"
+#include "../test-utils/it_utils.h"
+
+#include "rbox-storage.hpp"
+#include "rbox-save.h"
+
+#include "../mocks/mock_test.h"
+#include "rados-dovecot-ceph-cfg-impl.h"
+using ::testing::_;
+using ::testing::AtLeast;
+using ::testing::Invoke;
+using ::testing::Matcher;
+using ::testing::Return;
+using ::testing::ReturnRef;
+using ::testing::Sequence;
+#pragma GCC diagnostic pop
+
+static const char *message =
+    "From: user@domain.org\n"
+    "Date: Sat, 24 Mar 2017 23:00:00 +0200\n"
+    "Mime-Version: 1.0\n"
+    "Content-Type: text/plain; charset=us-ascii\n"
+    "\n"
+    "body\n";
+
+static std::string user = "client.admin";
+static std::string cluster = "ceph";
+static std::string pool = "mail_storage";
+static std::string suffix = "_u";
+static librados::IoCtx test_ioctx;
+
+static librmb::RadosMail *alloc_test_mail() {
+  librmb::RadosMail *mail = new librmb::RadosMail();
+  mail->set_mail_buffer(nullptr);
+  librmb::RadosMetadata recv_date = librmb::RadosMetadata(librmb::RBOX_METADATA_RECEIVED_TIME, time(NULL));
+  mail->add_metadata(recv_date);
+  librmb::RadosMetadata guid = librmb::RadosMetadata(librmb::RBOX_METADATA_GUID, "67ffff24efc0e559194f00009c60b9f7");
+  mail->add_metadata(guid);
+  return mail;
+}
+
+static void free_test_mail(librmb::RadosMail *mail) {
+  if (mail != nullptr) {
+    delete mail->get_mail_buffer();
+    delete mail;
+  }
+}
+
+/* storage mock allocating and releasing rados mails like RadosStorageImpl */
+static librmbtest::RadosStorageMock *create_storage_mock() {
+  librmbtest::RadosStorageMock *storage_mock = new librmbtest::RadosStorageMock();
+  EXPECT_CALL(*storage_mock, get_max_object_size()).WillRepeatedly(Return(65000));
+  EXPECT_CALL(*storage_mock, get_max_write_size_bytes()).WillRepeatedly(Return(65000));
+  EXPECT_CALL(*storage_mock, set_ceph_wait_method(_)).WillRepeatedly(Return());
+  EXPECT_CALL(*storage_mock, get_io_ctx()).WillRepeatedly(ReturnRef(test_ioctx));
+  EXPECT_CALL(*storage_mock, open_connection("mail_storage", _, "ceph", "client.admin")).WillRepeatedly(Return(0));
+  EXPECT_CALL(*storage_mock, execute_operation(_, _)).WillRepeatedly(Return(true));
+  EXPECT_CALL(*storage_mock, append_to_object(_, _, _)).WillRepeatedly(Return(true));
+  EXPECT_CALL(*storage_mock, alloc_rados_mail()).WillRepeatedly(Invoke(alloc_test_mail));
+  EXPECT_CALL(*storage_mock, free_rados_mail(_)).WillRepeatedly(Invoke(free_test_mail));
+  EXPECT_CALL(*storage_mock, aio_copy(_, _, _, _, _, _, _)).WillRepeatedly(Return(0));
+  // copies are finished by aio_wait only
+  EXPECT_CALL(*storage_mock, aio_is_complete(_)).WillRepeatedly(Return(false));
+  return storage_mock;
+}
+
+static librmbtest::RadosDovecotCephCfgMock *create_cfg_mock(int copy_window) {
+  librmbtest::RadosDovecotCephCfgMock *cfg_mock = new librmbtest::RadosDovecotCephCfgMock();
+  EXPECT_CALL(*cfg_mock, is_config_valid()).WillRepeatedly(Return(true));
+  EXPECT_CALL(*cfg_mock, get_index_pool_name()).WillRepeatedly(ReturnRef(pool));
+  EXPECT_CALL(*cfg_mock, get_object_search_method()).WillRepeatedly(Return(0));
+  EXPECT_CALL(*cfg_mock, is_write_chunks()).WillRepeatedly(Return(false));
+  EXPECT_CALL(*cfg_mock, is_ceph_posix_bugfix_enabled()).WillRepeatedly(Return(false));
+  EXPECT_CALL(*cfg_mock, is_ceph_aio_wait_for_safe_and_cb()).WillRepeatedly(Return(false));
+  EXPECT_CALL(*cfg_mock, load_rados_config()).WillRepeatedly(Return(0));
+  EXPECT_CALL(*cfg_mock, is_mail_attribute(_)).WillRepeatedly(Return(true));
+  EXPECT_CALL(*cfg_mock, is_user_mapping()).WillRepeatedly(Return(false));
+  EXPECT_CALL(*cfg_mock, get_rados_username()).WillRepeatedly(ReturnRef(user));
+  EXPECT_CALL(*cfg_mock, get_rados_cluster_name()).WillRepeatedly(ReturnRef(cluster));
+  EXPECT_CALL(*cfg_mock, get_pool_name()).WillRepeatedly(ReturnRef(pool));
+  EXPECT_CALL(*cfg_mock, get_user_suffix()).WillRepeatedly(ReturnRef(suffix));
+  EXPECT_CALL(*cfg_mock, get_write_method()).WillRepeatedly(Return(1));
+  EXPECT_CALL(*cfg_mock, get_copy_aio_window()).WillRepeatedly(Return(copy_window));
+  return cfg_mock;
+}
+
+static void add_mails(struct mail_namespace *namespaces, int count) {
+  for (int i = 0; i < count; i++) {
+    testutils::ItUtils::add_mail(message, "INBOX", namespaces, create_storage_mock());
+  }
+}
+
+/* replace the storage, config and metadata storage of the mailbox with mocks */
+static void set_mocks(struct mailbox *box, librmbtest::RadosStorageMock *storage_mock,
+                      librmbtest::RadosDovecotCephCfgMock *cfg_mock, librmbtest::RadosStorageMetadataMock *ms_mock) {
+  struct rbox_storage *storage = (struct rbox_storage *)box->storage;
+  delete storage->s;
+  storage->s = storage_mock;
+
+  delete storage->ms;
+  librmbtest::RadosMetadataStorageProducerMock *ms_p_mock = new librmbtest::RadosMetadataStorageProducerMock();
+  EXPECT_CALL(*ms_p_mock, get_storage()).WillRepeatedly(Return(ms_mock));
+  EXPECT_CALL(*ms_mock, set_metadata(_, _)).WillRepeatedly(Return(0));
+  storage->ms = ms_p_mock;
+
+  delete storage->config;
+  storage->ns_mgr->set_config(cfg_mock);
+  storage->config = cfg_mock;
+}
+
+static struct mailbox_transaction_context *begin_transaction(struct mailbox *box) {
+#ifdef DOVECOT_CEPH_PLUGIN_HAVE_MAIL_STORAGE_TRANSACTION_OLD_SIGNATURE
+  return mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL);
+#else
+  return mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL, "copy test");
+#endif
+}
+
+/*
+ * copy the first count mails of box within trans.
+ * @param[out] results mailbox_copy result of each mail
+ * @param[out] waits aio_wait calls counted by the storage mock after each copy
+ */
+static void copy_mails(struct mailbox_transaction_context *trans, unsigned int count, const int *wait_calls,
+                       std::vector<int> *results, std::vector<int> *waits) {
+  struct mail_search_args *search_args = mail_search_build_init();
+  mail_search_build_add(search_args, SEARCH_ALL);
+  struct mail_search_context *search_ctx =
+      mailbox_search_init(trans, search_args, NULL, static_cast<mail_fetch_field>(0), NULL);
+  mail_search_args_unref(&search_args);
+
+  struct mail *mail;
+  while (results->size() < count && mailbox_search_next(search_ctx, &mail)) {
+    struct mail_save_context *save_ctx = mailbox_save_alloc(trans);
+    mailbox_save_copy_flags(save_ctx, mail);
+    results->push_back(mailbox_copy(&save_ctx, mail));
+    waits->push_back(*wait_calls);
+  }
+  EXPECT_GE(mailbox_search_deinit(&search_ctx), 0);
+}
+
+/**
+ * at most get_copy_aio_window copies are in flight, the remaining copies are
+ * finished before the uids are assigned in commit_pre.
+ */
+TEST_F(StorageTest, copy_aio_window) {
+  struct mail_namespace *ns = mail_namespace_find_inbox(s_test_mail_user->namespaces);
+  ASSERT_NE(ns, nullptr);
+  add_mails(s_test_mail_user->namespaces, 3);
+
+  struct mailbox *box = mailbox_alloc(ns->list, "INBOX", MAILBOX_FLAG_SAVEONLY);
+  librmbtest::RadosStorageMock *storage_mock = create_storage_mock();
+  librmbtest::RadosStorageMetadataMock ms_mock;
+  int wait_calls = 0;
+  EXPECT_CALL(*storage_mock, aio_wait(_)).WillRepeatedly(Invoke([&wait_calls](librados::AioCompletion *) {
+    wait_calls++;
+    return 0;
+  }));
+  EXPECT_CALL(*storage_mock, delete_mail(Matcher<librmb::RadosMail *>(_))).Times(0);
+  set_mocks(box, storage_mock, create_cfg_mock(2), &ms_mock);
+  ASSERT_GE(mailbox_open(box), 0);
+
+  struct mailbox_transaction_context *trans = begin_transaction(box);
+  std::vector<int> results;
+  std::vector<int> waits;
+  copy_mails(trans, 3, &wait_calls, &results, &waits);
+
+  ASSERT_EQ(3u, results.size());
+  EXPECT_EQ(std::vector<int>({0, 0, 0}), results);
+  // the third copy waits for the first one
+  EXPECT_EQ(std::vector<int>({0, 0, 1}), waits);
+
+  EXPECT_GE(mailbox_transaction_commit(&trans), 0);
+  EXPECT_EQ(3, wait_calls);
+  mailbox_free(&box);
+}
+
+/**
+ * rollback waits for the copies in flight before their objects are removed.
+ */
+TEST_F(StorageTest, copy_rollback_waits_before_clean_up) {
+  struct mail_namespace *ns = mail_namespace_find_inbox(s_test_mail_user->namespaces);
+  ASSERT_NE(ns, nullptr);
+  add_mails(s_test_mail_user->namespaces, 1);
+
+  struct mailbox *box = mailbox_alloc(ns->list, "INBOX", MAILBOX_FLAG_SAVEONLY);
+  librmbtest::RadosStorageMock *storage_mock = create_storage_mock();
+  librmbtest::RadosStorageMetadataMock ms_mock;
+  int wait_calls = 0;
+  Sequence seq;
+  EXPECT_CALL(*storage_mock, aio_wait(_)).InSequence(seq).WillOnce(Invoke([&wait_calls](librados::AioCompletion *) {
+    wait_calls++;
+    return -EIO;
+  }));
+  EXPECT_CALL(*storage_mock, delete_mail(Matcher<librmb::RadosMail *>(_))).InSequence(seq).WillOnce(Return(0));
+  set_mocks(box, storage_mock, create_cfg_mock(8), &ms_mock);
+  ASSERT_GE(mailbox_open(box), 0);
+
+  struct mailbox_transaction_context *trans = begin_transaction(box);
+  std::vector<int> results;
+  std::vector<int> waits;
+  copy_mails(trans, 1, &wait_calls, &results, &waits);
+
+  EXPECT_EQ(std::vector<int>({0}), results);
+  EXPECT_EQ(std::vector<int>({0}), waits);
+
+  mailbox_transaction_rollback(&trans);
+  EXPECT_EQ(1, wait_calls);
+  mailbox_free(&box);
+}
+
+/**
+ * a failed copy is reported by the mailbox_copy call waiting for it, the
+ * transaction is rolled back.
+ */
+TEST_F(StorageTest, copy_failure_from_window_wait) {
+  struct mail_namespace *ns = mail_namespace_find_inbox(s_test_mail_user->namespaces);
+  ASSERT_NE(ns, nullptr);
+  add_mails(s_test_mail_user->namespaces, 2);
+
+  struct mailbox *box = mailbox_alloc(ns->list, "INBOX", MAILBOX_FLAG_SAVEONLY);
+  librmbtest::RadosStorageMock *storage_mock = create_storage_mock();
+  librmbtest::RadosStorageMetadataMock ms_mock;
+  int wait_calls = 0;
+  EXPECT_CALL(*storage_mock, aio_wait(_))
+      .WillOnce(Invoke([&wait_calls](librados::AioCompletion *) {
+        wait_calls++;
+        return -EIO;
+      }))
+      .WillOnce(Invoke([&wait_calls](librados::AioCompletion *) {
+        wait_calls++;
+        return 0;
+      }));
+  // both copied objects are removed
+  EXPECT_CALL(*storage_mock, delete_mail(Matcher<librmb::RadosMail *>(_))).Times(2).WillRepeatedly(Return(0));
+  set_mocks(box, storage_mock, create_cfg_mock(1), &ms_mock);
+  ASSERT_GE(mailbox_open(box), 0);
+
+  struct mailbox_transaction_context *trans = begin_transaction(box);
+  std::vector<int> results;
+  std::vector<int> waits;
+  copy_mails(trans, 2, &wait_calls, &results, &waits);
+
+  ASSERT_EQ(2u, results.size());
+  // the first copy is sent successfully, its failure is reported by the second mail
+  EXPECT_EQ(0, results[0]);
+  EXPECT_EQ(-1, results[1]);
+  EXPECT_EQ(std::vector<int>({0, 1}), waits);
+
+  mailbox_transaction_rollback(&trans);
+  EXPECT_EQ(2, wait_calls);
+  mailbox_free(&box);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleMock(&argc, argv);
+  return RUN_ALL_TESTS();
+}